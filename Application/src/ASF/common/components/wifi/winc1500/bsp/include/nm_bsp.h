@@ -60,6 +60,8 @@
 
 
 #define BSP_MIN(x,y) ((x)>(y)?(y):(x))
+/*!< Task notification bit set by the WINC interrupt, see nm_bsp_wait_for_event */
+#define NM_BSP_EVENT_NOTIFY_BIT	(1ul << 0)
 /*!< 
 *     Computes the minimum of \b x and \b y.
 */
@@ -281,6 +283,28 @@ void nm_bsp_register_isr(tpfNmBspIsr pfIsr);
 void nm_bsp_interrupt_ctrl(uint8 u8Enable);
   /**@}*/
 
+/** @defgroup NmBspWaitForEvent nm_bsp_wait_for_event
+*     @ingroup BSPAPI
+*    Blocks the calling task until the WINC interrupts the host
+*/
+/**@{*/
+/*!
+ * @fn           void nm_bsp_wait_for_event(uint32);
+ * @pre			 The interrupt must be registered using nm_bsp_register_isr first.
+ * @brief        Blocks the calling task on a task notification given by the WINC interrupt, instead of polling
+ *				 m2m_wifi_handle_events in a loop. An interrupt that fired since the previous call returns at once.
+ *				 Call m2m_wifi_handle_events after it returns to process the event.
+ *				 The interrupt sets NM_BSP_EVENT_NOTIFY_BIT in the task's notification value, so the task may use
+ *				 the other bits for its own events. Any notification ends the wait early.
+ * @param [in]   u32TimeoutMs
+ *               Longest time to wait, in milliseconds
+ * @note         Only one task (the one driving the WINC) may wait at a time.
+ * @return       None
+
+ */
+void nm_bsp_wait_for_event(uint32 u32TimeoutMs);
+  /**@}*/
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,14 +37,25 @@
 #include "common/include/nm_common.h"
 #include "asf.h"
 #include "conf_winc.h"
+#include "FreeRTOS.h"
+#include "task.h"
 
 static tpfNmBspIsr gpfIsr;
+static TaskHandle_t gpxEventTask = NULL;
 
 static void chip_isr(void)
 {
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
 	if (gpfIsr) {
 		gpfIsr();
 	}
+
+	/* Wake the task waiting in nm_bsp_wait_for_event */
+	if (gpxEventTask != NULL) {
+		xTaskNotifyFromISR(gpxEventTask, NM_BSP_EVENT_NOTIFY_BIT, eSetBits, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
 }
 
 /*
@@ -164,6 +175,18 @@ void nm_bsp_register_isr(tpfNmBspIsr pfIsr)
 			EXTINT_CALLBACK_TYPE_DETECT);
 }
 
+/*
+ *	@fn		nm_bsp_wait_for_event
+ *	@brief	Block the calling task until the WINC interrupt or the timeout
+ *	@param[IN]	u32TimeoutMs
+ *				Longest wait in milliseconds
+ */
+void nm_bsp_wait_for_event(uint32 u32TimeoutMs)
+{
+	gpxEventTask = xTaskGetCurrentTaskHandle();
+	xTaskNotifyWait(0, NM_BSP_EVENT_NOTIFY_BIT, NULL, pdMS_TO_TICKS(u32TimeoutMs));
+}
+
 /*
  *	@fn		nm_bsp_interrupt_ctrl
  *	@brief	Enable/Disable interrupts
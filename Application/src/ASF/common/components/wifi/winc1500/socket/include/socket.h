@@ -1563,6 +1563,18 @@ NMI_API sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen);
 @endcode
 */
 NMI_API sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec);
+
+/*!
+@fn	\
+	NMI_API void socketSetRecvBuffer(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen);
+
+@brief	Moves the USER buffer of a receive that is being delivered.
+
+	Only valid from the @ref SOCKET_MSG_RECV callback, while u16RemainingSize is not zero: the next chunks of the
+	data go to pvRecvBuf (at most u16BufLen bytes per chunk) instead of overwriting the chunk just delivered.
+	Does not post a new receive; the next @ref recv sets its own buffer.
+*/
+NMI_API void socketSetRecvBuffer(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen);
 /** @} */
 /** @defgroup ReceiveFromSocketFn recvfrom
  *   @ingroup SocketAPI
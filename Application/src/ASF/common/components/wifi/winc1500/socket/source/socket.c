@@ -881,6 +881,25 @@ sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmse
 	return s16Ret;
 }
 /*********************************************************************
+Function
+		socketSetRecvBuffer
+
+Description
+		Called from the receive callback: the rest of the data being
+		delivered goes to another buffer, see socket.h.
+
+Return
+		None.
+*********************************************************************/
+NMI_API void socketSetRecvBuffer(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen)
+{
+	if((sock >= 0) && (sock < MAX_SOCKET) && (pvRecvBuf != NULL) && (u16BufLen != 0))
+	{
+		gastrSockets[sock].pu8UserBuffer		= (uint8*)pvRecvBuf;
+		gastrSockets[sock].u16UserBufferSize	= u16BufLen;
+	}
+}
+/*********************************************************************
 Function
 		close
 
@@ -97,7 +97,7 @@ extern "C" {
  *
  * Note: not used by the J-Link RTT stream port (see trcStreamingPort.h instead)
  ******************************************************************************/
-#define TRC_CFG_PAGED_EVENT_BUFFER_PAGE_COUNT 10
+#define TRC_CFG_PAGED_EVENT_BUFFER_PAGE_COUNT 6
 
 /*******************************************************************************
  * Configuration Macro: TRC_CFG_PAGED_EVENT_BUFFER_PAGE_SIZE
@@ -110,7 +110,7 @@ extern "C" {
  *
  * Note: not used by the J-Link RTT stream port (see trcStreamingPort.h instead)
  ******************************************************************************/
-#define TRC_CFG_PAGED_EVENT_BUFFER_PAGE_SIZE 500
+#define TRC_CFG_PAGED_EVENT_BUFFER_PAGE_SIZE 512 /* One SD card sector */
 
 /*******************************************************************************
  * TRC_CFG_ISR_TAILCHAINING_THRESHOLD
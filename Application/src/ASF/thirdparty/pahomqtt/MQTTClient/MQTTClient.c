@@ -15,6 +15,11 @@
  *    Microchip Technologies            - Fixed crash issues in subscribe function
  *******************************************************************************/
 #include "MQTTClient.h"
+#include <string.h>
+
+#if (MESSAGE_HANDLER_SLOTS & (MESSAGE_HANDLER_SLOTS - 1)) != 0 || MESSAGE_HANDLER_SLOTS <= MAX_MESSAGE_HANDLERS
+#error "MESSAGE_HANDLER_SLOTS must be a power of two larger than MAX_MESSAGE_HANDLERS"
+#endif
 
 /*Function prototypes to remove build warnings*/
 int deliverMessage(MQTTClient* c, MQTTString* topicName, MQTTMessage* message);
@@ -30,6 +35,127 @@ static void NewMessageData(MessageData* md, MQTTString* aTopicName, MQTTMessage*
 }
 
 
+// FNV-1a, spreads topics that only differ in their last level
+static unsigned int topicHash(const char* topic, int len)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)topic[i]) * 16777619u;
+    return hash;
+}
+
+
+static char isWildcardFilter(const char* topicFilter)
+{
+    return strpbrk(topicFilter, "+#") != NULL;
+}
+
+
+// Linear probing from the hash slot: returns the slot holding the topic, or the free slot where it would go
+static int findExactHandler(MQTTClient* c, const char* topic, int len, unsigned int hash)
+{
+    int i = hash & (MESSAGE_HANDLER_SLOTS - 1);
+
+    while (c->messageHandlers[i].topicFilter != 0)
+    {
+        if (c->messageHandlers[i].hash == hash && c->messageHandlers[i].topicLen == len &&
+                memcmp(c->messageHandlers[i].topicFilter, topic, len) == 0)
+            break;
+        i = (i + 1) & (MESSAGE_HANDLER_SLOTS - 1);
+    }
+    return i;
+}
+
+
+// Returns the entry holding topicFilter, else a free entry (topicFilter == 0), else NULL when the table is full
+static struct MessageHandlers* findHandlerEntry(MQTTClient* c, const char* topicFilter)
+{
+    struct MessageHandlers* entry = NULL;
+    int i;
+
+    if (isWildcardFilter(topicFilter))
+    {
+        for (i = 0; i < MAX_WILDCARD_HANDLERS; ++i)
+        {
+            if (c->wildcardHandlers[i].topicFilter == 0)
+            {
+                if (entry == NULL)
+                    entry = &c->wildcardHandlers[i];
+            }
+            else if (strcmp(c->wildcardHandlers[i].topicFilter, topicFilter) == 0)
+                return &c->wildcardHandlers[i];
+        }
+    }
+    else
+    {
+        int len = strlen(topicFilter);
+        entry = &c->messageHandlers[findExactHandler(c, topicFilter, len, topicHash(topicFilter, len))];
+        if (entry->topicFilter == 0 && c->messageHandlerCount >= MAX_MESSAGE_HANDLERS)
+            entry = NULL;
+    }
+    return entry;
+}
+
+
+static int setMessageHandler(MQTTClient* c, const char* topicFilter, messageHandler fp)
+{
+    struct MessageHandlers* entry = findHandlerEntry(c, topicFilter);
+
+    if (entry == NULL)
+        return HANDLER_TABLE_FULL;
+    if (entry->topicFilter == 0)
+    {
+        entry->topicFilter = topicFilter;
+        entry->topicLen = strlen(topicFilter);
+        entry->hash = topicHash(topicFilter, entry->topicLen);
+        if (entry >= &c->messageHandlers[0] && entry < &c->messageHandlers[MESSAGE_HANDLER_SLOTS])
+            c->messageHandlerCount++;
+    }
+    entry->fp = fp;
+    return SUCCESS;
+}
+
+
+static struct InflightPublish* findInflight(MQTTClient* c, unsigned short id)
+{
+    int i;
+
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].id == id)
+            return &c->inflight[i];
+    }
+    return NULL;
+}
+
+
+// Frees the slot before calling back, so the handler may publish again
+static void completeInflight(MQTTClient* c, struct InflightPublish* slot, int rc)
+{
+    unsigned short id = slot->id;
+    void* context = slot->context;
+
+    slot->id = 0;
+    if (c->publishComplete != NULL)
+        c->publishComplete(c, id, rc, context);
+}
+
+
+// Fails the publishes that were not acknowledged in time, or all of them
+static void expireInflight(MQTTClient* c, char all)
+{
+    int i;
+
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].id != 0 && (all || TimerIsExpired(&c->inflight[i].timer)))
+            completeInflight(c, &c->inflight[i], FAILURE);
+    }
+}
+
+
 static int getNextPacketId(MQTTClient *c) {
     return c->next_packetid = (c->next_packetid == MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
 }
@@ -64,13 +190,20 @@ void MQTTClientInit(MQTTClient* c, Network* network, unsigned int command_timeou
     int i;
     c->ipstack = network;
     
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    for (i = 0; i < MESSAGE_HANDLER_SLOTS; ++i)
         c->messageHandlers[i].topicFilter = 0;
+    for (i = 0; i < MAX_WILDCARD_HANDLERS; ++i)
+        c->wildcardHandlers[i].topicFilter = 0;
+    c->messageHandlerCount = 0;
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+        c->inflight[i].id = 0;
+    c->publishComplete = NULL;
     c->command_timeout_ms = command_timeout_ms;
     c->buf = sendbuf;
     c->buf_size = sendbuf_size;
     c->readbuf = readbuf;
     c->readbuf_size = readbuf_size;
+    c->rxstart = c->rxlen = c->rxskip = c->packetlen = 0;
     c->isconnected = 0;
     c->ping_outstanding = 0;
     c->defaultMessageHandler = NULL;
@@ -82,56 +215,100 @@ void MQTTClientInit(MQTTClient* c, Network* network, unsigned int command_timeou
 }
 
 
-static int decodePacket(MQTTClient* c, int* value, int timeout)
+// Length of the whole packet starting at buf from its fixed header: 0 while the header is incomplete,
+// FAILURE if the remaining length is malformed
+static int packetLength(const unsigned char* buf, int len)
 {
-    unsigned char i;
     int multiplier = 1;
-    int len = 0;
+    int value = 0;
+    int i;
     const int MAX_NO_OF_REMAINING_LENGTH_BYTES = 4;
 
-    *value = 0;
-    do
+    for (i = 1; i <= MAX_NO_OF_REMAINING_LENGTH_BYTES; ++i)
     {
-        int rc = MQTTPACKET_READ_ERROR;
-
-        if (++len > MAX_NO_OF_REMAINING_LENGTH_BYTES)
-        {
-            rc = MQTTPACKET_READ_ERROR; /* bad data */
-            goto exit;
-        }
-        rc = c->ipstack->mqttread(c->ipstack, &i, 1, timeout);
-        if (rc != 1)
-            goto exit;
-        *value += (i & 127) * multiplier;
+        if (i >= len)
+            return 0;
+        value += (buf[i] & 127) * multiplier;
+        if ((buf[i] & 128) == 0)
+            return 1 + i + value;
         multiplier *= 128;
-    } while ((i & 128) != 0);
-exit:
-    return len;
+    }
+    return FAILURE;
 }
 
 
+// The network receives into readbuf behind the bytes already there and packets are parsed where they landed:
+// one receive can hold several packets, and a packet split over receives is completed by the next one.
+// What is left of the last receive is moved to the front before the next one, so every receive is offered
+// all of readbuf behind it: the WINC overwrites its buffer with the rest of a segment that does not fit.
+// Returns the packet type with the packet at c->readbuf + c->rxstart, valid until the next readPacket,
+// 0 if no complete packet arrived in time
 static int readPacket(MQTTClient* c, Timer* timer)
 {
-    int rc = FAILURE;
+    int rc = 0;
+    int total = 0;
+    int received = 0;
     MQTTHeader header = {0};
-    int len = 0;
-    int rem_len = 0;
 
-    /* 1. read the header byte.  This has the packet type in it */
-    if (c->ipstack->mqttread(c->ipstack, c->readbuf, 1, TimerLeftMS(timer)) != 1)
-        goto exit;
+    /* the packet returned last time has been handled */
+    c->rxstart += c->packetlen;
+    c->rxlen -= c->packetlen;
+    c->packetlen = 0;
+    if (c->rxlen == 0)
+        c->rxstart = 0;
 
-    len = 1;
-    /* 2. read the remaining length.  This is variable in itself */
-    decodePacket(c, &rem_len, TimerLeftMS(timer));
-    len += MQTTPacket_encode(c->readbuf + 1, rem_len); /* put the original remaining length back into the buffer */
+    while (1)
+    {
+        if (c->rxskip > 0)
+        {
+            int drop = (c->rxlen < c->rxskip) ? c->rxlen : c->rxskip;
+            c->rxskip -= drop;
+            c->rxstart += drop;
+            c->rxlen -= drop;
+            if (c->rxskip == 0 && c->rxlen > 0)
+                continue; /* the next packet starts in what is left */
+        }
+        else if ((total = packetLength(c->readbuf + c->rxstart, c->rxlen)) < 0)
+        {
+            c->rxstart = c->rxlen = 0; /* cannot find the next packet: drop what was received */
+            rc = FAILURE;
+            goto exit;
+        }
+        else if (total > (int)c->readbuf_size)
+        {
+            c->rxskip = total; /* never fits: skip its bytes as they come */
+            rc = BUFFER_OVERFLOW;
+            goto exit;
+        }
+        else if (total > 0 && total <= c->rxlen)
+        {
+            c->packetlen = total;
+            header.byte = c->readbuf[c->rxstart];
+            rc = header.bits.type;
+            goto exit;
+        }
 
-    /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (rem_len > 0 && (c->ipstack->mqttread(c->ipstack, c->readbuf + len, rem_len, TimerLeftMS(timer)) != rem_len))
-        goto exit;
+        if (c->rxstart > 0)
+        {
+            if (c->rxlen > 0)
+                memmove(c->readbuf, c->readbuf + c->rxstart, c->rxlen);
+            c->rxstart = 0;
+        }
 
-    header.byte = c->readbuf[0];
-    rc = header.bits.type;
+        if (received && TimerIsExpired(timer))
+            goto exit;
+        received = c->ipstack->mqttrecv(c->ipstack, c->readbuf + c->rxstart + c->rxlen,
+                                        c->readbuf_size - c->rxstart - c->rxlen, TimerLeftMS(timer));
+        if (received == BUFFER_OVERFLOW)
+        {
+            c->rxstart = c->rxlen = 0; /* part of the stream was lost: the next packet cannot be found */
+            rc = FAILURE;
+            goto exit;
+        }
+        if (received <= 0)
+            goto exit;
+        c->rxlen += received;
+    }
 exit:
     return rc;
 }
@@ -172,20 +349,36 @@ int deliverMessage(MQTTClient* c, MQTTString* topicName, MQTTMessage* message)
 {
     int i;
     int rc = FAILURE;
+    MQTTString name = *topicName;
+    struct MessageHandlers* entry;
 
-    // we have to find the right message handler - indexed by topic
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    if (name.cstring)
     {
-        if (c->messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(topicName, (char*)c->messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)c->messageHandlers[i].topicFilter, topicName)))
+        name.lenstring.data = name.cstring;
+        name.lenstring.len = strlen(name.cstring);
+    }
+
+    // exact topics: one hash lookup instead of comparing against every subscription
+    entry = &c->messageHandlers[findExactHandler(c, name.lenstring.data, name.lenstring.len,
+                                                 topicHash(name.lenstring.data, name.lenstring.len))];
+    if (entry->topicFilter != 0 && entry->fp != NULL)
+    {
+        MessageData md;
+        NewMessageData(&md, topicName, message);
+        entry->fp(&md);
+        rc = SUCCESS;
+    }
+
+    // then every wildcard filter that matches
+    for (i = 0; i < MAX_WILDCARD_HANDLERS; ++i)
+    {
+        if (c->wildcardHandlers[i].topicFilter != 0 && c->wildcardHandlers[i].fp != NULL &&
+                isTopicMatched((char*)c->wildcardHandlers[i].topicFilter, &name))
         {
-            if (c->messageHandlers[i].fp != NULL)
-            {
-                MessageData md;
-                NewMessageData(&md, topicName, message);
-                c->messageHandlers[i].fp(&md);
-                rc = SUCCESS;
-            }
+            MessageData md;
+            NewMessageData(&md, topicName, message);
+            c->wildcardHandlers[i].fp(&md);
+            rc = SUCCESS;
         }
     }
     
@@ -232,15 +425,30 @@ exit:
 int cycle(MQTTClient* c, Timer* timer)
 {
     // read the socket, see what work is due
-    unsigned short packet_type = readPacket(c, timer);
+    int packet_type = readPacket(c, timer);
     
     int len = 0,
         rc = SUCCESS;
 
+    if (packet_type == FAILURE)
+    {
+        rc = FAILURE; // the stream was lost, the session has to start over
+        goto exit;
+    }
+
     switch (packet_type)
     {
-        case CONNACK:
         case PUBACK:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type;
+            struct InflightPublish* slot;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf + c->rxstart, c->packetlen) == 1 && mypacketid != 0 &&
+                    (slot = findInflight(c, mypacketid)) != NULL && slot->qos == QOS1)
+                completeInflight(c, slot, SUCCESS);
+            break;
+        }
+        case CONNACK:
         case SUBACK:
             break;
         case PUBLISH:
@@ -249,7 +457,7 @@ int cycle(MQTTClient* c, Timer* timer)
             MQTTMessage msg;
             int intQoS;
             if (MQTTDeserialize_publish(&msg.dup, &intQoS, &msg.retained, &msg.id, &topicName,
-               (unsigned char**)&msg.payload, (int*)&msg.payloadlen, c->readbuf, c->readbuf_size) != 1)
+               (unsigned char**)&msg.payload, (int*)&msg.payloadlen, c->readbuf + c->rxstart, c->packetlen) != 1)
                 goto exit;
             msg.qos = (enum QoS)intQoS;
             deliverMessage(c, &topicName, &msg);
@@ -272,7 +480,7 @@ int cycle(MQTTClient* c, Timer* timer)
         {
             unsigned short mypacketid;
             unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf + c->rxstart, c->packetlen) != 1)
                 rc = FAILURE;
             else if ((len = MQTTSerialize_ack(c->buf, c->buf_size, PUBREL, 0, mypacketid)) <= 0)
                 rc = FAILURE;
@@ -280,15 +488,30 @@ int cycle(MQTTClient* c, Timer* timer)
                 rc = FAILURE; // there was a problem
             if (rc == FAILURE)
                 goto exit; // there was a problem
+            struct InflightPublish* slot = (mypacketid != 0) ? findInflight(c, mypacketid) : NULL;
+            if (slot != NULL && slot->qos == QOS2)
+            {
+                slot->released = 1;
+                TimerCountdownMS(&slot->timer, c->command_timeout_ms);
+            }
             break;
         }
         case PUBCOMP:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type;
+            struct InflightPublish* slot;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf + c->rxstart, c->packetlen) == 1 && mypacketid != 0 &&
+                    (slot = findInflight(c, mypacketid)) != NULL && slot->released)
+                completeInflight(c, slot, SUCCESS);
             break;
+        }
         case PINGRESP:
             c->ping_outstanding = 0;
             break;
     }
     keepalive(c);
+    expireInflight(c, 0);
 exit:
     if (rc == SUCCESS)
         rc = packet_type;
@@ -373,6 +596,8 @@ int MQTTConnect(MQTTClient* c, MQTTPacket_connectData* options)
 #endif
 	if (c->isconnected) /* don't send connect packet again if we are already connected */
 		goto exit;
+    expireInflight(c, 1);                           // left over from a lost connection
+    c->rxstart = c->rxlen = c->rxskip = c->packetlen = 0;
     
     TimerInit(&connect_timer);
     TimerCountdownMS(&connect_timer, c->command_timeout_ms);
@@ -392,7 +617,7 @@ int MQTTConnect(MQTTClient* c, MQTTPacket_connectData* options)
     {
         unsigned char connack_rc = 255;
         unsigned char sessionPresent = 0;
-        if (MQTTDeserialize_connack(&sessionPresent, &connack_rc, c->readbuf, c->readbuf_size) == 1)
+        if (MQTTDeserialize_connack(&sessionPresent, &connack_rc, c->readbuf + c->rxstart, c->packetlen) == 1)
             rc = connack_rc;
         else
             rc = FAILURE;
@@ -426,6 +651,12 @@ int MQTTSubscribe(MQTTClient* c, const char* topicFilter, enum QoS qos, messageH
 #endif
 	if (!c->isconnected)
 		goto exit;
+    // don't subscribe to something that could not be delivered
+    if (findHandlerEntry(c, topicFilter) == NULL)
+    {
+        rc = HANDLER_TABLE_FULL;
+        goto exit;
+    }
 
     TimerInit(&timer);
     TimerCountdownMS(&timer, c->command_timeout_ms);
@@ -441,22 +672,10 @@ int MQTTSubscribe(MQTTClient* c, const char* topicFilter, enum QoS qos, messageH
     {
         int count = 0, grantedQoS = -1;
         unsigned short mypacketid;
-        if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, c->readbuf, c->readbuf_size) == 1)
+        if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, c->readbuf + c->rxstart, c->packetlen) == 1)
             rc = grantedQoS; // 0, 1, 2 or 0x80 
         if (rc != 0x80)
-        {
-            int i;
-            for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-            {
-                if (c->messageHandlers[i].topicFilter == 0)
-                {
-                    c->messageHandlers[i].topicFilter = topicFilter;
-                    c->messageHandlers[i].fp = msgHandler;
-                    rc = 0;
-                    break;
-                }
-            }
-        }
+            rc = setMessageHandler(c, topicFilter, msgHandler);
     }
     else 
         rc = FAILURE;
@@ -469,6 +688,21 @@ exit:
 }
 
 
+int MQTTSetMessageHandler(MQTTClient* c, const char* topicFilter, messageHandler msgHandler)
+{
+    int rc;
+
+#if defined(MQTT_TASK)
+	MutexLock(&c->mutex);
+#endif
+    rc = setMessageHandler(c, topicFilter, msgHandler);
+#if defined(MQTT_TASK)
+	MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
 int MQTTUnsubscribe(MQTTClient* c, const char* topicFilter)
 {   
     int rc = FAILURE;
@@ -494,7 +728,7 @@ int MQTTUnsubscribe(MQTTClient* c, const char* topicFilter)
     if (waitfor(c, UNSUBACK, &timer) == UNSUBACK)
     {
         unsigned short mypacketid;  // should be the same as the packetid above
-        if (MQTTDeserialize_unsuback(&mypacketid, c->readbuf, c->readbuf_size) == 1)
+        if (MQTTDeserialize_unsuback(&mypacketid, c->readbuf + c->rxstart, c->packetlen) == 1)
             rc = 0; 
     }
     else
@@ -535,31 +769,78 @@ int MQTTPublish(MQTTClient* c, const char* topicName, MQTTMessage* message)
     if ((rc = sendPacket(c, len, &timer)) != SUCCESS) // send the subscribe packet
         goto exit; // there was a problem
     
-    if (message->qos == QOS1)
+    // acknowledgements of MQTTPublishAsync packets may arrive first: wait for the one with our id
+    if (message->qos == QOS1 || message->qos == QOS2)
     {
-        if (waitfor(c, PUBACK, &timer) == PUBACK)
+        int ack = (message->qos == QOS1) ? PUBACK : PUBCOMP;
+        rc = FAILURE;
+        while (waitfor(c, ack, &timer) == ack)
         {
             unsigned short mypacketid;
             unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
-                rc = FAILURE;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf + c->rxstart, c->packetlen) != 1)
+                break;
+            if (mypacketid == message->id)
+            {
+                rc = SUCCESS;
+                break;
+            }
         }
-        else
-            rc = FAILURE;
     }
-    else if (message->qos == QOS2)
+    
+exit:
+#if defined(MQTT_TASK)
+	MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+int MQTTPublishAsync(MQTTClient* c, const char* topicName, MQTTMessage* message, void* context)
+{
+    int rc = FAILURE;
+    Timer timer;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicName;
+    int len = 0;
+    struct InflightPublish* slot = NULL;
+
+#if defined(MQTT_TASK)
+	MutexLock(&c->mutex);
+#endif
+	if (!c->isconnected)
+		goto exit;
+
+    if (message->qos == QOS1 || message->qos == QOS2)
     {
-        if (waitfor(c, PUBCOMP, &timer) == PUBCOMP)
+        if ((slot = findInflight(c, 0)) == NULL)
         {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
-                rc = FAILURE;
+            rc = INFLIGHT_WINDOW_FULL;
+            goto exit;
         }
-        else
-            rc = FAILURE;
+        message->id = getNextPacketId(c);
     }
-    
+
+    TimerInit(&timer);
+    TimerCountdownMS(&timer, c->command_timeout_ms);
+
+    len = MQTTSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
+              topic, (unsigned char*)message->payload, message->payloadlen);
+    if (len <= 0)
+        goto exit;
+    if ((rc = sendPacket(c, len, &timer)) != SUCCESS)
+        goto exit;
+
+    if (slot != NULL)
+    {
+        slot->id = message->id;
+        slot->qos = message->qos;
+        slot->released = 0;
+        slot->context = context;
+        TimerInit(&slot->timer);
+        TimerCountdownMS(&slot->timer, c->command_timeout_ms);
+    }
+
 exit:
 #if defined(MQTT_TASK)
 	MutexUnlock(&c->mutex);
@@ -585,6 +866,7 @@ int MQTTDisconnect(MQTTClient* c)
         rc = sendPacket(c, len, &timer);            // send the disconnect packet
         
     c->isconnected = 0;
+    expireInflight(c, 1);                           // their acknowledgements will not come
 
 #if defined(MQTT_TASK)
 	MutexUnlock(&c->mutex);
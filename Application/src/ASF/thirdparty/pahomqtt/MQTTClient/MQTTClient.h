@@ -51,20 +51,32 @@
 #define MAX_PACKET_ID 65535 /* according to the MQTT specification - do not change! */
 
 #if !defined(MAX_MESSAGE_HANDLERS)
-#define MAX_MESSAGE_HANDLERS 5 /* redefinable - how many subscriptions do you want? */
+#define MAX_MESSAGE_HANDLERS 12 /* redefinable - how many exact (no '+' or '#') subscriptions do you want? */
+#endif
+
+#if !defined(MAX_WILDCARD_HANDLERS)
+#define MAX_WILDCARD_HANDLERS 4 /* redefinable - how many subscriptions with '+' or '#' do you want? */
+#endif
+
+#if !defined(MAX_INFLIGHT_PUBLISHES)
+#define MAX_INFLIGHT_PUBLISHES 4 /* redefinable - how many QoS 1/2 publishes MQTTPublishAsync leaves unacknowledged */
+#endif
+
+#if !defined(MESSAGE_HANDLER_SLOTS)
+#define MESSAGE_HANDLER_SLOTS 16 /* hash slots of the exact topics, a power of two larger than MAX_MESSAGE_HANDLERS */
 #endif
 
 enum QoS { QOS0, QOS1, QOS2 };
 
 /* all failure return codes must be negative */
-enum returnCode { BUFFER_OVERFLOW = -2, FAILURE = -1, SUCCESS = 0 };
+enum returnCode { INFLIGHT_WINDOW_FULL = -4, HANDLER_TABLE_FULL = -3, BUFFER_OVERFLOW = -2, FAILURE = -1, SUCCESS = 0 };
 
 /* The Platform specific header must define the Network and Timer structures and functions
  * which operate on them.
  *
 typedef struct Network
 {
-	int (*mqttread)(Network*, unsigned char* read_buffer, int, int);
+	int (*mqttrecv)(Network*, unsigned char* read_buffer, int, int);   returns the bytes of one receive (up to len), 0 or less on timeout/error, BUFFER_OVERFLOW if data was lost
 	int (*mqttwrite)(Network*, unsigned char* send_buffer, int, int);
 } Network;*/
 
@@ -94,6 +106,11 @@ typedef struct MessageData
 
 typedef void (*messageHandler)(MessageData*);
 
+struct MQTTClient;
+
+/* Completion of a MQTTPublishAsync: rc is SUCCESS once acknowledged, FAILURE on timeout or disconnection */
+typedef void (*publishCompleteHandler)(struct MQTTClient* c, unsigned short id, int rc, void* context);
+
 typedef struct MQTTClient
 {
     unsigned int next_packetid,
@@ -101,7 +118,11 @@ typedef struct MQTTClient
     size_t buf_size,
       readbuf_size;
     unsigned char *buf,
-      *readbuf;
+      *readbuf;                                   /* the network receives straight into it, packets are parsed in place */
+    int rxstart,                                  /* offset of the first unhandled byte in readbuf */
+      rxlen,                                      /* received bytes from rxstart on */
+      rxskip,                                     /* bytes still to discard of a packet larger than readbuf */
+      packetlen;                                  /* length of the packet at rxstart returned by the last readPacket */
     unsigned int keepAliveInterval;
     char ping_outstanding;
     int isconnected;
@@ -110,7 +131,21 @@ typedef struct MQTTClient
     {
         const char* topicFilter;
         void (*fp) (MessageData*);
-    } messageHandlers[MAX_MESSAGE_HANDLERS];      /* Message handlers are indexed by subscription topic */
+        unsigned int hash;                        /* hash of topicFilter, exact topics only */
+        unsigned short topicLen;                  /* strlen(topicFilter) */
+    } messageHandlers[MESSAGE_HANDLER_SLOTS],     /* Exact topics, open addressing indexed by topic hash */
+      wildcardHandlers[MAX_WILDCARD_HANDLERS];    /* Topic filters with '+' or '#', matched in order */
+    unsigned int messageHandlerCount;             /* Used slots of messageHandlers */
+
+    struct InflightPublish
+    {
+        unsigned short id;                        /* packet id, 0 if the slot is free */
+        unsigned char qos;
+        unsigned char released;                   /* QoS 2: PUBREC received and PUBREL sent, waiting for PUBCOMP */
+        void* context;                            /* passed to publishComplete */
+        Timer timer;                              /* acknowledgement deadline */
+    } inflight[MAX_INFLIGHT_PUBLISHES];           /* QoS 1/2 publishes of MQTTPublishAsync not acknowledged yet */
+    publishCompleteHandler publishComplete;
 
     void (*defaultMessageHandler) (MessageData*);
 
@@ -150,14 +185,37 @@ DLLExport int MQTTConnect(MQTTClient* client, MQTTPacket_connectData* options);
  */
 DLLExport int MQTTPublish(MQTTClient* client, const char*, MQTTMessage*);
 
+/** MQTT Publish Async - send an MQTT publish packet without waiting for the acknowledgement.
+ *  QoS 1/2 publishes take a slot of the in-flight window until MQTTYield receives their PUBACK/PUBCOMP
+ *  (or command_timeout_ms passes); client->publishComplete is then called with the packet id and context.
+ *  The payload is copied into the send buffer, so it can be released when this returns.
+ *  QoS 0 publishes have no completion: they are done when this returns SUCCESS.
+ *  @param client - the client object to use
+ *  @param topic - the topic to publish to
+ *  @param message - the message to send, its id is set for QoS 1/2
+ *  @param context - passed to publishComplete
+ *  @return success code, INFLIGHT_WINDOW_FULL (nothing sent) if MAX_INFLIGHT_PUBLISHES are not acknowledged yet
+ */
+DLLExport int MQTTPublishAsync(MQTTClient* client, const char*, MQTTMessage*, void* context);
+
 /** MQTT Subscribe - send an MQTT subscribe packet and wait for suback before returning.
  *  @param client - the client object to use
  *  @param topicFilter - the topic filter to subscribe to
  *  @param message - the message to send
- *  @return success code
+ *  @return success code, HANDLER_TABLE_FULL (nothing sent) if the filter does not fit in the handler table
  */
 DLLExport int MQTTSubscribe(MQTTClient* client, const char* topicFilter, enum QoS, messageHandler);
 
+/** MQTT SetMessageHandler - set or replace the message handler of a topic filter without subscribing.
+ *  Subscribing again to the same filter replaces its handler, it does not use another entry.
+ *  The topic filter is referenced, not copied, so it must stay valid.
+ *  @param client - the client object to use
+ *  @param topicFilter - the topic filter set the message handler for
+ *  @param messageHandler - pointer to the message handler function
+ *  @return success code, HANDLER_TABLE_FULL if there is no room for another filter
+ */
+DLLExport int MQTTSetMessageHandler(MQTTClient* client, const char* topicFilter, messageHandler);
+
 /** MQTT Subscribe - send an MQTT unsubscribe packet and wait for unsuback before returning.
  *  @param client - the client object to use
  *  @param topicFilter - the topic filter to unsubscribe from
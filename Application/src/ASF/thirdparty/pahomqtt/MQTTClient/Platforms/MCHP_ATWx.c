@@ -21,10 +21,12 @@
 #include "MQTTClient/Wrapper/mqtt.h"
 #include "driver/include/m2m_wifi.h"
 #include "socket/include/socket.h"
+#include "bsp/include/nm_bsp.h"
 #include "string.h"
 
 #define IPV4_BYTE(val,index) 	((val >> (index * 8)) & 0xFF)
-#define MQTT_RX_POOL_SIZE		256
+#define WINC_EVENT_WAIT_MS		100	/* Longest sleep between two event checks, in case an interrupt is missed */
+#define WINC_RX_SPILL_SIZE		1460	/* TCP MSS of the WINC: the most a segment can bring beyond the offered buffer */
 
 static unsigned long MilliTimer=0;
 static int32_t gi32MQTTBrokerIp=0;
@@ -33,11 +35,16 @@ static bool gbMQTTBrokerIpresolved=false;
 static bool gbMQTTBrokerConnected=false;
 static bool gbMQTTBrokerSendDone=false;
 static bool gbMQTTBrokerRecvDone=false;
-static unsigned char gcMQTTRxFIFO[MQTT_RX_POOL_SIZE];
-static uint32_t gu32MQTTRxFIFOPtr=0;
-static uint32_t gu32MQTTRxFIFOLen=0;
+static bool gbMQTTBrokerRxOverrun=false;
+static bool gbMQTTBrokerRxToSpill=false;
 static char *gpcHostAddr;
 
+/* A segment larger than the buffer offered to recv comes in several callbacks, each chunk into the same buffer.
+ * The chunks after the first are steered into the spill buffer instead, and handed out by the next receives. */
+static uint8_t gau8MQTTRxSpill[WINC_RX_SPILL_SIZE];
+static int gi32MQTTRxSpillStart=0;
+static int gi32MQTTRxSpillLen=0;
+
 static bool isMQTTSocket(SOCKET sock)
 {
 	unsigned int cIdx;
@@ -91,15 +98,30 @@ void tcpClientSocketEventHandler(SOCKET sock, uint8_t u8Msg, void *pvMsg)
 			case SOCKET_MSG_RECV:
 			{
 				tstrSocketRecvMsg* pstrRx = (tstrSocketRecvMsg*)pvMsg;
-				gi32MQTTBrokerRxLen = pstrRx->s16BufferSize;
-				if((gi32MQTTBrokerRxLen<0) && (gi32MQTTBrokerRxLen!=SOCK_ERR_TIMEOUT)) {
+				if(pstrRx->s16BufferSize <= 0) {
+					gi32MQTTBrokerRxLen = pstrRx->s16BufferSize;
 					#ifdef MQTT_PLATFORM_DBG
-					printf("ERROR >> Receive error for broker socket (Err=%ld).\r\n",gi32MQTTBrokerRxLen);
+					if(gi32MQTTBrokerRxLen!=SOCK_ERR_TIMEOUT)
+						printf("ERROR >> Receive error for broker socket (Err=%ld).\r\n",gi32MQTTBrokerRxLen);
 					#endif
 				}
+				else if(!gbMQTTBrokerRxToSpill)
+					gi32MQTTBrokerRxLen = pstrRx->s16BufferSize; /* the first chunk, in the buffer given to recv */
+				else
+					gi32MQTTRxSpillLen += pstrRx->s16BufferSize;
 				#ifdef MQTT_PLATFORM_DBG
 				printf("DEBUG >> Remaining data in Rx buffer of broker socket: %d\r\n",pstrRx->u16RemainingSize);
 				#endif
+				if(pstrRx->u16RemainingSize != 0) {
+					/* The driver delivers the rest into the current buffer: move it past what arrived */
+					if(gi32MQTTRxSpillLen == WINC_RX_SPILL_SIZE) {
+						gbMQTTBrokerRxOverrun = true; /* cannot happen with segments up to the MSS */
+						gi32MQTTRxSpillLen = 0;
+					}
+					gbMQTTBrokerRxToSpill = true;
+					socketSetRecvBuffer(sock, &gau8MQTTRxSpill[gi32MQTTRxSpillLen], WINC_RX_SPILL_SIZE - gi32MQTTRxSpillLen);
+					break;
+				}
 				gbMQTTBrokerRecvDone=true;
 			}
 			break;
@@ -108,6 +130,15 @@ void tcpClientSocketEventHandler(SOCKET sock, uint8_t u8Msg, void *pvMsg)
 	}
 }
 
+/* Process the WINC events until the callback sets *pbDone. Sleeps on the WINC interrupt in between instead of spinning */
+static void WINC1500_wait_for(bool *pbDone) {
+	m2m_wifi_handle_events(NULL);
+	while (false == *pbDone) {
+		nm_bsp_wait_for_event(WINC_EVENT_WAIT_MS);
+		m2m_wifi_handle_events(NULL);
+	}
+}
+
 void SysTick_Handler_MQTT(void){
 	MilliTimer++;
 }
@@ -129,8 +160,8 @@ void TimerCountdown(Timer* timer, unsigned int timeout) {
 
 
 int TimerLeftMS(Timer* timer) {
-	xTaskCheckForTimeOut(&timer->xTimeOut, &timer->xTicksToWait); /* updates xTicksToWait to the number left */
-	return (timer->xTicksToWait < 0) ? 0 : (timer->xTicksToWait * portTICK_PERIOD_MS);
+	xTaskCheckForTimeOut(&timer->xTimeOut, &timer->xTicksToWait); /* updates xTicksToWait to the number left, 0 once expired */
+	return timer->xTicksToWait * portTICK_PERIOD_MS;
 }
 
 
@@ -139,72 +170,64 @@ void TimerInit(Timer* timer) {
 	memset(&timer->xTimeOut, '\0', sizeof(timer->xTimeOut));
 }
 
-static int WINC1500_read(Network* n, unsigned char* buffer, int len, int timeout_ms) { 
-  //at times the upper layer requests for single byte of data, but network has more in rx buffer.
-  //this results in callback being invoked multiple times with length 1 before returning. To prevent loss of
-  //data in this process, pool data internally and give it to upper layer on request. 
+static int WINC1500_recv(Network* n, unsigned char* buffer, int len, int timeout_ms) { 
+  //the socket delivers straight into the client's read buffer, which parses the packets in place.
+  //returns what one receive brought (up to len), or the error code of the callback.
+  
+  //first the rest of the last segment, if it did not fit
+  if(gi32MQTTRxSpillLen > 0){
+	  int size = (gi32MQTTRxSpillLen < len) ? gi32MQTTRxSpillLen : len;
+	  memcpy(buffer, &gau8MQTTRxSpill[gi32MQTTRxSpillStart], size);
+	  gi32MQTTRxSpillStart += size;
+	  gi32MQTTRxSpillLen -= size;
+	  return size;
+  }
+  gi32MQTTRxSpillStart = 0;
+  gbMQTTBrokerRxToSpill = false;
   
-  //temporary workaround for timer overrun 
+  //temporary workaround for timer overrun (a zero timeout means no timeout to the driver)
   if(0==timeout_ms) timeout_ms=10;
   
-  if(0==gu32MQTTRxFIFOLen){ //no data in internal FIFO
-	  #ifdef MQTT_PLATFORM_DBG
-	  printf("DEBUG >> Requesting data from network\r\n");
-	  #endif
-	  gbMQTTBrokerRecvDone=false;
-	  if (SOCK_ERR_NO_ERROR!=recv(n->socket,gcMQTTRxFIFO,MQTT_RX_POOL_SIZE,timeout_ms)){
-		  #ifdef MQTT_PLATFORM_DBG
-		  printf("ERROR >> recv failed\r\n");
-		  #endif
-		  return -1;
-	  }
-	  //call handle_events until we get rx callback 
-	  while (false==gbMQTTBrokerRecvDone){
-		  m2m_wifi_handle_events(NULL);
-	  }
-	  
-	  //update current FIFO length
-	  if(gi32MQTTBrokerRxLen>0){ //data recieved form network
-		gu32MQTTRxFIFOLen=gi32MQTTBrokerRxLen;
-		gu32MQTTRxFIFOPtr=0;
-		#ifdef MQTT_PLATFORM_DBG
-		printf("DEBUG >> filled FiFo from network. length=%d\r\n",gu32MQTTRxFIFOLen);
-		#endif
-	  
+  #ifdef MQTT_PLATFORM_DBG
+  printf("DEBUG >> Requesting data from network\r\n");
+  #endif
+  gbMQTTBrokerRecvDone=false;
+  gbMQTTBrokerRxOverrun=false;
+  if (SOCK_ERR_NO_ERROR!=recv(n->socket,buffer,(uint16)len,timeout_ms)){
 	  #ifdef MQTT_PLATFORM_DBG
-    	printf("DEBUG >> rx data through socket: \r\n");
-    	int i=0;
-    	for(i=0;i<gu32MQTTRxFIFOLen;i++)
-    	printf("0x%x, ",gcMQTTRxFIFO[i]);
-    	printf("\r\n");
+	  printf("ERROR >> recv failed\r\n");
 	  #endif
-	  }
-	  else{//mostly in case of timeout
-		  gu32MQTTRxFIFOLen=0;
-		  gu32MQTTRxFIFOPtr=0;
-		  #ifdef MQTT_PLATFORM_DBG
-		  printf("DEBUG >> no data to send. returning error code (%d)\r\n",gi32MQTTBrokerRxLen);
-		  #endif
-		  return gi32MQTTBrokerRxLen; //this corresponds to the error code.
-	  }
+	  return -1;
   }
-  //return data to client from data present in the FIFO from previous recv()
-  if(len>(int)gu32MQTTRxFIFOLen){
+  //handle events until we get rx callback 
+  WINC1500_wait_for(&gbMQTTBrokerRecvDone);
+  
+  if(gbMQTTBrokerRxOverrun){ //part of the stream was overwritten, packets cannot be found anymore
+	  gi32MQTTRxSpillLen = 0;
 	  #ifdef MQTT_PLATFORM_DBG
-	  printf("ERROR >> unable to process read request since FIFO contains less data than requested\r\n");
+	  printf("ERROR >> rx data did not fit in %d bytes\r\n",len);
 	  #endif
-	  return -1;
+	  return BUFFER_OVERFLOW;
   }
- 
-  memcpy((void*)buffer, (const void*)&gcMQTTRxFIFO[gu32MQTTRxFIFOPtr],len);
-  gu32MQTTRxFIFOLen-=len;
-  gu32MQTTRxFIFOPtr+=len;
   
-  return len;
+  #ifdef MQTT_PLATFORM_DBG
+  if(gi32MQTTBrokerRxLen>0){
+	printf("DEBUG >> rx data through socket: \r\n");
+	int i=0;
+	for(i=0;i<gi32MQTTBrokerRxLen;i++)
+	printf("0x%x, ",buffer[i]);
+	printf("\r\n");
+  }
+  else{//mostly in case of timeout
+	printf("DEBUG >> no data received. returning error code (%d)\r\n",gi32MQTTBrokerRxLen);
+  }
+  #endif
+  return gi32MQTTBrokerRxLen; //data length, or the error code.
 }
 
 
 static int WINC1500_write(Network* n, unsigned char* buffer, int len, int timeout_ms) {
+  (void)timeout_ms; //the WINC send takes no timeout
   gbMQTTBrokerSendDone=false;
   if (SOCK_ERR_NO_ERROR!=send(n->socket,buffer,len,0)){
 	  #ifdef MQTT_PLATFORM_DBG
@@ -213,9 +236,7 @@ static int WINC1500_write(Network* n, unsigned char* buffer, int len, int timeou
 	  return -1;
   }
   //wait for send callback
-  while (false==gbMQTTBrokerSendDone){
-	  m2m_wifi_handle_events(NULL);
-  }
+  WINC1500_wait_for(&gbMQTTBrokerSendDone);
   
   #ifdef MQTT_PLATFORM_DBG
   printf("DEBUG >> sent data through socket: \r\n");
@@ -233,6 +254,7 @@ static int WINC1500_write(Network* n, unsigned char* buffer, int len, int timeou
 
 
 static void WINC1500_disconnect(Network* n) {
+	gi32MQTTRxSpillLen = 0; //the rest of the stream of the old connection
 	close(n->socket);
 	n->socket=-1;
 	gbMQTTBrokerConnected=false;
@@ -241,7 +263,7 @@ static void WINC1500_disconnect(Network* n) {
 
 void NetworkInit(Network* n) {
 	n->socket = -1;
-	n->mqttread = WINC1500_read;
+	n->mqttrecv = WINC1500_recv;
 	n->mqttwrite = WINC1500_write;
 	n->disconnect = WINC1500_disconnect;
 }
@@ -254,9 +276,7 @@ int ConnectNetwork(Network* n, char* addr, int port, int TLSFlag){
   gethostbyname((uint8*)addr);
  
   //wait for resolver callback
-  while (false==gbMQTTBrokerIpresolved){
-	  m2m_wifi_handle_events(NULL);
-  }
+  WINC1500_wait_for(&gbMQTTBrokerIpresolved);
   
   n->hostIP = gi32MQTTBrokerIp;
   
@@ -290,9 +310,7 @@ int ConnectNetwork(Network* n, char* addr, int port, int TLSFlag){
   gbMQTTBrokerConnected = false;
   
   /*wait for SOCKET_MSG_CONNECT event */
-  while(false==gbMQTTBrokerConnected){
-    m2m_wifi_handle_events(NULL);
-  }
+  WINC1500_wait_for(&gbMQTTBrokerConnected);
   
   /* Success */
   #ifdef MQTT_PLATFORM_DBG
@@ -37,12 +37,12 @@ struct Network_t
 {
 	int socket;
 	int hostIP;
-	int (*mqttread) (Network*, unsigned char*, int, int);
+	int (*mqttrecv) (Network*, unsigned char*, int, int);
 	int (*mqttwrite) (Network*, unsigned char*, int, int);
 	void (*disconnect) (Network*);
 }; 
 
-int winc1500_read(Network*, unsigned char*, unsigned int, int);
+int winc1500_recv(Network*, unsigned char*, unsigned int, int);
 int winc1500_write(Network*, unsigned char*, unsigned int, int);
 void winc1500_disconnect(Network*);
 void NetworkInit(Network* n);
@@ -24,6 +24,7 @@ struct mqtt_client_pool mqttClientPool[MQTT_MAX_CLIENTS] = {0,};
 
 static void allocateClient(struct mqtt_module *module);
 static void deAllocateClient(struct mqtt_module *module);
+static void publishComplete(MQTTClient *client, unsigned short id, int rc, void *context);
 
 static void allocateClient(struct mqtt_module *module)
 {
@@ -61,6 +62,29 @@ static void deAllocateClient(struct mqtt_module *module)
 	}
 }
 
+static void publishComplete(MQTTClient *client, unsigned short id, int rc, void *context)
+{
+	unsigned int cIdx;
+	union mqtt_data data;
+	
+	for(cIdx = 0; cIdx < MQTT_MAX_CLIENTS; cIdx++)
+	{
+		struct mqtt_module *module = mqttClientPool[cIdx].mqtt_instance;
+		
+		if(module && module->client == client)
+		{
+			if(module->callback)
+			{
+				data.published.result = rc;
+				data.published.id = id;
+				data.published.context = context;
+				module->callback(module, MQTT_CALLBACK_PUBLISHED, &data);
+			}
+			return;
+		}
+	}
+}
+
 int mqtt_init(struct mqtt_module *module, struct mqtt_config *config)
 {
 	unsigned int timeout_ms;
@@ -76,6 +100,7 @@ int mqtt_init(struct mqtt_module *module, struct mqtt_config *config)
 	if(module->client)
 	{
 		MQTTClientInit(module->client, &(module->network), timeout_ms, config->send_buffer, config->send_buffer_size, config->read_buffer, config->read_buffer_size);
+		module->client->publishComplete = publishComplete;
 		return SUCCESS;
 	}
 	else
@@ -212,6 +237,19 @@ int mqtt_publish(struct mqtt_module *const module, const char *topic, const char
 	return rc;
 }
 
+int mqtt_publish_async(struct mqtt_module *const module, const char *topic, const char *msg, uint32_t msg_len, uint8_t qos, uint8_t retain, void *context)
+{
+	MQTTMessage mqttMsg;
+	
+	mqttMsg.qos = qos;
+	mqttMsg.payload = (char *)msg;
+	mqttMsg.payloadlen = (size_t)msg_len;
+	mqttMsg.retained = retain;
+	mqttMsg.dup = 0;
+	
+	return MQTTPublishAsync(module->client, topic, &mqttMsg, context);
+}
+
 int mqtt_subscribe(struct mqtt_module *module, const char *topic, uint8_t qos, messageHandler msgHandler)
 {
 	int rc;
@@ -179,7 +179,12 @@ struct mqtt_data_connected {
  * \brief Structure of the MQTT_CALLBACK_PUBLISHED callback.
  */
 struct mqtt_data_published {
-	int dummy;
+	/** Result of operation: SUCCESS once acknowledged, FAILURE on timeout or disconnection. */
+	int result;
+	/** Packet id of the publish. */
+	uint16_t id;
+	/** Context given to \ref mqtt_publish_async. */
+	void *context;
 };
 
 /**
@@ -541,6 +546,27 @@ int mqtt_disconnect(struct mqtt_module *const module, int force_close);
  */
 int mqtt_publish(struct mqtt_module *const module, const char *topic, const char *msg, uint32_t msg_len, uint8_t qos, uint8_t retain);
 
+/**
+ * \brief Send publish message to MQTT broker server without waiting for its acknowledgement.
+ * QoS 1/2 messages stay in the in-flight window (MAX_INFLIGHT_PUBLISHES) until \ref mqtt_yield receives their
+ * acknowledgement; MQTT_CALLBACK_PUBLISHED is then sent with the result, packet id and context.
+ * The payload is copied when sending, so it can be released when this function returns.
+ * QoS 0 messages have no MQTT_CALLBACK_PUBLISHED: they are complete when this function returns SUCCESS.
+ *
+ * \param[in]  module_inst     Instance of MQTT module.
+ * \param[in]  topic           Topic of this MQTT message.
+ * \param[in]  msg             Payload of this MQTT message.
+ * \param[in]  msg_len         Payload size of this MQTT message.
+ * \param[in]  qos             QOS level of this MQTT message. (0 <= qos <= 2)
+ * \param[in]  retain          Whether broker server will be store this MQTT message or not.
+ * \param[in]  context         Given back in \ref mqtt_data_published.
+ *
+ * \return     SUCCESS                 Message sent.
+ * \return     INFLIGHT_WINDOW_FULL    Nothing sent, wait for acknowledgements of earlier messages.
+ * \return     FAILURE                 Not connected or send failed.
+ */
+int mqtt_publish_async(struct mqtt_module *const module, const char *topic, const char *msg, uint32_t msg_len, uint8_t qos, uint8_t retain, void *context);
+
 /**
  * \brief Send subscribe message to MQTT broker server.
  * If operation of this function is complete, MQTT_CALLBACK_SUBSCRIBED event will be sent through MQTT callback.
@@ -0,0 +1,280 @@
+/**************************************************************************/
+/**
+ * @file        Bench.c
+ * @brief       On-target micro-benchmarks run by the "bench" CLI command, see Bench.h
+ * @details     Only the timed loop is measured; opening files, selecting devices and other setup is not.
+ *				The data written to the SPI bus and the SD card is read straight from flash, so no large
+ *				RAM buffer is needed.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "Bench.h"
+
+#include <errno.h>
+
+#include "BenchTimer.h"
+#include "I2cDriver/I2cDriver.h"
+#include "LCD/LCD.h"
+#include "LED/LED.h"
+#include "SerialConsole.h"
+#include "asf.h"
+#include "flag.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define BENCH_PRIORITY (configMAX_PRIORITIES - 1)   ///< Priority of the CLI task while a benchmark runs
+#define BENCH_IMU_ADDR 0x6B                          ///< I2C address of the LSM6DSO
+#define BENCH_IMU_WHO_AM_I 0x0F                      ///< Register read by the I2C benchmark
+#define BENCH_FLASH_DATA ((const uint8_t *)(FLASH_ADDR + NVMCTRL_ROW_SIZE))   ///< Source data of the writes
+#define BENCH_SCREEN_BYTES (ST7735_WIDTH * ST7735_HEIGHT * 2)                  ///< One full screen in RGB565
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** One entry of the suite. run times 'iterations' operations and returns the total cycles in *cycles */
+struct BenchCase {
+	const char *name;
+	uint32_t iterations;
+	uint32_t bytesPerOp;
+	int (*run)(const struct BenchCase *bench, uint32_t *cycles);
+};
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int bench_lcd_fill(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_lcd_fill_dma(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_spi_raw(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_i2c_read(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_sd_write(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_led_send(const struct BenchCase *bench, uint32_t *cycles);
+static int bench_log_message(const struct BenchCase *bench, uint32_t *cycles);
+static void bench_lcd_bus_take(void);
+static void bench_lcd_bus_give(void);
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static const struct BenchCase benchCases[] = {
+	{"lcd_fill", 2, BENCH_SCREEN_BYTES, bench_lcd_fill},
+	{"lcd_fill_dma", 2, BENCH_SCREEN_BYTES, bench_lcd_fill_dma},
+	{"spi_raw", 8, BENCH_SPI_SIZE, bench_spi_raw},
+	{"i2c_read", 32, 1, bench_i2c_read},
+	{"sd_write_512", BENCH_SD_TOTAL / 512, 512, bench_sd_write},
+	{"sd_write_4k", BENCH_SD_TOTAL / 4096, 4096, bench_sd_write},
+	{"sd_write_32k", BENCH_SD_TOTAL / 32768, 32768, bench_sd_write},
+	{"led_send", 4, 0, bench_led_send},
+	{"log_message", 16, 0, bench_log_message},
+};
+
+#define BENCH_CASE_COUNT ((int)(sizeof(benchCases) / sizeof(benchCases[0])))
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+int BenchCount(void)
+{
+	return BENCH_CASE_COUNT;
+}
+
+const char *BenchName(int index)
+{
+	return (index >= 0 && index < BENCH_CASE_COUNT) ? benchCases[index].name : NULL;
+}
+
+int BenchRun(int index, struct BenchResult *result)
+{
+	const struct BenchCase *bench;
+	UBaseType_t priority;
+	uint32_t cycles = 0;
+	int res;
+
+	if (index < 0 || index >= BENCH_CASE_COUNT) {
+		return -EINVAL;
+	}
+	bench = &benchCases[index];
+
+	// Keep the other tasks (and their SPI/I2C traffic) out of the measurement
+	priority = uxTaskPriorityGet(NULL);
+	vTaskPrioritySet(NULL, BENCH_PRIORITY);
+	res = bench->run(bench, &cycles);
+	vTaskPrioritySet(NULL, priority);
+
+	if (res != 0) {
+		return res;
+	}
+
+	result->name = bench->name;
+	result->iterations = bench->iterations;
+	result->bytesPerOp = bench->bytesPerOp;
+	result->cyclesPerOp = cycles / bench->iterations;
+	result->usPerOp = BenchTimerCyclesToUs(result->cyclesPerOp);
+	// bytes / us = MB/s, times 1000 for kB/s. Computed from the total to keep the precision
+	uint32_t totalUs = BenchTimerCyclesToUs(cycles);
+	result->kBps = (totalUs > 0) ? (uint32_t)(((uint64_t)bench->bytesPerOp * bench->iterations * 1000) / totalUs) : 0;
+	return 0;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+// Full screen fill, one 16-bit SPI write per pixel. The clock display is paused so it does not draw in between
+static int bench_lcd_fill(const struct BenchCase *bench, uint32_t *cycles)
+{
+	int stopRtcShow = stop_rtc_show_flag;
+	stop_rtc_show_flag = 1;
+	bench_lcd_bus_take();
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations; i++) {
+		lcd_fill_rect(0, 0, ST7735_WIDTH, ST7735_HEIGHT, (i & 1) ? ST7735_WHITE : ST7735_BLACK);
+	}
+	*cycles = BenchTimerNow() - start;
+
+	bench_lcd_bus_give();
+	stop_rtc_show_flag = stopRtcShow;
+	return 0;
+}
+
+// Full screen fill in DMA chunks. lcd_fill_rect_dma polls the DMA completion flag, so it runs with the scheduler suspended
+static int bench_lcd_fill_dma(const struct BenchCase *bench, uint32_t *cycles)
+{
+	int stopRtcShow = stop_rtc_show_flag;
+	stop_rtc_show_flag = 1;
+	bench_lcd_bus_take();
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations; i++) {
+		lcd_fill_rect_dma(0, 0, ST7735_WIDTH, ST7735_HEIGHT, (i & 1) ? ST7735_WHITE : ST7735_BLACK);
+	}
+	*cycles = BenchTimerNow() - start;
+
+	bench_lcd_bus_give();
+	// The screen was overwritten, the clock redraws itself on its next update
+	stop_rtc_show_flag = stopRtcShow;
+	return 0;
+}
+
+// Blocking SPI writes on the LCD bus with no slave selected: the bus and driver limit, no device overhead
+static int bench_spi_raw(const struct BenchCase *bench, uint32_t *cycles)
+{
+	int res = 0;
+	bench_lcd_bus_take();
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations && res == 0; i++) {
+		if (spi_write_buffer_wait(&spi_master_instance, BENCH_FLASH_DATA, bench->bytesPerOp) != STATUS_OK) {
+			res = -EIO;
+		}
+	}
+	*cycles = BenchTimerNow() - start;
+
+	bench_lcd_bus_give();
+	return res;
+}
+
+// The LCD has no bus lock, and the tasks that draw can be preempted with its CS low. The scheduler is suspended
+// at a moment the CS is high, so no transfer is in progress and none can start until bench_lcd_bus_give
+static void bench_lcd_bus_take(void)
+{
+	vTaskSuspendAll();
+	while (!port_pin_get_output_level(LCD_CS_PIN)) {
+		xTaskResumeAll();
+		vTaskDelay(1);
+		vTaskSuspendAll();
+	}
+}
+
+static void bench_lcd_bus_give(void)
+{
+	xTaskResumeAll();
+}
+
+// Register read round trip: address + register out, one byte in
+static int bench_i2c_read(const struct BenchCase *bench, uint32_t *cycles)
+{
+	uint8_t reg = BENCH_IMU_WHO_AM_I;
+	uint8_t value;
+	I2C_Data data = {.address = BENCH_IMU_ADDR, .msgOut = &reg, .lenOut = 1, .msgIn = &value, .lenIn = 1};
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations; i++) {
+		int32_t res = I2cReadDataWait(&data, 0, pdMS_TO_TICKS(100));
+		if (res != 0) {
+			return (int)res;
+		}
+	}
+	*cycles = BenchTimerNow() - start;
+	return 0;
+}
+
+// Sequential f_write of bytesPerOp blocks to a new file, f_sync included. The card must be mounted
+static int bench_sd_write(const struct BenchCase *bench, uint32_t *cycles)
+{
+	static FIL file;
+	UINT written;
+	int res = 0;
+
+	if (f_open(&file, BENCH_SD_FILE_NAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+		return -ENODEV;
+	}
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations && res == 0; i++) {
+		if (f_write(&file, BENCH_FLASH_DATA, bench->bytesPerOp, &written) != FR_OK) {
+			res = -EIO;
+		} else if (written != bench->bytesPerOp) {
+			res = -ENOSPC;
+		}
+	}
+	if (res == 0 && f_sync(&file) != FR_OK) {
+		res = -EIO;
+	}
+	*cycles = BenchTimerNow() - start;
+
+	f_close(&file);
+	f_unlink(BENCH_SD_FILE_NAME);
+	return res;
+}
+
+// One LED strip update. SK6812_Send ends with a 10 ms delay, which is part of the result
+static int bench_led_send(const struct BenchCase *bench, uint32_t *cycles)
+{
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations; i++) {
+		SK6812_Send();
+	}
+	*cycles = BenchTimerNow() - start;
+	return 0;
+}
+
+// Cost of one LogMessage call in the caller's context, at the INFO level so that it is never filtered.
+// setLogLevel also sets every module level, the ones set with the "log" command are put back after
+static int bench_log_message(const struct BenchCase *bench, uint32_t *cycles)
+{
+	enum eDebugLogLevels level = getLogLevel();
+	uint8_t moduleLevels[N_LOG_MODULES];
+	for (int module = 0; module < N_LOG_MODULES; module++) {
+		moduleLevels[module] = logModuleLevels[module];
+	}
+	setLogLevel(LOG_INFO_LVL);
+
+	uint32_t start = BenchTimerNow();
+	for (uint32_t i = 0; i < bench->iterations; i++) {
+		LogMessage(LOG_INFO_LVL, "bench %lu\r\n", (unsigned long)i);
+	}
+	*cycles = BenchTimerNow() - start;
+
+	setLogLevel(level);
+	for (int module = 0; module < N_LOG_MODULES; module++) {
+		setLogModuleLevel((enum eLogModules) module, (enum eDebugLogLevels) moduleLevels[module]);
+	}
+	return 0;
+}
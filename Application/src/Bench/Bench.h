@@ -0,0 +1,66 @@
+/**************************************************************************/
+/**
+ * @file        Bench.h
+ * @brief       On-target micro-benchmarks run by the "bench" CLI command
+ * @details     Each benchmark runs its operation a fixed number of times and is timed with BenchTimer, so the
+ *				results of two firmware builds can be compared line by line. The benchmarks drive the real
+ *				peripherals (LCD, SPI, I2C, SD card, LED) and run at the highest priority, so the other tasks
+ *				are held off until the suite is done.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define BENCH_SD_FILE_NAME "0:bench.bin"    ///< Scratch file of the SD benchmarks, deleted afterwards
+#define BENCH_SD_TOTAL (64UL * 1024)        ///< Bytes written by each SD benchmark
+#define BENCH_SPI_SIZE 4096                 ///< Bytes sent by the raw SPI benchmark
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Result of one benchmark, see BenchRun */
+struct BenchResult {
+	const char *name;      /**< Short name of the benchmark */
+	uint32_t iterations;   /**< Number of operations timed */
+	uint32_t bytesPerOp;   /**< Bytes moved per operation, 0 if not a transfer */
+	uint32_t cyclesPerOp;  /**< Average CPU cycles per operation */
+	uint32_t usPerOp;      /**< Average time per operation in microseconds */
+	uint32_t kBps;         /**< Throughput in kB/s (1000 B), 0 if not a transfer */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			int BenchCount(void)
+ * @brief		Returns the number of benchmarks in the suite
+ *****************************************************************************/
+int BenchCount(void);
+
+/**
+ * @fn			const char *BenchName(int index)
+ * @brief		Returns the name of a benchmark, NULL if the index is out of range
+ *****************************************************************************/
+const char *BenchName(int index);
+
+/**
+ * @fn			int BenchRun(int index, struct BenchResult *result)
+ * @brief		Runs one benchmark and fills result
+ * @return		0 on success, -EINVAL if the index is out of range, or the negative error of the operation
+ * @note		Blocks the other tasks while it runs. Call from the CLI task only
+ *****************************************************************************/
+int BenchRun(int index, struct BenchResult *result);
+
+#endif /* BENCH_H */
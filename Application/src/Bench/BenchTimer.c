@@ -0,0 +1,46 @@
+/**************************************************************************/
+/**
+ * @file        BenchTimer.c
+ * @brief       Cycle-accurate timer shared by all the benchmarks, see BenchTimer.h
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "BenchTimer.h"
+
+#include "asf.h"
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+uint32_t BenchTimerNow(void)
+{
+	uint32_t reload = SysTick->LOAD + 1;
+	uint32_t ticks, value;
+	bool tickPending;
+
+	// Sample the tick count, the counter and the pending flag together
+	UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	ticks = xTaskGetTickCountFromISR();
+	value = SysTick->VAL;
+	tickPending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+	// The counter reloaded but the tick interrupt has not run yet: the tick count is one behind.
+	// A high value means the reload happened before the counter was read
+	if (tickPending && value > reload / 2) {
+		ticks++;
+	}
+
+	return ticks * reload + (reload - 1 - value);
+}
+
+uint32_t BenchTimerCyclesToUs(uint32_t cycles)
+{
+	return cycles / (system_cpu_clock_get_hz() / 1000000UL);
+}
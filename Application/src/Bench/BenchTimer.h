@@ -0,0 +1,39 @@
+/**************************************************************************/
+/**
+ * @file        BenchTimer.h
+ * @brief       Cycle-accurate timer shared by all the benchmarks of the "bench" command
+ * @details     The Cortex-M0+ has no cycle counter, so the time is rebuilt from the RTOS tick count and the
+ *				SysTick down-counter: cycles = ticks * (LOAD + 1) + elapsed part of the current tick. The count
+ *				wraps every 2^32 cycles (~89 s at 48 MHz); differences of two readings are valid below that.
+ *				It also works with interrupts disabled for less than half a tick.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef BENCH_TIMER_H
+#define BENCH_TIMER_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			uint32_t BenchTimerNow(void)
+ * @brief		Returns the current time in CPU cycles
+ * @note		Requires the scheduler to be running (SysTick is started by the kernel)
+ *****************************************************************************/
+uint32_t BenchTimerNow(void);
+
+/**
+ * @fn			uint32_t BenchTimerCyclesToUs(uint32_t cycles)
+ * @brief		Converts a number of CPU cycles to microseconds
+ *****************************************************************************/
+uint32_t BenchTimerCyclesToUs(uint32_t cycles);
+
+#endif /* BENCH_TIMER_H */
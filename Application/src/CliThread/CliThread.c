@@ -11,8 +11,16 @@
  ******************************************************************************/
 #include "CliThread.h"
 
+#include <errno.h>
+
 #include "I2cDriver/I2cDriver.h"
 #include "WifiHandlerThread/WifiHandler.h"
+#include "SerialConsole/DeferredLog.h"
+#include "RunTimeStats/RunTimeStats.h"
+#include "Trace/TraceSd.h"
+#include "Bench/Bench.h"
+#include "Heap/Heap.h"
+#include "MemPool/MemPool.h"
 /******************************************************************************
  * Defines
  ******************************************************************************/
@@ -26,6 +34,7 @@ static int8_t *const pcWelcomeMessage =
 
 static const CLI_Command_Definition_t xOTAUCommand = {"fw", "fw: Download a file and perform an FW update\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_OTAU, 0};
 static const CLI_Command_Definition_t xI2cScan = {"i2c", "i2c: Scans I2C bus\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_i2cScan, 0};
+static const CLI_Command_Definition_t xBenchCommand = {"bench", "bench: Runs the micro-benchmarks, one CSV line per benchmark\r\n", CLI_Bench, 0};
 static const CLI_Command_Definition_t xGoldCommand = {"gold", "gold:\r\n Create golden image of current firmware as g_application.bin\r\n", CLI_Gold, 0};
 // Clear screen command
 const CLI_Command_Definition_t xClearScreen =
@@ -56,12 +65,63 @@ static const CLI_Command_Definition_t xTicksCommand =
 		CLI_ShowTicks,
 		0};
 
+static const CLI_Command_Definition_t xTopCommand =
+	{
+		"top",
+		"top [seconds]: Shows CPU usage, stack high-water mark, state and priority per task. Refreshes until a key is pressed\r\n",
+		CLI_Top,
+		-1};
+
+static const CLI_Command_Definition_t xTraceCommand =
+	{
+		"trace",
+		"trace [start|stop]: Streams a Tracealyzer trace to " TRACE_SD_FILE_NAME " on the SD card, or shows its state\r\n",
+		CLI_Trace,
+		-1};
+
+static const CLI_Command_Definition_t xHeapCommand =
+	{
+		"heap",
+		"heap: Shows free heap, largest free block, fragmentation and the live allocations per call site and the memory pool usage\r\n",
+		CLI_Heap,
+		0};
+
+static const CLI_Command_Definition_t xUartStatsCommand =
+	{
+		"uart",
+		"uart: Shows serial console TX throughput and dropped bytes\r\n",
+		CLI_UartStats,
+		0};
+
+static const CLI_Command_Definition_t xMqttStatsCommand =
+	{
+		"mqtt",
+		"mqtt: Shows the outbound MQTT counters per priority class (queued, dropped, published, latency)\r\n",
+		CLI_MqttStats,
+		0};
+
+static const CLI_Command_Definition_t xLogCommand =
+	{
+		"log",
+		"log [<module> [<level>]|all <level>]: Shows or sets the log level per module. Levels from lowest: debug, info, warning, error, fatal, off\r\n",
+		CLI_LogLevel,
+		-1};
+
+static const char *const logLevelNames[] = {"debug", "info", "warning", "error", "fatal", "off"};
+
 SemaphoreHandle_t xRxSemaphore; // Semaphore for CLI
 
+static TickType_t topPeriod; // Refresh period of the "top" command
+
+static char pcEcho[CLI_RX_CHUNK_SIZE + 1]; // Characters to echo, written once per received chunk
+static uint8_t echoLen = 0;
+
 /******************************************************************************
  * Forward Declarations
  ******************************************************************************/
-static void FreeRTOS_read(char *character);
+static size_t FreeRTOS_read(char *buffer, size_t len);
+static void cli_flush_echo(void);
+static bool cli_wait_for_key(TickType_t timeout);
 /******************************************************************************
  * Callback Functions
  ******************************************************************************/
@@ -77,9 +137,16 @@ void vCommandConsoleTask(void *pvParameters)
     FreeRTOS_CLIRegisterCommand(&xClearScreen);
     FreeRTOS_CLIRegisterCommand(&xResetCommand);
     FreeRTOS_CLIRegisterCommand(&xI2cScan);
+    FreeRTOS_CLIRegisterCommand(&xBenchCommand);
 	FreeRTOS_CLIRegisterCommand(&xVersionCommand);
 	FreeRTOS_CLIRegisterCommand(&xTicksCommand);
+	FreeRTOS_CLIRegisterCommand(&xTopCommand);
+	FreeRTOS_CLIRegisterCommand(&xTraceCommand);
+	FreeRTOS_CLIRegisterCommand(&xHeapCommand);
 	FreeRTOS_CLIRegisterCommand(&xGoldCommand);
+	FreeRTOS_CLIRegisterCommand(&xUartStatsCommand);
+	FreeRTOS_CLIRegisterCommand(&xMqttStatsCommand);
+	FreeRTOS_CLIRegisterCommand(&xLogCommand);
 
     uint8_t cRxedChar[2], cInputIndex = 0;
     BaseType_t xMoreDataToFollow;
@@ -89,6 +156,8 @@ void vCommandConsoleTask(void *pvParameters)
     static bool isEscapeCode = false;
     static char pcEscapeCodes[4];
     static uint8_t pcEscapeCodePos = 0;
+    static char rxChunk[CLI_RX_CHUNK_SIZE];
+    char lastRxedChar = 0;
 
     // Any semaphores/mutexes/etc you needed to be initialized, you can do them here
 	xRxSemaphore = xSemaphoreCreateBinary();
@@ -103,164 +172,224 @@ void vCommandConsoleTask(void *pvParameters)
 
     /* Send a welcome message to the user knows they are connected. */
     SerialConsoleWriteString(pcWelcomeMessage);
-    char rxChar;
     for (;;)
     {
-        /* This implementation reads a single character at a time.  Wait in the
-        Blocked state until a character is received. */
+        /* Wait in the Blocked state until characters are received, then process
+        everything that was buffered. A pasted line arrives as one chunk. */
 
-        FreeRTOS_read(&cRxedChar);
+        size_t rxCount = FreeRTOS_read(rxChunk, sizeof(rxChunk));
 
-        if (cRxedChar[0] == '\n' || cRxedChar[0] == '\r')
+        for (size_t rxPos = 0; rxPos < rxCount; rxPos++)
         {
-            /* A newline character was received, so the input command string is
-            complete and can be processed.  Transmit a line separator, just to
-            make the output easier to read. */
-            SerialConsoleWriteString("\r\n");
-            // Copy for last command
-            isEscapeCode = false;
-            pcEscapeCodePos = 0;
-            strncpy(pcLastCommand, pcInputString, MAX_INPUT_LENGTH_CLI - 1);
-            pcLastCommand[MAX_INPUT_LENGTH_CLI - 1] = 0; // Ensure null termination
-
-            /* The command interpreter is called repeatedly until it returns
-            pdFALSE.  See the "Implementing a command" documentation for an
-            explanation of why this is. */
-            do
+            cRxedChar[0] = rxChunk[rxPos];
+
+            // "\r\n" ends a single line
+            bool isLfAfterCr = (cRxedChar[0] == '\n' && lastRxedChar == '\r');
+            lastRxedChar = cRxedChar[0];
+            if (isLfAfterCr)
             {
-                /* Send the command string to the command interpreter.  Any
-                output generated by the command interpreter will be placed in the
-                pcOutputString buffer. */
-                xMoreDataToFollow = FreeRTOS_CLIProcessCommand(
-                    pcInputString,        /* The command string.*/
-                    pcOutputString,       /* The output buffer. */
-                    MAX_OUTPUT_LENGTH_CLI /* The size of the output buffer. */
-                );
-
-                /* Write the output generated by the command interpreter to the
-                console. */
-                // Ensure it is null terminated
-                pcOutputString[MAX_OUTPUT_LENGTH_CLI - 1] = 0;
-                SerialConsoleWriteString(pcOutputString);
-
-            } while (xMoreDataToFollow != pdFALSE);
-
-            /* All the strings generated by the input command have been sent.
-            Processing of the command is complete.  Clear the input string ready
-            to receive the next command. */
-            cInputIndex = 0;
-            memset(pcInputString, 0x00, MAX_INPUT_LENGTH_CLI);
-			memset(pcOutputString, 0, MAX_OUTPUT_LENGTH_CLI);
-        }
-        else
-        {
-            /* The if() clause performs the processing after a newline character
-    is received.  This else clause performs the processing if any other
-    character is received. */
+                continue;
+            }
 
-            if (true == isEscapeCode)
+            if (cRxedChar[0] == '\n' || cRxedChar[0] == '\r')
             {
+                cli_flush_echo();
+                /* A newline character was received, so the input command string is
+                complete and can be processed.  Transmit a line separator, just to
+                make the output easier to read. */
+                SerialConsoleWriteString("\r\n");
+                // Copy for last command
+                isEscapeCode = false;
+                pcEscapeCodePos = 0;
+                strncpy(pcLastCommand, pcInputString, MAX_INPUT_LENGTH_CLI - 1);
+                pcLastCommand[MAX_INPUT_LENGTH_CLI - 1] = 0; // Ensure null termination
 
-                if (pcEscapeCodePos < CLI_PC_ESCAPE_CODE_SIZE)
-                {
-                    pcEscapeCodes[pcEscapeCodePos++] = cRxedChar[0];
-                }
-                else
+                /* The command interpreter is called repeatedly until it returns
+                pdFALSE.  See the "Implementing a command" documentation for an
+                explanation of why this is. */
+                do
                 {
-                    isEscapeCode = false;
-                    pcEscapeCodePos = 0;
-                }
+                    /* Send the command string to the command interpreter.  Any
+                    output generated by the command interpreter will be placed in the
+                    pcOutputString buffer. */
+                    xMoreDataToFollow = FreeRTOS_CLIProcessCommand(
+                        pcInputString,        /* The command string.*/
+                        pcOutputString,       /* The output buffer. */
+                        MAX_OUTPUT_LENGTH_CLI /* The size of the output buffer. */
+                    );
+
+                    /* Write the output generated by the command interpreter to the
+                    console. */
+                    // Ensure it is null terminated
+                    pcOutputString[MAX_OUTPUT_LENGTH_CLI - 1] = 0;
+                    SerialConsoleWriteString(pcOutputString);
+
+                } while (xMoreDataToFollow != pdFALSE);
+
+                /* All the strings generated by the input command have been sent.
+                Processing of the command is complete.  Clear the input string ready
+                to receive the next command. */
+                cInputIndex = 0;
+                memset(pcInputString, 0x00, MAX_INPUT_LENGTH_CLI);
+    			memset(pcOutputString, 0, MAX_OUTPUT_LENGTH_CLI);
+            }
+            else
+            {
+                /* The if() clause performs the processing after a newline character
+        is received.  This else clause performs the processing if any other
+        character is received. */
 
-                if (pcEscapeCodePos >= CLI_PC_MIN_ESCAPE_CODE_SIZE)
+                if (true == isEscapeCode)
                 {
 
-                    // UP ARROW SHOW LAST COMMAND
-                    if (strcasecmp(pcEscapeCodes, "oa"))
+                    if (pcEscapeCodePos < CLI_PC_ESCAPE_CODE_SIZE)
+                    {
+                        pcEscapeCodes[pcEscapeCodePos++] = cRxedChar[0];
+                    }
+                    else
                     {
-                        /// Delete current line and add prompt (">")
-                        sprintf(pcInputString, "%c[2K\r>", 27);
-                        SerialConsoleWriteString(pcInputString);
-                        /// Clear input buffer
-                        cInputIndex = 0;
-                        memset(pcInputString, 0x00, MAX_INPUT_LENGTH_CLI);
-                        /// Send last command
-                        strncpy(pcInputString, pcLastCommand, MAX_INPUT_LENGTH_CLI - 1);
-                        cInputIndex = (strlen(pcInputString) < MAX_INPUT_LENGTH_CLI - 1) ? strlen(pcLastCommand) : MAX_INPUT_LENGTH_CLI - 1;
-                        SerialConsoleWriteString(pcInputString);
+                        isEscapeCode = false;
+                        pcEscapeCodePos = 0;
                     }
 
-                    isEscapeCode = false;
-                    pcEscapeCodePos = 0;
+                    if (pcEscapeCodePos >= CLI_PC_MIN_ESCAPE_CODE_SIZE)
+                    {
+
+                        // UP ARROW SHOW LAST COMMAND
+                        if (strcasecmp(pcEscapeCodes, "oa"))
+                        {
+                            cli_flush_echo();
+                            /// Delete current line and add prompt (">")
+                            sprintf(pcInputString, "%c[2K\r>", 27);
+                            SerialConsoleWriteString(pcInputString);
+                            /// Clear input buffer
+                            cInputIndex = 0;
+                            memset(pcInputString, 0x00, MAX_INPUT_LENGTH_CLI);
+                            /// Send last command
+                            strncpy(pcInputString, pcLastCommand, MAX_INPUT_LENGTH_CLI - 1);
+                            cInputIndex = (strlen(pcInputString) < MAX_INPUT_LENGTH_CLI - 1) ? strlen(pcLastCommand) : MAX_INPUT_LENGTH_CLI - 1;
+                            SerialConsoleWriteString(pcInputString);
+                        }
+
+                        isEscapeCode = false;
+                        pcEscapeCodePos = 0;
+                    }
                 }
-            }
-            /* The if() clause performs the processing after a newline character
-            is received.  This else clause performs the processing if any other
-            character is received. */
+                /* The if() clause performs the processing after a newline character
+                is received.  This else clause performs the processing if any other
+                character is received. */
 
-            else if (cRxedChar[0] == '\r')
-            {
-                /* Ignore carriage returns. */
-            }
-            else if (cRxedChar[0] == ASCII_BACKSPACE || cRxedChar[0] == ASCII_DELETE)
-            {
-                char erase[4] = {0x08, 0x20, 0x08, 0x00};
-                SerialConsoleWriteString(erase);
-                /* Backspace was pressed.  Erase the last character in the input
-                buffer - if there are any. */
-                if (cInputIndex > 0)
+                else if (cRxedChar[0] == '\r')
                 {
-                    cInputIndex--;
-                    pcInputString[cInputIndex] = 0;
+                    /* Ignore carriage returns. */
                 }
-            }
-            // ESC
-            else if (cRxedChar[0] == ASCII_ESC)
-            {
-                isEscapeCode = true; // Next characters will be code arguments
-                pcEscapeCodePos = 0;
-            }
-            else
-            {
-                /* A character was entered.  It was not a new line, backspace
-                or carriage return, so it is accepted as part of the input and
-                placed into the input buffer.  When a n is entered the complete
-                string will be passed to the command interpreter. */
-                if (cInputIndex < MAX_INPUT_LENGTH_CLI)
+                else if (cRxedChar[0] == ASCII_BACKSPACE || cRxedChar[0] == ASCII_DELETE)
                 {
-                    pcInputString[cInputIndex] = cRxedChar[0];
-                    cInputIndex++;
+                    cli_flush_echo();
+                    char erase[4] = {0x08, 0x20, 0x08, 0x00};
+                    SerialConsoleWriteString(erase);
+                    /* Backspace was pressed.  Erase the last character in the input
+                    buffer - if there are any. */
+                    if (cInputIndex > 0)
+                    {
+                        cInputIndex--;
+                        pcInputString[cInputIndex] = 0;
+                    }
                 }
+                // ESC
+                else if (cRxedChar[0] == ASCII_ESC)
+                {
+                    isEscapeCode = true; // Next characters will be code arguments
+                    pcEscapeCodePos = 0;
+                }
+                else
+                {
+                    /* A character was entered.  It was not a new line, backspace
+                    or carriage return, so it is accepted as part of the input and
+                    placed into the input buffer.  When a n is entered the complete
+                    string will be passed to the command interpreter. */
+                    if (cInputIndex < MAX_INPUT_LENGTH_CLI - 1)
+                    {
+                        pcInputString[cInputIndex] = cRxedChar[0];
+                        cInputIndex++;
+                    }
 
-                // Order Echo
-                cRxedChar[1] = 0;
-                SerialConsoleWriteString(&cRxedChar[0]);
+                    // Order Echo
+                    pcEcho[echoLen++] = cRxedChar[0];
+                }
             }
         }
+
+        // Echo everything accepted from this chunk in one write
+        cli_flush_echo();
     }
 }
 
 /**************************************************************************/ /**
- * @fn			void FreeRTOS_read(char* character)
- * @brief		STUDENTS TO COMPLETE. This function block the thread unless we received a character. How can we do this?
-                 There are multiple solutions! Check all the inter-thread communications available! See https://www.freertos.org/a00113.html
- * @details		STUDENTS TO COMPLETE.
- * @note
+ * @fn			size_t FreeRTOS_read(char *buffer, size_t len)
+ * @brief		Blocks the thread until characters are received, then returns everything buffered (up to len)
+ * @details		The RX callback gives xRxSemaphore for the first character that lands in an empty RX buffer and
+ *				for every end of line. After the first wake-up we wait (at most CLI_RX_LINE_WAIT_MS) for the end
+ *				of the line, so a pasted line is read in one chunk instead of waking once per character.
+ *				Characters left in the buffer are returned without blocking.
+ * @return		Number of characters copied to buffer
  *****************************************************************************/
-static void FreeRTOS_read(char *character)
+static size_t FreeRTOS_read(char *buffer, size_t len)
 {
-    // ToDo: Complete this function
-	uint8_t rxChar;
-	
-	//Wait for Signal and stop to block the thread when receiving data.
-	if (xSemaphoreTake(xRxSemaphore,portMAX_DELAY) == pdTRUE)
+	size_t count = SerialConsoleRead((uint8_t *)buffer, len);
+
+	while (count == 0)
 	{
-		//Read Character
-		if (SerialConsoleReadCharacter(&rxChar) != -1)
+		xSemaphoreTake(xRxSemaphore, portMAX_DELAY);
+		xSemaphoreTake(xRxSemaphore, pdMS_TO_TICKS(CLI_RX_LINE_WAIT_MS));
+		count = SerialConsoleRead((uint8_t *)buffer, len);
+	}
+	return count;
+}
+
+/**************************************************************************/ /**
+ * @fn			void cli_flush_echo(void)
+ * @brief		Writes the pending echo characters to the console
+ *****************************************************************************/
+static void cli_flush_echo(void)
+{
+	if (echoLen > 0)
+	{
+		pcEcho[echoLen] = 0;
+		SerialConsoleWriteString(pcEcho);
+		echoLen = 0;
+	}
+}
+
+/**************************************************************************/ /**
+ * @fn			bool cli_wait_for_key(TickType_t timeout)
+ * @brief		Waits up to timeout for a key, for commands that run until the user stops them
+ * @details		Everything received is discarded. A lone '\n' does not count, it is the tail of the "\r\n" that
+ *				started the command
+ * @return		true if a key was pressed
+ *****************************************************************************/
+static bool cli_wait_for_key(TickType_t timeout)
+{
+	TimeOut_t timeOut;
+	char discard[CLI_RX_CHUNK_SIZE];
+
+	vTaskSetTimeOutState(&timeOut);
+	do
+	{
+		size_t count;
+		while ((count = SerialConsoleRead((uint8_t *)discard, sizeof(discard))) > 0)
 		{
-			*character = rxChar;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (discard[i] != '\n')
+				{
+					return true;
+				}
+			}
 		}
-	}
-//    vTaskSuspend(NULL); // We suspend ourselves. Please remove this when doing your code
+	} while (xTaskCheckForTimeOut(&timeOut, &timeout) == pdFALSE && xSemaphoreTake(xRxSemaphore, timeout) == pdTRUE);
+
+	return false;
 }
 
 /******************************************************************************
@@ -300,11 +429,245 @@ BaseType_t CLI_ShowTicks(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const in
 	return pdFALSE;
 } 
 
+// Print per task CPU usage over the refresh period, one task per call. Runs until a key is pressed
+BaseType_t CLI_Top(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static struct RunTimeTaskStats tasks[RUN_TIME_STATS_MAX_TASKS];
+	static int taskCount = 0;
+	static int row = -1;
+	static bool running = false;
+
+	if (!running) {
+		BaseType_t paramLen;
+		const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+		uint32_t seconds = (param != NULL) ? strtoul(param, NULL, 10) : 0;
+		topPeriod = pdMS_TO_TICKS(((seconds > 0) ? seconds : CLI_TOP_DEFAULT_PERIOD_S) * 1000);
+		RunTimeStatsSample(tasks, RUN_TIME_STATS_MAX_TASKS); // Start of the first interval
+		running = true;
+	}
+
+	if (row < 0) {
+		// Wait for the next refresh; any key received in the meantime stops the command
+		if (cli_wait_for_key(topPeriod)) {
+			running = false;
+			pcWriteBuffer[0] = 0;
+			return pdFALSE;
+		}
+		taskCount = RunTimeStatsSample(tasks, RUN_TIME_STATS_MAX_TASKS);
+		if (taskCount < 0) {
+			running = false;
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Too many tasks, raise RUN_TIME_STATS_MAX_TASKS\r\n");
+			return pdFALSE;
+		}
+		row = 0;
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%c[2J%c[HTask     CPU%%   Stack free  State Prio  (heap free %u B)\r\n", ASCII_ESC, ASCII_ESC, (unsigned int)xPortGetFreeHeapSize());
+		return pdTRUE;
+	}
+
+	if (row < taskCount) {
+		struct RunTimeTaskStats *task = &tasks[row++];
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%-8s %3u.%u %6u words     %c  %4u\r\n", task->name, task->cpuPermille / 10, task->cpuPermille % 10,
+		         task->stackFreeWords, task->state, task->priority);
+		return pdTRUE;
+	}
+
+	row = -1;
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Press any key to stop\r\n");
+	return pdTRUE;
+}
+
+// Start or stop the trace capture to the SD card
+BaseType_t CLI_Trace(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	struct TraceSdStatus status;
+	int res;
+
+	if (param != NULL && paramLen == 5 && strncmp(param, "start", 5) == 0) {
+		res = TraceSdStart();
+		if (res == 0) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Tracing to %s\r\n", TRACE_SD_FILE_NAME);
+		} else if (res == -EBUSY) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Trace already running\r\n");
+		} else if (res == -ENOSPC) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "No room for %lu B on the SD card\r\n", (unsigned long)TRACE_SD_FILE_SIZE);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Cannot create %s (SD card mounted?)\r\n", TRACE_SD_FILE_NAME);
+		}
+		return pdFALSE;
+	}
+
+	if (param != NULL && paramLen == 4 && strncmp(param, "stop", 4) == 0) {
+		res = TraceSdStop();
+		TraceSdGetStatus(&status);
+		if (res == 0) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Trace stopped, %lu B in %s\r\n", status.bytesWritten, TRACE_SD_FILE_NAME);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "No trace to stop\r\n");
+		}
+		return pdFALSE;
+	}
+
+	TraceSdGetStatus(&status);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Trace %s%s, %lu B written\r\n", status.running ? "running" : "stopped",
+	         status.fileFull ? " (file full)" : "", status.bytesWritten);
+	return pdFALSE;
+}
+
+// Print the heap usage, then one line per allocation call site and one per memory pool class
+BaseType_t CLI_Heap(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static struct HeapTag tags[HEAP_MAX_TAGS];
+	static struct MemPoolStats pools[MEM_POOL_CLASSES];
+	static int tagCount = 0;
+	static int poolCount = 0;
+	static int row = -1;
+	struct HeapStats stats;
+
+	if (row < 0) {
+		HeapGetStats(&stats);
+		tagCount = HeapGetTags(tags, HEAP_MAX_TAGS);
+		poolCount = MemPoolGetStats(pools, MEM_POOL_CLASSES);
+		row = 0;
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Heap %u B: free %u, min %u, largest %u in %u blocks, frag %u.%u%%, %lu/%lu/%lu alloc/free/fail\r\n",
+		         (unsigned int)stats.heapSize, (unsigned int)stats.freeBytes, (unsigned int)stats.minEverFreeBytes, (unsigned int)stats.largestFreeBlock,
+		         (unsigned int)stats.freeBlocks, stats.fragmentationPermille / 10, stats.fragmentationPermille % 10, stats.allocations, stats.frees,
+		         stats.failures);
+		return pdTRUE;
+	}
+
+	if (row >= tagCount) {
+		struct MemPoolStats *pool = &pools[row++ - tagCount];
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "  pool %3u B  %u/%u free (%u reserved), max used %u, exhausted %lu\r\n", pool->blockSize,
+		         pool->freeBlocks, pool->blocks, pool->reserved, pool->maxUsed, pool->exhausted);
+	} else {
+		struct HeapTag *tag = &tags[row++];
+		if (tag->caller == HEAP_TAG_OTHER) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "  (other)    %3u blocks %5u B %5lu allocs\r\n", tag->liveBlocks, (unsigned int)tag->liveBytes, tag->allocations);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "  0x%08lx %3u blocks %5u B %5lu allocs\r\n", (unsigned long)tag->caller, tag->liveBlocks,
+			         (unsigned int)tag->liveBytes, tag->allocations);
+		}
+	}
+
+	if (row < tagCount + poolCount) {
+		return pdTRUE;
+	}
+	row = -1;
+	return pdFALSE;
+}
+
+// Print the serial console TX counters. Throughput is measured since the previous call
+BaseType_t CLI_UartStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static TickType_t lastTick = 0;
+	static uint32_t lastBytesSent = 0;
+	struct SerialConsoleTxStats stats;
+	TickType_t now = xTaskGetTickCount();
+
+	SerialConsoleGetTxStats(&stats);
+	uint32_t elapsedMs = (now - lastTick) * portTICK_PERIOD_MS;
+	uint32_t bytesPerSecond = (elapsedMs > 0) ? (uint32_t)(((uint64_t)(stats.bytesSent - lastBytesSent) * 1000) / elapsedMs) : 0;
+	lastTick = now;
+	lastBytesSent = stats.bytesSent;
+
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "UART TX (%s): %lu B sent, %lu B/s, %lu B dropped, %lu B pending\r\n",
+	         stats.dmaEnabled ? "DMA" : "IRQ", stats.bytesSent, bytesPerSecond, stats.bytesDropped, stats.bytesPending);
+	return pdFALSE;
+}
+
+// Print one line of counters per outbound MQTT priority class
+BaseType_t CLI_MqttStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static const char *const classNames[WIFI_MQTT_CLASSES] = {"control", "event", "telemetry"};
+	static struct WifiMqttClassStats stats[WIFI_MQTT_CLASSES];
+	static int row = 0;
+
+	if (row == 0) {
+		WifiGetMqttClassStats(stats);
+	}
+
+	struct WifiMqttClassStats *cls = &stats[row];
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%-9s %lu queued, %lu dropped, %lu published, %lu unacked, latency avg %lu max %lu ms\r\n", classNames[row],
+	         cls->enqueued, cls->dropped, cls->published, cls->unacked, (cls->published > 0) ? cls->totalLatencyMs / cls->published : 0, cls->maxLatencyMs);
+
+	if (++row < WIFI_MQTT_CLASSES) {
+		return pdTRUE;
+	}
+	row = 0;
+	return pdFALSE;
+}
+
+// Show the log level of every module or of one, or set the level of one module ("all" sets every module)
+BaseType_t CLI_LogLevel(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static uint8_t listIndex = 0;
+	BaseType_t moduleLen, levelLen;
+	const char *moduleName = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &moduleLen);
+	const char *levelName = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &levelLen);
+
+	if (moduleName == NULL) {
+		// One line per call, the output buffer cannot hold the whole list
+		if (listIndex < N_LOG_MODULES) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%-5s %s\r\n", getLogModuleName(listIndex), logLevelNames[logModuleLevels[listIndex]]);
+			listIndex++;
+			return pdTRUE;
+		}
+		struct DeferredLogStats stats;
+		DeferredLogGetStats(&stats);
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Deferred: %lu records, %lu dropped, %lu B pending\r\n", stats.recordsWritten, stats.recordsDropped, stats.bytesPending);
+		listIndex = 0;
+		return pdFALSE;
+	}
+
+	int module = -1;
+	for (int i = 0; i < N_LOG_MODULES; i++) {
+		const char *name = getLogModuleName((enum eLogModules)i);
+		if (strlen(name) == (size_t)moduleLen && strncmp(moduleName, name, moduleLen) == 0) {
+			module = i;
+		}
+	}
+	bool all = moduleLen == 3 && strncmp(moduleName, "all", 3) == 0;
+	if (module < 0 && !all) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown module\r\n");
+		return pdFALSE;
+	}
+
+	if (levelName == NULL) {
+		if (all) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: log [<module> [<level>]|all <level>]\r\n");
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%s %s\r\n", getLogModuleName((enum eLogModules)module), logLevelNames[logModuleLevels[module]]);
+		}
+		return pdFALSE;
+	}
+
+	int level = -1;
+	for (int i = 0; i < (int)(sizeof(logLevelNames) / sizeof(logLevelNames[0])); i++) {
+		if (strlen(logLevelNames[i]) == (size_t)levelLen && strncmp(levelName, logLevelNames[i], levelLen) == 0) {
+			level = i;
+		}
+	}
+	if (level < 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown level\r\n");
+		return pdFALSE;
+	}
+
+	if (all) {
+		setLogLevel((enum eDebugLogLevels)level);
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "All modules set to %s\r\n", logLevelNames[level]);
+		return pdFALSE;
+	}
+
+	setLogModuleLevel((enum eLogModules)module, (enum eDebugLogLevels)level);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%s set to %s\r\n", getLogModuleName((enum eLogModules)module), logLevelNames[level]);
+	return pdFALSE;
+}
+
 // Example CLI Command. Reads from the IMU and returns data.
 BaseType_t CLI_OTAU(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	const char *source_path = "0:/Application.bin";
-	f_unlink(source_path);
 	WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
 
 	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Starting OTA firmware download from:\r\n%s\r\n", MAIN_HTTP_FILE_URL);
@@ -355,6 +718,34 @@ BaseType_t CLI_i2cScan(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8
     return pdFALSE;
 }
 
+// Run the benchmark suite, one per call. Lines: bench,<name>,<iterations>,<bytes/op>,<cycles/op>,<us/op>,<kB/s>
+BaseType_t CLI_Bench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int index = -1;
+	struct BenchResult result;
+	int res;
+
+	if (index < 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "#bench,name,iterations,bytes,cycles,us,kBps (%lu Hz)\r\n", system_cpu_clock_get_hz());
+		index = 0;
+		return pdTRUE;
+	}
+
+	res = BenchRun(index, &result);
+	if (res == 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "bench,%s,%lu,%lu,%lu,%lu,%lu\r\n", result.name, result.iterations, result.bytesPerOp,
+		         result.cyclesPerOp, result.usPerOp, result.kBps);
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "bench,%s,error,%d\r\n", BenchName(index), res);
+	}
+
+	if (++index < BenchCount()) {
+		return pdTRUE;
+	}
+	index = -1;
+	return pdFALSE;
+}
+
 BaseType_t CLI_Gold(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
 	const char *source_path = "0:/Application.bin";
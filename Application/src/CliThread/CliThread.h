@@ -21,6 +21,9 @@
 #define MAX_OUTPUT_LENGTH_CLI   130	//STUDENT FILL  150
 
 #define CLI_MSG_LEN						16
+#define CLI_RX_CHUNK_SIZE				64	///< Characters read from the RX buffer per pass
+#define CLI_RX_LINE_WAIT_MS				5	///< Wait for the end of a line after the first character
+#define CLI_TOP_DEFAULT_PERIOD_S		2	///< Refresh period of "top" when none is given
 #define CLI_PC_ESCAPE_CODE_SIZE			4
 #define CLI_PC_MIN_ESCAPE_CODE_SIZE		2
 
@@ -34,6 +37,12 @@
 BaseType_t xCliClearTerminalScreen( char *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_ShowVersion(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 BaseType_t CLI_ShowTicks(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Top(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Trace(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Heap(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_UartStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_MqttStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_LogLevel(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 
 #define	CLI_COMMAND_CLEAR_SCREEN		"cls"
 #define CLI_HELP_CLEAR_SCREEN			"cls: Clears the terminal screen\r\n"
@@ -51,6 +60,7 @@ BaseType_t CLI_DistanceSensorGetDistance( int8_t *pcWriteBuffer,size_t xWriteBuf
 BaseType_t CLI_ResetDevice( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_SendDummyGameData( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_i2cScan(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Bench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 BaseType_t CLI_Gold(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 
 extern SemaphoreHandle_t xRxSemaphore; //This Variable is in the CliThread.c, but we need to use it
\ No newline at end of file
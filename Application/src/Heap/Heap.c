@@ -0,0 +1,323 @@
+/**************************************************************************/
+/**
+ * @file        Heap.c
+ * @brief       FreeRTOS heap with coalescing free list and allocation tagging, see Heap.h
+ * @details     Derived from FreeRTOS heap_4.c. The free list is sorted by address and ends with heapEnd, a
+ *				zero-size marker at the top of the heap. The top bit of a block's size marks it as allocated.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "Heap.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define HEAP_HEADER_SIZE ((sizeof(struct HeapBlock) + (portBYTE_ALIGNMENT - 1)) & ~((size_t)portBYTE_ALIGNMENT_MASK))
+#define HEAP_MIN_BLOCK_SIZE (HEAP_HEADER_SIZE << 1)           ///< Smaller leftovers are not split off
+#define HEAP_ALLOCATED_BIT ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Header in front of every block, free or allocated */
+struct HeapBlock {
+	struct HeapBlock *next;  ///< Next free block by address, NULL while allocated
+	size_t size;             ///< Size including the header, HEAP_ALLOCATED_BIT set while allocated
+#if HEAP_TAG_ALLOCATIONS
+	size_t tag;              ///< Index in heapTags of the call site, valid while allocated
+#endif
+};
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t heapArea[configTOTAL_HEAP_SIZE];
+static struct HeapBlock heapStart;                 ///< Head of the free list, not a real block
+static struct HeapBlock *heapEnd = NULL;           ///< End marker of the free list, NULL until the first allocation
+static size_t heapSize = 0;
+static size_t freeBytes = 0;
+static size_t minEverFreeBytes = 0;
+static uint32_t allocationCount = 0;
+static uint32_t freeCount = 0;
+static uint32_t failureCount = 0;
+
+#if HEAP_TAG_ALLOCATIONS
+static struct HeapTag heapTags[HEAP_MAX_TAGS];     ///< The last entry collects the call sites that did not fit
+static int heapTagCount = 0;
+#endif
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void heap_init(void);
+static void heap_insert_free_block(struct HeapBlock *block);
+#if HEAP_TAG_ALLOCATIONS
+static size_t heap_find_tag(uintptr_t caller);
+#endif
+
+/******************************************************************************
+ * FreeRTOS portable API
+ ******************************************************************************/
+void *pvPortMalloc(size_t xWantedSize)
+{
+#if HEAP_TAG_ALLOCATIONS
+	uintptr_t caller = (uintptr_t)__builtin_return_address(0) & ~(uintptr_t)1;   // Drop the Thumb bit
+#endif
+	struct HeapBlock *block, *previous, *remainder;
+	void *ret = NULL;
+
+	vTaskSuspendAll();
+	{
+		if (heapEnd == NULL) {
+			heap_init();
+		}
+
+		// A size with the top bit set cannot be marked as allocated, and would not fit anyway
+		if (xWantedSize > 0 && (xWantedSize & HEAP_ALLOCATED_BIT) == 0) {
+			xWantedSize += HEAP_HEADER_SIZE;
+			if ((xWantedSize & portBYTE_ALIGNMENT_MASK) != 0) {
+				xWantedSize += portBYTE_ALIGNMENT - (xWantedSize & portBYTE_ALIGNMENT_MASK);
+			}
+		} else {
+			xWantedSize = 0;
+		}
+
+		if (xWantedSize > 0 && xWantedSize <= freeBytes) {
+			// First fit
+			previous = &heapStart;
+			block = heapStart.next;
+			while (block->size < xWantedSize && block->next != NULL) {
+				previous = block;
+				block = block->next;
+			}
+
+			if (block != heapEnd) {
+				ret = (uint8_t *)block + HEAP_HEADER_SIZE;
+				previous->next = block->next;
+
+				// Give the unused end of the block back to the free list
+				if (block->size - xWantedSize > HEAP_MIN_BLOCK_SIZE) {
+					remainder = (struct HeapBlock *)((uint8_t *)block + xWantedSize);
+					remainder->size = block->size - xWantedSize;
+					block->size = xWantedSize;
+					heap_insert_free_block(remainder);
+				}
+
+				freeBytes -= block->size;
+				if (freeBytes < minEverFreeBytes) {
+					minEverFreeBytes = freeBytes;
+				}
+
+#if HEAP_TAG_ALLOCATIONS
+				block->tag = heap_find_tag(caller);
+				heapTags[block->tag].liveBlocks++;
+				heapTags[block->tag].liveBytes += block->size;
+				heapTags[block->tag].allocations++;
+#endif
+				block->size |= HEAP_ALLOCATED_BIT;
+				block->next = NULL;
+				allocationCount++;
+			}
+		}
+
+		traceMALLOC(ret, xWantedSize);
+	}
+	(void)xTaskResumeAll();
+
+	if (ret == NULL) {
+		failureCount++;
+#if (configUSE_MALLOC_FAILED_HOOK == 1)
+		extern void vApplicationMallocFailedHook(void);
+		vApplicationMallocFailedHook();
+#endif
+	}
+
+	configASSERT((((size_t)ret) & (size_t)portBYTE_ALIGNMENT_MASK) == 0);
+	return ret;
+}
+
+void vPortFree(void *pv)
+{
+	struct HeapBlock *block;
+
+	if (pv == NULL) {
+		return;
+	}
+
+	block = (struct HeapBlock *)((uint8_t *)pv - HEAP_HEADER_SIZE);
+	configASSERT((block->size & HEAP_ALLOCATED_BIT) != 0);
+	configASSERT(block->next == NULL);
+	if ((block->size & HEAP_ALLOCATED_BIT) == 0 || block->next != NULL) {
+		return;   // Not a block from this heap, or freed twice
+	}
+
+	block->size &= ~HEAP_ALLOCATED_BIT;
+
+	vTaskSuspendAll();
+	{
+#if HEAP_TAG_ALLOCATIONS
+		heapTags[block->tag].liveBlocks--;
+		heapTags[block->tag].liveBytes -= block->size;
+#endif
+		freeBytes += block->size;
+		freeCount++;
+		traceFREE(pv, block->size);
+		heap_insert_free_block(block);
+	}
+	(void)xTaskResumeAll();
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+	return freeBytes;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+	return minEverFreeBytes;
+}
+
+void vPortInitialiseBlocks(void)
+{
+	// The heap initialises itself on the first allocation
+}
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+void HeapGetStats(struct HeapStats *stats)
+{
+	struct HeapBlock *block;
+
+	memset(stats, 0, sizeof(*stats));
+
+	vTaskSuspendAll();
+	{
+		if (heapEnd != NULL) {
+			for (block = heapStart.next; block != heapEnd; block = block->next) {
+				stats->freeBlocks++;
+				if (block->size > stats->largestFreeBlock) {
+					stats->largestFreeBlock = block->size;
+				}
+			}
+		}
+		stats->heapSize = heapSize;
+		stats->freeBytes = freeBytes;
+		stats->minEverFreeBytes = minEverFreeBytes;
+		stats->allocations = allocationCount;
+		stats->frees = freeCount;
+		stats->failures = failureCount;
+	}
+	(void)xTaskResumeAll();
+
+	if (stats->freeBytes > 0) {
+		stats->fragmentationPermille = 1000 - (uint16_t)(((uint64_t)stats->largestFreeBlock * 1000) / stats->freeBytes);
+	}
+}
+
+int HeapGetTags(struct HeapTag *tags, int max)
+{
+#if HEAP_TAG_ALLOCATIONS
+	int count;
+
+	vTaskSuspendAll();
+	{
+		count = (heapTagCount < max) ? heapTagCount : max;
+		memcpy(tags, heapTags, count * sizeof(struct HeapTag));
+	}
+	(void)xTaskResumeAll();
+
+	return count;
+#else
+	(void)tags;
+	(void)max;
+	return 0;
+#endif
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+// Aligns the heap area and makes it one free block followed by the end marker
+static void heap_init(void)
+{
+	uintptr_t start = (uintptr_t)heapArea;
+	uintptr_t end = start + configTOTAL_HEAP_SIZE;
+	struct HeapBlock *first;
+
+	start = (start + portBYTE_ALIGNMENT_MASK) & ~(uintptr_t)portBYTE_ALIGNMENT_MASK;
+	end = (end - HEAP_HEADER_SIZE) & ~(uintptr_t)portBYTE_ALIGNMENT_MASK;
+
+	heapEnd = (struct HeapBlock *)end;
+	heapEnd->size = 0;
+	heapEnd->next = NULL;
+
+	first = (struct HeapBlock *)start;
+	first->size = end - start;
+	first->next = heapEnd;
+
+	heapStart.next = first;
+	heapStart.size = 0;
+
+	heapSize = first->size;
+	freeBytes = first->size;
+	minEverFreeBytes = first->size;
+}
+
+// Inserts a block in the address-sorted free list, merging it with the blocks right before and after it
+static void heap_insert_free_block(struct HeapBlock *block)
+{
+	struct HeapBlock *iterator;
+
+	for (iterator = &heapStart; iterator->next < block; iterator = iterator->next) {
+	}
+
+	if ((uint8_t *)iterator + iterator->size == (uint8_t *)block) {
+		iterator->size += block->size;
+		block = iterator;
+	}
+
+	if ((uint8_t *)block + block->size == (uint8_t *)iterator->next && iterator->next != heapEnd) {
+		block->size += iterator->next->size;
+		block->next = iterator->next->next;
+	} else {
+		block->next = iterator->next;
+	}
+
+	if (iterator != block) {
+		iterator->next = block;
+	}
+}
+
+#if HEAP_TAG_ALLOCATIONS
+// Returns the entry of a call site, creating it on its first allocation. Called with the scheduler suspended
+static size_t heap_find_tag(uintptr_t caller)
+{
+	for (int i = 0; i < heapTagCount; i++) {
+		if (heapTags[i].caller == caller) {
+			return i;
+		}
+	}
+
+	if (heapTagCount < HEAP_MAX_TAGS - 1) {
+		heapTags[heapTagCount].caller = caller;
+		return heapTagCount++;
+	}
+
+	// Table full: the last entry collects the rest
+	heapTags[HEAP_MAX_TAGS - 1].caller = HEAP_TAG_OTHER;
+	heapTagCount = HEAP_MAX_TAGS;
+	return HEAP_MAX_TAGS - 1;
+}
+#endif
@@ -0,0 +1,76 @@
+/**************************************************************************/
+/**
+ * @file        Heap.h
+ * @brief       FreeRTOS heap (pvPortMalloc/vPortFree) with coalescing free list and allocation tagging
+ * @details     Replaces heap_1, which never frees. The allocator follows FreeRTOS heap_4: a first-fit free
+ *				list sorted by address, where a freed block is merged with its free neighbours so the heap does
+ *				not fragment into small pieces. Allocation time grows with the number of free blocks, which stays
+ *				small in this firmware (most allocations are tasks and queues that live forever).
+ *
+ *				With HEAP_TAG_ALLOCATIONS each block remembers the call site (return address into the caller of
+ *				pvPortMalloc), and the live blocks and bytes are counted per call site. Resolve an address with
+ *				arm-none-eabi-addr2line -f -e Application.elf <address>. Allocations made by the kernel show up
+ *				under xTaskCreate, xQueueGenericCreate, etc.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef HEAP_H
+#define HEAP_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define HEAP_TAG_ALLOCATIONS 1   ///< 1 to count allocations per call site. Costs 8 bytes per block
+#define HEAP_MAX_TAGS 24         ///< Call sites tracked. Further sites are counted under HEAP_TAG_OTHER
+#define HEAP_TAG_OTHER 0         ///< Caller address of the entry that collects the untracked call sites
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Heap usage, see HeapGetStats */
+struct HeapStats {
+	size_t heapSize;                /**< Usable size of the heap, in bytes */
+	size_t freeBytes;               /**< Bytes free now */
+	size_t minEverFreeBytes;        /**< Lowest value of freeBytes since boot */
+	size_t largestFreeBlock;        /**< Largest single allocation that can succeed now (header included) */
+	size_t freeBlocks;              /**< Number of blocks in the free list */
+	uint16_t fragmentationPermille; /**< 1000 * (1 - largestFreeBlock / freeBytes): 0 when the free space is one block */
+	uint32_t allocations;           /**< Successful pvPortMalloc calls */
+	uint32_t frees;                 /**< vPortFree calls */
+	uint32_t failures;              /**< pvPortMalloc calls that returned NULL */
+};
+
+/** Live allocations of one call site, see HeapGetTags */
+struct HeapTag {
+	uintptr_t caller;      /**< Return address into the caller of pvPortMalloc, HEAP_TAG_OTHER for the overflow entry */
+	uint16_t liveBlocks;   /**< Blocks allocated and not freed yet */
+	size_t liveBytes;      /**< Bytes of those blocks, headers and padding included */
+	uint32_t allocations;  /**< Allocations made since boot */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			void HeapGetStats(struct HeapStats *stats)
+ * @brief		Copies the heap usage. Walks the free list with the scheduler suspended
+ *****************************************************************************/
+void HeapGetStats(struct HeapStats *stats);
+
+/**
+ * @fn			int HeapGetTags(struct HeapTag *tags, int max)
+ * @brief		Copies up to max call-site entries, in order of first allocation
+ * @return		Number of entries copied, 0 if tagging is disabled
+ *****************************************************************************/
+int HeapGetTags(struct HeapTag *tags, int max);
+
+#endif /* HEAP_H */
@@ -9,6 +9,8 @@
 
 
 RGB_t ledBuffer[LED_COUNT];
+static RGB_t blinkColor = {.green = 0, .red = 70, .blue = 0};   // color of mode 1
+static RGB_t holdColor = {.green = 0, .red = 0, .blue = 255};   // peak color of mode 2
 
 // SK6812_initialization
 void SK6812_Init(void)
@@ -158,7 +160,7 @@ void rainbow_swirl() {
 }
 
 void BLink_one_color(){
-	SK6812_SetAll(70,0,0);
+	SK6812_SetAll(blinkColor.red, blinkColor.green, blinkColor.blue);
 	SK6812_Send();
 	vTaskDelay(20);
 	SK6812_Clear();
@@ -168,19 +170,27 @@ void BLink_one_color(){
 void Hold_in_one_color(){
 	for (int i = 0; i<255; i+=5)
 	{
-		SK6812_SetAll(0,0,i);
+		SK6812_SetAll(holdColor.red * i / 255, holdColor.green * i / 255, holdColor.blue * i / 255);
 		SK6812_Send();
 		vTaskDelay(10);
 	}
 	for (int i = 255; i>0; i-=5)
 	{
-		SK6812_SetAll(0,0,i);
+		SK6812_SetAll(holdColor.red * i / 255, holdColor.green * i / 255, holdColor.blue * i / 255);
 		SK6812_Send();
 		vTaskDelay(10);
 	}
 }
 
 
+// Color of the one color modes (blink and hold), set from MQTT
+void LED_SetColor(uint8_t red, uint8_t green, uint8_t blue){
+	blinkColor.red = holdColor.red = red;
+	blinkColor.green = holdColor.green = green;
+	blinkColor.blue = holdColor.blue = blue;
+}
+
+
 /**************************************************************LED Task******************************************/
 //flag = 0, No LED
 //flag = 1, mode 1 blink
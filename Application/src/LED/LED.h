@@ -49,5 +49,6 @@ void explosion_effect();
 void rainbow_swirl();
 void BLink_one_color();
 void Hold_in_one_color();
+void LED_SetColor(uint8_t red, uint8_t green, uint8_t blue);
 
 #endif /* LED_H_ */
\ No newline at end of file
@@ -0,0 +1,177 @@
+/**************************************************************************/
+/**
+ * @file        MemPool.c
+ * @brief       Fixed-block memory pools, see MemPool.h
+ * @details     The classes are sized for the outbound MQTT messages: typical IMU batches fit the 64-byte
+ *				class, a full game fits the 128-byte class. A free block holds the pointer to the next free
+ *				block in its first word. The last blocks of the 128-byte class are reserved for the control
+ *				messages (download status), so a burst of games cannot take them.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "MemPool.h"
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define MEM_POOL_SMALL_SIZE 32
+#define MEM_POOL_SMALL_COUNT 8
+#define MEM_POOL_MEDIUM_SIZE 64
+#define MEM_POOL_MEDIUM_COUNT 6
+#define MEM_POOL_LARGE_SIZE 128
+#define MEM_POOL_LARGE_COUNT 4
+#define MEM_POOL_LARGE_RESERVED 2   ///< A download progress and the final status can be pending together
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** One size class */
+struct MemPoolClass {
+	uint8_t *start;      ///< First block
+	uint8_t *end;        ///< One past the last block
+	uint16_t blockSize;
+	uint16_t blocks;
+	uint16_t reserved;   ///< Free blocks only MemPoolAllocReserve takes
+	void *freeList;      ///< First free block, NULL when the class is empty
+	uint16_t freeBlocks;
+	uint16_t minFree;    ///< Lowest value of freeBlocks, gives the high-water mark
+	uint32_t exhausted;
+};
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint32_t poolSmall[MEM_POOL_SMALL_SIZE * MEM_POOL_SMALL_COUNT / sizeof(uint32_t)];
+static uint32_t poolMedium[MEM_POOL_MEDIUM_SIZE * MEM_POOL_MEDIUM_COUNT / sizeof(uint32_t)];
+static uint32_t poolLarge[MEM_POOL_LARGE_SIZE * MEM_POOL_LARGE_COUNT / sizeof(uint32_t)];
+
+/// Size classes, smallest first
+static struct MemPoolClass poolClasses[MEM_POOL_CLASSES] = {
+	{(uint8_t *)poolSmall, (uint8_t *)poolSmall + sizeof(poolSmall), MEM_POOL_SMALL_SIZE, MEM_POOL_SMALL_COUNT, 0},
+	{(uint8_t *)poolMedium, (uint8_t *)poolMedium + sizeof(poolMedium), MEM_POOL_MEDIUM_SIZE, MEM_POOL_MEDIUM_COUNT, 0},
+	{(uint8_t *)poolLarge, (uint8_t *)poolLarge + sizeof(poolLarge), MEM_POOL_LARGE_SIZE, MEM_POOL_LARGE_COUNT, MEM_POOL_LARGE_RESERVED},
+};
+
+static bool poolInitialized = false;
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void mem_pool_init(void);
+static void *mem_pool_take(size_t size, bool reserve);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+void *MemPoolAlloc(size_t size)
+{
+	return mem_pool_take(size, false);
+}
+
+void *MemPoolAllocReserve(size_t size)
+{
+	return mem_pool_take(size, true);
+}
+
+void MemPoolFree(void *block)
+{
+	if (block == NULL) {
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	for (int i = 0; i < MEM_POOL_CLASSES; i++) {
+		struct MemPoolClass *pool = &poolClasses[i];
+		if ((uint8_t *)block >= pool->start && (uint8_t *)block < pool->end) {
+			configASSERT(((uint8_t *)block - pool->start) % pool->blockSize == 0);
+			*(void **)block = pool->freeList;
+			pool->freeList = block;
+			pool->freeBlocks++;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+int MemPoolGetStats(struct MemPoolStats *stats, int max)
+{
+	int count = (max < MEM_POOL_CLASSES) ? max : MEM_POOL_CLASSES;
+
+	taskENTER_CRITICAL();
+	if (!poolInitialized) {
+		mem_pool_init();
+	}
+	for (int i = 0; i < count; i++) {
+		stats[i].blockSize = poolClasses[i].blockSize;
+		stats[i].blocks = poolClasses[i].blocks;
+		stats[i].reserved = poolClasses[i].reserved;
+		stats[i].freeBlocks = poolClasses[i].freeBlocks;
+		stats[i].maxUsed = poolClasses[i].blocks - poolClasses[i].minFree;
+		stats[i].exhausted = poolClasses[i].exhausted;
+	}
+	taskEXIT_CRITICAL();
+
+	return count;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+// Chains all the blocks of every class into its free list. Called once, in a critical section
+static void mem_pool_init(void)
+{
+	for (int i = 0; i < MEM_POOL_CLASSES; i++) {
+		struct MemPoolClass *pool = &poolClasses[i];
+		pool->freeList = NULL;
+		for (int b = pool->blocks - 1; b >= 0; b--) {
+			void *block = pool->start + b * pool->blockSize;
+			*(void **)block = pool->freeList;
+			pool->freeList = block;
+		}
+		pool->freeBlocks = pool->blocks;
+		pool->minFree = pool->blocks;
+	}
+	poolInitialized = true;
+}
+
+// Takes a block from the smallest class that has one free. Without reserve, the reserved blocks of a class count
+// as taken
+static void *mem_pool_take(size_t size, bool reserve)
+{
+	void *block = NULL;
+
+	taskENTER_CRITICAL();
+	if (!poolInitialized) {
+		mem_pool_init();
+	}
+
+	for (int i = 0; i < MEM_POOL_CLASSES && block == NULL; i++) {
+		struct MemPoolClass *pool = &poolClasses[i];
+		if (size > pool->blockSize) {
+			continue;
+		}
+		if (pool->freeList == NULL || (!reserve && pool->freeBlocks <= pool->reserved)) {
+			pool->exhausted++;
+			continue;
+		}
+		block = pool->freeList;
+		pool->freeList = *(void **)block;
+		if (--pool->freeBlocks < pool->minFree) {
+			pool->minFree = pool->freeBlocks;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	return block;
+}
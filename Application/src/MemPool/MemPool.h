@@ -0,0 +1,76 @@
+/**************************************************************************/
+/**
+ * @file        MemPool.h
+ * @brief       Fixed-block memory pools for messages handed between tasks
+ * @details     A few pools of equal-size blocks (size classes, see MemPool.c). MemPoolAlloc takes a block
+ *				from the smallest class that fits, or from a larger class if that one is empty. Allocation and
+ *				release are O(1): each class keeps its free blocks in a singly linked list threaded through the
+ *				blocks themselves. A producer fills a block and passes the pointer through a queue, the
+ *				consumer uses it in place and releases it, so the data is never copied.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define MEM_POOL_CLASSES 3   ///< Number of size classes
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Usage of one size class, see MemPoolGetStats */
+struct MemPoolStats {
+	uint16_t blockSize;   /**< Usable bytes per block */
+	uint16_t blocks;      /**< Blocks in the class */
+	uint16_t reserved;    /**< Blocks of them only MemPoolAllocReserve takes */
+	uint16_t freeBlocks;  /**< Blocks free now */
+	uint16_t maxUsed;     /**< High-water mark of blocks in use */
+	uint32_t exhausted;   /**< Requests that found this class empty (served by a larger class or failed) */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			void *MemPoolAlloc(size_t size)
+ * @brief		Takes a block of at least size bytes
+ * @return		The block (4-byte aligned), NULL if size is larger than the largest class or no block is free
+ * @note		Callable from tasks only
+ *****************************************************************************/
+void *MemPoolAlloc(size_t size);
+
+/**
+ * @fn			void *MemPoolAllocReserve(size_t size)
+ * @brief		Same as MemPoolAlloc, and may also take the reserved blocks of a class
+ * @return		The block (4-byte aligned), NULL if size is larger than the largest class or no block is free
+ * @note		Callable from tasks only. For messages that must not be lost, see WIFI_MQTT_CLASS_CONTROL
+ *****************************************************************************/
+void *MemPoolAllocReserve(size_t size);
+
+/**
+ * @fn			void MemPoolFree(void *block)
+ * @brief		Releases a block returned by MemPoolAlloc. NULL is ignored
+ * @note		Callable from tasks only. May be called from another task than the one that allocated
+ *****************************************************************************/
+void MemPoolFree(void *block);
+
+/**
+ * @fn			int MemPoolGetStats(struct MemPoolStats *stats, int max)
+ * @brief		Copies the usage of up to max classes, smallest first
+ * @return		Number of classes copied
+ *****************************************************************************/
+int MemPoolGetStats(struct MemPoolStats *stats, int max);
+
+#endif /* MEM_POOL_H */
@@ -0,0 +1,122 @@
+/**************************************************************************/
+/**
+ * @file        MqttCommand.c
+ * @brief       Command tables for the MQTT control topics, see MqttCommand.h
+ * @details     Tables hold a handful of commands, so the opcode lookup is a plain scan.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "MqttCommand.h"
+
+#include <errno.h>
+#include <string.h>
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static const struct MqttCommand *MqttCommandFindKeyword(const struct MqttCommandTable *table, const uint8_t *text, size_t len);
+static const struct MqttCommand *MqttCommandFindOpcode(const struct MqttCommandTable *table, uint8_t opcode);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+int MqttCommandDispatch(const struct MqttCommandTable *table, const uint8_t *payload, size_t len)
+{
+	const struct MqttCommand *command;
+
+	if (len == 0) {
+		return -ENOENT;
+	}
+
+	if (payload[0] < MQTT_COMMAND_OP_LIMIT) {
+		command = MqttCommandFindOpcode(table, payload[0]);
+		if (command == NULL) {
+			return -ENOENT;
+		}
+		if (len - 1 < command->args || len - 1 > UINT8_MAX) {
+			return -EINVAL;
+		}
+		command->handler(&payload[1], (uint8_t)(len - 1));
+		return 0;
+	}
+
+	command = MqttCommandFindKeyword(table, payload, len);
+	if (command == NULL) {
+		return -ENOENT;
+	}
+	if (command->args > 0) {
+		return -EINVAL;
+	}
+	command->handler(NULL, 0);
+	return 0;
+}
+
+bool MqttCommandTableIsValid(const struct MqttCommandTable *table)
+{
+	for (uint8_t i = 0; i < table->count; i++) {
+		const struct MqttCommand *command = &table->commands[i];
+
+		if (command->opcode == 0 || command->opcode >= MQTT_COMMAND_OP_LIMIT || MqttCommandFindOpcode(table, command->opcode) != command) {
+			return false;
+		}
+		if (i > 0 && strcmp(table->commands[i - 1].keyword, command->keyword) >= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/**
+ * @fn			static const struct MqttCommand *MqttCommandFindKeyword(const struct MqttCommandTable *table, const uint8_t *text, size_t len)
+ * @brief		Binary search of a keyword that is exactly text[0..len)
+ * @return		The command, NULL if there is none
+ *****************************************************************************/
+static const struct MqttCommand *MqttCommandFindKeyword(const struct MqttCommandTable *table, const uint8_t *text, size_t len)
+{
+	int low = 0;
+	int high = (int)table->count - 1;
+
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		const struct MqttCommand *command = &table->commands[mid];
+		size_t common = command->keywordLen < len ? command->keywordLen : len;
+		int cmp = memcmp(command->keyword, text, common);
+
+		if (cmp == 0) {
+			// Same start: the shorter string sorts first, like strcmp
+			cmp = (int)command->keywordLen - (int)len;
+		}
+		if (cmp == 0) {
+			return command;
+		} else if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @fn			static const struct MqttCommand *MqttCommandFindOpcode(const struct MqttCommandTable *table, uint8_t opcode)
+ * @brief		Finds the command with the given opcode
+ * @return		The command, NULL if there is none
+ *****************************************************************************/
+static const struct MqttCommand *MqttCommandFindOpcode(const struct MqttCommandTable *table, uint8_t opcode)
+{
+	for (uint8_t i = 0; i < table->count; i++) {
+		if (table->commands[i].opcode == opcode) {
+			return &table->commands[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,81 @@
+/**************************************************************************/
+/**
+ * @file        MqttCommand.h
+ * @brief       Command tables for the MQTT control topics
+ * @details     Each control topic has one constant table of commands. A payload is either
+ *				--text: the exact keyword (e.g. "forward"), no arguments. Matched on the whole payload, so a
+ *				  prefix such as "f" is not a command
+ *				--binary: one opcode byte below MQTT_COMMAND_OP_LIMIT followed by the argument bytes, for
+ *				  commands that carry parameters (speed, colour). Printable text never starts with such a byte
+ *
+ *				Text lookup is a binary search, so the table must be sorted by keyword (strcmp order).
+ *				MqttCommandTableIsValid checks that at startup.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef MQTT_COMMAND_H
+#define MQTT_COMMAND_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define MQTT_COMMAND_OP_LIMIT 0x20   ///< First byte below this value: binary command
+
+/// Table entry: text keyword (string literal), opcode, argument bytes the command needs, handler
+#define MQTT_COMMAND(keyword, opcode, args, handler) {keyword, sizeof(keyword) - 1, opcode, args, handler}
+
+/// Table of a topic from a constant array of MQTT_COMMAND entries
+#define MQTT_COMMAND_TABLE(array) {array, sizeof(array) / sizeof(array[0])}
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Handler of a command. args holds argLen bytes (at least the entry's argument count, 0 for text) */
+typedef void (*MqttCommandHandler)(const uint8_t *args, uint8_t argLen);
+
+/** One command, use MQTT_COMMAND */
+struct MqttCommand {
+	const char *keyword;          ///< Text form of the command
+	uint8_t keywordLen;           ///< strlen(keyword)
+	uint8_t opcode;               ///< Binary form of the command, 1 to MQTT_COMMAND_OP_LIMIT - 1
+	uint8_t args;                 ///< Argument bytes needed. Commands with arguments only exist in binary form
+	MqttCommandHandler handler;   ///< Called when the command is received
+};
+
+/** Commands of one topic, use MQTT_COMMAND_TABLE */
+struct MqttCommandTable {
+	const struct MqttCommand *commands;   ///< Sorted by keyword
+	uint8_t count;                        ///< Number of commands
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			int MqttCommandDispatch(const struct MqttCommandTable *table, const uint8_t *payload, size_t len)
+ * @brief		Finds the command of a payload in the table and calls its handler
+ * @return		0 if a command was run, -ENOENT if the payload is not a command of the table, -EINVAL if the
+ *				command needs more argument bytes than received
+ *****************************************************************************/
+int MqttCommandDispatch(const struct MqttCommandTable *table, const uint8_t *payload, size_t len);
+
+/**
+ * @fn			bool MqttCommandTableIsValid(const struct MqttCommandTable *table)
+ * @brief		Checks that the keywords are sorted without duplicates and the opcodes are unique and below
+ *				MQTT_COMMAND_OP_LIMIT. Meant for a configASSERT at startup: an unsorted table makes some
+ *				keywords unreachable
+ * @return		true if the table can be searched
+ *****************************************************************************/
+bool MqttCommandTableIsValid(const struct MqttCommandTable *table);
+
+#endif /* MQTT_COMMAND_H */
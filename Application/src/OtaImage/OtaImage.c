@@ -0,0 +1,210 @@
+/**************************************************************************/
+/**
+ * @file        OtaImage.c
+ * @brief       Manifest and streaming check of an OTA firmware image, see OtaImage.h
+ * @details     Network chunks start anywhere, so every update is split into an unaligned head, a run of
+ *				whole words for the DSU and a short tail. Both paths work on the same (not inverted) CRC
+ *				register, so they can take turns.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "OtaImage.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asf.h"
+#include "ASF/sam0/drivers/dsu/crc32/crc32.h" // asf.h may resolve <crc32.h> to the common service instead
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define CRC32_POLYNOMIAL 0xEDB88320ul  ///< IEEE 802.3, reflected
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+extern uint32_t _sfixed;    ///< Linker script: start of the firmware in flash
+extern uint32_t _etext;     ///< Linker script: end of the code, the initial values of .relocate follow
+extern uint32_t _srelocate; ///< Linker script: start of .relocate in RAM
+extern uint32_t _erelocate; ///< Linker script: end of .relocate in RAM
+
+static uint32_t runningCrc;
+static bool runningCrcKnown = false;
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static uint32_t Crc32Software(uint32_t crc, const uint8_t *data, size_t length);
+static const char *OtaManifestValue(const char *text, const char *key);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+int OtaManifestParse(const char *text, size_t length, struct OtaManifest *manifest)
+{
+	char copy[OTA_MANIFEST_MAX_SIZE + 1];
+	const char *version, *size, *crc;
+
+	if (length > OTA_MANIFEST_MAX_SIZE) {
+		return -EMSGSIZE;
+	}
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	version = OtaManifestValue(copy, "version");
+	size = OtaManifestValue(copy, "size");
+	crc = OtaManifestValue(copy, "crc32");
+	if (size == NULL || crc == NULL) {
+		return -EINVAL;
+	}
+
+	manifest->version = (version != NULL) ? strtoul(version, NULL, 10) : 0;
+	manifest->size = strtoul(size, NULL, 10);
+	manifest->crc32 = strtoul(crc, NULL, 16);
+	return (manifest->size > OTA_IMAGE_TRAILER_SIZE) ? 0 : -EINVAL;
+}
+
+void OtaImageBegin(struct OtaImageCheck *check, const struct OtaManifest *manifest)
+{
+	dsu_crc32_init(); // DSU bus clock, on after reset anyway
+	check->manifest = *manifest;
+	check->offset = 0;
+	check->crc = 0xFFFFFFFF;
+	memset(check->trailer, 0, sizeof(check->trailer));
+}
+
+void OtaImageUpdate(struct OtaImageCheck *check, const void *data, size_t length)
+{
+	const uint8_t *bytes = data;
+	uint32_t firmwareSize = check->manifest.size - OTA_IMAGE_TRAILER_SIZE;
+
+	// Firmware bytes go into the CRC
+	if (check->offset < firmwareSize) {
+		size_t chunk = firmwareSize - check->offset;
+		if (chunk > length) {
+			chunk = length;
+		}
+		check->crc = Crc32Update(check->crc, bytes, chunk);
+		check->offset += chunk;
+		bytes += chunk;
+		length -= chunk;
+	}
+
+	// The trailer is kept to compare; anything past it only counts towards the size
+	while (length > 0) {
+		if (check->offset < check->manifest.size) {
+			check->trailer[check->offset - firmwareSize] = *bytes;
+		}
+		check->offset++;
+		bytes++;
+		length--;
+	}
+}
+
+int OtaImageVerify(const struct OtaImageCheck *check)
+{
+	uint32_t crc = check->crc ^ 0xFFFFFFFF;
+	uint32_t trailer = (uint32_t)check->trailer[0] | ((uint32_t)check->trailer[1] << 8) | ((uint32_t)check->trailer[2] << 16) |
+	                   ((uint32_t)check->trailer[3] << 24);
+
+	if (check->offset != check->manifest.size) {
+		return -EMSGSIZE;
+	}
+	if (crc != check->manifest.crc32 || trailer != check->manifest.crc32) {
+		return -EBADMSG;
+	}
+	return 0;
+}
+
+uint32_t OtaImageRunningCrc(void)
+{
+	if (!runningCrcKnown) {
+		const uint8_t *image = (const uint8_t *)&_sfixed;
+		size_t size = ((const uint8_t *)&_etext - image) + ((const uint8_t *)&_erelocate - (const uint8_t *)&_srelocate);
+		uint32_t crc = 0xFFFFFFFF;
+
+		dsu_crc32_init();
+		for (size_t offset = 0; offset < size; offset += OTA_RUNNING_CRC_STEP) {
+			size_t step = (size - offset < OTA_RUNNING_CRC_STEP) ? size - offset : OTA_RUNNING_CRC_STEP;
+			crc = Crc32Update(crc, &image[offset], step);
+		}
+		runningCrc = crc ^ 0xFFFFFFFF;
+		runningCrcKnown = true;
+	}
+	return runningCrc;
+}
+
+uint32_t Crc32Update(uint32_t crc, const void *data, size_t length)
+{
+	const uint8_t *bytes = data;
+
+	// Up to the first word boundary
+	size_t head = (4 - ((uintptr_t)bytes & 3)) & 3;
+	if (head > length) {
+		head = length;
+	}
+	crc = Crc32Software(crc, bytes, head);
+	bytes += head;
+	length -= head;
+
+	// Whole words in hardware. The DSU may refuse the address (bus error), the software then does them
+	size_t words = length & ~(size_t)3;
+	if (words > 0) {
+		uint32_t dsuCrc = crc;
+		if (dsu_crc32_cal((uint32_t)bytes, words, &dsuCrc) == STATUS_OK) {
+			crc = dsuCrc;
+		} else {
+			crc = Crc32Software(crc, bytes, words);
+		}
+		bytes += words;
+		length -= words;
+	}
+
+	return Crc32Software(crc, bytes, length);
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/**
+ * @brief	Bitwise CRC32, only used for a few bytes per update
+ */
+static uint32_t Crc32Software(uint32_t crc, const uint8_t *data, size_t length)
+{
+	while (length-- > 0) {
+		crc ^= *data++;
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0 - (crc & 1)));
+		}
+	}
+	return crc;
+}
+
+/**
+ * @brief	Finds "key=" at the start of a line and returns what follows the '=', NULL if the key is missing
+ */
+static const char *OtaManifestValue(const char *text, const char *key)
+{
+	size_t keyLen = strlen(key);
+	const char *line = text;
+
+	while (line != NULL && *line != '\0') {
+		if (strncmp(line, key, keyLen) == 0 && line[keyLen] == '=') {
+			return &line[keyLen + 1];
+		}
+		line = strchr(line, '\n');
+		if (line != NULL) {
+			line++;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,106 @@
+/**************************************************************************/
+/**
+ * @file        OtaImage.h
+ * @brief       Manifest and streaming check of an OTA firmware image
+ * @details     The image (Application.bin) is the firmware followed by a 4-byte little endian CRC32 of the
+ *				firmware, the trailer the bootloader's Firmware_Check reads. Before the image, the downloader
+ *				fetches a small text manifest, one key=value per line:
+ *				--version=<decimal>   build number of the image
+ *				--size=<decimal>      size of Application.bin in bytes, trailer included
+ *				--crc32=<hex>         CRC32 of the firmware (same value as the trailer)
+ *				Unknown keys are ignored, so the manifest can grow.
+ *
+ *				While the image arrives, OtaImageUpdate runs the CRC over the firmware bytes and keeps the
+ *				trailer. OtaImageVerify then tells whether the image matches its manifest, before Flag.txt is
+ *				written and the bootloader flashes it.
+ *
+ *				The CRC is the usual CRC32 (IEEE 802.3, reflected, initial value and final XOR 0xFFFFFFFF) the
+ *				bootloader computes with the DSU. Word-aligned runs of data go through the DSU as well; the few
+ *				bytes around them, or everything if the DSU refuses the address, are done in software.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef OTA_IMAGE_H
+#define OTA_IMAGE_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define OTA_IMAGE_TRAILER_SIZE 4      ///< CRC32 at the end of the image
+#define OTA_MANIFEST_MAX_SIZE 128     ///< Largest manifest that is parsed
+#define OTA_RUNNING_CRC_STEP 4096     ///< Flash bytes per DSU run in OtaImageRunningCrc, interrupts are off during each
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Contents of the manifest */
+struct OtaManifest {
+	uint32_t version; ///< Build number of the image
+	uint32_t size;    ///< Image size in bytes, trailer included
+	uint32_t crc32;   ///< CRC32 of the firmware, trailer excluded
+};
+
+/** Running check of an image being received, see OtaImageBegin */
+struct OtaImageCheck {
+	struct OtaManifest manifest;                  ///< What the image must match
+	uint32_t offset;                              ///< Bytes of the image seen so far
+	uint32_t crc;                                 ///< CRC register over the firmware bytes seen, not inverted
+	uint8_t trailer[OTA_IMAGE_TRAILER_SIZE];      ///< Last bytes of the image
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			int OtaManifestParse(const char *text, size_t length, struct OtaManifest *manifest)
+ * @brief		Reads the manifest body (not terminated)
+ * @return		0 on success, -EINVAL if size or crc32 is missing or the size cannot hold a trailer,
+ *				-EMSGSIZE if the text is longer than OTA_MANIFEST_MAX_SIZE
+ *****************************************************************************/
+int OtaManifestParse(const char *text, size_t length, struct OtaManifest *manifest);
+
+/**
+ * @fn			void OtaImageBegin(struct OtaImageCheck *check, const struct OtaManifest *manifest)
+ * @brief		Starts the check of an image from its first byte
+ *****************************************************************************/
+void OtaImageBegin(struct OtaImageCheck *check, const struct OtaManifest *manifest);
+
+/**
+ * @fn			void OtaImageUpdate(struct OtaImageCheck *check, const void *data, size_t length)
+ * @brief		Adds the next bytes of the image, in order
+ *****************************************************************************/
+void OtaImageUpdate(struct OtaImageCheck *check, const void *data, size_t length);
+
+/**
+ * @fn			int OtaImageVerify(const struct OtaImageCheck *check)
+ * @brief		Checks the whole image against its manifest
+ * @return		0 if size, CRC and trailer match, -EMSGSIZE if the size differs, -EBADMSG if the CRC or the
+ *				trailer differs
+ *****************************************************************************/
+int OtaImageVerify(const struct OtaImageCheck *check);
+
+/**
+ * @fn			uint32_t OtaImageRunningCrc(void)
+ * @brief		CRC32 of the running firmware, the value the manifest of its image states
+ * @details		Runs over the firmware in flash as the linker placed it (.text and the initial values of .relocate,
+ *				i.e. what Application.bin holds before its trailer). Computed on the first call, then cached
+ *****************************************************************************/
+uint32_t OtaImageRunningCrc(void);
+
+/**
+ * @fn			uint32_t Crc32Update(uint32_t crc, const void *data, size_t length)
+ * @brief		Runs the CRC32 register over data. Start with 0xFFFFFFFF and XOR the result with 0xFFFFFFFF
+ * @note		Uses the DSU, which disables interrupts while it runs (a few microseconds per KB)
+ *****************************************************************************/
+uint32_t Crc32Update(uint32_t crc, const void *data, size_t length);
+
+#endif /* OTA_IMAGE_H */
@@ -0,0 +1,142 @@
+/**************************************************************************/
+/**
+ * @file        RunTimeStats.c
+ * @brief       Per-task CPU usage and stack usage, see RunTimeStats.h
+ * @details     The counter is read on every context switch, so it is read straight from the COUNT register.
+ *				READREQ.RCONT keeps COUNT synchronized continuously, which avoids a read request (and the wait
+ *				for synchronization) on each read.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "RunTimeStats.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define RUN_TIME_STATS_COUNT32_ADDR 0x10 ///< Offset of COUNT32.COUNT, for READREQ.ADDR
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static struct tc_module runTimeTc;                                ///< TC4/TC5 in 32-bit mode
+static TaskStatus_t taskStatus[RUN_TIME_STATS_MAX_TASKS];         ///< Snapshot from uxTaskGetSystemState
+static UBaseType_t prevTaskNumber[RUN_TIME_STATS_MAX_TASKS];      ///< Task numbers of the previous snapshot
+static uint32_t prevTaskCounter[RUN_TIME_STATS_MAX_TASKS];        ///< Run time of each task at the previous snapshot
+static UBaseType_t prevTaskCount = 0;                             ///< Entries in the previous snapshot
+static uint32_t prevTotal = 0;                                    ///< Run time counter at the previous snapshot
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static uint32_t previous_task_counter(UBaseType_t taskNumber);
+static char state_letter(eTaskState state);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+void RunTimeStatsTimerInit(void)
+{
+	struct tc_config config;
+
+	tc_get_config_defaults(&config);
+	config.counter_size = TC_COUNTER_SIZE_32BIT;
+	config.clock_source = GCLK_GENERATOR_0;
+	config.clock_prescaler = RUN_TIME_STATS_PRESCALER;
+	config.count_direction = TC_COUNT_DIRECTION_UP;
+	config.run_in_standby = false;
+
+	if (tc_init(&runTimeTc, RUN_TIME_STATS_TC, &config) != STATUS_OK) {
+		return; // Counter stays at 0: stats read 0% but the kernel keeps running
+	}
+	tc_enable(&runTimeTc);
+
+	RUN_TIME_STATS_TC->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(RUN_TIME_STATS_COUNT32_ADDR);
+}
+
+uint32_t RunTimeStatsGetCounter(void)
+{
+	return RUN_TIME_STATS_TC->COUNT32.COUNT.reg;
+}
+
+int RunTimeStatsSample(struct RunTimeTaskStats *stats, int maxTasks)
+{
+	uint32_t total;
+	UBaseType_t count = uxTaskGetSystemState(taskStatus, RUN_TIME_STATS_MAX_TASKS, &total);
+
+	if (count == 0) {
+		return -1; // Array too small for all the tasks
+	}
+
+	uint32_t elapsed = total - prevTotal;
+	int filled = 0;
+
+	for (UBaseType_t i = 0; i < count && filled < maxTasks; i++) {
+		TaskStatus_t *task = &taskStatus[i];
+		uint32_t ran = task->ulRunTimeCounter - previous_task_counter(task->xTaskNumber);
+		struct RunTimeTaskStats entry;
+
+		strncpy(entry.name, task->pcTaskName, configMAX_TASK_NAME_LEN - 1);
+		entry.name[configMAX_TASK_NAME_LEN - 1] = 0;
+		entry.cpuPermille = (elapsed > 0) ? (uint16_t)(((uint64_t)ran * 1000) / elapsed) : 0;
+		entry.stackFreeWords = task->usStackHighWaterMark;
+		entry.priority = (uint8_t)task->uxCurrentPriority;
+		entry.state = state_letter(task->eCurrentState);
+
+		// Insertion sort, highest CPU usage first
+		int pos = filled;
+		while (pos > 0 && stats[pos - 1].cpuPermille < entry.cpuPermille) {
+			stats[pos] = stats[pos - 1];
+			pos--;
+		}
+		stats[pos] = entry;
+		filled++;
+	}
+
+	// Keep this snapshot as the start of the next interval
+	for (UBaseType_t i = 0; i < count; i++) {
+		prevTaskNumber[i] = taskStatus[i].xTaskNumber;
+		prevTaskCounter[i] = taskStatus[i].ulRunTimeCounter;
+	}
+	prevTaskCount = count;
+	prevTotal = total;
+
+	return filled;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/// Run time of a task at the previous snapshot, 0 for a task created since then
+static uint32_t previous_task_counter(UBaseType_t taskNumber)
+{
+	for (UBaseType_t i = 0; i < prevTaskCount; i++) {
+		if (prevTaskNumber[i] == taskNumber) {
+			return prevTaskCounter[i];
+		}
+	}
+	return 0;
+}
+
+static char state_letter(eTaskState state)
+{
+	switch (state) {
+		case eRunning:
+			return 'R';
+		case eReady:
+			return 'r';
+		case eBlocked:
+			return 'B';
+		case eSuspended:
+			return 'S';
+		case eDeleted:
+			return 'D';
+		default:
+			return '?';
+	}
+}
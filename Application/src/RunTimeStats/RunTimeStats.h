@@ -0,0 +1,71 @@
+/**************************************************************************/
+/**
+ * @file        RunTimeStats.h
+ * @brief       Per-task CPU usage and stack usage, for the "top" CLI command
+ * @details     FreeRTOS accounts the time each task runs against a free-running counter. TC4 and TC5 are
+ *				chained as a 32-bit counter clocked at RUN_TIME_STATS_HZ for that purpose. CPU usage is
+ *				computed over the interval between two calls to RunTimeStatsSample, so counter wrap-around
+ *				(every ~6 hours) does not matter.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef RUN_TIME_STATS_H
+#define RUN_TIME_STATS_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "asf.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define RUN_TIME_STATS_TC TC4                  ///< Master of the 32-bit counter pair (TC5 is the slave)
+#define RUN_TIME_STATS_PRESCALER TC_CLOCK_PRESCALER_DIV256
+#define RUN_TIME_STATS_HZ (48000000UL / 256)   ///< Counter frequency: GCLK0 / 256, ~190 counts per tick
+#define RUN_TIME_STATS_MAX_TASKS 16            ///< Tasks tracked by RunTimeStatsSample
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Usage of one task over the last sampling interval */
+struct RunTimeTaskStats {
+	char name[configMAX_TASK_NAME_LEN]; /**< Task name */
+	uint16_t cpuPermille;               /**< CPU time in 1/1000, over the last interval */
+	uint16_t stackFreeWords;            /**< Stack high-water mark: fewest free words ever */
+	uint8_t priority;                   /**< Current priority */
+	char state;                         /**< R(unning), r(eady), B(locked), S(uspended), D(eleted) */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			void RunTimeStatsTimerInit(void)
+ * @brief		Starts the run time counter. Called by the kernel (portCONFIGURE_TIMER_FOR_RUN_TIME_STATS)
+ *****************************************************************************/
+void RunTimeStatsTimerInit(void);
+
+/**
+ * @fn			uint32_t RunTimeStatsGetCounter(void)
+ * @brief		Reads the run time counter. Called by the kernel on every context switch
+ *****************************************************************************/
+uint32_t RunTimeStatsGetCounter(void);
+
+/**
+ * @fn			int RunTimeStatsSample(struct RunTimeTaskStats *stats, int maxTasks)
+ * @brief		Takes a snapshot of all tasks and computes their CPU usage since the previous snapshot
+ * @details		The first call measures since the scheduler started. Tasks are sorted by CPU usage, highest first
+ * @param[out]	stats Receives one entry per task
+ * @param[in]	maxTasks Number of entries in stats
+ * @return		Number of entries filled, -1 if there are more than RUN_TIME_STATS_MAX_TASKS tasks
+ * @note		Not reentrant, call from one task only (the CLI)
+ *****************************************************************************/
+int RunTimeStatsSample(struct RunTimeTaskStats *stats, int maxTasks);
+
+#endif /* RUN_TIME_STATS_H */
@@ -0,0 +1,425 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLog.c
+ * @ingroup 	Serial Console
+ * @brief       Deferred (binary) back end of the debug logger
+ * @details     LogMessage hands its format string and va_list to DeferredLogWrite, which only walks the format
+ *				to learn the size of each argument and copies the raw values into a binary record. The records
+ *				are kept in a ring buffer until vDeferredLogTask, running at the lowest application priority,
+ *				formats them one conversion at a time and writes the result to the serial console.
+ *				See DeferredLog.h for the record layout.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "DeferredLog.h"
+#include "DeferredLogFormat.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define DEFERRED_LOG_OUTPUT_SIZE 128  ///< Size of a formatted line, same as the direct mode buffer
+#define DEFERRED_LOG_MAX_SPEC 16      ///< Longest conversion specification that is formatted, e.g. "%-08.3lx"
+#define DEFERRED_LOG_PRINT_TIMESTAMP 0 ///< Set to 1 to prefix every line with the tick count of the log call
+
+#define DEFERRED_LOG_IS_IN_FLASH(ptr) ((uint32_t)(ptr) < HMCRAMC0_ADDR) ///< Constant strings stay valid forever
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t logRingStorage[DEFERRED_LOG_BUFFER_SIZE]; ///< Storage of the binary log ring
+static circular_buf_t logRing;                           ///< Binary log ring (producers: LogMessage callers, consumer: drain task)
+static TaskHandle_t drainTaskHandle = NULL;              ///< Drain task, NULL while deferred mode is off
+static volatile uint32_t recordsWritten = 0;             ///< Records stored since boot
+static volatile uint32_t recordsDropped = 0;             ///< Records lost because the ring was full
+static char outputLine[DEFERRED_LOG_OUTPUT_SIZE];        ///< Formatted line, only used by the drain task
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static size_t put_word(uint8_t *record, size_t pos, uint32_t value);
+static size_t put_bytes(uint8_t *record, size_t pos, const void *data, size_t length);
+static size_t put_string(uint8_t *record, size_t pos, const char *string);
+static uint32_t get_word(const uint8_t *data);
+static size_t format_record(const uint8_t *record, char *out, size_t outLength);
+static size_t format_conversion(const struct DeferredLogConversion *conversion, const uint8_t *record, size_t *pos, char *out, size_t outLength);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+
+/**
+ * @brief Returns true if LogMessage should store records instead of formatting them.
+ */
+bool DeferredLogIsActive(void)
+{
+	return drainTaskHandle != NULL;
+}
+
+/**
+ * @brief Stores a binary log record. See DeferredLog.h.
+ */
+int DeferredLogWrite(enum eDebugLogLevels level, const char *format, va_list args)
+{
+	uint8_t record[DEFERRED_LOG_MAX_RECORD];
+	struct DeferredLogConversion conversion;
+	const char *next = format;
+	size_t pos = DEFERRED_LOG_HEADER_SIZE;
+	uint8_t flags = 0;
+
+	if (!DEFERRED_LOG_IS_IN_FLASH(format))
+	{
+		flags |= DEFERRED_LOG_INLINE_FORMAT;
+		if (strnlen(format, DEFERRED_LOG_MAX_STRING + 1) > DEFERRED_LOG_MAX_STRING)
+		{
+			flags |= DEFERRED_LOG_TRUNCATED;
+		}
+		pos = put_string(record, pos, format);
+	}
+
+	while ((next = DeferredLogNextConversion(next, &conversion)) != NULL)
+	{
+		for (uint8_t star = 0; star < conversion.stars; star++)
+		{
+			pos = put_word(record, pos, (uint32_t)va_arg(args, int));
+		}
+
+		switch (conversion.kind)
+		{
+			case DEFERRED_ARG_WORD:
+				pos = put_word(record, pos, va_arg(args, uint32_t));
+				break;
+
+			case DEFERRED_ARG_WIDE_INT: {
+				uint64_t value = va_arg(args, uint64_t);
+				pos = put_bytes(record, pos, &value, sizeof(value));
+				break;
+			}
+
+			case DEFERRED_ARG_DOUBLE: {
+				double value = va_arg(args, double);
+				pos = put_bytes(record, pos, &value, sizeof(value));
+				break;
+			}
+
+			case DEFERRED_ARG_STRING:
+				pos = put_string(record, pos, va_arg(args, const char *));
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	record[0] = (uint8_t)pos;
+	record[1] = (uint8_t)level | flags;
+	put_word(record, 2, xTaskGetTickCount());
+	put_word(record, 6, (uint32_t)format);
+
+	// Several tasks log, so the producer side of the ring is serialized. Copying one record is short
+	int result = -1;
+	taskENTER_CRITICAL();
+	if (circular_buf_capacity(&logRing) - circular_buf_size(&logRing) >= pos)
+	{
+		circular_buf_put_n(&logRing, record, pos);
+		recordsWritten++;
+		result = 0;
+	}
+	else
+	{
+		recordsDropped++;
+	}
+	taskEXIT_CRITICAL();
+
+	if (result == 0)
+	{
+		xTaskNotifyGive(drainTaskHandle);
+	}
+	return result;
+}
+
+/**
+ * @brief Copies the deferred logger counters into the given structure.
+ */
+void DeferredLogGetStats(struct DeferredLogStats *stats)
+{
+	if (stats != NULL)
+	{
+		stats->recordsWritten = recordsWritten;
+		stats->recordsDropped = recordsDropped;
+		stats->bytesPending = DeferredLogIsActive() ? circular_buf_size(&logRing) : 0;
+	}
+}
+
+/**
+ * @brief Drain task. Formats the stored records and prints them.
+ */
+void vDeferredLogTask(void *pvParameters)
+{
+	static uint8_t record[DEFERRED_LOG_MAX_RECORD];
+	struct SerialConsoleTxStats txStats;
+	(void)pvParameters;
+
+	circular_buf_init(&logRing, logRingStorage, DEFERRED_LOG_BUFFER_SIZE);
+	drainTaskHandle = xTaskGetCurrentTaskHandle(); // From here on LogMessage stores records
+
+	for (;;)
+	{
+		// A record is published with a single head update, so it is always complete when its length byte is there
+		while (circular_buf_get(&logRing, &record[0]) == 0)
+		{
+			circular_buf_get_n(&logRing, &record[1], record[0] - 1);
+			size_t length = format_record(record, outputLine, DEFERRED_LOG_OUTPUT_SIZE);
+
+			// Wait for room on the console instead of losing the line: nobody waits on us
+			SerialConsoleGetTxStats(&txStats);
+			while (txStats.bytesFree < length)
+			{
+				vTaskDelay(1);
+				SerialConsoleGetTxStats(&txStats);
+			}
+			SerialConsoleWriteString(outputLine);
+		}
+
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+
+/**************************************************************************/
+/**
+ * @fn			static size_t put_bytes(uint8_t *record, size_t pos, const void *data, size_t length)
+ * @brief		Appends raw bytes to a record if they fit
+ * @return		New write position. Unchanged if the data did not fit
+ *****************************************************************************/
+static size_t put_bytes(uint8_t *record, size_t pos, const void *data, size_t length)
+{
+	if (pos + length > DEFERRED_LOG_MAX_RECORD)
+	{
+		return pos;
+	}
+	memcpy(&record[pos], data, length);
+	return pos + length;
+}
+
+/**************************************************************************/
+/**
+ * @fn			static size_t put_word(uint8_t *record, size_t pos, uint32_t value)
+ * @brief		Appends a 32 bit little endian value to a record
+ *****************************************************************************/
+static size_t put_word(uint8_t *record, size_t pos, uint32_t value)
+{
+	uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+	return put_bytes(record, pos, bytes, sizeof(bytes));
+}
+
+/**************************************************************************/
+/**
+ * @fn			static size_t put_string(uint8_t *record, size_t pos, const char *string)
+ * @brief		Appends a length prefixed copy of a string, truncated to what fits in the record
+ *****************************************************************************/
+static size_t put_string(uint8_t *record, size_t pos, const char *string)
+{
+	size_t length;
+
+	if (string == NULL)
+	{
+		string = "(null)";
+	}
+	if (pos + 1 > DEFERRED_LOG_MAX_RECORD)
+	{
+		return pos;
+	}
+
+	length = strnlen(string, DEFERRED_LOG_MAX_STRING);
+	if (pos + 1 + length > DEFERRED_LOG_MAX_RECORD)
+	{
+		length = DEFERRED_LOG_MAX_RECORD - pos - 1;
+	}
+
+	record[pos] = (uint8_t)length;
+	memcpy(&record[pos + 1], string, length);
+	return pos + 1 + length;
+}
+
+/**************************************************************************/
+/**
+ * @fn			static uint32_t get_word(const uint8_t *data)
+ * @brief		Reads a 32 bit little endian value
+ *****************************************************************************/
+static uint32_t get_word(const uint8_t *data)
+{
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**************************************************************************/
+/**
+ * @fn			static size_t format_record(const uint8_t *record, char *out, size_t outLength)
+ * @brief		Formats a binary record into a NULL terminated line
+ * @return		Length of the line
+ *****************************************************************************/
+static size_t format_record(const uint8_t *record, char *out, size_t outLength)
+{
+	char inlineFormat[DEFERRED_LOG_MAX_STRING + 1];
+	const char *format = (const char *)get_word(&record[6]);
+	struct DeferredLogConversion conversion;
+	size_t pos = DEFERRED_LOG_HEADER_SIZE;
+	size_t used = 0;
+
+	if (record[1] & DEFERRED_LOG_INLINE_FORMAT)
+	{
+		size_t length = record[pos];
+		memcpy(inlineFormat, &record[pos + 1], length);
+		inlineFormat[length] = '\0';
+		format = inlineFormat;
+		pos += 1 + length;
+	}
+
+#if DEFERRED_LOG_PRINT_TIMESTAMP
+	used = snprintf(out, outLength, "[%lu] ", (unsigned long)get_word(&record[2]));
+#endif
+
+	while (*format != '\0' && used < outLength - 1)
+	{
+		const char *next = DeferredLogNextConversion(format, &conversion);
+		size_t literal = (next != NULL) ? (size_t)(conversion.start - format) : strlen(format);
+
+		if (literal > outLength - 1 - used)
+		{
+			literal = outLength - 1 - used;
+		}
+		memcpy(&out[used], format, literal);
+		used += literal;
+
+		if (next == NULL)
+		{
+			break;
+		}
+		used += format_conversion(&conversion, record, &pos, &out[used], outLength - used);
+		format = next;
+	}
+
+	if (record[1] & DEFERRED_LOG_TRUNCATED)
+	{
+		const size_t mark = sizeof(DEFERRED_LOG_TRUNCATED_MARK) - 1;
+		if (used > outLength - 1 - mark)
+		{
+			used = outLength - 1 - mark;
+		}
+		memcpy(&out[used], DEFERRED_LOG_TRUNCATED_MARK, mark);
+		used += mark;
+	}
+	out[used] = '\0';
+	return used;
+}
+
+/**************************************************************************/
+/**
+ * @fn			static size_t format_conversion(const struct DeferredLogConversion *conversion, const uint8_t *record,
+ *											size_t *pos, char *out, size_t outLength)
+ * @brief		Formats one conversion with the next argument(s) of the record
+ * @details		The specification is copied out of the format string and passed to snprintf with the single value
+ *				it needs, so printf keeps doing the actual formatting. If the record ran out of arguments (it was
+ *				cut to DEFERRED_LOG_MAX_RECORD) the specification is printed as is.
+ * @return		Number of characters written to out, NULL terminator excluded
+ *****************************************************************************/
+static size_t format_conversion(const struct DeferredLogConversion *conversion, const uint8_t *record, size_t *pos, char *out, size_t outLength)
+{
+	const size_t end = record[0];
+	char spec[DEFERRED_LOG_MAX_SPEC + 1];
+	char string[DEFERRED_LOG_MAX_STRING + 1];
+	int star[2] = {0, 0};
+	int written = -1;
+
+	if (conversion->kind == DEFERRED_ARG_NONE && conversion->length == 2 && conversion->start[1] == '%')
+	{
+		out[0] = '%';
+		out[1] = '\0';
+		return 1;
+	}
+
+	for (uint8_t i = 0; i < conversion->stars && *pos + 4 <= end; i++)
+	{
+		star[i] = (int)get_word(&record[*pos]);
+		*pos += 4;
+	}
+
+	if (conversion->length <= DEFERRED_LOG_MAX_SPEC)
+	{
+		memcpy(spec, conversion->start, conversion->length);
+		spec[conversion->length] = '\0';
+
+// snprintf with the '*' arguments the specification asks for, followed by the value
+#define FORMAT_VALUE(value)                                                                                                    \
+	((conversion->stars == 0) ? snprintf(out, outLength, spec, value)                                                          \
+	 : (conversion->stars == 1) ? snprintf(out, outLength, spec, star[0], value)                                               \
+	                            : snprintf(out, outLength, spec, star[0], star[1], value))
+
+		switch (conversion->kind)
+		{
+			case DEFERRED_ARG_WORD:
+				if (*pos + 4 <= end)
+				{
+					uint32_t value = get_word(&record[*pos]);
+					*pos += 4;
+					if (spec[conversion->length - 1] == 'n')
+						written = 0;
+					else if (spec[conversion->length - 1] == 'p')
+						written = FORMAT_VALUE((void *)value);
+					else
+						written = FORMAT_VALUE(value);
+				}
+				break;
+
+			case DEFERRED_ARG_WIDE_INT:
+				if (*pos + 8 <= end)
+				{
+					uint64_t value;
+					memcpy(&value, &record[*pos], sizeof(value));
+					*pos += 8;
+					written = FORMAT_VALUE(value);
+				}
+				break;
+
+			case DEFERRED_ARG_DOUBLE:
+				if (*pos + 8 <= end)
+				{
+					double value;
+					memcpy(&value, &record[*pos], sizeof(value));
+					*pos += 8;
+					written = FORMAT_VALUE(value);
+				}
+				break;
+
+			case DEFERRED_ARG_STRING:
+				if (*pos + 1 <= end && *pos + 1 + record[*pos] <= end)
+				{
+					size_t length = record[*pos];
+					memcpy(string, &record[*pos + 1], length);
+					string[length] = '\0';
+					*pos += 1 + length;
+					written = FORMAT_VALUE(string);
+				}
+				break;
+
+			default:
+				break;
+		}
+#undef FORMAT_VALUE
+	}
+
+	if (written < 0)
+	{
+		// Invalid specification or missing argument: print the specification itself
+		written = snprintf(out, outLength, "%.*s", (int)conversion->length, conversion->start);
+	}
+	return ((size_t)written < outLength) ? (size_t)written : outLength - 1;
+}
@@ -0,0 +1,97 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLog.h
+ * @ingroup 	Serial Console
+ * @brief       Deferred (binary) back end of the debug logger
+ * @details     In deferred mode LogMessage does not format anything in the caller's context. It stores a
+ *				binary record with the format-string pointer, a timestamp and the raw arguments into a ring
+ *				buffer, and the low priority task vDeferredLogTask formats and prints the records later.
+ *
+ *				Record layout (little endian, byte packed):
+ *				--u8  length of the whole record, header included
+ *				--u8  level (enum eDebugLogLevels), DEFERRED_LOG_INLINE_FORMAT set if the format is inlined,
+ *				  DEFERRED_LOG_TRUNCATED if that copy was cut
+ *				--u32 timestamp in RTOS ticks
+ *				--u32 address of the format string in flash
+ *				--[u8 length + bytes] copy of the format string, only if DEFERRED_LOG_INLINE_FORMAT is set
+ *				--one entry per conversion of the format string, in order:
+ *				  '*' width/precision, integers, chars and pointers: u32
+ *				  "ll"/"j" integers and floating point: 8 bytes (double)
+ *				  strings: u8 length + bytes (no terminator, truncated to DEFERRED_LOG_MAX_STRING)
+ *
+ *				Format strings that live in RAM (e.g. a buffer passed as format) would be gone by the time the
+ *				record is printed, so they are copied into the record instead of referenced. A copy cut to
+ *				DEFERRED_LOG_MAX_STRING is printed with DEFERRED_LOG_TRUNCATED_MARK after it.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialConsole.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define DEFERRED_LOG_BUFFER_SIZE 512      ///< Size of the binary log ring, must be a power of two
+#define DEFERRED_LOG_MAX_RECORD 128       ///< Largest record, in bytes. Arguments that do not fit are cut
+#define DEFERRED_LOG_MAX_STRING 48        ///< Longest %s argument (or inlined format) copied into a record
+#define DEFERRED_LOG_HEADER_SIZE 10       ///< Size of the fixed part of a record
+#define DEFERRED_LOG_INLINE_FORMAT 0x80   ///< Level flag: the format string is stored in the record
+#define DEFERRED_LOG_TRUNCATED 0x40       ///< Level flag: the stored format string was cut to DEFERRED_LOG_MAX_STRING
+#define DEFERRED_LOG_TRUNCATED_MARK "...\r\n" ///< Ends the line of a cut format, which lost its own line end
+
+#define DEFERRED_LOG_TASK_SIZE 200                       ///< Stack of the drain task, in words
+#define DEFERRED_LOG_PRIORITY (tskIDLE_PRIORITY + 1)     ///< The drain task only runs when nothing else does
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Counters of the deferred logger, see DeferredLogGetStats */
+struct DeferredLogStats {
+	uint32_t recordsWritten; /**< Records stored in the ring */
+	uint32_t recordsDropped; /**< Records discarded because the ring was full */
+	uint32_t bytesPending;   /**< Bytes waiting in the ring */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			bool DeferredLogIsActive(void)
+ * @brief		Returns true once the drain task runs; before that LogMessage formats in place
+ *****************************************************************************/
+bool DeferredLogIsActive(void);
+
+/**
+ * @fn			int DeferredLogWrite(enum eDebugLogLevels level, const char *format, va_list args)
+ * @brief		Stores a log record for the given format and arguments
+ * @details		Only walks the format string to find the size of each argument; no formatting is done here
+ * @return		0 on success, -1 if the record was dropped because the ring is full
+ * @note		Callable from any task. Not callable from interrupts
+ *****************************************************************************/
+int DeferredLogWrite(enum eDebugLogLevels level, const char *format, va_list args);
+
+/**
+ * @fn			void DeferredLogGetStats(struct DeferredLogStats *stats)
+ * @brief		Copies the number of records written and dropped
+ *****************************************************************************/
+void DeferredLogGetStats(struct DeferredLogStats *stats);
+
+/**
+ * @fn			void vDeferredLogTask(void *pvParameters)
+ * @brief		Drain task: formats the stored records and writes them to the serial console
+ * @note		Turns deferred mode on when it starts
+ *****************************************************************************/
+void vDeferredLogTask(void *pvParameters);
+
+#endif /* DEFERRED_LOG_H */
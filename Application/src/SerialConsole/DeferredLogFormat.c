@@ -0,0 +1,77 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLogFormat.c
+ * @ingroup 	Serial Console
+ * @brief       printf format string parser shared by the deferred logger and its host decoder, see
+ *				DeferredLogFormat.h
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "DeferredLogFormat.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+const char *DeferredLogNextConversion(const char *format, struct DeferredLogConversion *conversion)
+{
+	const char *p = strchr(format, '%');
+	bool wide = false;
+
+	if (p == NULL)
+	{
+		return NULL;
+	}
+
+	conversion->start = p++;
+	conversion->stars = 0;
+	conversion->kind = DEFERRED_ARG_NONE;
+
+	while (*p != '\0' && strchr("-+ #0", *p) != NULL) p++;
+	if (*p == '*') { conversion->stars++; p++; }
+	while (*p >= '0' && *p <= '9') p++;
+	if (*p == '.')
+	{
+		p++;
+		if (*p == '*') { conversion->stars++; p++; }
+		while (*p >= '0' && *p <= '9') p++;
+	}
+	while (*p != '\0' && strchr("hljztL", *p) != NULL)
+	{
+		wide |= (*p == 'j') || (*p == 'l' && p[1] == 'l');
+		p++;
+	}
+
+	switch (*p)
+	{
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			conversion->kind = wide ? DEFERRED_ARG_WIDE_INT : DEFERRED_ARG_WORD;
+			break;
+		case 'c': case 'p': case 'n':
+			conversion->kind = DEFERRED_ARG_WORD;
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			conversion->kind = DEFERRED_ARG_DOUBLE;
+			break;
+		case 's':
+			conversion->kind = DEFERRED_ARG_STRING;
+			break;
+		case '\0':
+			conversion->length = p - conversion->start;
+			return p;
+		default: // "%%" or an unknown conversion: no argument
+			break;
+	}
+
+	p++;
+	conversion->length = p - conversion->start;
+	return p;
+}
@@ -0,0 +1,57 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLogFormat.h
+ * @ingroup 	Serial Console
+ * @brief       printf format string parser shared by the deferred logger and its host decoder
+ * @details     DeferredLogWrite (DeferredLog.c) walks the format to learn how each argument is stored in the
+ *				record, and the formatters (format_record, Tools/DeferredLogDecode.c) walk it again to read them
+ *				back. Both sides must see the same conversions, so they use this one parser. It only needs the C
+ *				library and builds for the target and the host.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef DEFERRED_LOG_FORMAT_H
+#define DEFERRED_LOG_FORMAT_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Structures and Enumerations
+ ******************************************************************************/
+/** Storage class of a printf argument */
+enum eDeferredLogArgKind {
+	DEFERRED_ARG_NONE,     /**< No argument ("%%" or an invalid specification) */
+	DEFERRED_ARG_WORD,     /**< int, long, char, pointer: 32 bits */
+	DEFERRED_ARG_WIDE_INT, /**< long long, intmax_t: 64 bits */
+	DEFERRED_ARG_DOUBLE,   /**< float (promoted) and double: 64 bits */
+	DEFERRED_ARG_STRING    /**< char *: length and characters */
+};
+
+/** One conversion specification found in a format string */
+struct DeferredLogConversion {
+	const char *start;             /**< Points at the '%' */
+	size_t length;                 /**< Length of the specification, conversion character included */
+	uint8_t stars;                 /**< Number of '*' width/precision arguments before the value */
+	enum eDeferredLogArgKind kind; /**< How the value is passed */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			const char *DeferredLogNextConversion(const char *format, struct DeferredLogConversion *conversion)
+ * @brief		Finds the next conversion specification in a printf format string
+ * @return		Pointer to the character after the specification, or NULL if there are no more
+ * @note		Handles flags, width, precision (including '*') and the hh/h/l/ll/j/z/t/L length modifiers. A
+ *				specification cut by the end of the string has no argument and ends there
+ *****************************************************************************/
+const char *DeferredLogNextConversion(const char *format, struct DeferredLogConversion *conversion);
+
+#endif /* DEFERRED_LOG_FORMAT_H */
@@ -12,6 +12,7 @@
  *				The code in this file will:
  *				--Initialize a SERCOM port (SERCOM # ) to be an UART channel operating at 115200 baud/second, 8N1
  *				--Register callbacks for the device to read and write characters asynchronously as required by the CLI
+ *				--Drain the TX ring buffer through a DMA channel, one contiguous span per transfer
  *				--Initialize the CLI and Debug Logger data structures
  *
  *				Usage:
@@ -29,6 +30,8 @@
 #include "SerialConsole.h"
 #include "semphr.h"
 #include "CliThread.h"
+#include "DeferredLog.h"
+#include <errno.h>
 /******************************************************************************
  * Defines
  ******************************************************************************/
@@ -38,23 +41,34 @@
 /******************************************************************************
  * Structures and Enumerations
  ******************************************************************************/
-cbuf_handle_t cbufRx; ///< Circular buffer handler for receiving characters
-cbuf_handle_t cbufTx; ///< Circular buffer handler for transmitting characters
+circular_buf_t cbufRx; ///< Circular buffer for receiving characters (producer: RX callback, consumer: CLI)
+circular_buf_t cbufTx; ///< Circular buffer for transmitting characters (producers: tasks, consumer: TX callback)
 
 char latestRx; ///< Holds the latest character received
-char latestTx; ///< Holds the latest character to be transmitted
+
+static struct dma_resource txDmaResource;                          ///< DMA channel that feeds the SERCOM DATA register
+static DmacDescriptor txDmaDescriptor __attribute__((aligned(16))); ///< Descriptor reused for every TX span
+static bool txDmaReady = false;                                     ///< False if no DMA channel could be allocated
+static volatile size_t txSpanLength = 0;                            ///< Bytes of the TX ring currently in flight, 0 when idle
+static volatile uint32_t txBytesSent = 0;                           ///< Total bytes handed to the UART
+static volatile uint32_t txBytesDropped = 0;                        ///< Total bytes rejected because the TX ring was full
 
 /******************************************************************************
  * Callback Declarations
  ******************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module); // Callback for when we finish writing characters to UART
 void usart_read_callback(struct usart_module *const usart_module); // Callback for when we finis reading characters from UART
+void usart_tx_dma_callback(struct dma_resource *const resource); // Callback for when the DMA finishes sending a TX span
 
 /******************************************************************************
  * Local Function Declarations
  ******************************************************************************/
 static void configure_usart(void);
 static void configure_usart_callbacks(void);
+static void configure_usart_tx_dma(void);
+static void start_tx_span(void);
+static void finish_tx_span(void);
+static void log_write_args(enum eDebugLogLevels level, const char *format, va_list args);
 
 /******************************************************************************
  * Global Variables
@@ -62,7 +76,10 @@ static void configure_usart_callbacks(void);
 struct usart_module usart_instance;
 char rxCharacterBuffer[RX_BUFFER_SIZE]; 			   ///< Buffer to store received characters
 char txCharacterBuffer[TX_BUFFER_SIZE]; 			   ///< Buffer to store characters to be sent
-enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///< Default debug level
+enum eDebugLogLevels currentDebugLevel = LOG_DEBUG_LVL; ///< Default debug level, prints everything
+volatile uint8_t logModuleLevels[N_LOG_MODULES] = {LOG_DEBUG_LVL, LOG_DEBUG_LVL, LOG_DEBUG_LVL, LOG_DEBUG_LVL}; ///< Runtime level of each module
+
+static const char *const logModuleNames[N_LOG_MODULES] = {"app", "wifi", "http", "mqtt"}; ///< Names used by the "log" CLI command
 
 SemaphoreHandle_t xRxSemaphore; //This Variable is in the CliThread.c, but we need to use it
 
@@ -76,12 +93,13 @@ SemaphoreHandle_t xRxSemaphore; //This Variable is in the CliThread.c, but we ne
 void InitializeSerialConsole(void)
 {
     // Initialize circular buffers for RX and TX
-	cbufRx = circular_buf_init((uint8_t *)rxCharacterBuffer, RX_BUFFER_SIZE);
-    cbufTx = circular_buf_init((uint8_t *)txCharacterBuffer, TX_BUFFER_SIZE);
+	circular_buf_init(&cbufRx, (uint8_t *)rxCharacterBuffer, RX_BUFFER_SIZE);
+    circular_buf_init(&cbufTx, (uint8_t *)txCharacterBuffer, TX_BUFFER_SIZE);
 
     // Configure USART and Callbacks
 	configure_usart();
     configure_usart_callbacks();
+	configure_usart_tx_dma();
     NVIC_SetPriority(SERCOM4_IRQn, 10);
 
     usart_read_buffer_job(&usart_instance, (uint8_t *)&latestRx, 1); // Kicks off constant reading of characters
@@ -105,16 +123,37 @@ void SerialConsoleWriteString(char *string)
 {
     if (string != NULL)
     {
-        for (size_t iter = 0; iter < strlen(string); iter++)
-        {
-            circular_buf_put(cbufTx, string[iter]);
-        }
+        size_t length = strlen(string);
 
-        if (usart_get_job_status(&usart_instance, USART_TRANSCEIVER_TX) == STATUS_OK)
+        // Several tasks write to the console, so the producer side is serialized. The critical
+        // section also keeps the TX callback from restarting the DMA while we check txSpanLength
+        taskENTER_CRITICAL();
+        // Never overwrite unsent bytes: they may be part of the span the DMA is reading
+        txBytesDropped += length - circular_buf_put_n(&cbufTx, (uint8_t *)string, length);
+
+        if (txSpanLength == 0)
         {
-            circular_buf_get(cbufTx, (uint8_t *)&latestTx); // Perform only if the SERCOM TX is free (not busy)
-            usart_write_buffer_job(&usart_instance, (uint8_t *)&latestTx, 1);
+            start_tx_span(); // Perform only if the SERCOM TX is free (not busy)
         }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/**
+ * @brief Copies the TX counters into the given structure.
+ * @param stats Pointer to the structure to fill.
+ */
+void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats)
+{
+    if (stats != NULL)
+    {
+        taskENTER_CRITICAL();
+        stats->bytesSent = txBytesSent;
+        stats->bytesDropped = txBytesDropped;
+        stats->bytesPending = circular_buf_size(&cbufTx);
+        stats->bytesFree = circular_buf_capacity(&cbufTx) - stats->bytesPending;
+        taskEXIT_CRITICAL();
+        stats->dmaEnabled = txDmaReady;
     }
 }
 
@@ -125,10 +164,19 @@ void SerialConsoleWriteString(char *string)
  */
 int SerialConsoleReadCharacter(uint8_t *rxChar)
 {
-    vTaskSuspendAll();
-    int a = circular_buf_get(cbufRx, (uint8_t *)rxChar);
-    xTaskResumeAll();
-    return a;
+    // Single consumer of a SPSC ring fed by the RX callback, no locking needed
+    return circular_buf_get(&cbufRx, (uint8_t *)rxChar);
+}
+
+/**
+ * @brief Reads all the characters available in the RX buffer, up to len.
+ * @param buffer Destination of the characters.
+ * @param len Size of buffer.
+ * @return Number of characters copied, 0 if the buffer is empty.
+ */
+size_t SerialConsoleRead(uint8_t *buffer, size_t len)
+{
+    return circular_buf_get_n(&cbufRx, buffer, len);
 }
 
 /**
@@ -147,6 +195,33 @@ enum eDebugLogLevels getLogLevel(void)
 void setLogLevel(enum eDebugLogLevels debugLevel)
 {
     currentDebugLevel = debugLevel;
+    for (int module = 0; module < N_LOG_MODULES; module++)
+    {
+        logModuleLevels[module] = debugLevel;
+    }
+}
+
+/**
+ * @brief Sets the runtime log level of one module.
+ * @return 0 on success, -EINVAL if the module or level is out of range.
+ */
+int setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel)
+{
+    if (module >= N_LOG_MODULES || debugLevel >= N_DEBUG_LEVELS)
+    {
+        return -EINVAL;
+    }
+    logModuleLevels[module] = debugLevel;
+    return 0;
+}
+
+/**
+ * @brief Gets the name of a log module.
+ * @return The name, or NULL if the module is out of range.
+ */
+const char *getLogModuleName(enum eLogModules module)
+{
+    return (module < N_LOG_MODULES) ? logModuleNames[module] : NULL;
 }
 
 /**
@@ -159,19 +234,24 @@ void LogMessage(enum eDebugLogLevels level, const char *format, ...)
 	
 	// Only print if the level is >= current debug level
 	if (level >= currentDebugLevel) {
-		char buffer[128]; // Buffer to hold the formatted message
 		va_list args;
-		
-		// Format the message with variable arguments
 		va_start(args, format);
-		vsprintf(buffer, format, args);
+		log_write_args(level, format, args);
 		va_end(args);
-		
-		// Send the formatted message to the serial console
-		SerialConsoleWriteString(buffer);
 	}
 }
 
+/**
+ * @brief Writes a log message without level filtering, the LOG_* macros filter before calling this.
+ */
+void LogWrite(enum eDebugLogLevels level, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log_write_args(level, format, args);
+	va_end(args);
+}
+
 /*
 COMMAND LINE INTERFACE COMMANDS
 */
@@ -180,6 +260,28 @@ COMMAND LINE INTERFACE COMMANDS
  * Local Functions
  ******************************************************************************/
 
+/**************************************************************************/ 
+/**
+ * @fn			static void log_write_args(enum eDebugLogLevels level, const char *format, va_list args)
+ * @brief		Formats and prints a log message, or stores it for the deferred log task when that task runs
+ * @note
+ *****************************************************************************/
+static void log_write_args(enum eDebugLogLevels level, const char *format, va_list args)
+{
+	if (DeferredLogIsActive()) {
+		// Only store the raw arguments, the deferred log task does the formatting
+		DeferredLogWrite(level, format, args);
+	} else {
+		char buffer[128]; // Buffer to hold the formatted message
+
+		// Format the message with variable arguments
+		vsnprintf(buffer, sizeof(buffer), format, args);
+
+		// Send the formatted message to the serial console
+		SerialConsoleWriteString(buffer);
+	}
+}
+
 /**************************************************************************/ 
 /**
  * @fn			static void configure_usart(void)
@@ -224,6 +326,88 @@ static void configure_usart_callbacks(void)
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_RECEIVED);
 }
 
+/**************************************************************************/ 
+/**
+ * @fn			static void configure_usart_tx_dma(void)
+ * @brief		Allocates a DMA channel triggered by the SERCOM TX (DRE) request so a whole span of the
+ *				TX ring is sent with a single interrupt at the end of the transfer
+ * @note		If no channel is available the console falls back to interrupt driven buffer jobs
+ *****************************************************************************/
+static void configure_usart_tx_dma(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+
+	config.peripheral_trigger = SERCOM4_DMAC_ID_TX;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	if (dma_allocate(&txDmaResource, &config) != STATUS_OK)
+	{
+		txDmaReady = false;
+		return;
+	}
+
+	dma_register_callback(&txDmaResource, usart_tx_dma_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&txDmaResource, DMA_CALLBACK_TRANSFER_DONE);
+
+	struct dma_descriptor_config descriptor_config;
+	dma_descriptor_get_config_defaults(&descriptor_config);
+
+	descriptor_config.beat_size = DMA_BEAT_SIZE_BYTE;
+	descriptor_config.dst_increment_enable = false;
+	descriptor_config.src_increment_enable = true;
+	descriptor_config.destination_address = (uint32_t)&usart_instance.hw->USART.DATA.reg;
+
+	dma_descriptor_create(&txDmaDescriptor, &descriptor_config);
+	txDmaResource.descriptor = &txDmaDescriptor;
+
+	txDmaReady = true;
+}
+
+/**************************************************************************/ 
+/**
+ * @fn			static void start_tx_span(void)
+ * @brief		Hands the largest contiguous run of the TX ring to the DMA (or to a USART buffer job)
+ * @note		Must be called with the TX callbacks masked, i.e. inside a critical section or from the
+ *				TX completion callbacks themselves
+ *****************************************************************************/
+static void start_tx_span(void)
+{
+	uint8_t *span;
+	size_t length = circular_buf_peek_span(&cbufTx, &span);
+
+	txSpanLength = length;
+	if (length == 0)
+	{
+		return;
+	}
+
+	if (txDmaReady)
+	{
+		// The DMA source address is the address of the last beat plus one when incrementing
+		txDmaDescriptor.BTCNT.reg = length;
+		txDmaDescriptor.SRCADDR.reg = (uint32_t)span + length;
+		dma_start_transfer_job(&txDmaResource);
+	}
+	else
+	{
+		usart_write_buffer_job(&usart_instance, span, length);
+	}
+}
+
+/**************************************************************************/ 
+/**
+ * @fn			static void finish_tx_span(void)
+ * @brief		Releases the span that was just sent and starts the next one, if any
+ * @note
+ *****************************************************************************/
+static void finish_tx_span(void)
+{
+	circular_buf_consume(&cbufTx, txSpanLength);
+	txBytesSent += txSpanLength;
+	start_tx_span();
+}
+
 /******************************************************************************
  * Callback Functions
  ******************************************************************************/
@@ -237,17 +421,24 @@ static void configure_usart_callbacks(void)
  *****************************************************************************/
 void usart_read_callback(struct usart_module *const usart_module)
 {
-	// ToDo: Complete this function 
-	// Store the latest received character into the RX buffer.
-	circular_buf_put(cbufRx, (uint8_t)latestRx);
-	
-	// Notify CLI that there is a character.
+	(void)usart_module;
+	// Open the next time receiving first, so the next character cannot overrun the UART
+	char rx = latestRx;
+	usart_read_buffer_job(&usart_instance, (uint8_t *)&latestRx, 1);
+
+	// Store the character into the RX buffer. Dropped if the CLI is not keeping up
+	bool wasEmpty = circular_buf_empty(&cbufRx);
+	if (circular_buf_put(&cbufRx, (uint8_t)rx) != 0) {
+		return;
+	}
+
+	// Only wake the CLI when there is new work: the first character after it emptied the buffer (it
+	// drains everything it finds), or the end of a line. Characters in between ride along.
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-	xSemaphoreGiveFromISR(xRxSemaphore, &xHigherPriorityTaskWoken);
-	
-	// Open the next time receiving.
-	usart_read_buffer_job(&usart_instance, (uint8_t *)&latestRx, 1); 
-	
+	if (wasEmpty || rx == '\r' || rx == '\n') {
+		xSemaphoreGiveFromISR(xRxSemaphore, &xHigherPriorityTaskWoken);
+	}
+
 	// If there is a higher priority task, switch the task.
 	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 	
@@ -261,10 +452,20 @@ void usart_read_callback(struct usart_module *const usart_module)
  *****************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module)
 {
-	if (circular_buf_get(cbufTx, (uint8_t *)&latestTx) != -1) // Only continue if there are more characters to send
-	{
-		usart_write_buffer_job(&usart_instance, (uint8_t *)&latestTx, 1);
-	}
+	(void)usart_module;
+	finish_tx_span(); // Only used when no DMA channel is available
+}
+
+/**************************************************************************/ 
+/**
+ * @fn			void usart_tx_dma_callback(struct dma_resource *const resource)
+ * @brief		Callback called when the DMA has written a whole TX span into the SERCOM
+ * @note
+ *****************************************************************************/
+void usart_tx_dma_callback(struct dma_resource *const resource)
+{
+	(void)resource;
+	finish_tx_span();
 }
 
 /**
@@ -37,9 +37,10 @@
  /******************************************************************************
   * Enumerations
   ******************************************************************************/
+ /** Log levels, lowest first. A module prints the messages at or above its level */
  enum eDebugLogLevels {
-	 LOG_INFO_LVL    = 0, /**< Logs an INFO message */
-	 LOG_DEBUG_LVL   = 1, /**< Logs a DEBUG message */
+	 LOG_DEBUG_LVL   = 0, /**< Logs a DEBUG message */
+	 LOG_INFO_LVL    = 1, /**< Logs an INFO message */
 	 LOG_WARNING_LVL = 2, /**< Logs a WARNING message */
 	 LOG_ERROR_LVL   = 3, /**< Logs an ERROR message */
 	 LOG_FATAL_LVL   = 4, /**< Logs a FATAL message (non-recoverable error) */
@@ -47,6 +48,88 @@
 	 N_DEBUG_LEVELS  = 6  /**< Maximum number of log levels */
  };
 
+ /** Modules that log through the LOG_* macros. Each one has its own runtime level */
+ enum eLogModules {
+	 LOG_MODULE_APP  = 0, /**< Default for files that do not declare a module */
+	 LOG_MODULE_WIFI = 1, /**< Wi-Fi task and connection management */
+	 LOG_MODULE_HTTP = 2, /**< HTTP client and OTA download */
+	 LOG_MODULE_MQTT = 3, /**< MQTT client and topic handlers */
+	 N_LOG_MODULES   = 4  /**< Number of modules */
+ };
+
+/******************************************************************************
+ * Logging front end
+ ******************************************************************************/
+/*
+ * Usage: define LOG_MODULE before the includes of a .c file, then use LOG_DEBUG(...), LOG_INFO(...), etc.
+ * Use LOGM_DEBUG(module, ...) and friends to log on behalf of another module.
+ *
+ * A call is kept in the binary only if its level is at or above the compile-time floor of its module
+ * (LOG_COMPILE_LEVEL_<MODULE>, defaulting to LOG_COMPILE_LEVEL). Calls below the floor are removed by
+ * the compiler together with their arguments. The calls that are kept are filtered at runtime against
+ * the level of their module, see setLogModuleLevel and the "log" CLI command.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG_LVL ///< Default compile-time floor, keeps every call
+#endif
+#ifndef LOG_COMPILE_LEVEL_APP
+#define LOG_COMPILE_LEVEL_APP LOG_COMPILE_LEVEL
+#endif
+#ifndef LOG_COMPILE_LEVEL_WIFI
+#define LOG_COMPILE_LEVEL_WIFI LOG_COMPILE_LEVEL
+#endif
+#ifndef LOG_COMPILE_LEVEL_HTTP
+#define LOG_COMPILE_LEVEL_HTTP LOG_COMPILE_LEVEL
+#endif
+#ifndef LOG_COMPILE_LEVEL_MQTT
+#define LOG_COMPILE_LEVEL_MQTT LOG_COMPILE_LEVEL
+#endif
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_APP ///< Module of the current file
+#endif
+
+/// Compile-time floor of a module. Folds to a constant when module is a constant
+#define LOG_COMPILE_FLOOR(module)                                 \
+	 ((module) == LOG_MODULE_WIFI   ? LOG_COMPILE_LEVEL_WIFI      \
+	  : (module) == LOG_MODULE_HTTP ? LOG_COMPILE_LEVEL_HTTP      \
+	  : (module) == LOG_MODULE_MQTT ? LOG_COMPILE_LEVEL_MQTT      \
+	                                : LOG_COMPILE_LEVEL_APP)
+
+/// Logs on behalf of a module. Arguments are not evaluated unless the message is printed
+#define LOGM_MESSAGE(module, level, ...)                                                         \
+	 do {                                                                                         \
+		 if ((level) >= LOG_COMPILE_FLOOR(module) && (level) >= logModuleLevels[(module)]) {      \
+			 LogWrite((level), __VA_ARGS__);                                                      \
+		 }                                                                                        \
+	 } while (0)
+
+#define LOGM_INFO(module, ...) LOGM_MESSAGE(module, LOG_INFO_LVL, __VA_ARGS__)
+#define LOGM_DEBUG(module, ...) LOGM_MESSAGE(module, LOG_DEBUG_LVL, __VA_ARGS__)
+#define LOGM_WARNING(module, ...) LOGM_MESSAGE(module, LOG_WARNING_LVL, __VA_ARGS__)
+#define LOGM_ERROR(module, ...) LOGM_MESSAGE(module, LOG_ERROR_LVL, __VA_ARGS__)
+#define LOGM_FATAL(module, ...) LOGM_MESSAGE(module, LOG_FATAL_LVL, __VA_ARGS__)
+
+#define LOG_INFO(...) LOGM_INFO(LOG_MODULE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOGM_DEBUG(LOG_MODULE, __VA_ARGS__)
+#define LOG_WARNING(...) LOGM_WARNING(LOG_MODULE, __VA_ARGS__)
+#define LOG_ERROR(...) LOGM_ERROR(LOG_MODULE, __VA_ARGS__)
+#define LOG_FATAL(...) LOGM_FATAL(LOG_MODULE, __VA_ARGS__)
+
+extern volatile uint8_t logModuleLevels[N_LOG_MODULES]; ///< Runtime level of each module, see setLogModuleLevel
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Counters of the TX path, see SerialConsoleGetTxStats */
+struct SerialConsoleTxStats {
+	uint32_t bytesSent;    /**< Bytes written to the UART since boot */
+	uint32_t bytesDropped; /**< Bytes rejected because the TX ring buffer was full */
+	uint32_t bytesPending; /**< Bytes waiting in the TX ring buffer */
+	uint32_t bytesFree;    /**< Room left in the TX ring buffer */
+	bool dmaEnabled;       /**< True if the TX ring is drained by DMA */
+};
+
 /******************************************************************************
 * Global Function Declarations
 ******************************************************************************/
@@ -72,11 +155,22 @@ void DeinitializeSerialConsole(void);
  * @fn			void SerialConsoleWriteString(char * string)
  * @brief		Writes a string to be written to the uart. Copies the string to a ring buffer that 
  * 				is used to hold the text send to the uart
- * @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'
+ * @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'. The ring is
+ *				drained by DMA in contiguous spans. If the ring is full the rest of the string is dropped
+ *				and counted, see SerialConsoleGetTxStats
  * @note			Use to send a string of characters to the user via UART
  *****************************************************************************/
 void SerialConsoleWriteString(char * string);
 
+/**
+ * @fn			void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats)
+ * @brief		Copies the number of bytes sent, dropped and pending on the TX path
+ * @details		Bytes are dropped (never overwritten) when the writer outpaces the UART and the
+ *				TX ring buffer 'cbufTx' fills up
+ * @param[out]	stats Structure that receives the counters
+ *****************************************************************************/
+void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats);
+
 /**
  * @fn			int SerialConsoleReadCharacter(uint8_t *rxChar)
  * @brief		Reads a character from the RX ring buffer and stores it on the pointer given as an argument.
@@ -89,9 +183,22 @@ void SerialConsoleWriteString(char * string);
  *****************************************************************************/
 int SerialConsoleReadCharacter(uint8_t *rxChar);
 
+/**
+ * @fn			size_t SerialConsoleRead(uint8_t *buffer, size_t len)
+ * @brief		Reads up to len characters from the RX ring buffer in one go
+ * @details		xRxSemaphore is given when a character arrives in an empty RX buffer and at every end of line,
+ *				so a reader that blocks on it must drain the buffer (until this returns 0) before blocking again
+ * @param[out]	buffer Destination of the characters
+ * @param[in]	len Size of buffer
+ * @return		Number of characters read, 0 if the buffer is empty
+ *****************************************************************************/
+size_t SerialConsoleRead(uint8_t *buffer, size_t len);
+
 /**
  * @fn			LogMessage
  * @brief		Logs a message at the specified debug level.
+ * @details		Once the deferred log task runs (see DeferredLog.h) the message is not formatted here: the format
+ *				pointer and raw arguments are stored and formatted later by that task
  * @param   	level  Determines the log levels of the message to output. If the level is smaller than 
  * 					   the current “logLevel” it is not printed.
  * @param   	format Pointer to a array of characters to be printed.
@@ -102,10 +209,32 @@ int SerialConsoleReadCharacter(uint8_t *rxChar);
  *****************************************************************************/
 void LogMessage(enum eDebugLogLevels level, const char *format, ...);
 
+/**
+ * @fn			LogWrite
+ * @brief		Writes a log message without any level filtering. Used by the LOG_* macros, which filter first
+ * @param   	level  Level of the message (kept in deferred records)
+ * @param   	format printf format string
+ *****************************************************************************/
+void LogWrite(enum eDebugLogLevels level, const char *format, ...);
+
+/**
+ * @fn			int setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel)
+ * @brief		Sets the runtime level of one module. Messages of that module below the level are not printed
+ * @return		0 on success, -EINVAL if the module or level is out of range
+ *****************************************************************************/
+int setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel);
+
+/**
+ * @fn			const char *getLogModuleName(enum eLogModules module)
+ * @brief		Returns the name of a module as used by the "log" CLI command, NULL if out of range
+ *****************************************************************************/
+const char *getLogModuleName(enum eLogModules module);
+
 /**
  * @fn			eDebugLogLevels getLogLevel(void)
  * @brief		Sets the level of debug to print to the console to the given argument.
- *				Debug logs below the given level will not be allowed to be printed on the system
+ *				Debug logs below the given level will not be allowed to be printed on the system.
+ *				Also sets the runtime level of every module
  * @param[in]   debugLevel The debug level to be set for the debug logger
  * @note
  *****************************************************************************/
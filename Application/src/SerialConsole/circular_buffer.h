@@ -1,78 +1,83 @@
 /**************************************************************************//**
 * @file        circular_buffer library
 * @ingroup 	   Serial Console
-* @brief       This library for a circular buffer is taken from https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer/circular_buffer.c
-*				Author: Phillips Johnston
-* @details     Please refer to the github code above and to "https://embeddedartistry.com/blog/2017/4/6/circular-buffers-in-cc" for more information
-*
-*
+* @brief       Lock-free single-producer/single-consumer byte ring. The API follows the circular buffer from
+*				https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer/circular_buffer.c
+*				(Author: Phillips Johnston), reworked for the serial console.
+* @details     The storage size must be a power of two. head and tail are free-running counters that are
+*				masked on access, so no modulo and no separate "full" flag are needed: the buffer is full when
+*				head - tail == size. Exactly one context may put (it owns head) and exactly one context may get
+*				(it owns tail); e.g. a task and an ISR. No locking is needed between the two sides, but several
+*				producers (or several consumers) must serialize among themselves.
 *
 * @copyright
 * @author		Phillips Johnston
 * @date        Aug 6, 2018
-* @version		0.1
+* @version		0.2
 *****************************************************************************/
 
 
 #ifndef CIRCULAR_BUFFER_H_
 #define CIRCULAR_BUFFER_H_
 
-/// Opaque circular buffer structure
-typedef struct circular_buf_t circular_buf_t;
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/// Circular buffer structure. Allocate it statically and pass it to circular_buf_init
+typedef struct circular_buf_t {
+	uint8_t * buffer;     ///< Storage, owned by the caller
+	size_t mask;          ///< size - 1, size being a power of two
+	volatile size_t head; ///< Free-running write counter, only written by the producer
+	volatile size_t tail; ///< Free-running read counter, only written by the consumer
+} circular_buf_t;
 
 /// Handle type, the way users interact with the API
 typedef circular_buf_t* cbuf_handle_t;
 
-/// Pass in a storage buffer and size, returns a circular buffer handle
-/// Requires: buffer is not NULL, size > 0
-/// Ensures: cbuf has been created and is returned in an empty state
-cbuf_handle_t circular_buf_init(uint8_t* buffer, size_t size);
-
-/// Free a circular buffer structure
-/// Requires: cbuf is valid and created by circular_buf_init
-/// Does not free data buffer; owner is responsible for that
-void circular_buf_free(cbuf_handle_t cbuf);
+/// Attach a storage buffer to a statically allocated buffer structure
+/// Requires: cbuf and buffer are not NULL, size is a power of two
+/// Returns 0 on success, -1 if the arguments are invalid
+int circular_buf_init(cbuf_handle_t cbuf, uint8_t* buffer, size_t size);
 
 /// Reset the circular buffer to empty, head == tail. Data not cleared
-/// Requires: cbuf is valid and created by circular_buf_init
+/// Requires: neither the producer nor the consumer is using the buffer
 void circular_buf_reset(cbuf_handle_t cbuf);
 
-/// Put version 1 continues to add data if the buffer is full
-/// Old data is overwritten
-/// Requires: cbuf is valid and created by circular_buf_init
-void circular_buf_put(cbuf_handle_t cbuf, uint8_t data);
-
-/// Put Version 2 rejects new data if the buffer is full
-/// Requires: cbuf is valid and created by circular_buf_init
+/// Producer: add one byte, rejects new data if the buffer is full
 /// Returns 0 on success, -1 if buffer is full
-int circular_buf_put2(cbuf_handle_t cbuf, uint8_t data);
+int circular_buf_put(cbuf_handle_t cbuf, uint8_t data);
 
-/// Retrieve a value from the buffer
-/// Requires: cbuf is valid and created by circular_buf_init
+/// Producer: add up to len bytes, stops when the buffer is full
+/// Returns the number of bytes stored
+size_t circular_buf_put_n(cbuf_handle_t cbuf, const uint8_t * data, size_t len);
+
+/// Consumer: retrieve one byte
 /// Returns 0 on success, -1 if the buffer is empty
 int circular_buf_get(cbuf_handle_t cbuf, uint8_t * data);
 
-/// CHecks if the buffer is empty
-/// Requires: cbuf is valid and created by circular_buf_init
-/// Returns true if the buffer is empty
+/// Consumer: retrieve up to len bytes
+/// Returns the number of bytes copied to data
+size_t circular_buf_get_n(cbuf_handle_t cbuf, uint8_t * data, size_t len);
+
+/// Consumer: get the largest contiguous run of stored bytes starting at the tail, without removing it
+/// Returns the length of the run (0 if empty); *data points at its first byte
+size_t circular_buf_peek_span(cbuf_handle_t cbuf, uint8_t ** data);
+
+/// Consumer: drop len bytes from the tail, typically after a peeked span has been used
+/// Requires: len <= circular_buf_size(cbuf)
+void circular_buf_consume(cbuf_handle_t cbuf, size_t len);
+
+/// Checks if the buffer is empty
 bool circular_buf_empty(cbuf_handle_t cbuf);
 
 /// Checks if the buffer is full
-/// Requires: cbuf is valid and created by circular_buf_init
-/// Returns true if the buffer is full
 bool circular_buf_full(cbuf_handle_t cbuf);
 
-/// Check the capacity of the buffer
-/// Requires: cbuf is valid and created by circular_buf_init
 /// Returns the maximum capacity of the buffer
 size_t circular_buf_capacity(cbuf_handle_t cbuf);
 
-/// Check the number of elements stored in the buffer
-/// Requires: cbuf is valid and created by circular_buf_init
-/// Returns the current number of elements in the buffer
+/// Returns the current number of bytes stored in the buffer
 size_t circular_buf_size(cbuf_handle_t cbuf);
 
-//TODO: int circular_buf_get_range(circular_buf_t cbuf, uint8_t *data, size_t len);
-//TODO: int circular_buf_put_range(circular_buf_t cbuf, uint8_t * data, size_t len);
-
-#endif //CIRCULAR_BUFFER_H_
\ No newline at end of file
+#endif //CIRCULAR_BUFFER_H_
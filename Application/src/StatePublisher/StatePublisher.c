@@ -0,0 +1,104 @@
+/**************************************************************************/
+/**
+ * @file        StatePublisher.c
+ * @brief       Publish-on-change for device state topics, see StatePublisher.h
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "StatePublisher.h"
+
+#include "task.h"
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static bool StatePublisherPublish(struct StateTopic *topic, StatePublish publish, TickType_t now);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+void StatePublisherSet(struct StateTopic *topic, int32_t value)
+{
+	if (value == topic->value) {
+		return;
+	}
+	topic->value = value;
+	if (!topic->pending) {
+		topic->pending = true;
+		topic->changedAt = xTaskGetTickCount();
+	}
+}
+
+void StatePublisherInvalidate(struct StateTopic *topics, uint8_t count)
+{
+	TickType_t now = xTaskGetTickCount();
+
+	for (uint8_t i = 0; i < count; i++) {
+		topics[i].published = false;
+		topics[i].pending = true;
+		topics[i].changedAt = now - topics[i].coalesce;
+	}
+}
+
+TickType_t StatePublisherRun(struct StateTopic *topics, uint8_t count, StatePublish publish)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t next = portMAX_DELAY;
+
+	for (uint8_t i = 0; i < count; i++) {
+		struct StateTopic *topic = &topics[i];
+		TickType_t wait = portMAX_DELAY;
+
+		if (topic->pending && now - topic->changedAt >= topic->coalesce) {
+			if (topic->published && topic->value == topic->lastValue) {
+				// Changed and changed back within the window: the broker already has it
+				topic->pending = false;
+			} else if (StatePublisherPublish(topic, publish, now)) {
+				topic->pending = false;
+			}
+		} else if (!topic->pending && topic->published && topic->heartbeat != 0 && now - topic->publishedAt >= topic->heartbeat) {
+			StatePublisherPublish(topic, publish, now);
+		}
+
+		// A topic still due here failed to publish: try again a bit later
+		if (topic->pending) {
+			TickType_t elapsed = now - topic->changedAt;
+			wait = elapsed < topic->coalesce ? topic->coalesce - elapsed : pdMS_TO_TICKS(STATE_PUBLISHER_RETRY_MS);
+		} else if (topic->published && topic->heartbeat != 0) {
+			TickType_t age = now - topic->publishedAt;
+			wait = age < topic->heartbeat ? topic->heartbeat - age : pdMS_TO_TICKS(STATE_PUBLISHER_RETRY_MS);
+		}
+
+		if (wait < next) {
+			next = wait;
+		}
+	}
+	return next;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/**
+ * @fn			static bool StatePublisherPublish(struct StateTopic *topic, StatePublish publish, TickType_t now)
+ * @brief		Publishes the current value of a topic
+ * @return		false if the publication failed, true if it was sent or the value has no payload
+ *****************************************************************************/
+static bool StatePublisherPublish(struct StateTopic *topic, StatePublish publish, TickType_t now)
+{
+	const char *payload = topic->format(topic->value);
+
+	if (payload != NULL && publish(topic->topic, payload, topic->qos) != 0) {
+		return false;
+	}
+	topic->lastValue = topic->value;
+	topic->published = true;
+	topic->publishedAt = now;
+	return true;
+}
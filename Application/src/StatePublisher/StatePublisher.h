@@ -0,0 +1,89 @@
+/**************************************************************************/
+/**
+ * @file        StatePublisher.h
+ * @brief       Publish-on-change for device state topics
+ * @details     A state topic remembers the last value it published. StatePublisherSet records the current
+ *				value, which may be called as often as the state is sampled. StatePublisherRun publishes a topic
+ *				only when
+ *				--its value differs from the last published one and has been changing for coalesceMs (a burst
+ *				  of changes inside the window sends only the last value), or
+ *				--heartbeatMs (if not 0) passed since the last publication, to refresh late subscribers.
+ *				After a (re)connection StatePublisherInvalidate makes every topic publish its value once.
+ *
+ *				Not thread safe: the WiFi task owns the topics.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef STATE_PUBLISHER_H
+#define STATE_PUBLISHER_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define STATE_PUBLISHER_RETRY_MS 100   ///< Wait before a failed publication is tried again
+
+/// State topic initializer: topic, QoS, coalescing window and heartbeat in ms, payload of a value
+#define STATE_TOPIC(name, qos, coalesceMs, heartbeatMs, format)                                                                  \
+	{name, format, pdMS_TO_TICKS(coalesceMs), pdMS_TO_TICKS(heartbeatMs), qos, false, false, 0, 0, 0, 0}
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Returns the payload (a constant string) of a state value, NULL if the value is not published */
+typedef const char *(*StateFormat)(int32_t value);
+
+/** Publishes a payload, returns 0 on success. Provided by the caller of StatePublisherRun */
+typedef int (*StatePublish)(const char *topic, const char *payload, uint8_t qos);
+
+/** One state topic, use STATE_TOPIC. The fields after qos are private */
+struct StateTopic {
+	const char *topic;       ///< MQTT topic
+	StateFormat format;      ///< Payload of a value
+	TickType_t coalesce;     ///< Time a change waits for further changes before it is published
+	TickType_t heartbeat;    ///< Republish period of an unchanged value, 0 for none
+	uint8_t qos;             ///< QoS of the publications
+
+	bool pending;            ///< value changed (or was invalidated) since the last publication
+	bool published;          ///< lastValue holds a value the broker has
+	int32_t value;           ///< Current value
+	int32_t lastValue;       ///< Last published value
+	TickType_t changedAt;    ///< Start of the current burst of changes
+	TickType_t publishedAt;  ///< Time of the last publication
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			void StatePublisherSet(struct StateTopic *topic, int32_t value)
+ * @brief		Records the current value of a state topic
+ *****************************************************************************/
+void StatePublisherSet(struct StateTopic *topic, int32_t value);
+
+/**
+ * @fn			void StatePublisherInvalidate(struct StateTopic *topics, uint8_t count)
+ * @brief		Forgets what the broker has, so every topic publishes its value at the next run
+ * @note		Call when the MQTT connection is (re)established
+ *****************************************************************************/
+void StatePublisherInvalidate(struct StateTopic *topics, uint8_t count);
+
+/**
+ * @fn			TickType_t StatePublisherRun(struct StateTopic *topics, uint8_t count, StatePublish publish)
+ * @brief		Publishes the topics that are due
+ * @details		A topic whose publication fails stays due and is tried again at the next run
+ * @return		Ticks until a topic is due again, portMAX_DELAY if none is waiting
+ *****************************************************************************/
+TickType_t StatePublisherRun(struct StateTopic *topics, uint8_t count, StatePublish publish);
+
+#endif /* STATE_PUBLISHER_H */
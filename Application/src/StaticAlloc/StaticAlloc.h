@@ -0,0 +1,65 @@
+/**************************************************************************/
+/**
+ * @file        StaticAlloc.h
+ * @brief       Task and queue memory that is either static or taken from the heap, per build option
+ * @details     With configSUPPORT_STATIC_ALLOCATION set to 1 (FreeRTOSConfig.h), the stack and TCB of a task and
+ *				the storage of a queue are static variables placed in the section .bss.rtos.<subsystem>. The
+ *				linker map then lists the RAM of each subsystem, and nothing is allocated at boot.
+ *				With 0 the same macros fall back to xTaskCreate/xQueueCreate and reserve nothing.
+ *
+ *				Usage, at file scope:      STATIC_TASK_MEMORY(cli, CLI_TASK_SIZE);
+ *				                           STATIC_QUEUE_MEMORY(wifi, wifiState, 5, sizeof(uint32_t));
+ *				then in a function:        STATIC_TASK_CREATE(cli, vCommandConsoleTask, "CLI_TASK", CLI_TASK_SIZE, CLI_PRIORITY, &handle)
+ *				                           queue = STATIC_QUEUE_CREATE(wifiState, 5, sizeof(uint32_t));
+ *				The sizes given to the _MEMORY and _CREATE macros must match.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+
+/// Section of the static RTOS objects of a subsystem
+#define STATIC_ALLOC_SECTION(subsystem) __attribute__((section(".bss.rtos." #subsystem)))
+
+/// Stack and TCB of the task of a subsystem
+#define STATIC_TASK_MEMORY(subsystem, stackWords) \
+	static StackType_t subsystem##TaskStack[stackWords] STATIC_ALLOC_SECTION(subsystem); \
+	static StaticTask_t subsystem##TaskTcb STATIC_ALLOC_SECTION(subsystem)
+
+/// Creates the task of a subsystem in its static memory. Evaluates to pdPASS or pdFAIL like xTaskCreate
+#define STATIC_TASK_CREATE(subsystem, code, name, stackWords, priority, handle) \
+	(((*(handle) = xTaskCreateStatic((code), (name), (stackWords), NULL, (priority), subsystem##TaskStack, &subsystem##TaskTcb)) != NULL) ? pdPASS : pdFAIL)
+
+/// Storage and control block of a queue, placed in the section of its subsystem
+#define STATIC_QUEUE_MEMORY(subsystem, queue, length, itemSize) \
+	static uint8_t queue##QueueStorage[(length) * (itemSize)] STATIC_ALLOC_SECTION(subsystem); \
+	static StaticQueue_t queue##QueueBlock STATIC_ALLOC_SECTION(subsystem)
+
+/// Creates a queue in its static memory. Evaluates to the handle
+#define STATIC_QUEUE_CREATE(queue, length, itemSize) xQueueCreateStatic((length), (itemSize), queue##QueueStorage, &queue##QueueBlock)
+
+#else
+
+#define STATIC_TASK_MEMORY(subsystem, stackWords) extern int subsystem##TaskUnused
+#define STATIC_TASK_CREATE(subsystem, code, name, stackWords, priority, handle) xTaskCreate((code), (name), (stackWords), NULL, (priority), (handle))
+#define STATIC_QUEUE_MEMORY(subsystem, queue, length, itemSize) extern int queue##QueueUnused
+#define STATIC_QUEUE_CREATE(queue, length, itemSize) xQueueCreate((length), (itemSize))
+
+#endif
+
+#endif /* STATIC_ALLOC_H */
@@ -0,0 +1,68 @@
+/**************************************************************************/
+/**
+ * @file        FatFsSync.c
+ * @brief       FreeRTOS locking for FatFs (_FS_REENTRANT, see conf_fatfs.h)
+ * @details     FatFs calls these functions to lock a volume around every file system call. Each volume gets
+ *				one mutex, created on the first f_mount and kept for the life of the program, so a remount reuses
+ *				it. Heap/Heap.c could free it on unmount, but a task still blocked in ff_req_grant (a file call
+ *				racing the card removal) would then wait on a deleted mutex, and every card swap would take and
+ *				return a heap block for nothing.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "asf.h"
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static SemaphoreHandle_t volumeMutex[_VOLUMES]; ///< One mutex per logical drive
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+/**
+ * @brief	Creates (or reuses) the mutex of a volume. Called by f_mount
+ * @return	1 on success, 0 if the mutex cannot be created
+ */
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+{
+	if (volumeMutex[vol] == NULL) {
+		volumeMutex[vol] = xSemaphoreCreateMutex();
+	}
+	*sobj = volumeMutex[vol];
+
+	return (*sobj != NULL) ? 1 : 0;
+}
+
+/**
+ * @brief	Called by f_mount when a volume is unregistered. The mutex is kept for the next mount
+ * @return	1
+ */
+int ff_del_syncobj(_SYNC_t sobj)
+{
+	(void)sobj;
+	return 1;
+}
+
+/**
+ * @brief	Locks a volume before a file system call
+ * @return	1 if the lock was taken, 0 on timeout (the call then fails with FR_TIMEOUT)
+ */
+int ff_req_grant(_SYNC_t sobj)
+{
+	return (xSemaphoreTake(sobj, _FS_TIMEOUT) == pdTRUE) ? 1 : 0;
+}
+
+/**
+ * @brief	Unlocks a volume after a file system call
+ */
+void ff_rel_grant(_SYNC_t sobj)
+{
+	xSemaphoreGive(sobj);
+}
@@ -0,0 +1,190 @@
+/**************************************************************************/
+/**
+ * @file        SdWriter.c
+ * @brief       Double-buffered sequential writer for a file on the SD card, see SdWriter.h
+ * @details     The two buffers circulate between two queues: freeQueue holds the ones the producer may fill,
+ *				writeQueue the full ones waiting for vSdWriterTask. The producer keeps at most one buffer
+ *				(fillBlock) between calls.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <errno.h>
+#include <string.h>
+
+#include "SdWriter.h"
+#include "StaticAlloc/StaticAlloc.h"
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** A buffer handed between the producer and the writer task */
+struct SdWriterBlock {
+	uint8_t *data;   /**< One of writerBuffers */
+	uint16_t length; /**< Bytes to write */
+};
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t writerBuffers[2][SD_WRITER_BUFFER_SIZE];
+STATIC_QUEUE_MEMORY(sdWriter, sdWriterFree, 2, sizeof(struct SdWriterBlock));
+STATIC_QUEUE_MEMORY(sdWriter, sdWriterWrite, 2, sizeof(struct SdWriterBlock));
+static QueueHandle_t freeQueue = NULL;   ///< Buffers the producer may fill
+static QueueHandle_t writeQueue = NULL;  ///< Full buffers for the writer task
+
+static FIL *writerFile = NULL;           ///< Attached file, NULL when stopped
+static volatile int writerError = 0;     ///< First write error since SdWriterStart, sticky
+static struct SdWriterBlock fillBlock;   ///< Buffer being filled, valid while holdingBlock is true
+static bool holdingBlock = false;
+static uint16_t fillTarget;              ///< Length at which fillBlock is handed over
+static struct SdWriterStats writerStats;
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void SdWriterSubmit(void);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+int SdWriterStart(FIL *file)
+{
+	if (freeQueue == NULL) {
+		return -EAGAIN;
+	}
+	if (writerFile != NULL) {
+		return -EBUSY;
+	}
+
+	writerFile = file;
+	writerError = 0;
+	memset(&writerStats, 0, sizeof(writerStats));
+	// Cut the first buffer so the following ones start on a sector of the file
+	fillTarget = SD_WRITER_BUFFER_SIZE - (f_tell(file) % SD_WRITER_SECTOR_SIZE);
+	return 0;
+}
+
+int SdWriterWrite(const void *data, size_t length)
+{
+	const uint8_t *bytes = data;
+
+	if (writerFile == NULL) {
+		return -EINVAL;
+	}
+
+	while (length > 0 && writerError == 0) {
+		if (!holdingBlock) {
+			TickType_t start = xTaskGetTickCount();
+			xQueueReceive(freeQueue, &fillBlock, portMAX_DELAY);
+			writerStats.waitMs += (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+			fillBlock.length = 0;
+			holdingBlock = true;
+		}
+
+		size_t chunk = fillTarget - fillBlock.length;
+		if (chunk > length) {
+			chunk = length;
+		}
+		memcpy(&fillBlock.data[fillBlock.length], bytes, chunk);
+		fillBlock.length += chunk;
+		bytes += chunk;
+		length -= chunk;
+
+		if (fillBlock.length == fillTarget) {
+			SdWriterSubmit();
+			fillTarget = SD_WRITER_BUFFER_SIZE;
+		}
+	}
+	return writerError;
+}
+
+int SdWriterFlush(void)
+{
+	struct SdWriterBlock blocks[2];
+
+	if (writerFile == NULL) {
+		return -EINVAL;
+	}
+
+	if (holdingBlock && fillBlock.length > 0) {
+		SdWriterSubmit();
+	} else if (holdingBlock) {
+		xQueueSend(freeQueue, &fillBlock, 0);
+		holdingBlock = false;
+	}
+
+	// Both buffers back in the free queue: every write is done
+	xQueueReceive(freeQueue, &blocks[0], portMAX_DELAY);
+	xQueueReceive(freeQueue, &blocks[1], portMAX_DELAY);
+	xQueueSend(freeQueue, &blocks[0], 0);
+	xQueueSend(freeQueue, &blocks[1], 0);
+
+	// A short write leaves the file off a sector boundary, realign the next buffer
+	fillTarget = SD_WRITER_BUFFER_SIZE - (f_tell(writerFile) % SD_WRITER_SECTOR_SIZE);
+	return writerError;
+}
+
+int SdWriterStop(void)
+{
+	if (writerFile == NULL) {
+		return 0;
+	}
+
+	int rc = SdWriterFlush();
+	writerFile = NULL;
+	return rc;
+}
+
+void SdWriterGetStats(struct SdWriterStats *stats)
+{
+	*stats = writerStats;
+}
+
+void vSdWriterTask(void *pvParameters)
+{
+	struct SdWriterBlock block;
+	(void)pvParameters;
+
+	writeQueue = STATIC_QUEUE_CREATE(sdWriterWrite, 2, sizeof(struct SdWriterBlock));
+	QueueHandle_t queue = STATIC_QUEUE_CREATE(sdWriterFree, 2, sizeof(struct SdWriterBlock));
+	for (uint8_t i = 0; i < 2; i++) {
+		block.data = writerBuffers[i];
+		block.length = 0;
+		xQueueSend(queue, &block, 0);
+	}
+	freeQueue = queue; // From here on SdWriterStart accepts files
+
+	for (;;) {
+		xQueueReceive(writeQueue, &block, portMAX_DELAY);
+		// After an error the data is dropped, the producer gets the error from its next call
+		if (writerError == 0) {
+			UINT written = 0;
+			TickType_t start = xTaskGetTickCount();
+			if (f_write(writerFile, block.data, block.length, &written) != FR_OK || written != block.length) {
+				writerError = -EIO;
+			}
+			writerStats.writeMs += (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+			writerStats.bytesWritten += written;
+			writerStats.writes++;
+		}
+		xQueueSend(freeQueue, &block, portMAX_DELAY);
+	}
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/**
+ * @brief	Hands fillBlock to the writer task
+ */
+static void SdWriterSubmit(void)
+{
+	xQueueSend(writeQueue, &fillBlock, portMAX_DELAY);
+	holdingBlock = false;
+}
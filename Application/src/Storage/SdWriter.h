@@ -0,0 +1,94 @@
+/**************************************************************************/
+/**
+ * @file        SdWriter.h
+ * @brief       Double-buffered sequential writer for a file on the SD card
+ * @details     The producer (the WiFi task, from the HTTP receive callback) copies data into one of two
+ *				SD_WRITER_BUFFER_SIZE buffers. A full buffer goes to vSdWriterTask, which f_writes it while the
+ *				producer fills the other one. The producer only waits when both buffers are still being written.
+ *
+ *				The first buffer is cut short so that it ends on a 512-byte boundary of the file: every later
+ *				f_write starts on a sector and covers whole sectors, which FatFs writes straight to the card
+ *				without reading the sector first.
+ *
+ *				Only one file at a time. The file must not be used by anybody else between SdWriterStart and
+ *				SdWriterStop; after SdWriterFlush it may be synced or sought.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+#include "asf.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define SD_WRITER_SECTOR_SIZE 512                       ///< FatFs sector size
+#define SD_WRITER_BUFFER_SIZE (2 * SD_WRITER_SECTOR_SIZE) ///< Size of each of the two buffers, a multiple of the sector size
+#define SD_WRITER_TASK_SIZE 256                         ///< Stack of the writer task, in words
+#define SD_WRITER_PRIORITY (tskIDLE_PRIORITY + 2)       ///< Below the WiFi task, so the network is served first
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Counters of the writer since the last SdWriterStart, see SdWriterGetStats */
+struct SdWriterStats {
+	uint32_t bytesWritten; /**< Bytes written to the file */
+	uint32_t writes;       /**< f_write calls */
+	uint32_t writeMs;      /**< Time spent in f_write */
+	uint32_t waitMs;       /**< Time the producer waited for a free buffer */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			int SdWriterStart(FIL *file)
+ * @brief		Attaches an open file; data is written from its current position on
+ * @return		0 on success, -EBUSY if a file is attached already, -EAGAIN if the writer task does not run yet
+ *****************************************************************************/
+int SdWriterStart(FIL *file);
+
+/**
+ * @fn			int SdWriterWrite(const void *data, size_t length)
+ * @brief		Copies data into the buffers, handing every full buffer to the writer task
+ * @return		0 on success, -EIO if a write to the file failed (then or earlier), -EINVAL if no file is attached
+ * @note		Blocks while both buffers are being written
+ *****************************************************************************/
+int SdWriterWrite(const void *data, size_t length);
+
+/**
+ * @fn			int SdWriterFlush(void)
+ * @brief		Writes the buffered data and waits until every write is done
+ * @return		0 on success, -EIO if a write failed, -EINVAL if no file is attached
+ *****************************************************************************/
+int SdWriterFlush(void);
+
+/**
+ * @fn			int SdWriterStop(void)
+ * @brief		Flushes and detaches the file. The file stays open
+ * @return		The result of the flush, 0 if no file was attached
+ *****************************************************************************/
+int SdWriterStop(void);
+
+/**
+ * @fn			void SdWriterGetStats(struct SdWriterStats *stats)
+ * @brief		Copies the counters of the current (or last) file
+ *****************************************************************************/
+void SdWriterGetStats(struct SdWriterStats *stats);
+
+/**
+ * @fn			void vSdWriterTask(void *pvParameters)
+ * @brief		Writer task: writes the full buffers to the attached file and hands them back
+ *****************************************************************************/
+void vSdWriterTask(void *pvParameters);
+
+#endif /* SD_WRITER_H */
@@ -0,0 +1,102 @@
+/**************************************************************************/
+/**
+ * @file        ImuTelemetry.c
+ * @brief       Compact binary encoding of IMU sample batches, see ImuTelemetry.h
+ * @details     The header is written with a count of 0 and patched by ImuTelemetryEnd. Samples are only appended
+ *				when their worst case fits, so the stream writer never has to flush.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include "ImuTelemetry.h"
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int ImuTelemetryFull(void *module, char *buffer, size_t buffer_len);
+static void ImuTelemetryVarint(struct stream_writer *writer, uint32_t value);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+void ImuTelemetryBegin(struct ImuTelemetryBatch *batch, char *buffer, size_t size)
+{
+	stream_writer_init(&batch->writer, buffer, size, ImuTelemetryFull, batch);
+	batch->count = 0;
+}
+
+bool ImuTelemetryAdd(struct ImuTelemetryBatch *batch, int16_t x, int16_t y, int16_t z, uint32_t timeMs)
+{
+	struct stream_writer *writer = &batch->writer;
+
+	if (batch->count == 0) {
+		if (writer->max_size < IMU_TELEMETRY_HEADER_SIZE + IMU_TELEMETRY_FIRST_SAMPLE_SIZE) {
+			return false;
+		}
+		stream_writer_send_8(writer, IMU_TELEMETRY_FORMAT);
+		stream_writer_send_8(writer, 0);
+		stream_writer_send_32LE(writer, (int32_t)timeMs);
+		stream_writer_send_16LE(writer, x);
+		stream_writer_send_16LE(writer, y);
+		stream_writer_send_16LE(writer, z);
+		batch->firstMs = timeMs;
+	} else {
+		if (batch->count == UINT8_MAX || writer->max_size - writer->written < IMU_TELEMETRY_MAX_SAMPLE_SIZE ||
+		    timeMs - batch->lastMs > IMU_TELEMETRY_MAX_STEP_MS) {
+			return false;
+		}
+		ImuTelemetryVarint(writer, timeMs - batch->lastMs);
+		ImuTelemetryVarint(writer, ((uint32_t)(x - batch->last[0]) << 1) ^ (uint32_t)((x - batch->last[0]) >> 31));
+		ImuTelemetryVarint(writer, ((uint32_t)(y - batch->last[1]) << 1) ^ (uint32_t)((y - batch->last[1]) >> 31));
+		ImuTelemetryVarint(writer, ((uint32_t)(z - batch->last[2]) << 1) ^ (uint32_t)((z - batch->last[2]) >> 31));
+	}
+
+	batch->count++;
+	batch->lastMs = timeMs;
+	batch->last[0] = x;
+	batch->last[1] = y;
+	batch->last[2] = z;
+	return true;
+}
+
+size_t ImuTelemetryEnd(struct ImuTelemetryBatch *batch)
+{
+	if (batch->count == 0) {
+		return 0;
+	}
+	batch->writer.buffer[1] = (char)batch->count;
+	return batch->writer.written;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/**
+ * @fn			static int ImuTelemetryFull(void *module, char *buffer, size_t buffer_len)
+ * @brief		Stream writer flush callback. Never called: ImuTelemetryAdd checks the room first
+ *****************************************************************************/
+static int ImuTelemetryFull(void *module, char *buffer, size_t buffer_len)
+{
+	(void)module;
+	(void)buffer;
+	(void)buffer_len;
+	return 0;
+}
+
+/**
+ * @fn			static void ImuTelemetryVarint(struct stream_writer *writer, uint32_t value)
+ * @brief		Writes value as an unsigned LEB128 varint
+ *****************************************************************************/
+static void ImuTelemetryVarint(struct stream_writer *writer, uint32_t value)
+{
+	while (value >= 0x80) {
+		stream_writer_send_8(writer, (int8_t)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	stream_writer_send_8(writer, (int8_t)value);
+}
@@ -0,0 +1,85 @@
+/**************************************************************************/
+/**
+ * @file        ImuTelemetry.h
+ * @brief       Compact binary encoding of IMU sample batches for MQTT
+ * @details     Several samples are packed into one payload with the stream writer (iot/stream_writer.h).
+ *				Payload layout, all multi-byte fixed fields little endian:
+ *				--u8  format, IMU_TELEMETRY_FORMAT
+ *				--u8  number of samples N (at least 1)
+ *				--u32 time of the first sample, in ms since boot
+ *				--first sample: s16 x, s16 y, s16 z (milli-g)
+ *				--each of the N - 1 following samples:
+ *				  varint  ms since the previous sample
+ *				  zvarint x, y, z minus those of the previous sample
+ *
+ *				varint: unsigned LEB128, 7 bits per byte, least significant group first, bit 7 set on every byte
+ *				except the last. zvarint: the signed value v zigzag-mapped to (v << 1) ^ (v >> 31), then as varint.
+ *				A slowly moving sensor takes about 4 bytes per sample instead of about 40 for the JSON text.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef IMU_TELEMETRY_H
+#define IMU_TELEMETRY_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iot/stream_writer.h"
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define IMU_TELEMETRY_FORMAT 1              ///< First byte of the payload, bumped when the layout changes
+#define IMU_TELEMETRY_HEADER_SIZE 6         ///< format, count and time
+#define IMU_TELEMETRY_FIRST_SAMPLE_SIZE 6   ///< Three s16
+#define IMU_TELEMETRY_MAX_SAMPLE_SIZE 12    ///< Worst case of a following sample: 3-byte time step, three 3-byte deltas
+#define IMU_TELEMETRY_MAX_STEP_MS 0x1FFFFF  ///< Largest time step that fits in 3 varint bytes
+
+/// Largest payload of a batch of n samples
+#define IMU_TELEMETRY_SIZE(n) (IMU_TELEMETRY_HEADER_SIZE + IMU_TELEMETRY_FIRST_SAMPLE_SIZE + ((n) - 1) * IMU_TELEMETRY_MAX_SAMPLE_SIZE)
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** Batch being encoded. Owned by one task */
+struct ImuTelemetryBatch {
+	struct stream_writer writer;   ///< Writes into the caller's buffer
+	uint8_t count;                 ///< Samples in the batch
+	uint32_t firstMs;              ///< Time of the first sample
+	uint32_t lastMs;               ///< Time of the previous sample
+	int16_t last[3];               ///< Previous sample
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			void ImuTelemetryBegin(struct ImuTelemetryBatch *batch, char *buffer, size_t size)
+ * @brief		Starts an empty batch encoded into buffer
+ * @param[in]	size Size of buffer, IMU_TELEMETRY_SIZE(samples) to be sure the samples fit
+ *****************************************************************************/
+void ImuTelemetryBegin(struct ImuTelemetryBatch *batch, char *buffer, size_t size);
+
+/**
+ * @fn			bool ImuTelemetryAdd(struct ImuTelemetryBatch *batch, int16_t x, int16_t y, int16_t z, uint32_t timeMs)
+ * @brief		Appends a sample taken at timeMs (ms since boot) to the batch
+ * @return		false if the sample could not be added: the buffer may be too small for it, or it comes more than
+ *				IMU_TELEMETRY_MAX_STEP_MS after the previous one. End the batch and start a new one
+ *****************************************************************************/
+bool ImuTelemetryAdd(struct ImuTelemetryBatch *batch, int16_t x, int16_t y, int16_t z, uint32_t timeMs);
+
+/**
+ * @fn			size_t ImuTelemetryEnd(struct ImuTelemetryBatch *batch)
+ * @brief		Completes the header of the batch
+ * @return		Length of the payload in the buffer, 0 if the batch holds no sample
+ *****************************************************************************/
+size_t ImuTelemetryEnd(struct ImuTelemetryBatch *batch);
+
+#endif /* IMU_TELEMETRY_H */
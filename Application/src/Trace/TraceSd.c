@@ -0,0 +1,154 @@
+/**************************************************************************/
+/**
+ * @file        TraceSd.c
+ * @brief       Streams the Percepio (Tracealyzer) trace to a file on the SD card, see TraceSd.h
+ * @details     TraceSdWrite runs in the TzCtrl task; TraceSdStart and TraceSdStop run in the caller's task (the
+ *				CLI). traceFileMutex keeps them from using the file at the same time.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <errno.h>
+
+#include "TraceSd.h"
+#include "asf.h"
+#include "trcRecorder.h"
+
+/******************************************************************************
+ * Variables
+ ******************************************************************************/
+static FIL traceFile;                            ///< The trace file, valid while traceFileOpen is true
+static bool traceFileOpen = false;               ///< traceFile is open
+static volatile bool traceFileFull = false;      ///< The last capture filled the file
+static volatile uint32_t traceBytesWritten = 0;  ///< Bytes written to the file by the current capture
+static SemaphoreHandle_t traceFileMutex = NULL;  ///< Protects traceFile
+static int traceCloseResult = -EINVAL;           ///< TraceSdStop result once TraceSdWrite closed the file itself
+
+/******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int trace_file_close(void);
+
+/******************************************************************************
+ * Global Functions
+ ******************************************************************************/
+int TraceSdStart(void)
+{
+	if (traceFileMutex == NULL) {
+		traceFileMutex = xSemaphoreCreateMutex();
+		if (traceFileMutex == NULL) {
+			return -ENOMEM;
+		}
+	}
+
+	xSemaphoreTake(traceFileMutex, portMAX_DELAY);
+	if (traceFileOpen) {
+		xSemaphoreGive(traceFileMutex);
+		return -EBUSY;
+	}
+
+	if (f_open(&traceFile, TRACE_SD_FILE_NAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+		xSemaphoreGive(traceFileMutex);
+		return -EIO;
+	}
+
+	// Seeking past the end allocates the clusters; the file pointer stops early if the card is full
+	if (f_lseek(&traceFile, TRACE_SD_FILE_SIZE) != FR_OK || f_tell(&traceFile) != TRACE_SD_FILE_SIZE || f_lseek(&traceFile, 0) != FR_OK) {
+		f_close(&traceFile);
+		f_unlink(TRACE_SD_FILE_NAME);
+		xSemaphoreGive(traceFileMutex);
+		return -ENOSPC;
+	}
+
+	traceFileOpen = true;
+	traceFileFull = false;
+	traceBytesWritten = 0;
+	traceCloseResult = -EINVAL;
+	xSemaphoreGive(traceFileMutex);
+
+	vTraceEnable(TRC_START);
+	return 0;
+}
+
+int TraceSdStop(void)
+{
+	if (traceFileMutex == NULL) {
+		return -EINVAL;
+	}
+
+	vTraceStop();
+	// TzCtrl transfers the full pages left in the buffer on its next runs; the page in use is lost
+	vTaskDelay(pdMS_TO_TICKS(TRACE_SD_FLUSH_MS));
+
+	xSemaphoreTake(traceFileMutex, portMAX_DELAY);
+	int res = traceCloseResult;
+	if (traceFileOpen) {
+		res = trace_file_close();
+	}
+	traceCloseResult = -EINVAL;
+	xSemaphoreGive(traceFileMutex);
+
+	return res;
+}
+
+void TraceSdGetStatus(struct TraceSdStatus *status)
+{
+	status->running = (xTraceIsRecordingEnabled() != 0);
+	status->fileFull = traceFileFull;
+	status->bytesWritten = traceBytesWritten;
+}
+
+/**
+ * @brief	Stream port write function, called by TzCtrl with one page of trace data
+ * @return	0 on success. Non-zero stops the recorder
+ */
+int32_t TraceSdWrite(void *data, uint32_t size, int32_t *ptrBytesWritten)
+{
+	UINT written = 0;
+	int32_t result = 0;
+
+	*ptrBytesWritten = 0;
+	if (traceFileMutex == NULL) {
+		return -1;
+	}
+
+	xSemaphoreTake(traceFileMutex, portMAX_DELAY);
+	if (!traceFileOpen) {
+		// Pages left over after TraceSdStop closed the file: drop them
+		*ptrBytesWritten = (int32_t)size;
+	} else if (traceBytesWritten + size > TRACE_SD_FILE_SIZE) {
+		// The recorder stops: close the file now, so the capture is on the card and the next one can start
+		traceFileFull = true;
+		traceCloseResult = trace_file_close();
+		result = -1;
+	} else if (f_write(&traceFile, data, size, &written) != FR_OK || written != size) {
+		trace_file_close();
+		traceCloseResult = -EIO;
+		result = -1;
+	} else {
+		traceBytesWritten += written;
+		*ptrBytesWritten = (int32_t)written;
+	}
+	xSemaphoreGive(traceFileMutex);
+
+	return result;
+}
+
+/******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+// Gives back the pre-allocated space that was not used and closes the file. Called with traceFileMutex held
+static int trace_file_close(void)
+{
+	FRESULT res = f_truncate(&traceFile);
+	if (f_close(&traceFile) != FR_OK) {
+		res = FR_DISK_ERR;
+	}
+	traceFileOpen = false;
+	return (res == FR_OK) ? 0 : -EIO;
+}
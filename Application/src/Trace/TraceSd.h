@@ -0,0 +1,70 @@
+/**************************************************************************/
+/**
+ * @file        TraceSd.h
+ * @brief       Streams the Percepio (Tracealyzer) trace to a file on the SD card
+ * @details     The recorder runs in streaming mode. Events are kept in the recorder's paged buffer (bounded RAM,
+ *				see trcStreamingConfig.h) and the TzCtrl task writes the full pages to TRACE_SD_FILE_NAME.
+ *				The file is pre-allocated to TRACE_SD_FILE_SIZE when the capture starts, so the writes do not have
+ *				to allocate clusters. The capture stops by itself when the file is full, and the file is closed.
+ *				The card must have been mounted (init_storage() in the WiFi task) before starting a capture.
+ *				Open the file in Tracealyzer with File > Open > Open File.
+ *
+ * @copyright
+ * @author
+ * @version		0.1
+ *****************************************************************************/
+
+#ifndef TRACE_SD_H
+#define TRACE_SD_H
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Defines
+ ******************************************************************************/
+#define TRACE_SD_FILE_NAME "0:trace.psf"          ///< Trace file on the SD card
+#define TRACE_SD_FILE_SIZE (2UL * 1024 * 1024)   ///< Pre-allocated size, a few minutes of trace
+#define TRACE_SD_FLUSH_MS 50                     ///< Time given to TzCtrl to write the last full pages on stop
+
+/******************************************************************************
+ * Structures
+ ******************************************************************************/
+/** State of the capture, see TraceSdGetStatus */
+struct TraceSdStatus {
+	bool running;          /**< The recorder is capturing */
+	bool fileFull;         /**< The capture stopped because the file is full */
+	uint32_t bytesWritten; /**< Bytes written to the file by the current or last capture */
+};
+
+/******************************************************************************
+ * Global Function Declarations
+ ******************************************************************************/
+/**
+ * @fn			int TraceSdStart(void)
+ * @brief		Creates and pre-allocates the trace file, then starts the recorder
+ * @return		0 on success, -EBUSY if a capture is running, -EIO if the file cannot be created (card not
+ *				mounted?), -ENOSPC if the card has no room for TRACE_SD_FILE_SIZE
+ * @note		Blocks while the file is allocated. Call from a task
+ *****************************************************************************/
+int TraceSdStart(void);
+
+/**
+ * @fn			int TraceSdStop(void)
+ * @brief		Stops the recorder, writes what is left and closes the file at the size actually written
+ * @return		0 on success, -EINVAL if no capture was started, -EIO if the file cannot be closed or a write
+ *				failed
+ * @note		Call from a task. A capture that filled the file (or failed to write) has closed it already
+ *****************************************************************************/
+int TraceSdStop(void);
+
+/**
+ * @fn			void TraceSdGetStatus(struct TraceSdStatus *status)
+ * @brief		Copies the state of the capture
+ *****************************************************************************/
+void TraceSdGetStatus(struct TraceSdStatus *status);
+
+#endif /* TRACE_SD_H */
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * Trace Recorder Library for Tracealyzer v4.3.7
+ * trcStreamingPort.h
+ *
+ * Stream port writing the trace to a file on the SD card (see TraceSd.h).
+ *
+ * Writing to the card goes through FatFs and the SD/MMC driver, which take
+ * mutexes and so create trace events themselves. The paged event buffer must
+ * therefore be used: events are stored in RAM pages and the TzCtrl task writes
+ * the full pages to the file. The RAM used is fixed by
+ * TRC_CFG_PAGED_EVENT_BUFFER_PAGE_COUNT x TRC_CFG_PAGED_EVENT_BUFFER_PAGE_SIZE
+ * (trcStreamingConfig.h). When all pages are full, new events are dropped.
+ ******************************************************************************/
+
+#ifndef TRC_STREAMING_PORT_H
+#define TRC_STREAMING_PORT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int32_t TraceSdWrite(void* data, uint32_t size, int32_t* ptrBytesWritten);
+
+#define TRC_STREAM_PORT_USE_INTERNAL_BUFFER 1
+
+#define TRC_STREAM_PORT_READ_DATA(_ptrData, _size, _ptrBytesRead) 0 /* No commands from Tracealyzer, use the "trace" CLI command */
+
+#define TRC_STREAM_PORT_WRITE_DATA(_ptrData, _size, _ptrBytesSent) TraceSdWrite(_ptrData, _size, _ptrBytesSent)
+
+#define TRC_STREAM_PORT_MALLOC() /* Static allocation, see TRC_CFG_RECORDER_BUFFER_ALLOCATION */
+
+#define TRC_STREAM_PORT_INIT() TRC_STREAM_PORT_MALLOC()
+
+/* The file is opened and closed by TraceSdStart/TraceSdStop, not in the
+   recorder's critical sections */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRC_STREAMING_PORT_H */
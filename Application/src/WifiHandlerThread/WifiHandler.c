@@ -9,28 +9,59 @@
 /******************************************************************************
  * Includes
  ******************************************************************************/
+#define LOG_MODULE LOG_MODULE_WIFI
 
 #include "WifiHandlerThread/WifiHandler.h"
 #include "Motor.h"
+#include "MemPool/MemPool.h"
+#include "MqttCommand/MqttCommand.h"
+#include "OtaImage/OtaImage.h"
+#include "StatePublisher/StatePublisher.h"
+#include "StaticAlloc/StaticAlloc.h"
+#include "Storage/SdWriter.h"
 //#include "LED/LED.h"
 #include <errno.h>
 
 /******************************************************************************
  * Defines
  ******************************************************************************/
+#define WIFI_MQTT_STATE_CONTEXT ((void *)(uintptr_t)(WIFI_MQTT_CLASSES + 1))   ///< mqtt_publish_async context of the state topics
 
 /******************************************************************************
  * Variables
  ******************************************************************************/
-volatile char mqtt_msg[64] = "{\"d\":{\"temp\":17}}\"";
-volatile char mqtt_msg_temp[64] = "{\"d\":{\"temp\":17}}\"";
-
 volatile uint32_t temperature = 1;
 int8_t wifiStateMachine = WIFI_MQTT_INIT;   ///< Global variable that determines the state of the WIFI handler.
 QueueHandle_t xQueueWifiState = NULL;       ///< Queue to determine the Wifi state from other threads.
-QueueHandle_t xQueueGameBuffer = NULL;      ///< Queue to send the next play to the cloud
-QueueHandle_t xQueueImuBuffer = NULL;       ///< Queue to send IMU data to the cloud
-QueueHandle_t xQueueDistanceBuffer = NULL;  ///< Queue to send the distance to the cloud
+static QueueHandle_t mqttOutQueues[WIFI_MQTT_CLASSES];  ///< Pointers to the MQTT messages to publish (struct MqttOutMessage), per class
+static struct WifiMqttClassStats mqttClassStats[WIFI_MQTT_CLASSES];
+static bool mqttWindowFull = false;  ///< Every in-flight slot awaits an acknowledgement, the queues wait for mqtt_yield
+static struct MqttOutMessage *mqttHeldMessage = NULL;  ///< Taken from its queue, waits for a free in-flight slot. Owned by the WiFi task
+static TaskHandle_t wifiTask = NULL;        ///< The WiFi task, woken by task notifications (WIFI_NOTIFY_*)
+
+/// What happens to a message sent to a full class queue
+enum eMqttClassPolicy {
+    MQTT_POLICY_BLOCK,            ///< Wait up to blockTicks for room, then drop the new message
+    MQTT_POLICY_DROP_OLDEST,      ///< Drop the oldest pending message to make room
+    MQTT_POLICY_DROP_NEWEST,      ///< Drop the new message
+    MQTT_POLICY_COALESCE_LATEST,  ///< The new message replaces the pending one of the same topic
+};
+
+/// Policy of each outbound MQTT priority class
+static const struct {
+    uint8_t policy;
+    TickType_t blockTicks;
+} mqttClassConfig[WIFI_MQTT_CLASSES] = {
+    [WIFI_MQTT_CLASS_CONTROL] = {MQTT_POLICY_BLOCK, pdMS_TO_TICKS(WIFI_MQTT_CONTROL_BLOCK_MS)},
+    [WIFI_MQTT_CLASS_EVENT] = {MQTT_POLICY_COALESCE_LATEST, 0},
+    [WIFI_MQTT_CLASS_TELEMETRY] = {MQTT_POLICY_DROP_OLDEST, 0},
+};
+
+// Queue memory, static when configSUPPORT_STATIC_ALLOCATION is 1 (see StaticAlloc.h)
+STATIC_QUEUE_MEMORY(wifi, wifiState, WIFI_STATE_QUEUE_LEN, sizeof(uint32_t));
+STATIC_QUEUE_MEMORY(wifi, mqttControl, WIFI_MQTT_CONTROL_QUEUE_LEN, sizeof(struct MqttOutMessage *));
+STATIC_QUEUE_MEMORY(wifi, mqttEvent, WIFI_MQTT_EVENT_QUEUE_LEN, sizeof(struct MqttOutMessage *));
+STATIC_QUEUE_MEMORY(wifi, mqttTelemetry, WIFI_MQTT_TELEMETRY_QUEUE_LEN, sizeof(struct MqttOutMessage *));
 
 /*HTTP DOWNLOAD RELATED DEFINES AND VARIABLES*/
 
@@ -45,8 +76,23 @@ static FIL file_object;
 static uint32_t http_file_size = 0;
 /** Receiving content length. */
 static uint32_t received_file_size = 0;
+/** Bytes synced to the SD card when the connection was lost, the next request asks for the rest (Range). */
+static uint32_t resume_file_size = 0;
+/** Reconnections in a row that brought no new data. */
+static uint8_t download_retries = 0;
+/** Suspended and no Range request sent since: a Wi-Fi drop suspends twice (wifi_cb, then the HTTP disconnect). */
+static bool download_suspended = false;
+/** Which request of the download runs: the manifest first, then the image it describes. CURRENT: the server
+ * image is the running one, nothing to download. */
+static enum { OTA_STAGE_MANIFEST, OTA_STAGE_IMAGE_PENDING, OTA_STAGE_IMAGE, OTA_STAGE_CURRENT } ota_stage = OTA_STAGE_MANIFEST;
+/** Manifest of the image being downloaded. */
+static struct OtaManifest ota_manifest;
+/** CRC and size check of the image, updated as it is stored. */
+static struct OtaImageCheck ota_image_check;
 /** File name to download. */
 static char save_file_name[MAIN_MAX_FILE_NAME_LENGTH + 1] = "0:";
+/** File the image is downloaded to, renamed to save_file_name once it is verified. */
+static char part_file_name[MAIN_MAX_FILE_NAME_LENGTH + 1];
 
 /** UART module for debug. */
 // static struct usart_module cdc_uart_module;
@@ -69,14 +115,33 @@ static struct mqtt_module mqtt_inst;
 static unsigned char mqtt_read_buffer[MAIN_MQTT_BUFFER_SIZE];
 static unsigned char mqtt_send_buffer[MAIN_MQTT_BUFFER_SIZE];
 
+/* Socket users. The WINC has one socket callback, every event is given to each client (socket_event_handler) */
+static const struct {
+    tpfAppSocketCb event;
+    tpfAppResolveCb resolve;
+} socketClients[] = {
+    {mqtt_socket_event_handler, mqtt_socket_resolve_handler},
+    {http_client_socket_event_handler, http_client_socket_resolve_handler},
+};
+
+/* Last download progress published on NODE_OTAFU_PROGRESS_TOPIC, in percent */
+static int8_t downloadProgress = -1;
+/* Start of the current download, for the throughput report */
+static TickType_t downloadStartTick;
+
 /******************************************************************************
  * Forward Declarations
  ******************************************************************************/
 static void MQTT_InitRoutine(void);
-static void MQTT_HandleGameMessages(void);
-static void MQTT_HandleImuMessages(void);
+static void MQTT_HandleTransactions(void);
+static void MQTT_HandleOutMessages(void);
+static BaseType_t WifiMqttCoalesce(QueueHandle_t queue, struct MqttOutMessage *msg, struct WifiMqttClassStats *stats);
+static int WifiSendImuBatch(struct ImuTelemetryBatch *batch);
+static void WifiNotify(uint32_t bits);
+static void WifiWaitForWork(TickType_t timeout);
 static void HTTP_DownloadFileInit(void);
 static void HTTP_DownloadFileTransaction(void);
+static void HTTP_PublishProgress(const char *state);
 /******************************************************************************
  * Callback Functions
  ******************************************************************************/
@@ -121,121 +186,169 @@ static inline bool is_state_set(download_state mask)
 }
 
 /**
- * \brief File existing check.
- * \param[in] fp The file pointer to check.
- * \param[in] file_path_name The file name to check.
- * \return true if this file name is exist, false otherwise.
+ * \brief Start file download via HTTP connection.
  */
-static bool is_exist_file(FIL *fp, const char *file_path_name)
+static void start_download(void)
 {
-    if (fp == NULL || file_path_name == NULL) {
-        return false;
+    if (!is_state_set(STORAGE_READY)) {
+        LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: MMC storage not ready.\r\n");
+        add_state(CANCELED);
+        return;
     }
 
-    FRESULT ret = f_open(&file_object, (char const *)file_path_name, FA_OPEN_EXISTING);
-    f_close(&file_object);
-    return (ret == FR_OK);
-}
-
-/**
- * \brief Make to unique file name.
- * \param[in] fp The file pointer to check.
- * \param[out] file_path_name The file name change to uniquely and changed name is returned to this buffer.
- * \param[in] max_len Maximum file name length.
- * \return true if this file name is unique, false otherwise.
- */
-static bool rename_to_unique(FIL *fp, char *file_path_name, uint8_t max_len)
-{
-#define NUMBRING_MAX (3)
-#define ADDITION_SIZE (NUMBRING_MAX + 1) /* '-' character is added before the number. */
-    uint16_t i = 1, name_len = 0, ext_len = 0, count = 0;
-    char name[MAIN_MAX_FILE_NAME_LENGTH + 1] = {0};
-    char ext[MAIN_MAX_FILE_EXT_LENGTH + 1] = {0};
-    char numbering[NUMBRING_MAX + 1] = {0};
-    char *p = NULL;
-    bool valid_ext = false;
-
-    if (file_path_name == NULL) {
-        return false;
+    if (!is_state_set(WIFI_CONNECTED)) {
+        LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: Wi-Fi is not connected.\r\n");
+        return;
     }
 
-    if (!is_exist_file(fp, file_path_name)) {
-        return true;
-    } else if (strlen(file_path_name) > MAIN_MAX_FILE_NAME_LENGTH) {
-        return false;
+    if (is_state_set(GET_REQUESTED)) {
+        LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: request is sent already.\r\n");
+        return;
     }
 
-    p = strrchr(file_path_name, '.');
-    if (p != NULL) {
-        ext_len = strlen(p);
-        if (ext_len < MAIN_MAX_FILE_EXT_LENGTH) {
-            valid_ext = true;
-            strcpy(ext, p);
-            if (strlen(file_path_name) - ext_len > MAIN_MAX_FILE_NAME_LENGTH - ADDITION_SIZE) {
-                name_len = MAIN_MAX_FILE_NAME_LENGTH - ADDITION_SIZE - ext_len;
-                strncpy(name, file_path_name, name_len);
-            } else {
-                name_len = (p - file_path_name);
-                strncpy(name, file_path_name, name_len);
-            }
-        } else {
-            name_len = MAIN_MAX_FILE_NAME_LENGTH - ADDITION_SIZE;
-            strncpy(name, file_path_name, name_len);
+    if (is_state_set(DOWNLOADING)) {
+        /* The file is still open with resume_file_size bytes synced: only ask for the rest. */
+        char range[sizeof("Range: bytes=4294967295-\r\n")];
+        snprintf(range, sizeof(range), "Range: bytes=%lu-\r\n", (unsigned long)resume_file_size);
+        LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: resuming at %lu...\r\n", (unsigned long)resume_file_size);
+        if (http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL, range) == 0) {
+            download_suspended = false;
         }
-    } else {
-        name_len = MAIN_MAX_FILE_NAME_LENGTH - ADDITION_SIZE;
-        strncpy(name, file_path_name, name_len);
+        return;
     }
 
-    name[name_len++] = '-';
-
-    for (i = 0, count = 1; i < NUMBRING_MAX; i++) {
-        count *= 10;
+    if (ota_stage == OTA_STAGE_MANIFEST) {
+        /* The running firmware's CRC is its identity: a server that tags the manifest with the image CRC
+         * answers 304 when they match. */
+        char identity[sizeof("If-None-Match: \"ffffffff\"\r\n")];
+        snprintf(identity, sizeof(identity), "If-None-Match: \"%08lx\"\r\n", (unsigned long)OtaImageRunningCrc());
+        LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: requesting the manifest...\r\n");
+        http_client_send_request(&http_client_module_inst, MAIN_HTTP_MANIFEST_URL, HTTP_METHOD_GET, NULL, identity);
+        return;
     }
-    for (i = 1; i < count; i++) {
-        sprintf(numbering, MAIN_ZERO_FMT(NUMBRING_MAX), i);
-        strncpy(&name[name_len], numbering, NUMBRING_MAX);
-        if (valid_ext) {
-            strcpy(&name[name_len + NUMBRING_MAX], ext);
-        }
 
-        if (!is_exist_file(fp, name)) {
-            memset(file_path_name, 0, max_len);
-            strcpy(file_path_name, name);
-            return true;
-        }
+    /* Send the HTTP request. */
+    LOGM_DEBUG(LOG_MODULE_HTTP, "start_download: sending HTTP request...\r\n");
+    int http_req_status = http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL, NULL);
+    if (http_req_status == 0) {
+        ota_stage = OTA_STAGE_IMAGE;
     }
-    return false;
 }
 
 /**
- * \brief Start file download via HTTP connection.
+ * \brief Read the manifest response and let the image request go out.
+ * \param[in] response_code HTTP status of the response.
+ * \param[in] content Body, NULL if it did not fit the receive buffer.
+ * \param[in] content_length Length of the body.
  */
-static void start_download(void)
+static void accept_manifest_response(unsigned int response_code, const char *content, uint32_t content_length)
 {
-    if (!is_state_set(STORAGE_READY)) {
-        LogMessage(LOG_DEBUG_LVL, "start_download: MMC storage not ready.\r\n");
+    if (response_code == 304) {
+        LOGM_INFO(LOG_MODULE_HTTP, "Manifest not modified, firmware is up to date.\r\n");
+        ota_stage = OTA_STAGE_CURRENT;
+        add_state(COMPLETED);
         return;
     }
 
-    if (!is_state_set(WIFI_CONNECTED)) {
-        LogMessage(LOG_DEBUG_LVL, "start_download: Wi-Fi is not connected.\r\n");
+    if (response_code != 200 || content == NULL || OtaManifestParse(content, content_length, &ota_manifest) != 0) {
+        LOGM_ERROR(LOG_MODULE_HTTP, "accept_manifest_response: no valid manifest (%u), download canceled.\r\n", response_code);
+        add_state(CANCELED);
         return;
     }
 
-    if (is_state_set(GET_REQUESTED)) {
-        LogMessage(LOG_DEBUG_LVL, "start_download: request is sent already.\r\n");
+    LOGM_INFO(LOG_MODULE_HTTP, "Manifest: version %lu, %lu B, CRC32 0x%08lX\r\n", (unsigned long)ota_manifest.version, (unsigned long)ota_manifest.size,
+              (unsigned long)ota_manifest.crc32);
+    /* Also for servers that ignore If-None-Match */
+    if (ota_manifest.crc32 == OtaImageRunningCrc()) {
+        LOGM_INFO(LOG_MODULE_HTTP, "Manifest matches the running firmware, nothing to download.\r\n");
+        ota_stage = OTA_STAGE_CURRENT;
+        add_state(COMPLETED);
         return;
     }
+    /* The image request is sent from HTTP_DownloadFileTransaction, once the client is done with this response. */
+    clear_state(GET_REQUESTED);
+    ota_stage = OTA_STAGE_IMAGE_PENDING;
+}
 
-    if (is_state_set(DOWNLOADING)) {
-        LogMessage(LOG_DEBUG_LVL, "start_download: running download already.\r\n");
-        return;
+/**
+ * \brief Write out the buffered data and close the download file.
+ * \return true if every byte reached the file.
+ */
+static bool close_download_file(void)
+{
+    bool written = (SdWriterStop() == 0);
+    written = (f_close(&file_object) == FR_OK) && written;
+    clear_state(DOWNLOADING);
+    return written;
+}
+
+/**
+ * \brief Keep what was downloaded when the connection is lost.
+ * Syncs the open file so its bytes are on the SD card and records their count, the next start_download
+ * continues from there with a Range request. Only the first call of an outage counts as a retry.
+ * \return true if the download can be resumed, false if it was given up (CANCELED).
+ */
+static bool suspend_download(void)
+{
+    clear_state(GET_REQUESTED);
+    if (is_state_set(COMPLETED | CANCELED)) {
+        return false;
+    }
+    if (!is_state_set(DOWNLOADING) || download_suspended) {
+        return true;
     }
 
-    /* Send the HTTP request. */
-    LogMessage(LOG_DEBUG_LVL, "start_download: sending HTTP request...\r\n");
-    int http_req_status = http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL, NULL);
+    download_retries = (received_file_size > resume_file_size) ? 0 : download_retries + 1;
+    if (SdWriterFlush() != 0 || f_sync(&file_object) != FR_OK || download_retries > WIFI_DOWNLOAD_RETRIES) {
+        LOGM_DEBUG(LOG_MODULE_HTTP, "suspend_download: cannot resume, download canceled.\r\n");
+        close_download_file();
+        add_state(CANCELED);
+        return false;
+    }
+    resume_file_size = received_file_size;
+    download_suspended = true;
+    return true;
+}
+
+/**
+ * \brief Check the response to a (resumed) download request.
+ * \param[in] response_code HTTP status of the response.
+ * \param[in] content_length Length of the response body.
+ * \return true if the body is to be stored, false if the download was canceled.
+ */
+static bool accept_download_response(unsigned int response_code, uint32_t content_length)
+{
+    if (response_code == 206 && is_state_set(DOWNLOADING) && resume_file_size + content_length == http_file_size) {
+        /* Partial content: the body continues the file. */
+        received_file_size = resume_file_size;
+        return true;
+    }
+
+    if (response_code != 200 || content_length != ota_manifest.size) {
+        LOGM_ERROR(LOG_MODULE_HTTP, "accept_download_response: %u with %lu B, manifest says %lu B. Download canceled.\r\n", response_code,
+                   (unsigned long)content_length, (unsigned long)ota_manifest.size);
+        if (is_state_set(DOWNLOADING)) {
+            close_download_file();
+        }
+        add_state(CANCELED);
+        return false;
+    }
+
+    if (is_state_set(DOWNLOADING)) {
+        /* The server sent the whole file instead of the range: start the file over. */
+        LOGM_DEBUG(LOG_MODULE_HTTP, "accept_download_response: no range support, downloading from the start.\r\n");
+        SdWriterStop();
+        if (f_lseek(&file_object, 0) != FR_OK || f_truncate(&file_object) != FR_OK || SdWriterStart(&file_object) != 0) {
+            close_download_file();
+            add_state(CANCELED);
+            return false;
+        }
+    }
+    http_file_size = content_length;
+    received_file_size = 0;
+    resume_file_size = 0;
+    OtaImageBegin(&ota_image_check, &ota_manifest);
+    return true;
 }
 
 /**
@@ -247,7 +360,7 @@ static void store_file_packet(char *data, uint32_t length)
 {
     FRESULT ret;
     if ((data == NULL) || (length < 1)) {
-        LogMessage(LOG_DEBUG_LVL, "store_file_packet: empty data.\r\n");
+        LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: empty data.\r\n");
         return;
     }
 
@@ -263,16 +376,28 @@ static void store_file_packet(char *data, uint32_t length)
             cp++;
             strcpy(&save_file_name[2], cp);
         } else {
-            LogMessage(LOG_DEBUG_LVL, "store_file_packet: file name is invalid. Download canceled.\r\n");
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file name is invalid. Download canceled.\r\n");
             add_state(CANCELED);
             return;
         }
-		
-        rename_to_unique(&file_object, save_file_name, MAIN_MAX_FILE_NAME_LENGTH);
-        LogMessage(LOG_DEBUG_LVL, "store_file_packet: creating file [%s]\r\n", save_file_name);
-        ret = f_open(&file_object, (char const *)save_file_name, FA_CREATE_ALWAYS | FA_WRITE);
+        /* The image on the card stays until the new one is verified, a failed download leaves nothing to flash. */
+        if (snprintf(part_file_name, sizeof(part_file_name), "%s%s", save_file_name, MAIN_PART_FILE_EXT) >= (int)sizeof(part_file_name)) {
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file name is too long. Download canceled.\r\n");
+            add_state(CANCELED);
+            return;
+        }
+
+        LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: creating file [%s]\r\n", part_file_name);
+        ret = f_open(&file_object, (char const *)part_file_name, FA_CREATE_ALWAYS | FA_WRITE);
         if (ret != FR_OK) {
-            LogMessage(LOG_DEBUG_LVL, "store_file_packet: file creation error! ret:%d\r\n", ret);
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file creation error! ret:%d\r\n", ret);
+            return;
+        }
+        /* The SD writer task writes whole sectors while the next packets arrive. */
+        if (SdWriterStart(&file_object) != 0) {
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: SD writer busy, download canceled.\r\n");
+            f_close(&file_object);
+            add_state(CANCELED);
             return;
         }
 
@@ -281,20 +406,23 @@ static void store_file_packet(char *data, uint32_t length)
     }
 
     if (data != NULL) {
-        UINT wsize = 0;
-        ret = f_write(&file_object, (const void *)data, length, &wsize);
-        if (ret != FR_OK) {
-            f_close(&file_object);
+        if (SdWriterWrite(data, length) != 0) {
+            close_download_file();
             add_state(CANCELED);
-            LogMessage(LOG_DEBUG_LVL, "store_file_packet: file write error, download canceled.\r\n");
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file write error, download canceled.\r\n");
             return;
         }
 
-        received_file_size += wsize;
-        LogMessage(LOG_DEBUG_LVL, "store_file_packet: received[%lu], file size[%lu]\r\n", (unsigned long)received_file_size, (unsigned long)http_file_size);
+        OtaImageUpdate(&ota_image_check, data, length);
+        received_file_size += length;
+        LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: received[%lu], file size[%lu]\r\n", (unsigned long)received_file_size, (unsigned long)http_file_size);
         if (received_file_size >= http_file_size) {
-            f_close(&file_object);
-            LogMessage(LOG_DEBUG_LVL, "store_file_packet: file downloaded successfully.\r\n");
+            if (!close_download_file()) {
+                add_state(CANCELED);
+                LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file write error, download canceled.\r\n");
+                return;
+            }
+            LOGM_DEBUG(LOG_MODULE_HTTP, "store_file_packet: file downloaded successfully.\r\n");
             port_pin_set_output_level(LED_0_PIN, false);
             add_state(COMPLETED);
             return;
@@ -313,21 +441,21 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 {
     switch (type) {
         case HTTP_CLIENT_CALLBACK_SOCK_CONNECTED:
-            LogMessage(LOG_DEBUG_LVL, "http_client_callback: HTTP client socket connected.\r\n");
+            LOGM_DEBUG(LOG_MODULE_HTTP, "http_client_callback: HTTP client socket connected.\r\n");
             break;
 
         case HTTP_CLIENT_CALLBACK_REQUESTED:
-            LogMessage(LOG_DEBUG_LVL, "http_client_callback: request completed.\r\n");
+            LOGM_DEBUG(LOG_MODULE_HTTP, "http_client_callback: request completed.\r\n");
             add_state(GET_REQUESTED);
             break;
 
         case HTTP_CLIENT_CALLBACK_RECV_RESPONSE:
-            LogMessage(LOG_DEBUG_LVL, "http_client_callback: received response %u data size %u\r\n", (unsigned int)data->recv_response.response_code, (unsigned int)data->recv_response.content_length);
-            if ((unsigned int)data->recv_response.response_code == 200) {
-                http_file_size = data->recv_response.content_length;
-                received_file_size = 0;
-            } else {
-                add_state(CANCELED);
+            LOGM_DEBUG(LOG_MODULE_HTTP, "http_client_callback: received response %u data size %u\r\n", (unsigned int)data->recv_response.response_code, (unsigned int)data->recv_response.content_length);
+            if (ota_stage == OTA_STAGE_MANIFEST) {
+                accept_manifest_response((unsigned int)data->recv_response.response_code, data->recv_response.content, data->recv_response.content_length);
+                break;
+            }
+            if (!accept_download_response((unsigned int)data->recv_response.response_code, data->recv_response.content_length)) {
                 return;
             }
             if (data->recv_response.content_length <= MAIN_BUFFER_MAX_SIZE) {
@@ -337,6 +465,9 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
             break;
 
         case HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA:
+            if (ota_stage != OTA_STAGE_IMAGE || is_state_set(CANCELED)) {
+                break; /* Rest of a rejected manifest or image response. */
+            }
             store_file_packet(data->recv_chunked_data.data, data->recv_chunked_data.length);
             if (data->recv_chunked_data.is_complete) {
                 add_state(COMPLETED);
@@ -345,72 +476,23 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
             break;
 
         case HTTP_CLIENT_CALLBACK_DISCONNECTED:
-            LogMessage(LOG_DEBUG_LVL, "http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
+            LOGM_DEBUG(LOG_MODULE_HTTP, "http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
 
             /* If disconnect reason is equal to -ECONNRESET(-104),
              * It means the server has closed the connection (timeout).
              * This is normal operation.
              */
-            if (data->disconnected.reason == -EAGAIN) {
-                /* Server has not responded. Retry immediately. */
-                if (is_state_set(DOWNLOADING)) {
-                    f_close(&file_object);
-                    clear_state(DOWNLOADING);
-                }
-
-                if (is_state_set(GET_REQUESTED)) {
-                    clear_state(GET_REQUESTED);
+            if (data->disconnected.reason == -EAGAIN || (is_state_set(DOWNLOADING) && !is_state_set(COMPLETED | CANCELED))) {
+                /* Server has not responded or the transfer broke off. Retry immediately from what is stored. */
+                if (suspend_download()) {
+                    start_download();
                 }
-
-                start_download();
             }
 
             break;
     }
 }
 
-/**
- * \brief Callback to get the data from socket.
- *
- * \param[in] sock socket handler.
- * \param[in] u8Msg socket event type. Possible values are:
- *  - SOCKET_MSG_BIND
- *  - SOCKET_MSG_LISTEN
- *  - SOCKET_MSG_ACCEPT
- *  - SOCKET_MSG_CONNECT
- *  - SOCKET_MSG_RECV
- *  - SOCKET_MSG_SEND
- *  - SOCKET_MSG_SENDTO
- *  - SOCKET_MSG_RECVFROM
- * \param[in] pvMsg is a pointer to message structure. Existing types are:
- *  - tstrSocketBindMsg
- *  - tstrSocketListenMsg
- *  - tstrSocketAcceptMsg
- *  - tstrSocketConnectMsg
- *  - tstrSocketRecvMsg
- */
-static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
-{
-    http_client_socket_event_handler(sock, u8Msg, pvMsg);
-}
-
-/**
- * \brief Callback for the gethostbyname function (DNS Resolution callback).
- * \param[in] pu8DomainName Domain name of the host.
- * \param[in] u32ServerIP Server IPv4 address encoded in NW byte order format. If it is Zero, then the DNS resolution failed.
- */
-static void resolve_cb(uint8_t *pu8DomainName, uint32_t u32ServerIP)
-{
-    LogMessage(LOG_DEBUG_LVL,
-               "resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n",
-               pu8DomainName,
-               (int)IPV4_BYTE(u32ServerIP, 0),
-               (int)IPV4_BYTE(u32ServerIP, 1),
-               (int)IPV4_BYTE(u32ServerIP, 2),
-               (int)IPV4_BYTE(u32ServerIP, 3));
-    http_client_socket_resolve_handler(pu8DomainName, u32ServerIP);
-}
-
 /**
  * \brief Callback to get the Wi-Fi status update.
  *
@@ -442,19 +524,13 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
         case M2M_WIFI_RESP_CON_STATE_CHANGED: {
             tstrM2mWifiStateChanged *pstrWifiState = (tstrM2mWifiStateChanged *)pvMsg;
             if (pstrWifiState->u8CurrState == M2M_WIFI_CONNECTED) {
-                LogMessage(LOG_DEBUG_LVL, "wifi_cb: M2M_WIFI_CONNECTED\r\n");
+                LOG_DEBUG("wifi_cb: M2M_WIFI_CONNECTED\r\n");
                 m2m_wifi_request_dhcp_client();
             } else if (pstrWifiState->u8CurrState == M2M_WIFI_DISCONNECTED) {
-                LogMessage(LOG_DEBUG_LVL, "wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
+                LOG_DEBUG("wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
                 clear_state(WIFI_CONNECTED);
-                if (is_state_set(DOWNLOADING)) {
-                    f_close(&file_object);
-                    clear_state(DOWNLOADING);
-                }
-
-                if (is_state_set(GET_REQUESTED)) {
-                    clear_state(GET_REQUESTED);
-                }
+                /* The download resumes from the stored bytes once Wi-Fi is back (M2M_WIFI_REQ_DHCP_CONF). */
+                suspend_download();
 
                 /* Disconnect from MQTT broker. */
                 /* Force close the MQTT connection, because cannot send a disconnect message to the broker when network is broken. */
@@ -468,17 +544,15 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 
         case M2M_WIFI_REQ_DHCP_CONF: {
             uint8_t *pu8IPAddress = (uint8_t *)pvMsg;
-            LogMessage(LOG_DEBUG_LVL, "wifi_cb: IP address is %u.%u.%u.%u\r\n", pu8IPAddress[0], pu8IPAddress[1], pu8IPAddress[2], pu8IPAddress[3]);
+            LOG_DEBUG("wifi_cb: IP address is %u.%u.%u.%u\r\n", pu8IPAddress[0], pu8IPAddress[1], pu8IPAddress[2], pu8IPAddress[3]);
             add_state(WIFI_CONNECTED);
 
+            /* Try to connect to MQTT broker when Wi-Fi was connected. */
+            if (mqtt_connect(&mqtt_inst, main_mqtt_broker)) {
+                LOGM_DEBUG(LOG_MODULE_MQTT, "Error connecting to MQTT Broker!\r\n");
+            }
             if (do_download_flag == 1) {
                 start_download();
-
-            } else {
-                /* Try to connect to MQTT broker when Wi-Fi was connected. */
-                if (mqtt_connect(&mqtt_inst, main_mqtt_broker)) {
-                    LogMessage(LOG_DEBUG_LVL, "Error connecting to MQTT Broker!\r\n");
-                }
             }
         } break;
 
@@ -498,28 +572,28 @@ void init_storage(void)
     /* Initialize SD/MMC stack. */
     sd_mmc_init();
     while (true) {
-        LogMessage(LOG_DEBUG_LVL, "init_storage: please plug an SD/MMC card in slot...\r\n");
+        LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: please plug an SD/MMC card in slot...\r\n");
 
         /* Wait card present and ready. */
         do {
             status = sd_mmc_test_unit_ready(0);
             if (CTRL_FAIL == status) {
-                LogMessage(LOG_DEBUG_LVL, "init_storage: SD Card install failed.\r\n");
-                LogMessage(LOG_DEBUG_LVL, "init_storage: try unplug and re-plug the card.\r\n");
+                LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: SD Card install failed.\r\n");
+                LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: try unplug and re-plug the card.\r\n");
                 while (CTRL_NO_PRESENT != sd_mmc_check(0)) {
                 }
             }
         } while (CTRL_GOOD != status);
 
-        LogMessage(LOG_DEBUG_LVL, "init_storage: mounting SD card...\r\n");
+        LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: mounting SD card...\r\n");
         memset(&fatfs, 0, sizeof(FATFS));
         res = f_mount(LUN_ID_SD_MMC_0_MEM, &fatfs);
         if (FR_INVALID_DRIVE == res) {
-            LogMessage(LOG_DEBUG_LVL, "init_storage: SD card mount failed! (res %d)\r\n", res);
+            LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: SD card mount failed! (res %d)\r\n", res);
             return;
         }
 
-        LogMessage(LOG_DEBUG_LVL, "init_storage: SD card mount OK.\r\n");
+        LOGM_DEBUG(LOG_MODULE_HTTP, "init_storage: SD card mount OK.\r\n");
         add_state(STORAGE_READY);
         return;
     }
@@ -578,7 +652,7 @@ static void configure_http_client(void)
 
     ret = http_client_init(&http_client_module_inst, &httpc_conf);
     if (ret < 0) {
-        LogMessage(LOG_DEBUG_LVL, "configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
+        LOGM_DEBUG(LOG_MODULE_HTTP, "configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
         while (1) {
         } /* Loop forever. */
     }
@@ -608,7 +682,10 @@ void SubscribeHandler(MessageData *msgData);
  */
 static void socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data)
 {
-    mqtt_socket_event_handler(sock, msg_type, msg_data);
+    // MQTT and HTTP clients run at the same time, each handler ignores the sockets it does not own
+    for (size_t i = 0; i < sizeof(socketClients) / sizeof(socketClients[0]); i++) {
+        socketClients[i].event(sock, msg_type, msg_data);
+    }
 }
 
 /**
@@ -619,7 +696,17 @@ static void socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data)
  */
 static void socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
 {
-    mqtt_socket_resolve_handler(doamin_name, server_ip);
+    LOGM_DEBUG(LOG_MODULE_WIFI,
+               "%s IP address is %d.%d.%d.%d\r\n",
+               doamin_name,
+               (int)IPV4_BYTE(server_ip, 0),
+               (int)IPV4_BYTE(server_ip, 1),
+               (int)IPV4_BYTE(server_ip, 2),
+               (int)IPV4_BYTE(server_ip, 3));
+    // Each client only takes the answer for the host it asked for
+    for (size_t i = 0; i < sizeof(socketClients) / sizeof(socketClients[0]); i++) {
+        socketClients[i].resolve(doamin_name, server_ip);
+    }
 }
 
 /**
@@ -631,7 +718,7 @@ static void socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
 void SubscribeHandlerLedTopic(MessageData *msgData)
 {
     uint8_t rgb[3] = {0, 0, 0};
-    LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
     // Will receive something of the style "rgb(222, 224, 189)"
     if (strncmp(msgData->message->payload, "rgb(", 4) == 0) {
         char *p = (char *)&msgData->message->payload[4];
@@ -641,7 +728,7 @@ void SubscribeHandlerLedTopic(MessageData *msgData)
             if (*p != ',') break;
             p++; /* skip, */
         }
-        LogMessage(LOG_DEBUG_LVL, "\r\nRGB %d %d %d\r\n", rgb[0], rgb[1], rgb[2]);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nRGB %d %d %d\r\n", rgb[0], rgb[1], rgb[2]);
     }
 }
 
@@ -652,9 +739,9 @@ void SubscribeHandlerGameTopic(MessageData *msgData)
 
     // Parse input. The start string must be '{"game":['
     if (strncmp(msgData->message->payload, "{\"game\":[", 9) == 0) {
-        LogMessage(LOG_DEBUG_LVL, "\r\nGame message received!\r\n");
-        LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
-        LogMessage(LOG_DEBUG_LVL, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nGame message received!\r\n");
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
 
         int nb = 0;
         char *p = &msgData->message->payload[9];
@@ -663,125 +750,198 @@ void SubscribeHandlerGameTopic(MessageData *msgData)
             if (*p != ',') break;
             p++; /* skip, */
         }
-        LogMessage(LOG_DEBUG_LVL, "\r\nParsed Command: ");
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nParsed Command: ");
         for (int i = 0; i < GAME_SIZE; i++) {
-            LogMessage(LOG_DEBUG_LVL, "%d,", game.game[i]);
+            LOGM_DEBUG(LOG_MODULE_MQTT, "%d,", game.game[i]);
         }
 
     } else {
-        LogMessage(LOG_DEBUG_LVL, "\r\nGame message received but not understood!\r\n");
-        LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
-        LogMessage(LOG_DEBUG_LVL, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nGame message received but not understood!\r\n");
+        LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
     }
 }
 
 void SubscribeHandlerImuTopic(MessageData *msgData)
 {
-    LogMessage(LOG_DEBUG_LVL, "\r\nIMU topic received!\r\n");
-    LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nIMU topic received!\r\n");
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
 }
 
 void SubscribeHandlerDistanceTopic(MessageData *msgData)
 {
-    LogMessage(LOG_DEBUG_LVL, "\r\nDistance topic received!\r\n");
-    LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nDistance topic received!\r\n");
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+}
+
+/* Commands of the control topics. Keep each table sorted by keyword (binary search, checked when the task starts), see MqttCommand.h */
+static void SwitchOn(const uint8_t *args, uint8_t argLen)
+{
+	port_pin_set_output_level(LED_0_PIN, LED_0_ACTIVE);
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Switch ON -> LED ON\r\n");
+}
+
+static void SwitchOff(const uint8_t *args, uint8_t argLen)
+{
+	port_pin_set_output_level(LED_0_PIN, LED_0_INACTIVE);
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Switch OFF -> LED OFF\r\n");
+}
+
+static const struct MqttCommand switchCommands[] = {
+	MQTT_COMMAND("off", MQTT_OP_SWITCH_OFF, 0, SwitchOff),
+	MQTT_COMMAND("on", MQTT_OP_SWITCH_ON, 0, SwitchOn),
+};
+
+static void MotorForward(const uint8_t *args, uint8_t argLen)
+{
+	move_forward();
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Move Forward\r\n");
+}
+
+static void MotorBackward(const uint8_t *args, uint8_t argLen)
+{
+	move_backward();
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Move Backward\r\n");
+}
+
+static void MotorLeft(const uint8_t *args, uint8_t argLen)
+{
+	move_left();
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Move Left\r\n");
+}
+
+static void MotorRight(const uint8_t *args, uint8_t argLen)
+{
+	move_right();
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Move Right\r\n");
+}
+
+static void MotorStop(const uint8_t *args, uint8_t argLen)
+{
+	stop();
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Stop\r\n");
+}
+
+// Binary only: int8 left speed, int8 right speed
+static void MotorSpeed(const uint8_t *args, uint8_t argLen)
+{
+	set_motors_speeds((int8_t)args[0], (int8_t)args[1]);
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Speed %d %d\r\n", (int8_t)args[0], (int8_t)args[1]);
+}
+
+static const struct MqttCommand motorCommands[] = {
+	MQTT_COMMAND("backward", MQTT_OP_MOTOR_BACKWARD, 0, MotorBackward),
+	MQTT_COMMAND("forward", MQTT_OP_MOTOR_FORWARD, 0, MotorForward),
+	MQTT_COMMAND("left", MQTT_OP_MOTOR_LEFT, 0, MotorLeft),
+	MQTT_COMMAND("right", MQTT_OP_MOTOR_RIGHT, 0, MotorRight),
+	MQTT_COMMAND("speed", MQTT_OP_MOTOR_SPEED, 2, MotorSpeed),
+	MQTT_COMMAND("stop", MQTT_OP_MOTOR_STOP, 0, MotorStop),
+};
+
+static void LedStripBlink(const uint8_t *args, uint8_t argLen)
+{
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Blink\r\n");
+	led_flag = 1;
+}
+
+static void LedStripOneColor(const uint8_t *args, uint8_t argLen)
+{
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Hold in one Light\r\n");
+	led_flag = 2;
+}
+
+static void LedStripMultipleColors(const uint8_t *args, uint8_t argLen)
+{
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Hold in multiple Light\r\n");
+	led_flag = 3;
+}
+
+static void LedStripClose(const uint8_t *args, uint8_t argLen)
+{
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Close LED Strip\r\n");
+	led_flag = 4;
+}
+
+// Binary only: red, green, blue of the one color modes
+static void LedStripColor(const uint8_t *args, uint8_t argLen)
+{
+	LED_SetColor(args[0], args[1], args[2]);
+	LOGM_DEBUG(LOG_MODULE_MQTT, "LED Strip color %d %d %d\r\n", args[0], args[1], args[2]);
+}
+
+static const struct MqttCommand ledStripCommands[] = {
+	MQTT_COMMAND("blink", MQTT_OP_LED_BLINK, 0, LedStripBlink),
+	MQTT_COMMAND("close", MQTT_OP_LED_CLOSE, 0, LedStripClose),
+	MQTT_COMMAND("color", MQTT_OP_LED_COLOR, 3, LedStripColor),
+	MQTT_COMMAND("multiple colors", MQTT_OP_LED_MULTIPLE_COLORS, 0, LedStripMultipleColors),
+	MQTT_COMMAND("one color", MQTT_OP_LED_ONE_COLOR, 0, LedStripOneColor),
+};
+
+static void OtafuFirmware(const uint8_t *args, uint8_t argLen)
+{
+	// MQTT stays up during a download, so an order can come while one runs: it keeps running
+	if (do_download_flag || wifiStateMachine == WIFI_DOWNLOAD_HANDLE) {
+		LOGM_DEBUG(LOG_MODULE_MQTT, "OTA Update Order ignored, a download is running\r\n");
+		HTTP_PublishProgress("busy");
+		return;
+	}
+	WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
+	LOGM_DEBUG(LOG_MODULE_MQTT, "Received OTA Update Order from Node-RED\r\n");
+}
+
+static const struct MqttCommand otafuCommands[] = {
+	MQTT_COMMAND("fw", MQTT_OP_OTAFU_FIRMWARE, 0, OtafuFirmware),
+};
+
+static const struct MqttCommandTable switchTable = MQTT_COMMAND_TABLE(switchCommands);
+static const struct MqttCommandTable motorTable = MQTT_COMMAND_TABLE(motorCommands);
+static const struct MqttCommandTable ledStripTable = MQTT_COMMAND_TABLE(ledStripCommands);
+static const struct MqttCommandTable otafuTable = MQTT_COMMAND_TABLE(otafuCommands);
+
+/**
+ static void MQTT_DispatchCommand(const struct MqttCommandTable *table, MessageData *msgData)
+ * @brief	Runs the command in the payload of a control topic message
+
+*/
+static void MQTT_DispatchCommand(const struct MqttCommandTable *table, MessageData *msgData)
+{
+	int rc = MqttCommandDispatch(table, (const uint8_t *)msgData->message->payload, msgData->message->payloadlen);
+	if (rc != 0) {
+		LOGM_DEBUG(LOG_MODULE_MQTT, "Unknown command on %.*s (%d)\r\n", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data, rc);
+	}
 }
 
 void SubscribeHandlerSwitch(MessageData *msgData)
 {
 	// Example message: "on" or "off"
-	char *payload = (char *)msgData->message->payload;
-
-	if (strncmp(payload, "on", msgData->message->payloadlen) == 0) {
-		port_pin_set_output_level(LED_0_PIN, LED_0_ACTIVE);
-		LogMessage(LOG_DEBUG_LVL, "Switch ON -> LED ON\r\n");
-		} else if (strncmp(payload, "off", msgData->message->payloadlen) == 0) {
-		port_pin_set_output_level(LED_0_PIN, LED_0_INACTIVE);
-		LogMessage(LOG_DEBUG_LVL, "Switch OFF -> LED OFF\r\n");
-	}
+	MQTT_DispatchCommand(&switchTable, msgData);
 }
 
 void SubscribeHandlerMotor(MessageData *msgData)
 {
-	// Example message: "forward", "backward", "left", "right", "stop"
-	char *payload = (char *)msgData->message->payload;
-
-	if (strncmp(payload, "forward", msgData->message->payloadlen) == 0) {
-		move_forward();
-		//voice_control_flag = 6;
-		LogMessage(LOG_DEBUG_LVL, "Move Forward\r\n");
-	} 
-	else if (strncmp(payload, "backward", msgData->message->payloadlen) == 0) {
-		move_backward();
-		//voice_control_flag = 7;
-		LogMessage(LOG_DEBUG_LVL, "Move Backward\r\n");
-	}
-	else if (strncmp(payload, "left", msgData->message->payloadlen) == 0) {
-		move_left();
-		//voice_control_flag = 8;
-		LogMessage(LOG_DEBUG_LVL, "Move Left\r\n");
-	}
-	else if (strncmp(payload, "right", msgData->message->payloadlen) == 0) {
-		move_right();
-		//voice_control_flag = 9;
-		LogMessage(LOG_DEBUG_LVL, "Move Right\r\n");
-	}
-	else if (strncmp(payload, "stop", msgData->message->payloadlen) == 0) {
-		stop();
-		//voice_control_flag = 10;
-		LogMessage(LOG_DEBUG_LVL, "Stop\r\n");
-	}			
+	// Example message: "forward", "backward", "left", "right", "stop", or MQTT_OP_MOTOR_SPEED + 2 speeds
+	MQTT_DispatchCommand(&motorTable, msgData);
 }
 
 void SubscribeHandlerLEDStrip(MessageData *msgData)
 {
-	// Example message: "blink","one color","multiple colors"
-	char *payload = (char *)msgData->message->payload;
-
-	if (strncmp(payload, "blink", msgData->message->payloadlen) == 0) {
-		LogMessage(LOG_DEBUG_LVL, "Blink\r\n");
-		//voice_control_flag = 1;
-		led_flag = 1;
-		//BLink_one_color();
-	}
-	else if (strncmp(payload, "one color", msgData->message->payloadlen) == 0) {
-		LogMessage(LOG_DEBUG_LVL, "Hold in one Light\r\n");
-		//voice_control_flag = 2;
-		led_flag = 2;
-		//Hold_in_one_color();
-	}
-	else if (strncmp(payload, "multiple colors", msgData->message->payloadlen) == 0) {
-		LogMessage(LOG_DEBUG_LVL, "Hold in multiple Light\r\n");
-		//voice_control_flag = 3;
-		led_flag = 3;
-		//rainbow_swirl();
-	}
-	else if (strncmp(payload, "close", msgData->message->payloadlen) == 0) {
-		LogMessage(LOG_DEBUG_LVL, "Close LED Strip\r\n");
-		//voice_control_flag = 4;
-		led_flag = 4;
-		//SK6812_Clear();
-	}
+	// Example message: "blink","one color","multiple colors","close", or MQTT_OP_LED_COLOR + r, g, b
+	MQTT_DispatchCommand(&ledStripTable, msgData);
 }
 
 void SubscribeHandlerOTAFU(MessageData *msgData)
 {
-	
-	char *payload = (char *)msgData->message->payload;
-
-	if (strncmp(payload, "fw", msgData->message->payloadlen) == 0) {
-		WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
-		LogMessage(LOG_DEBUG_LVL, "Received OTA Update Order from Node-RED\r\n");
-	} 
+	// Example message: "fw"
+	MQTT_DispatchCommand(&otafuTable, msgData);
 }
 
 void SubscribeHandler(MessageData *msgData)
 {
     /* You received publish message which you had subscribed. */
     /* Print Topic and message */
-    LogMessage(LOG_DEBUG_LVL, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
-    LogMessage(LOG_DEBUG_LVL, " >> ");
-    LogMessage(LOG_DEBUG_LVL, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
+    LOGM_DEBUG(LOG_MODULE_MQTT, "\r\n %.*s", msgData->topicName->lenstring.len, msgData->topicName->lenstring.data);
+    LOGM_DEBUG(LOG_MODULE_MQTT, " >> ");
+    LOGM_DEBUG(LOG_MODULE_MQTT, "%.*s", msgData->message->payloadlen, (char *)msgData->message->payload);
 
     // Handle LedData message
     if (strncmp((char *)msgData->topicName->lenstring.data, LED_TOPIC, msgData->message->payloadlen) == 0) {
@@ -793,6 +953,58 @@ void SubscribeHandler(MessageData *msgData)
     }
 }
 
+/// Payload of the button state
+static const char *ButtonStatePayload(int32_t pressed)
+{
+    return pressed ? "on" : "off";
+}
+
+/// Payload of voice_control_flag, NULL for the values that are not published
+static const char *VoiceStatePayload(int32_t flag)
+{
+    static const char *const payloads[] = {"No", "Blink", "Hold in one color", "Hold in multiple colors", "Close LED", "start",
+                                           "forward", "backward", "left", "right", "stop", "end"};
+    return (flag >= 0 && flag < (int32_t)(sizeof(payloads) / sizeof(payloads[0]))) ? payloads[flag] : NULL;
+}
+
+/// Device state topics published to Node-RED, indexed by WIFI_STATE_*
+static struct StateTopic mqttStates[WIFI_STATE_COUNT] = {
+    [WIFI_STATE_BUTTON] = STATE_TOPIC(NODE_BUTTON_TOPIC, WIFI_BUTTON_QOS, 0, 0, ButtonStatePayload),
+    [WIFI_STATE_VOICE] = STATE_TOPIC(NODE_VOICE_TOPIC, WIFI_VOICE_QOS, WIFI_VOICE_COALESCE_MS, WIFI_VOICE_HEARTBEAT_MS, VoiceStatePayload),
+};
+
+/**
+ static int MQTT_PublishState(const char *topic, const char *payload, uint8_t qos)
+ * @brief	Publishes a device state for StatePublisherRun
+ * @return	0 once sent, the mqtt_publish_async error otherwise (INFLIGHT_WINDOW_FULL: StatePublisherRun tries again)
+ * @note	Does not wait for the acknowledgement, it takes an in-flight slot like the queued messages. The payloads
+ *			are constant strings, there is no block to hold on to
+
+*/
+static int MQTT_PublishState(const char *topic, const char *payload, uint8_t qos)
+{
+    LOGM_DEBUG(LOG_MODULE_MQTT, "%s >> %s\r\n", topic, payload);
+    int rc = mqtt_publish_async(&mqtt_inst, topic, payload, strlen(payload), qos, 0, WIFI_MQTT_STATE_CONTEXT);
+    if (rc == INFLIGHT_WINDOW_FULL) {
+        mqttWindowFull = true;
+    }
+    return rc;
+}
+
+/// Topics subscribed on every connection. The MQTT client dispatches them by topic hash (see MAX_MESSAGE_HANDLERS)
+static const struct {
+    const char *topic;
+    messageHandler handler;
+} mqttSubscriptions[] = {
+    {NODE_SWITCH_TOPIC, SubscribeHandlerSwitch},      // MCU LED
+    {NODE_MOTOR_TOPIC, SubscribeHandlerMotor},        // MCU MOTOR
+    {NODE_LED_TOPIC, SubscribeHandlerLEDStrip},       // MCU LED Strip
+    {NODE_OTAFU_TOPIC, SubscribeHandlerOTAFU},        // OTAFU Update
+    {GAME_TOPIC_IN, SubscribeHandlerGameTopic},
+    {LED_TOPIC, SubscribeHandlerLedTopic},
+    {IMU_TOPIC, SubscribeHandlerImuTopic},
+};
+
 /**
  * \brief Callback to get the MQTT status update.
  *
@@ -816,14 +1028,14 @@ static void mqtt_callback(struct mqtt_module *module_inst, int type, union mqtt_
              * Or else retry to connect to broker server.
              */
             if (data->sock_connected.result >= 0) {
-                LogMessage(LOG_DEBUG_LVL, "\r\nConnecting to Broker...");
+                LOGM_DEBUG(LOG_MODULE_MQTT, "\r\nConnecting to Broker...");
                 if (0 != mqtt_connect_broker(module_inst, 1, CLOUDMQTT_USER_ID, CLOUDMQTT_USER_PASSWORD, CLOUDMQTT_USER_ID, NULL, NULL, 0, 0, 0)) {
-                    LogMessage(LOG_DEBUG_LVL, "MQTT  Error - NOT Connected to broker\r\n");
+                    LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT  Error - NOT Connected to broker\r\n");
                 } else {
-                    LogMessage(LOG_DEBUG_LVL, "MQTT Connected to broker\r\n");
+                    LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT Connected to broker\r\n");
                 }
             } else {
-                LogMessage(LOG_DEBUG_LVL, "Connect fail to server(%s)! retry it automatically.\r\n", main_mqtt_broker);
+                LOGM_DEBUG(LOG_MODULE_MQTT, "Connect fail to server(%s)! retry it automatically.\r\n", main_mqtt_broker);
                 mqtt_connect(module_inst, main_mqtt_broker); /* Retry that. */
             }
         } break;
@@ -831,26 +1043,43 @@ static void mqtt_callback(struct mqtt_module *module_inst, int type, union mqtt_
         case MQTT_CALLBACK_CONNECTED:
             if (data->connected.result == MQTT_CONN_RESULT_ACCEPT) {
                 /* Subscribe chat topic. */
-				mqtt_subscribe(module_inst, NODE_SWITCH_TOPIC, 2, SubscribeHandlerSwitch); //MCU LED
-				mqtt_subscribe(module_inst, NODE_MOTOR_TOPIC, 2, SubscribeHandlerMotor); //MCU MOTOR
-				mqtt_subscribe(module_inst, NODE_LED_TOPIC, 2, SubscribeHandlerLEDStrip);//MCU LED Strip
-				mqtt_subscribe(module_inst, NODE_OTAFU_TOPIC, 2, SubscribeHandlerOTAFU);//OTAFU Update
-                mqtt_subscribe(module_inst, GAME_TOPIC_IN, 2, SubscribeHandlerGameTopic);
-                mqtt_subscribe(module_inst, LED_TOPIC, 2, SubscribeHandlerLedTopic);
-                mqtt_subscribe(module_inst, IMU_TOPIC, 2, SubscribeHandlerImuTopic);
+                for (size_t i = 0; i < sizeof(mqttSubscriptions) / sizeof(mqttSubscriptions[0]); i++) {
+                    int rc = mqtt_subscribe(module_inst, mqttSubscriptions[i].topic, 2, mqttSubscriptions[i].handler);
+                    if (rc == HANDLER_TABLE_FULL) {
+                        LOGM_ERROR(LOG_MODULE_MQTT, "No MQTT handler left for %s, raise MAX_MESSAGE_HANDLERS\r\n", mqttSubscriptions[i].topic);
+                    } else if (rc < 0) {
+                        LOGM_ERROR(LOG_MODULE_MQTT, "MQTT subscribe to %s failed (%d)\r\n", mqttSubscriptions[i].topic, rc);
+                    }
+                }
                 /* Enable USART receiving callback. */
 
-                LogMessage(LOG_DEBUG_LVL, "MQTT Connected\r\n");
+                // The broker may have missed changes while disconnected: send every state again
+                StatePublisherInvalidate(mqttStates, WIFI_STATE_COUNT);
+                LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT Connected\r\n");
             } else {
                 /* Cannot connect for some reason. */
-                LogMessage(LOG_DEBUG_LVL, "MQTT broker decline your access! error code %d\r\n", data->connected.result);
+                LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT broker decline your access! error code %d\r\n", data->connected.result);
             }
 
             break;
 
+        case MQTT_CALLBACK_PUBLISHED:
+            // Completion of mqtt_publish_async, the context is the class index + 1 or WIFI_MQTT_STATE_CONTEXT
+            // (mqtt_publish passes no data)
+            if (data != NULL && data->published.context != NULL) {
+                uint8_t msgClass = (uint8_t)((uintptr_t)data->published.context - 1);
+                if (data->published.result != SUCCESS && msgClass < WIFI_MQTT_CLASSES) {
+                    mqttClassStats[msgClass].unacked++;
+                    LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT publish %u not acknowledged\r\n", data->published.id);
+                }
+                mqttWindowFull = false;
+                WifiNotify(WIFI_NOTIFY_MQTT_OUT);
+            }
+            break;
+
         case MQTT_CALLBACK_DISCONNECTED:
             /* Stop timer and USART callback. */
-            LogMessage(LOG_DEBUG_LVL, "MQTT disconnected\r\n");
+            LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT disconnected\r\n");
             // usart_disable_callback(&cdc_uart_module, USART_CALLBACK_BUFFER_RECEIVED);
             break;
     }
@@ -875,14 +1104,14 @@ static void configure_mqtt(void)
 
     result = mqtt_init(&mqtt_inst, &mqtt_conf);
     if (result < 0) {
-        LogMessage(LOG_DEBUG_LVL, "MQTT initialization failed. Error code is (%d)\r\n", result);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT initialization failed. Error code is (%d)\r\n", result);
         while (1) {
         }
     }
 
     result = mqtt_register_callback(&mqtt_inst, mqtt_callback);
     if (result < 0) {
-        LogMessage(LOG_DEBUG_LVL, "MQTT register callback failed. Error code is (%d)\r\n", result);
+        LOGM_DEBUG(LOG_MODULE_MQTT, "MQTT register callback failed. Error code is (%d)\r\n", result);
         while (1) {
         }
     }
@@ -928,19 +1157,23 @@ void configure_extint_callbacks(void)
 */
 static void HTTP_DownloadFileInit(void)
 {
-    if (mqtt_disconnect(&mqtt_inst, main_mqtt_broker)) {
-        LogMessage(LOG_DEBUG_LVL, "Error connecting to MQTT Broker!\r\n");
-    }
-    while ((mqtt_inst.isConnected)) {
-        m2m_wifi_handle_events(NULL);
+    if (do_download_flag) {
+        // Requested again (CLI) while a download runs: starting over would leave its file and SD writer behind
+        LOGM_DEBUG(LOG_MODULE_HTTP, "HTTP_DownloadFileInit: download running already.\r\n");
+        wifiStateMachine = WIFI_DOWNLOAD_HANDLE;
+        return;
     }
-    socketDeinit();
-    // DOWNLOAD A FILE
+
+    // DOWNLOAD A FILE. The HTTP client gets its own socket, MQTT stays connected
     do_download_flag = true;
-    /* Register socket callback function. */
-    registerSocketCallback(socket_cb, resolve_cb);
-    /* Initialize socket module. */
-    socketInit();
+    clear_state(COMPLETED | CANCELED);
+    resume_file_size = 0;
+    download_retries = 0;
+    download_suspended = false;
+    ota_stage = OTA_STAGE_MANIFEST;
+    downloadProgress = -1;
+    downloadStartTick = xTaskGetTickCount();
+    HTTP_PublishProgress("downloading");
 
     start_download();
     wifiStateMachine = WIFI_DOWNLOAD_HANDLE;
@@ -949,25 +1182,64 @@ static void HTTP_DownloadFileInit(void)
 /**
  static void HTTP_DownloadFileTransaction(void)
  * @brief	Routine to handle the HTTP transaction of downloading a file
- * @note
+ * @note	Runs once per main loop pass like MQTT_HandleTransactions, so commands and messages keep flowing.
+ *			Download events come from the same m2m_wifi_handle_events call
 
 */
 static void HTTP_DownloadFileTransaction(void)
 {
-    /* Connect to router. */
-    while (!(is_state_set(COMPLETED) || is_state_set(CANCELED))) {
-        /* Handle pending events from network controller. */
-        m2m_wifi_handle_events(NULL);
-        /* Checks the timer timeout. */
-        sw_timer_task(&swt_module_inst);
-        vTaskDelay(5);
+    MQTT_HandleTransactions();
+    if (!(is_state_set(COMPLETED) || is_state_set(CANCELED))) {
+        if (ota_stage == OTA_STAGE_IMAGE_PENDING && is_state_set(WIFI_CONNECTED)) {
+            start_download();
+        }
+        HTTP_PublishProgress("downloading");
+        return;
     }
 
-    // Disable socket for HTTP Transfer
-    socketDeinit();
-    vTaskDelay(1000);
-    // CONNECT TO MQTT BROKER
     do_download_flag = false;
+    if (is_state_set(CANCELED)) {
+        // Keep the current firmware, the bootloader only flashes when Flag.txt exists
+        LOGM_ERROR(LOG_MODULE_HTTP, "Download canceled\r\n");
+        HTTP_PublishProgress("failed");
+        wifiStateMachine = WIFI_MQTT_HANDLE;
+        return;
+    }
+    if (ota_stage == OTA_STAGE_CURRENT) {
+        HTTP_PublishProgress("current");
+        wifiStateMachine = WIFI_MQTT_HANDLE;
+        return;
+    }
+
+    int verified = OtaImageVerify(&ota_image_check);
+    if (verified != 0) {
+        // No Flag.txt, and the file goes so that nothing can flash it
+        LOGM_ERROR(LOG_MODULE_HTTP, "Image rejected (%d): %lu B, CRC32 0x%08lX, manifest %lu B, CRC32 0x%08lX\r\n", verified,
+                   (unsigned long)ota_image_check.offset, (unsigned long)(ota_image_check.crc ^ 0xFFFFFFFF), (unsigned long)ota_manifest.size,
+                   (unsigned long)ota_manifest.crc32);
+        f_unlink(part_file_name);
+        HTTP_PublishProgress("rejected");
+        wifiStateMachine = WIFI_MQTT_HANDLE;
+        return;
+    }
+    f_unlink(save_file_name);
+    FRESULT renamed = f_rename(part_file_name, save_file_name);
+    if (renamed != FR_OK) {
+        LOGM_ERROR(LOG_MODULE_HTTP, "Cannot rename %s to %s (%d)\r\n", part_file_name, save_file_name, renamed);
+        HTTP_PublishProgress("failed");
+        wifiStateMachine = WIFI_MQTT_HANDLE;
+        return;
+    }
+    HTTP_PublishProgress("completed");
+
+    struct SdWriterStats sdStats;
+    SdWriterGetStats(&sdStats);
+    uint32_t elapsedMs = (xTaskGetTickCount() - downloadStartTick) * portTICK_PERIOD_MS;
+    uint32_t kbPerSecond = (elapsedMs > 0) ? (uint32_t)(((uint64_t)received_file_size * 1000) / (1024 * (uint64_t)elapsedMs)) : 0;
+    LOGM_INFO(LOG_MODULE_HTTP, "Downloaded %lu B in %lu ms (%lu KB/s). SD: %lu writes, %lu ms writing, %lu ms waiting for a buffer\r\n",
+              (unsigned long)received_file_size, elapsedMs, kbPerSecond, sdStats.writes, sdStats.writeMs, sdStats.waitMs);
+    // Give the progress message a chance to leave before the reset
+    MQTT_HandleTransactions();
 
     // Write Flag
     char test_file_name[] = "0:Flag.txt";
@@ -975,7 +1247,7 @@ static void HTTP_DownloadFileTransaction(void)
     FRESULT res = f_open(&file_object, (char const *)test_file_name, FA_CREATE_ALWAYS | FA_WRITE);
 
     if (res != FR_OK) {
-        LogMessage(LOG_INFO_LVL, "[FAIL] res %d\r\n", res);
+        LOGM_INFO(LOG_MODULE_HTTP, "[FAIL] res %d\r\n", res);
     } else {
         SerialConsoleWriteString("Flag.txt added!\r\n");
     }
@@ -985,6 +1257,32 @@ static void HTTP_DownloadFileTransaction(void)
 	system_reset();
 }
 
+/**
+ static void HTTP_PublishProgress(const char *state)
+ * @brief	Publishes the download state and progress on NODE_OTAFU_PROGRESS_TOPIC
+ * @param[in]	state "downloading", "completed", "failed", "rejected" (the image does not match its manifest) or
+ *			"current" (the server image is the running one). "busy": an OTA order came while a download runs
+ * @note	While downloading, only every WIFI_DOWNLOAD_PROGRESS_STEP percent is published. Control class: waits for
+ *			room in its queue and takes a reserved pool block, so the final state is not lost to a burst of games
+
+*/
+static void HTTP_PublishProgress(const char *state)
+{
+    int8_t percent = (http_file_size > 0) ? (int8_t)(((uint64_t)received_file_size * 100) / http_file_size) : 0;
+    if (strcmp(state, "downloading") == 0 && downloadProgress >= 0 && percent < downloadProgress + WIFI_DOWNLOAD_PROGRESS_STEP) {
+        return;
+    }
+    downloadProgress = percent;
+
+    struct MqttOutMessage *msg = WifiMqttMessageAlloc(NODE_OTAFU_PROGRESS_TOPIC, WIFI_PROGRESS_PAYLOAD_SIZE, WIFI_MQTT_CLASS_CONTROL);
+    if (msg == NULL) {
+        return;
+    }
+    msg->len = snprintf(msg->payload, msg->size, "{\"state\":\"%s\",\"received\":%lu,\"total\":%lu}", state, (unsigned long)received_file_size,
+                        (unsigned long)http_file_size);
+    WifiMqttMessageSend(msg);
+}
+
 /**
  static void MQTT_InitRoutine(void)
  * @brief	Routine to initialize the MQTT socket to prepare for MQTT transactions
@@ -1001,12 +1299,12 @@ static void MQTT_InitRoutine(void)
     /* Connect to router. */
     if (!(mqtt_inst.isConnected)) {
         if (mqtt_connect(&mqtt_inst, main_mqtt_broker)) {
-            LogMessage(LOG_DEBUG_LVL, "Error connecting to MQTT Broker!\r\n");
+            LOGM_DEBUG(LOG_MODULE_MQTT, "Error connecting to MQTT Broker!\r\n");
         }
     }
 
     if (mqtt_inst.isConnected) {
-        LogMessage(LOG_DEBUG_LVL, "Connected to MQTT Broker!\r\n");
+        LOGM_DEBUG(LOG_MODULE_MQTT, "Connected to MQTT Broker!\r\n");
     }
     wifiStateMachine = WIFI_MQTT_HANDLE;
 }
@@ -1024,44 +1322,60 @@ static void MQTT_HandleTransactions(void)
     sw_timer_task(&swt_module_inst);
 
     // Check if data has to be sent!
-    MQTT_HandleGameMessages();
-    MQTT_HandleImuMessages();
-
-    // Handle MQTT messages
-    if (mqtt_inst.isConnected) mqtt_yield(&mqtt_inst, 100);
-}
-
-static void MQTT_HandleImuMessages(void)
-{
-    struct ImuDataPacket imuDataVar;
-    if (pdPASS == xQueueReceive(xQueueImuBuffer, &imuDataVar, 0)) {
-        snprintf(mqtt_msg, 63, "{\"imux\":%d, \"imuy\": %d, \"imuz\": %d}", imuDataVar.xmg, imuDataVar.ymg, imuDataVar.zmg);
-        mqtt_publish(&mqtt_inst, IMU_TOPIC, mqtt_msg, strlen(mqtt_msg), 1, 0);
+    MQTT_HandleOutMessages();
+
+    // Handle MQTT messages. Incoming data is only read while a recv is pending, so this is a short poll
+    if (mqtt_inst.isConnected && mqtt_yield(&mqtt_inst, WIFI_MQTT_YIELD_MS) == FAILURE) {
+        // Received data was lost or a send failed: the next packet cannot be found, start a new session
+        LOGM_WARNING(LOG_MODULE_MQTT, "MQTT connection lost, reconnecting\r\n");
+        mqtt_disconnect(&mqtt_inst, 1);
+        mqtt_inst.network.disconnect(&mqtt_inst.network);
+        mqtt_connect(&mqtt_inst, main_mqtt_broker);
     }
 }
 
-static void MQTT_HandleGameMessages(void)
+// Publishes the queued messages in place and gives their blocks back to the pools. The classes are checked
+// again after every message, so a control message never waits behind more than one telemetry publish.
+// Publishes do not wait for their PUBACK/PUBCOMP: up to MAX_INFLIGHT_PUBLISHES are in flight and mqtt_yield
+// completes them. A message is taken off its queue before the publish, as the producers' drop policies free
+// what is still queued. When the window is full it is held in mqttHeldMessage and goes first once a slot is
+// free; the messages behind it stay queued, so the class policies still apply to them
+static void MQTT_HandleOutMessages(void)
 {
-    struct GameDataPacket gamePacket;
-    if (pdPASS == xQueueReceive(xQueueGameBuffer, &gamePacket, 0)) {
-        snprintf(mqtt_msg, 63, "{\"game\":[");
-        for (int iter = 0; iter < GAME_SIZE; iter++) {
-            char numGame[5];
-            if (gamePacket.game[iter] != 0xFF) {
-                snprintf(numGame, 3, "%d", gamePacket.game[iter]);
-                strcat(mqtt_msg, numGame);
-                if (gamePacket.game[iter + 1] != 0xFF && iter + 1 < GAME_SIZE) {
-                    snprintf(numGame, 5, ",");
-                    strcat(mqtt_msg, numGame);
-                }
-            } else {
-                break;
+    uint8_t msgClass = 0;
+    while (mqtt_inst.isConnected) {
+        struct MqttOutMessage *msg = mqttHeldMessage;
+        if (msg == NULL) {
+            while (msgClass < WIFI_MQTT_CLASSES && pdPASS != xQueueReceive(mqttOutQueues[msgClass], &msg, 0)) {
+                msgClass++;
+            }
+            if (msgClass == WIFI_MQTT_CLASSES) {
+                return;
             }
         }
-        strcat(mqtt_msg, "]}");
-        LogMessage(LOG_DEBUG_LVL, mqtt_msg);
-        LogMessage(LOG_DEBUG_LVL, "\r\n");
-        mqtt_publish(&mqtt_inst, GAME_TOPIC_OUT, mqtt_msg, strlen(mqtt_msg), 1, 0);
+        msgClass = msg->msgClass;
+        // The payload is copied into the send buffer, the block can be freed whatever the outcome
+        int rc = mqtt_publish_async(&mqtt_inst, msg->topic, msg->payload, msg->len, msg->qos, 0, (void *)(uintptr_t)(msgClass + 1));
+        if (rc == INFLIGHT_WINDOW_FULL) {
+            mqttHeldMessage = msg;
+            mqttWindowFull = true;
+            return;
+        }
+        mqttHeldMessage = NULL;
+        struct WifiMqttClassStats *stats = &mqttClassStats[msgClass];
+        uint32_t latencyMs = (xTaskGetTickCount() - msg->queuedAt) * portTICK_PERIOD_MS;
+        LOGM_DEBUG(LOG_MODULE_MQTT, "%s (%u bytes, %lu ms)\r\n", msg->topic, msg->len, latencyMs);
+        if (rc < 0) {
+            stats->dropped++;
+        } else {
+            stats->published++;
+            stats->totalLatencyMs += latencyMs;
+            if (latencyMs > stats->maxLatencyMs) {
+                stats->maxLatencyMs = latencyMs;
+            }
+        }
+        MemPoolFree(msg);
+        msgClass = 0;
     }
 }
 /**
@@ -1075,15 +1389,17 @@ void vWifiTask(void *pvParameters)
 {
     tstrWifiInitParam param;
     int8_t ret;
+    wifiTask = xTaskGetCurrentTaskHandle();
     vTaskDelay(100);
     init_state();
     // Create buffers to send data
-    xQueueWifiState = xQueueCreate(5, sizeof(uint32_t));
-    xQueueImuBuffer = xQueueCreate(5, sizeof(struct ImuDataPacket));
-    xQueueGameBuffer = xQueueCreate(2, sizeof(struct GameDataPacket));
-    xQueueDistanceBuffer = xQueueCreate(5, sizeof(uint16_t));
+    xQueueWifiState = STATIC_QUEUE_CREATE(wifiState, WIFI_STATE_QUEUE_LEN, sizeof(uint32_t));
+    mqttOutQueues[WIFI_MQTT_CLASS_CONTROL] = STATIC_QUEUE_CREATE(mqttControl, WIFI_MQTT_CONTROL_QUEUE_LEN, sizeof(struct MqttOutMessage *));
+    mqttOutQueues[WIFI_MQTT_CLASS_EVENT] = STATIC_QUEUE_CREATE(mqttEvent, WIFI_MQTT_EVENT_QUEUE_LEN, sizeof(struct MqttOutMessage *));
+    mqttOutQueues[WIFI_MQTT_CLASS_TELEMETRY] = STATIC_QUEUE_CREATE(mqttTelemetry, WIFI_MQTT_TELEMETRY_QUEUE_LEN, sizeof(struct MqttOutMessage *));
 
-    if (xQueueWifiState == NULL || xQueueImuBuffer == NULL || xQueueGameBuffer == NULL || xQueueDistanceBuffer == NULL) {
+    if (xQueueWifiState == NULL || mqttOutQueues[WIFI_MQTT_CLASS_CONTROL] == NULL || mqttOutQueues[WIFI_MQTT_CLASS_EVENT] == NULL ||
+        mqttOutQueues[WIFI_MQTT_CLASS_TELEMETRY] == NULL) {
         SerialConsoleWriteString("ERROR Initializing Wifi Data queues!\r\n");
     }
 
@@ -1094,6 +1410,12 @@ void vWifiTask(void *pvParameters)
     /* Initialize the HTTP client service. */
     configure_http_client();
 
+    /* The command tables are searched by keyword: an unsorted one would make some commands unreachable. */
+    configASSERT(MqttCommandTableIsValid(&switchTable));
+    configASSERT(MqttCommandTableIsValid(&motorTable));
+    configASSERT(MqttCommandTableIsValid(&ledStripTable));
+    configASSERT(MqttCommandTableIsValid(&otafuTable));
+
     /* Initialize the MQTT service. */
     configure_mqtt();
 
@@ -1113,12 +1435,12 @@ void vWifiTask(void *pvParameters)
     param.pfAppWifiCb = wifi_cb;
     ret = m2m_wifi_init(&param);
     if (M2M_SUCCESS != ret) {
-        LogMessage(LOG_DEBUG_LVL, "main: m2m_wifi_init call error! (res %d)\r\n", ret);
+        LOG_DEBUG("main: m2m_wifi_init call error! (res %d)\r\n", ret);
         while (1) {
         }
     }
 
-    LogMessage(LOG_DEBUG_LVL, "main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
+    LOG_DEBUG("main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
 
     // Re-enable socket for MQTT Transfer
     socketInit();
@@ -1131,6 +1453,7 @@ void vWifiTask(void *pvParameters)
         m2m_wifi_handle_events(NULL);
         /* Checks the timer timeout. */
         sw_timer_task(&swt_module_inst);
+        nm_bsp_wait_for_event(WIFI_EVENT_WAIT_MS);
     }
 
     vTaskDelay(1000);
@@ -1169,126 +1492,135 @@ void vWifiTask(void *pvParameters)
             wifiStateMachine = DataToReceive;  // Update new state
         }
 
-	//Publish   MCU to Node red
-	static bool button_prev_state = false;  // tracks last state
-	bool button_curr_state = !port_pin_get_input_level(BUTTON_0_PIN);  // low level 0 -> pressed(active) 1
-
-	if (button_curr_state != button_prev_state) {
-		button_prev_state = button_curr_state;
-
-		if (button_curr_state) {
-			// Button pressed
-			mqtt_publish(&mqtt_inst, NODE_BUTTON_TOPIC, "on", 2, 2, 0); //Pressed -> Get payload "on" -> LED on Node red light on
-			LogMessage(LOG_DEBUG_LVL, "Button pressed ?? MQTT ON\r\n");
-			} else {
-			// Button released
-			mqtt_publish(&mqtt_inst, NODE_BUTTON_TOPIC, "off", 3, 2, 0);
-			LogMessage(LOG_DEBUG_LVL, "Button released ?? MQTT OFF\r\n");
-		}
-	}
-	
-//Voice Control(mqttin publish to Node-RED)	
-	if(voice_control_flag == 0){
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "No", 2, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "No State\r\n");
-	}
-	else if (voice_control_flag == 1)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "Blink", 5, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Blink in one color\r\n");
-
-	}
-	else if (voice_control_flag == 2)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "Hold in one color", 17, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "hold in one color\r\n");
-	}
-	else if (voice_control_flag == 3)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "Hold in multiple colors", 23, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Hold in multiple colors\r\n");
-	}
-	else if (voice_control_flag == 4)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "Close LED", 9, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Close LED\r\n");
-	}
-	else if (voice_control_flag == 5)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "start", 5, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Count Down Time\r\n");
-	}
-	else if (voice_control_flag == 6)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "forward", 7, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Move Forward\r\n");
-	}
-	else if (voice_control_flag == 7)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "backward", 7, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Move Backward\r\n");
-	}
-	else if (voice_control_flag == 8)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "left", 4, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Move towards Left\r\n");
-	}
-	else if (voice_control_flag == 9)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "right", 5, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Move Towards Right\r\n");
-	}
-	else if (voice_control_flag == 10)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "stop", 4, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Stop\r\n");
-	}
-	else if (voice_control_flag == 11)
-	{
-		mqtt_publish(&mqtt_inst, NODE_VOICE_TOPIC, "end", 3, 2, 0);
-		LogMessage(LOG_DEBUG_LVL, "Voice Control End\r\n");
-	}
+        // Publish MCU state to Node-RED, only what changed (see StatePublisher.h)
+        TickType_t waitTicks = pdMS_TO_TICKS(WIFI_IDLE_WAIT_MS);
+        StatePublisherSet(&mqttStates[WIFI_STATE_BUTTON], !port_pin_get_input_level(BUTTON_0_PIN));  // low level 0 -> pressed(active) 1
+        StatePublisherSet(&mqttStates[WIFI_STATE_VOICE], voice_control_flag);
+        if (mqtt_inst.isConnected) {
+            TickType_t stateTicks = StatePublisherRun(mqttStates, WIFI_STATE_COUNT, MQTT_PublishState);
+            waitTicks = stateTicks < pdMS_TO_TICKS(WIFI_MQTT_POLL_MS) ? stateTicks : pdMS_TO_TICKS(WIFI_MQTT_POLL_MS);
+        }
 
-        vTaskDelay(100);
+        // Sleep until there is something to do. While connected, wake up anyway to poll the broker
+        WifiWaitForWork(waitTicks);
     }
     return;
 }
 
+/**
+ static void WifiNotify(uint32_t bits)
+ * @brief	Wakes the WiFi task with the given WIFI_NOTIFY_* bits
+ * @note	Does nothing before the WiFi task has started
+
+*/
+static void WifiNotify(uint32_t bits)
+{
+    if (wifiTask != NULL) {
+        xTaskNotify(wifiTask, bits, eSetBits);
+    }
+}
+
+/**
+ static void WifiWaitForWork(TickType_t timeout)
+ * @brief	Blocks the WiFi task until a message is queued, a state change is requested, the WINC interrupts or
+ *			the timeout expires
+ * @note	A notification can be consumed by a wait inside the WINC driver (nm_bsp_wait_for_event), so the queues
+ *			are checked first; what arrives after the check sets the notification and ends the wait at once
+
+*/
+static void WifiWaitForWork(TickType_t timeout)
+{
+    // Queued messages that wait for a free in-flight slot are no work until an acknowledgement comes
+    if (mqttHeldMessage != NULL && !mqttWindowFull) {
+        return;
+    }
+    for (uint8_t msgClass = 0; msgClass < WIFI_MQTT_CLASSES && !mqttWindowFull; msgClass++) {
+        if (uxQueueMessagesWaiting(mqttOutQueues[msgClass]) > 0) {
+            return;
+        }
+    }
+    if (uxQueueMessagesWaiting(xQueueWifiState) > 0) {
+        return;
+    }
+    xTaskNotifyWait(0, WIFI_NOTIFY_ALL, NULL, timeout);
+}
+
 void WifiHandlerSetState(uint8_t state)
 {
     if (state <= WIFI_DOWNLOAD_HANDLE) {
         xQueueSend(xQueueWifiState, &state, (TickType_t)10);
+        WifiNotify(WIFI_NOTIFY_STATE);
     }
 }
 
 /**
  void WifiAddImuDataToQueue(struct ImuDataPacket* imuPacket)
- * @brief	Adds an IMU struct to the queue to send via MQTT
+ * @brief	Adds an IMU sample to the batch sent via MQTT
  * @param[out]
 
- * @return		Returns pdTrue if data can be added to queue, pdFalse if queue is full
- * @note
+ * @return		Returns pdTrue if the sample was batched (and the batch queued when complete), pdFalse if a complete
+ *				batch could not be queued (its samples are lost)
+ * @note	Batches of WIFI_IMU_BATCH samples are sent in the binary layout of ImuTelemetry.h. A batch is also sent
+ *			when a sample comes WIFI_IMU_BATCH_MAX_MS after its first one. Only one task may add samples
 
 */
 int WifiAddImuDataToQueue(struct ImuDataPacket *imuPacket)
 {
-    int error = xQueueSend(xQueueImuBuffer, imuPacket, (TickType_t)10);
-    return error;
+    static char imuPayload[WIFI_IMU_PAYLOAD_SIZE];
+    static struct ImuTelemetryBatch imuBatch = {.count = 0};
+    uint32_t nowMs = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    int rc = pdTRUE;
+
+    if (imuBatch.count > 0 && nowMs - imuBatch.firstMs >= WIFI_IMU_BATCH_MAX_MS) {
+        rc = WifiSendImuBatch(&imuBatch);
+    }
+    if (imuBatch.count == 0) {
+        ImuTelemetryBegin(&imuBatch, imuPayload, sizeof(imuPayload));
+    }
+    ImuTelemetryAdd(&imuBatch, imuPacket->xmg, imuPacket->ymg, imuPacket->zmg, nowMs);
+    if (imuBatch.count >= WIFI_IMU_BATCH) {
+        rc = WifiSendImuBatch(&imuBatch);
+    }
+    return rc;
 }
 
 /**
- void WifiAddImuDataToQueue(struct ImuDataPacket* imuPacket)
+ static int WifiSendImuBatch(struct ImuTelemetryBatch *batch)
+ * @brief	Copies an IMU batch into a message of its exact size and queues it. The batch is empty afterwards
+ * @return		Returns pdTrue if the batch was queued, pdFalse otherwise
+
+*/
+static int WifiSendImuBatch(struct ImuTelemetryBatch *batch)
+{
+    size_t len = ImuTelemetryEnd(batch);
+    batch->count = 0;
+
+    struct MqttOutMessage *msg = WifiMqttMessageAlloc(IMU_TOPIC, len, WIFI_MQTT_CLASS_TELEMETRY);
+    if (msg == NULL) {
+        return pdFALSE;
+    }
+    memcpy(msg->payload, batch->writer.buffer, len);
+    msg->len = len;
+    return WifiMqttMessageSend(msg);
+}
+
+/**
+ void WifiAddDistanceDataToQueue(uint16_t *distance)
  * @brief	Adds an Distance data to the queue to send via MQTT
  * @param[out]
 
- * @return		Returns pdTrue if data can be added to queue, pdFalse if queue is full
- * @note
+ * @return		Returns pdTrue if data can be added to queue, pdFalse if no block is free
+ * @note	Telemetry class: when the queue is full the oldest pending telemetry message is dropped
 
 */
 int WifiAddDistanceDataToQueue(uint16_t *distance)
 {
-    int error = xQueueSend(xQueueDistanceBuffer, distance, (TickType_t)10);
-    return error;
+    struct MqttOutMessage *msg = WifiMqttMessageAlloc(DISTANCE_TOPIC, WIFI_DISTANCE_PAYLOAD_SIZE, WIFI_MQTT_CLASS_TELEMETRY);
+    if (msg == NULL) {
+        return pdFALSE;
+    }
+    msg->len = snprintf(msg->payload, msg->size, "{\"distance\":%u}", *distance);
+    return WifiMqttMessageSend(msg);
 }
 
 /**
@@ -1302,6 +1634,154 @@ int WifiAddDistanceDataToQueue(uint16_t *distance)
 */
 int WifiAddGameDataToQueue(struct GameDataPacket *game)
 {
-    int error = xQueueSend(xQueueGameBuffer, game, (TickType_t)10);
-    return error;
+    struct MqttOutMessage *msg = WifiMqttMessageAlloc(GAME_TOPIC_OUT, WIFI_GAME_PAYLOAD_SIZE, WIFI_MQTT_CLASS_EVENT);
+    if (msg == NULL) {
+        return pdFALSE;
+    }
+
+    // Payload sized for GAME_SIZE plays of up to 3 digits, nothing is cut
+    size_t len = snprintf(msg->payload, msg->size, "{\"game\":[");
+    for (int iter = 0; iter < GAME_SIZE && game->game[iter] != 0xFF; iter++) {
+        len += snprintf(msg->payload + len, msg->size - len, "%s%u", (iter > 0) ? "," : "", game->game[iter]);
+    }
+    len += snprintf(msg->payload + len, msg->size - len, "]}");
+    msg->len = len;
+    return WifiMqttMessageSend(msg);
+}
+
+/**
+ struct MqttOutMessage *WifiMqttMessageAlloc(const char *topic, size_t payloadSize, uint8_t msgClass)
+ * @brief	Takes a message block from the memory pools, to be filled and passed to WifiMqttMessageSend
+ * @param[in]	topic Topic to publish to. Must stay valid until the message is published (string literal)
+ * @param[in]	payloadSize Payload bytes needed, terminator included
+ * @param[in]	msgClass Priority class, WIFI_MQTT_CLASS_*
+ * @return		The message with QoS 1 and an empty payload, NULL if no block is free
+ * @note
+
+*/
+struct MqttOutMessage *WifiMqttMessageAlloc(const char *topic, size_t payloadSize, uint8_t msgClass)
+{
+    // Control messages may take the reserved blocks
+    size_t blockSize = sizeof(struct MqttOutMessage) + payloadSize;
+    struct MqttOutMessage *msg = (msgClass == WIFI_MQTT_CLASS_CONTROL) ? MemPoolAllocReserve(blockSize) : MemPoolAlloc(blockSize);
+    if (msg == NULL) {
+        LOGM_WARNING(LOG_MODULE_MQTT, "No pool block for %s\r\n", topic);
+        return NULL;
+    }
+    msg->topic = topic;
+    msg->msgClass = msgClass < WIFI_MQTT_CLASSES ? msgClass : WIFI_MQTT_CLASS_TELEMETRY;
+    msg->qos = 1;
+    msg->len = 0;
+    msg->size = payloadSize;
+    return msg;
+}
+
+/**
+ int WifiMqttMessageSend(struct MqttOutMessage *msg)
+ * @brief	Hands a message to the WiFi task, which publishes it and releases its block
+ * @param[in]	msg Message from WifiMqttMessageAlloc, with payload and len filled. Not to be used after the call
+ * @return		Returns pdTrue if the message was queued, pdFalse if the class policy dropped it (it is then released)
+ * @note	Never waits for the network. Only the control class waits, up to WIFI_MQTT_CONTROL_BLOCK_MS, for room
+ *			in its queue; the other classes drop or replace a message instead (see mqttClassConfig)
+
+*/
+int WifiMqttMessageSend(struct MqttOutMessage *msg)
+{
+    QueueHandle_t queue = mqttOutQueues[msg->msgClass];
+    struct WifiMqttClassStats *stats = &mqttClassStats[msg->msgClass];
+    struct MqttOutMessage *old;
+    BaseType_t queued;
+
+    if (queue == NULL) {
+        // The WiFi task has not started yet
+        MemPoolFree(msg);
+        return pdFALSE;
+    }
+
+    msg->queuedAt = xTaskGetTickCount();
+    if (mqttClassConfig[msg->msgClass].policy == MQTT_POLICY_BLOCK) {
+        queued = xQueueSend(queue, &msg, mqttClassConfig[msg->msgClass].blockTicks);
+    } else if (mqttClassConfig[msg->msgClass].policy == MQTT_POLICY_COALESCE_LATEST) {
+        queued = WifiMqttCoalesce(queue, msg, stats);
+    } else {
+        queued = xQueueSend(queue, &msg, 0);
+        if (queued != pdPASS && mqttClassConfig[msg->msgClass].policy != MQTT_POLICY_DROP_NEWEST) {
+            // Make room by dropping the oldest pending message. The WiFi task may take it first
+            while (queued != pdPASS) {
+                if (pdPASS == xQueueReceive(queue, &old, 0)) {
+                    MemPoolFree(old);
+                    taskENTER_CRITICAL();
+                    stats->dropped++;
+                    taskEXIT_CRITICAL();
+                }
+                queued = xQueueSend(queue, &msg, 0);
+            }
+        }
+    }
+
+    taskENTER_CRITICAL();
+    if (queued == pdPASS) {
+        stats->enqueued++;
+    } else {
+        stats->dropped++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (queued != pdPASS) {
+        MemPoolFree(msg);
+        return pdFALSE;
+    }
+    WifiNotify(WIFI_NOTIFY_MQTT_OUT);
+    return pdTRUE;
+}
+
+/**
+ static BaseType_t WifiMqttCoalesce(QueueHandle_t queue, struct MqttOutMessage *msg, struct WifiMqttClassStats *stats)
+ * @brief	Queues msg in place of the pending message of the same topic, if there is one
+ * @return		pdPASS if msg was queued, errQUEUE_FULL if every entry holds another topic (msg is dropped)
+ * @note	The queue is emptied and refilled with the scheduler suspended, so the pending order is kept and no
+ *			other producer or the WiFi task sees it half done
+
+*/
+static BaseType_t WifiMqttCoalesce(QueueHandle_t queue, struct MqttOutMessage *msg, struct WifiMqttClassStats *stats)
+{
+    struct MqttOutMessage *pending[WIFI_MQTT_EVENT_QUEUE_LEN];
+    struct MqttOutMessage *replaced = NULL;
+    UBaseType_t count = 0;
+    BaseType_t queued;
+
+    vTaskSuspendAll();
+    while (count < WIFI_MQTT_EVENT_QUEUE_LEN && pdPASS == xQueueReceive(queue, &pending[count], 0)) {
+        count++;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        if (replaced == NULL && strcmp(pending[i]->topic, msg->topic) == 0) {
+            replaced = pending[i];
+        } else {
+            xQueueSend(queue, &pending[i], 0);
+        }
+    }
+    queued = xQueueSend(queue, &msg, 0);
+    xTaskResumeAll();
+
+    if (replaced != NULL) {
+        MemPoolFree(replaced);
+        taskENTER_CRITICAL();
+        stats->dropped++;
+        taskEXIT_CRITICAL();
+    }
+    return queued;
+}
+
+/**
+ void WifiGetMqttClassStats(struct WifiMqttClassStats *stats)
+ * @brief	Copies the counters of the outbound MQTT priority classes
+ * @param[out]	stats WIFI_MQTT_CLASSES entries, indexed by WIFI_MQTT_CLASS_*
+
+*/
+void WifiGetMqttClassStats(struct WifiMqttClassStats *stats)
+{
+    taskENTER_CRITICAL();
+    memcpy(stats, mqttClassStats, sizeof(mqttClassStats));
+    taskEXIT_CRITICAL();
 }
\ No newline at end of file
@@ -27,6 +27,7 @@ extern "C" {
 #include "stdio_serial.h"
 #include "flag.h"
 #include "LED/LED.h"
+#include "Telemetry/ImuTelemetry.h"
 
 /******************************************************************************
  * Defines
@@ -37,8 +38,30 @@ extern "C" {
 #define WIFI_DOWNLOAD_INIT 2    ///< State for Wifi handler to Initialize Download Connection
 #define WIFI_DOWNLOAD_HANDLE 3  ///< State for Wifi handler to Handle Download Connection
 
-#define WIFI_TASK_SIZE 1000
+#define WIFI_TASK_SIZE (1024 - 128)
 #define WIFI_PRIORITY (configMAX_PRIORITIES - 2)
+#define WIFI_EVENT_WAIT_MS 100   ///< Longest sleep on the WINC interrupt while waiting for a network event
+#define WIFI_MQTT_YIELD_MS 20    ///< Time given to the MQTT client to read from the broker per loop
+#define WIFI_MQTT_POLL_MS 100    ///< Longest sleep of the main loop while connected (incoming MQTT, keep-alive)
+#define WIFI_IDLE_WAIT_MS 1000   ///< Longest sleep of the main loop while not connected (software timers)
+
+// Task notification bits of the WiFi task. Bit 0 (NM_BSP_EVENT_NOTIFY_BIT) is set by the WINC interrupt
+#define WIFI_NOTIFY_MQTT_OUT (1ul << 1)   ///< A message was queued for publishing (WifiMqttMessageSend)
+#define WIFI_NOTIFY_STATE (1ul << 2)      ///< A state change was queued on xQueueWifiState
+#define WIFI_NOTIFY_ALL (NM_BSP_EVENT_NOTIFY_BIT | WIFI_NOTIFY_MQTT_OUT | WIFI_NOTIFY_STATE)
+
+#define WIFI_STATE_QUEUE_LEN 5      ///< Length of xQueueWifiState
+
+// Outbound MQTT priority classes. The WiFi task always publishes from the lowest numbered non-empty class first
+#define WIFI_MQTT_CLASS_CONTROL 0     ///< Command acknowledgements, OTA status: block the producer briefly, never dropped silently. Takes the reserved pool blocks
+#define WIFI_MQTT_CLASS_EVENT 1       ///< Game data: only the latest pending message of each topic is kept
+#define WIFI_MQTT_CLASS_TELEMETRY 2   ///< IMU, distance: the oldest pending message is dropped when full
+#define WIFI_MQTT_CLASSES 3
+
+#define WIFI_MQTT_CONTROL_QUEUE_LEN 4     ///< Pending messages of WIFI_MQTT_CLASS_CONTROL
+#define WIFI_MQTT_CONTROL_BLOCK_MS 10     ///< Longest wait of a control producer for room in its queue
+#define WIFI_MQTT_EVENT_QUEUE_LEN 4       ///< Pending messages of WIFI_MQTT_CLASS_EVENT, one per topic
+#define WIFI_MQTT_TELEMETRY_QUEUE_LEN 4   ///< Pending messages of WIFI_MQTT_CLASS_TELEMETRY
 
 /** Wi-Fi AP Settings. */
 // Note: It is highly recommended that you save your Wi-Fi details in a separate header file, "secret.h", which is not committed to Github (added to gitignore).
@@ -53,15 +76,15 @@ extern "C" {
 
 /** Content URI for download. */
 #define MAIN_HTTP_FILE_URL "http://172.177.231.136/Application.bin"  ///< Change me to the URL to download your OTAU binary file from!
+/** Manifest (version, size, CRC32) of MAIN_HTTP_FILE_URL, fetched before it. See OtaImage.h */
+#define MAIN_HTTP_MANIFEST_URL "http://172.177.231.136/Application.manifest"
 
 /** Maximum size for packet buffer. */
 #define MAIN_BUFFER_MAX_SIZE (512)
 /** Maximum file name length. */
 #define MAIN_MAX_FILE_NAME_LENGTH (64)
-/** Maximum file extension length. */
-#define MAIN_MAX_FILE_EXT_LENGTH (8)
-/** Output format with '0'. */
-#define MAIN_ZERO_FMT(SZ) (SZ == 4) ? "%04d" : (SZ == 3) ? "%03d" : (SZ == 2) ? "%02d" : "%d"
+/** Appended to the file name while the image is downloaded and not verified yet. */
+#define MAIN_PART_FILE_EXT ".part"
 #define GAME_SIZE 20  ///< Number of plays in game
 
 typedef enum {
@@ -86,6 +109,36 @@ struct GameDataPacket {
     uint8_t game[GAME_SIZE];
 };
 
+#define WIFI_IMU_BATCH 8           ///< IMU samples per MQTT message (binary layout in ImuTelemetry.h)
+#define WIFI_IMU_BATCH_MAX_MS 1000 ///< A sample this long after the first of its batch sends the batch
+#define WIFI_IMU_PAYLOAD_SIZE IMU_TELEMETRY_SIZE(WIFI_IMU_BATCH)                                    ///< Largest IMU payload
+#define WIFI_GAME_PAYLOAD_SIZE (sizeof("{\"game\":[]}") + GAME_SIZE * 4)                     ///< Largest game payload
+#define WIFI_DISTANCE_PAYLOAD_SIZE sizeof("{\"distance\":65535}")                             ///< Largest distance payload
+#define WIFI_PROGRESS_PAYLOAD_SIZE sizeof("{\"state\":\"downloading\",\"received\":4294967295,\"total\":4294967295}")  ///< Largest download progress payload
+#define WIFI_DOWNLOAD_PROGRESS_STEP 5  ///< Percent of the download between two progress messages
+#define WIFI_DOWNLOAD_RETRIES 5        ///< Reconnections in a row without new data before a download is canceled
+
+// Outbound MQTT message, allocated from the memory pools. The WiFi task publishes it in place and frees it
+struct MqttOutMessage {
+    const char *topic;  ///< Topic to publish to
+    uint16_t len;       ///< Payload length, without the terminator
+    uint16_t size;      ///< Payload capacity
+    uint8_t qos;        ///< QoS of the publish
+    uint8_t msgClass;   ///< Priority class, WIFI_MQTT_CLASS_*
+    TickType_t queuedAt;  ///< Tick count when queued, for the latency counters
+    char payload[];     ///< Payload, follows the header in the same block
+};
+
+// Counters of an outbound MQTT priority class, see WifiGetMqttClassStats
+struct WifiMqttClassStats {
+    uint32_t enqueued;        ///< Messages accepted
+    uint32_t dropped;         ///< Messages dropped by the class policy (queue full) or lost on a replaced/failed send
+    uint32_t published;       ///< Messages handed to the MQTT client
+    uint32_t unacked;         ///< QoS 1/2 messages sent but never acknowledged (timeout or disconnection)
+    uint32_t maxLatencyMs;    ///< Longest time from queueing to publishing
+    uint32_t totalLatencyMs;  ///< Sum of the queueing times of the published messages
+};
+
 // Structure to hold an RGB LED Color packet
 struct RgbColorPacket {
     uint8_t red;
@@ -111,8 +164,39 @@ struct RgbColorPacket {
 #define NODE_LED_TOPIC "Status/ledstrip" // From Node-RED to MCU
 //OTAFU Update
 #define NODE_OTAFU_TOPIC "Status/OTAFU"  // From Node-RED to MCU
+#define NODE_OTAFU_PROGRESS_TOPIC "Status/OTAFU/Progress"  // From MCU to Node-RED, download state and progress
 //Voice Control(From MCU to Node-RED)
-#define NODE_VOICE_TOPIC "Status/Voice" 
+#define NODE_VOICE_TOPIC "Status/Voice"
+
+// Device state topics published to Node-RED (see StatePublisher.h)
+#define WIFI_STATE_BUTTON 0
+#define WIFI_STATE_VOICE 1
+#define WIFI_STATE_COUNT 2
+
+#define WIFI_BUTTON_QOS 2                ///< Button presses are events: exactly once
+#define WIFI_VOICE_QOS 1                 ///< The voice state is republished on heartbeat, a duplicate is harmless
+#define WIFI_VOICE_COALESCE_MS 200       ///< Voice changes within this window publish only the last state
+#define WIFI_VOICE_HEARTBEAT_MS 60000    ///< Republish period of an unchanged voice state
+
+// Binary opcodes of the control topics (first payload byte, see MqttCommand.h). Node-RED may send these
+// instead of the text keywords. Do not renumber, they are part of the protocol
+#define MQTT_OP_SWITCH_ON 0x01
+#define MQTT_OP_SWITCH_OFF 0x02
+
+#define MQTT_OP_MOTOR_FORWARD 0x01
+#define MQTT_OP_MOTOR_BACKWARD 0x02
+#define MQTT_OP_MOTOR_LEFT 0x03
+#define MQTT_OP_MOTOR_RIGHT 0x04
+#define MQTT_OP_MOTOR_STOP 0x05
+#define MQTT_OP_MOTOR_SPEED 0x06   ///< Arguments: int8 left speed, int8 right speed (-120 to 120)
+
+#define MQTT_OP_LED_BLINK 0x01
+#define MQTT_OP_LED_ONE_COLOR 0x02
+#define MQTT_OP_LED_MULTIPLE_COLORS 0x03
+#define MQTT_OP_LED_CLOSE 0x04
+#define MQTT_OP_LED_COLOR 0x05     ///< Arguments: red, green, blue of the one color modes
+
+#define MQTT_OP_OTAFU_FIRMWARE 0x01 
 
 
 #define PLAYER1 1  ///< Comment me to compile for player 2. Uncomment me to define for player 1.
@@ -174,6 +258,9 @@ void WifiHandlerSetState(uint8_t state);
 int WifiAddDistanceDataToQueue(uint16_t *distance);
 int WifiAddImuDataToQueue(struct ImuDataPacket *imuPacket);
 int WifiAddGameDataToQueue(struct GameDataPacket *game);
+struct MqttOutMessage *WifiMqttMessageAlloc(const char *topic, size_t payloadSize, uint8_t msgClass);
+int WifiMqttMessageSend(struct MqttOutMessage *msg);
+void WifiGetMqttClassStats(struct WifiMqttClassStats *stats);
 void SubscribeHandlerLedTopic(MessageData *msgData);
 void SubscribeHandlerGameTopic(MessageData *msgData);
 void SubscribeHandlerImuTopic(MessageData *msgData);
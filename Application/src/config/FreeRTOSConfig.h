@@ -42,6 +42,8 @@
 #include <gclk.h>
 #include <stdint.h>
 void assert_triggered(const char *file, uint32_t line);
+void RunTimeStatsTimerInit(void);
+uint32_t RunTimeStatsGetCounter(void);
 #endif
 
 #define configUSE_PREEMPTION 1
@@ -52,8 +54,18 @@ void assert_triggered(const char *file, uint32_t line);
 #define configTICK_RATE_HZ ((portTickType)1000)
 #define configMAX_PRIORITIES (5)
 #define configMINIMAL_STACK_SIZE ((unsigned short)100)
-/* configTOTAL_HEAP_SIZE is not used when heap_3.c is used. */
+/* Build option: 1 places the application tasks and queues, the idle, timer and trace tasks in static memory,
+   see StaticAlloc/StaticAlloc.h. 0 takes them from the heap */
+#ifndef configSUPPORT_STATIC_ALLOCATION
+#define configSUPPORT_STATIC_ALLOCATION 1
+#endif
+#define configSUPPORT_DYNAMIC_ALLOCATION 1
+/* Size of the heap in Heap/Heap.c. With static allocation it only holds the semaphores, mutexes and HTTP buffers */
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+#define configTOTAL_HEAP_SIZE ((size_t)(3072))
+#else
 #define configTOTAL_HEAP_SIZE ((size_t)(13000))
+#endif
 #define configMAX_TASK_NAME_LEN (8)
 #define configUSE_TRACE_FACILITY 1
 #define configUSE_16_BIT_TICKS 0
@@ -65,7 +77,10 @@ void assert_triggered(const char *file, uint32_t line);
 #define configUSE_MALLOC_FAILED_HOOK 1
 #define configUSE_COUNTING_SEMAPHORES 1
 #define configUSE_QUEUE_SETS 1
-#define configGENERATE_RUN_TIME_STATS 0
+#define configGENERATE_RUN_TIME_STATS 1
+/* Run time counter, see RunTimeStats/RunTimeStats.h */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() RunTimeStatsTimerInit()
+#define portGET_RUN_TIME_COUNTER_VALUE() RunTimeStatsGetCounter()
 #define configENABLE_BACKWARD_COMPATIBILITY 1
 #define configUSE_DAEMON_TASK_STARTUP_HOOK 1  // Ported from FreeRToS 9.0.0
 
@@ -31,12 +31,16 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_HTTP
+
 #include "iot/http/http_client.h"
 #include <string.h>
 #include "driver/include/m2m_wifi.h"
 #include "iot/stream_writer.h"
 #include <stdio.h>
 #include <errno.h>
+#include "SerialConsole.h"
+#include "FreeRTOS.h"
 
 #define DEFAULT_USER_AGENT "atmel/1.0.2"
 
@@ -174,7 +178,7 @@ int http_client_init(struct http_client_module *const module, struct http_client
 
 	/* Allocate the buffer in the heap. */
 	if (module->config.recv_buffer == NULL) {
-		module->config.recv_buffer = malloc(config->recv_buffer_size);
+		module->config.recv_buffer = pvPortMalloc(config->recv_buffer_size);
 		if (module->config.recv_buffer == NULL) {
 			return -ENOMEM;
 		}
@@ -204,11 +208,11 @@ int http_client_deinit(struct http_client_module *const module)
 	}
 
 	if (module->alloc_buffer != 0) {
-		free(module->config.recv_buffer);
+		vPortFree(module->config.recv_buffer);
 	}
 
 	if (module->req.ext_header != NULL) {
-		free(module->req.ext_header);
+		vPortFree(module->req.ext_header);
 	}
 
 	memset(module, 0, sizeof(struct http_client_module));
@@ -439,13 +443,14 @@ int http_client_send_request(struct http_client_module *const module, const char
 	}
 
 	if (module->req.ext_header != NULL) {
-		free(module->req.ext_header);
+		vPortFree(module->req.ext_header);
 	}
 	if (ext_header != NULL) {
-		module->req.ext_header = strdup(ext_header);
+		module->req.ext_header = pvPortMalloc(strlen(ext_header) + 1);
 		if (module->req.ext_header == NULL) {
 			return -ENOMEM;
 		}
+		strcpy(module->req.ext_header, ext_header);
 	} else {
 		module->req.ext_header = NULL;
 	}
@@ -1024,7 +1029,7 @@ int _http_client_handle_entity(struct http_client_module *const module)
 			if (data.recv_chunked_data.is_complete == 1) {
 				if (module->permanent == 0) {
 					/* This server was not supported keep alive. */
-					printf("1\r\n");
+					LOG_DEBUG("http_client: last chunk received, closing connection\r\n");
 					_http_client_clear_conn(module, 0);
 					return 0;
 				}
@@ -15,6 +15,9 @@
 #include "FreeRTOS.h"
 #include "I2cDriver\I2cDriver.h"
 #include "SerialConsole.h"
+#include "SerialConsole/DeferredLog.h"
+#include "StaticAlloc/StaticAlloc.h"
+#include "Storage/SdWriter.h"
 #include "WifiHandlerThread/WifiHandler.h"
 #include "asf.h"
 #include "driver/include/m2m_wifi.h"
@@ -39,6 +42,12 @@
 #define CLI_TASK_ID 1 /**< @brief ID for the command line interface task */
 #define WAIT_TX_COMPLETE_MS 1000
 
+#define LCD_TASK_SIZE (512 - 128)   ///< Stack of the LCD task, in words (1200 -> 512 -> 384)
+#define HEALTH_TASK_SIZE 128         ///< Stack of the health monitor task, in words
+#define VOICE_TASK_SIZE 128          ///< Stack of the voice control task, in words
+#define IMU_TASK_SIZE 128            ///< Stack of the IMU task, in words
+#define LED_TASK_SIZE 128            ///< Stack of the LED task, in words
+
 /****
  * Local Function Declaration
  ******************************************************************************/
@@ -64,6 +73,19 @@ static TaskHandle_t lcdTaskHandle = NULL;		//!< LCD task handle
 static TaskHandle_t ledTaskHandle = NULL;		//!< LED task handle
 static TaskHandle_t voicecontrolTaskHandle = NULL;//!< Voice Control task Handle
 static TaskHandle_t imuTaskHandle = NULL;
+static TaskHandle_t logTaskHandle = NULL;		//!< Deferred log task handle
+static TaskHandle_t sdWriterTaskHandle = NULL;	//!< SD writer task handle
+
+// Task memory, static when configSUPPORT_STATIC_ALLOCATION is 1 (see StaticAlloc.h)
+STATIC_TASK_MEMORY(cli, CLI_TASK_SIZE);
+STATIC_TASK_MEMORY(lcd, LCD_TASK_SIZE);
+STATIC_TASK_MEMORY(health, HEALTH_TASK_SIZE);
+STATIC_TASK_MEMORY(wifi, WIFI_TASK_SIZE);
+STATIC_TASK_MEMORY(voice, VOICE_TASK_SIZE);
+STATIC_TASK_MEMORY(imu, IMU_TASK_SIZE);
+STATIC_TASK_MEMORY(led, LED_TASK_SIZE);
+STATIC_TASK_MEMORY(log, DEFERRED_LOG_TASK_SIZE);
+STATIC_TASK_MEMORY(sdWriter, SD_WRITER_TASK_SIZE);
 
 char bufferPrint[64];   ///< Buffer for daemon task
 
@@ -93,8 +115,8 @@ int main(void) {
 	servo_control_init();
 	delay_init();	
 	Command_Detect();
-    // Initialize trace capabilities
-    vTraceEnable(TRC_START);
+    // Initialize trace capabilities. The trace is streamed to the SD card, started with the "trace" CLI command
+    vTraceEnable(TRC_INIT);
     // Start FreeRTOS scheduler
     vTaskStartScheduler();
 	
@@ -147,7 +169,7 @@ static void StartTasks(void) {
     // Initialize Tasks here (Change Stack Size)
 	
 	//CLI Task
-    if (xTaskCreate(vCommandConsoleTask, "CLI_TASK", CLI_TASK_SIZE, NULL, CLI_PRIORITY, &cliTaskHandle) != pdPASS) {
+    if (STATIC_TASK_CREATE(cli, vCommandConsoleTask, "CLI_TASK", CLI_TASK_SIZE, CLI_PRIORITY, &cliTaskHandle) != pdPASS) {
         SerialConsoleWriteString("ERR: CLI task could not be initialized!\r\n");
     }
 
@@ -155,7 +177,7 @@ static void StartTasks(void) {
     SerialConsoleWriteString(bufferPrint);
 	
 	////LCD Task(1200 -> 512 -> 256)
-	if (xTaskCreate(rtc_lcd_display_task, "LCD_TASK", 512-128, NULL, 4, &lcdTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(lcd, rtc_lcd_display_task, "LCD_TASK", LCD_TASK_SIZE, 4, &lcdTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERROR: LCD task could not be initialized!\r\n");
 		} else {
 		SerialConsoleWriteString("LCD task created successfully\r\n");
@@ -164,28 +186,28 @@ static void StartTasks(void) {
 	SerialConsoleWriteString(bufferPrint);
 
 	////Health Monitor Task
-	if (xTaskCreate(vHealthMonitorTask, "Health_Monitor_TASK", 128, NULL, 3, &healthTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(health, vHealthMonitorTask, "Health_Monitor_TASK", HEALTH_TASK_SIZE, 3, &healthTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERR: Health Monitor task could not be initialized!\r\n");
 	}
 	snprintf(bufferPrint, 64, "Heap after starting Health Monitor: %d\r\n", xPortGetFreeHeapSize());
 	SerialConsoleWriteString(bufferPrint);
 
 	//WIFI Task(1024 -> 512)
-	if (xTaskCreate(vWifiTask, "WIFI_TASK", 1024-128, NULL, WIFI_PRIORITY, &wifiTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(wifi, vWifiTask, "WIFI_TASK", WIFI_TASK_SIZE, WIFI_PRIORITY, &wifiTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERR: WIFI task could not be initialized!\r\n");
 	}
 	snprintf(bufferPrint, 64, "Heap after starting WIFI: %d\r\n", xPortGetFreeHeapSize());
 	SerialConsoleWriteString(bufferPrint);
 
 	////////Voice Control Task
-	if (xTaskCreate(vVoiceControlTask, "Voice_Control_TASK", 128, NULL, 3, &voicecontrolTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(voice, vVoiceControlTask, "Voice_Control_TASK", VOICE_TASK_SIZE, 3, &voicecontrolTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERR: Voice Control task could not be initialized!\r\n");
 	}
 	snprintf(bufferPrint, 64, "Heap after starting Voice Control: %d\r\n", xPortGetFreeHeapSize());
 	SerialConsoleWriteString(bufferPrint);
 	
 	//////IMU
-	if (xTaskCreate(vIMUTask, "IMU_TASK", 128, NULL, 3, &imuTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(imu, vIMUTask, "IMU_TASK", IMU_TASK_SIZE, 3, &imuTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERR: IMU Initialization Failed\r\n");
 		} else {
 		SerialConsoleWriteString("IMU Created Successfully\r\n");
@@ -196,14 +218,54 @@ static void StartTasks(void) {
 
 
 //LED Task(512 -> 256)
-	if (xTaskCreate(LED_Task, "LED_TASK", 128, NULL, 3, &ledTaskHandle) != pdPASS) {
+	if (STATIC_TASK_CREATE(led, LED_Task, "LED_TASK", LED_TASK_SIZE, 3, &ledTaskHandle) != pdPASS) {
 		SerialConsoleWriteString("ERR: LED Initialization Failed\r\n");
 		} else {
 		SerialConsoleWriteString("LED Created Successfully\r\n");
 	}
 	snprintf(bufferPrint, 64, "Heap after starting LED: %d\r\n", xPortGetFreeHeapSize());
 	SerialConsoleWriteString(bufferPrint);
+
+	// Deferred log drain task. LogMessage stops formatting in the caller once it runs
+	if (STATIC_TASK_CREATE(log, vDeferredLogTask, "LOG_TASK", DEFERRED_LOG_TASK_SIZE, DEFERRED_LOG_PRIORITY, &logTaskHandle) != pdPASS) {
+		SerialConsoleWriteString("ERR: Deferred log task could not be initialized!\r\n");
+	}
+	snprintf(bufferPrint, 64, "Heap after starting LOG: %d\r\n", xPortGetFreeHeapSize());
+	SerialConsoleWriteString(bufferPrint);
+
+	// SD writer task, writes the OTA download to the card while the next packets arrive
+	if (STATIC_TASK_CREATE(sdWriter, vSdWriterTask, "SD_WRITER_TASK", SD_WRITER_TASK_SIZE, SD_WRITER_PRIORITY, &sdWriterTaskHandle) != pdPASS) {
+		SerialConsoleWriteString("ERR: SD writer task could not be initialized!\r\n");
+	}
+	snprintf(bufferPrint, 64, "Heap after starting SD writer: %d\r\n", xPortGetFreeHeapSize());
+	SerialConsoleWriteString(bufferPrint);
+}
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+/**
+ * @brief	Memory of the idle task, required by the kernel when static allocation is enabled
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize) {
+	static StaticTask_t idleTaskTcb STATIC_ALLOC_SECTION(idle);
+	static StackType_t idleTaskStack[configMINIMAL_STACK_SIZE] STATIC_ALLOC_SECTION(idle);
+
+	*ppxIdleTaskTCBBuffer = &idleTaskTcb;
+	*ppxIdleTaskStackBuffer = idleTaskStack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/**
+ * @brief	Memory of the timer (daemon) task, required by the kernel when static allocation is enabled
+ */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize) {
+	static StaticTask_t timerTaskTcb STATIC_ALLOC_SECTION(timer);
+	static StackType_t timerTaskStack[configTIMER_TASK_STACK_DEPTH] STATIC_ALLOC_SECTION(timer);
+
+	*ppxTimerTaskTCBBuffer = &timerTaskTcb;
+	*ppxTimerTaskStackBuffer = timerTaskStack;
+	*pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
 }
+#endif
 
 void vApplicationMallocFailedHook(void) {
     SerialConsoleWriteString("Error on memory allocation on FREERTOS!\r\n");
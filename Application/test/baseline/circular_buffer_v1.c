@@ -0,0 +1,166 @@
+/**************************************************************************/
+/**
+ * @file        circular_buffer_v1.c
+ * @brief       The console ring buffer as it was before the SPSC ring, kept to benchmark against
+ *				(test_ring_bench.c). Symbols carry a v1_ prefix so it links next to the current one.
+ * @details     From https://github.com/embeddedartistry/embedded-resources (Phillips Johnston): malloc'd handle,
+ *				'%' on every index update, separate full flag, one byte per call.
+ *****************************************************************************/
+
+ #include <stdlib.h>
+ #include <stdint.h>
+ #include <stddef.h>
+ #include <stdbool.h>
+
+ #include "circular_buffer_v1.h"
+ // The definition of our circular buffer structure is hidden from the user
+ struct v1_circular_buf_t {
+	 uint8_t * buffer;
+	 size_t head;
+	 size_t tail;
+	 size_t max; //of the buffer
+	 bool full;
+ };
+
+ // Private Functions
+
+ static void advance_pointer(v1_cbuf_handle_t cbuf)
+ {
+	 //assert(cbuf);
+
+	 if(cbuf->full)
+	 {
+		 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+	 }
+
+	 cbuf->head = (cbuf->head + 1) % cbuf->max;
+
+	 // We mark full because we will advance tail on the next time around
+	 cbuf->full = (cbuf->head == cbuf->tail);
+ }
+
+ static void retreat_pointer(v1_cbuf_handle_t cbuf)
+ {
+	 //assert(cbuf);
+
+	 cbuf->full = false;
+	 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+ }
+
+ // APIs
+
+ v1_cbuf_handle_t v1_circular_buf_init(uint8_t* buffer, size_t size)
+ {
+	// assert(buffer && size);
+
+	 v1_cbuf_handle_t cbuf = malloc(sizeof(v1_circular_buf_t));
+	 //assert(cbuf);
+
+	 cbuf->buffer = buffer;
+	 cbuf->max = size;
+	 v1_circular_buf_reset(cbuf);
+
+	// assert(v1_circular_buf_empty(cbuf));
+
+	 return cbuf;
+ }
+
+ void v1_circular_buf_free(v1_cbuf_handle_t cbuf)
+ {
+	// assert(cbuf);
+	 free(cbuf);
+ }
+
+ void v1_circular_buf_reset(v1_cbuf_handle_t cbuf)
+ {
+	// assert(cbuf);
+
+	 cbuf->head = 0;
+	 cbuf->tail = 0;
+	 cbuf->full = false;
+ }
+
+ size_t v1_circular_buf_size(v1_cbuf_handle_t cbuf)
+ {
+	// assert(cbuf);
+
+	 size_t size = cbuf->max;
+
+	 if(!cbuf->full)
+	 {
+		 if(cbuf->head >= cbuf->tail)
+		 {
+			 size = (cbuf->head - cbuf->tail);
+		 }
+		 else
+		 {
+			 size = (cbuf->max + cbuf->head - cbuf->tail);
+		 }
+
+	 }
+
+	 return size;
+ }
+
+ size_t v1_circular_buf_capacity(v1_cbuf_handle_t cbuf)
+ {
+	 //assert(cbuf);
+
+	 return cbuf->max;
+ }
+
+ void v1_circular_buf_put(v1_cbuf_handle_t cbuf, uint8_t data)
+ {
+	 //assert(cbuf && cbuf->buffer);
+
+	 cbuf->buffer[cbuf->head] = data;
+
+	 advance_pointer(cbuf);
+ }
+
+ int v1_circular_buf_put2(v1_cbuf_handle_t cbuf, uint8_t data)
+ {
+	 int r = -1;
+
+	 //assert(cbuf && cbuf->buffer);
+
+	 if(!v1_circular_buf_full(cbuf))
+	 {
+		 cbuf->buffer[cbuf->head] = data;
+		 advance_pointer(cbuf);
+		 r = 0;
+	 }
+
+	 return r;
+ }
+
+ int v1_circular_buf_get(v1_cbuf_handle_t cbuf, uint8_t * data)
+ {
+	 //assert(cbuf && data && cbuf->buffer);
+	 
+	 int r = -1;
+
+	 if(!v1_circular_buf_empty(cbuf))
+	 {
+		 *data = cbuf->buffer[cbuf->tail];
+		 retreat_pointer(cbuf);
+
+		 r = 0;
+	 }
+
+	 return r;
+ }
+
+ bool v1_circular_buf_empty(v1_cbuf_handle_t cbuf)
+ {
+	 //assert(cbuf);
+
+	 return (!cbuf->full && (cbuf->head == cbuf->tail));
+ }
+
+ bool v1_circular_buf_full(v1_cbuf_handle_t cbuf)
+ {
+	// assert(cbuf);
+
+	 return cbuf->full;
+ }
\ No newline at end of file
@@ -0,0 +1,28 @@
+/**************************************************************************/
+/**
+ * @file        circular_buffer_v1.h
+ * @brief       Interface of the ring buffer before the SPSC ring, see circular_buffer_v1.c
+ *****************************************************************************/
+
+#ifndef CIRCULAR_BUFFER_V1_H_
+#define CIRCULAR_BUFFER_V1_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct v1_circular_buf_t v1_circular_buf_t;
+typedef v1_circular_buf_t* v1_cbuf_handle_t;
+
+v1_cbuf_handle_t v1_circular_buf_init(uint8_t* buffer, size_t size);
+void v1_circular_buf_free(v1_cbuf_handle_t cbuf);
+void v1_circular_buf_reset(v1_cbuf_handle_t cbuf);
+void v1_circular_buf_put(v1_cbuf_handle_t cbuf, uint8_t data);
+int v1_circular_buf_put2(v1_cbuf_handle_t cbuf, uint8_t data);
+int v1_circular_buf_get(v1_cbuf_handle_t cbuf, uint8_t * data);
+bool v1_circular_buf_empty(v1_cbuf_handle_t cbuf);
+bool v1_circular_buf_full(v1_cbuf_handle_t cbuf);
+size_t v1_circular_buf_capacity(v1_cbuf_handle_t cbuf);
+size_t v1_circular_buf_size(v1_cbuf_handle_t cbuf);
+
+#endif /* CIRCULAR_BUFFER_V1_H_ */
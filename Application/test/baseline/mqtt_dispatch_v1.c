@@ -0,0 +1,75 @@
+/**************************************************************************/
+/**
+ * @file        mqtt_dispatch_v1.c
+ * @brief       deliverMessage of the Paho client as it was before the hashed handler table, kept to benchmark
+ *				against (test_mqtt_dispatch.c). The handler array is passed in, count is MAX_MESSAGE_HANDLERS.
+ * @details     Every entry is compared to the topic, first as an exact topic, then as a filter with '+' and '#'.
+ *****************************************************************************/
+
+#include "mqtt_dispatch_v1.h"
+
+// assume topic filter and name is in correct format
+// # can only be at end
+// + and # can only be next to separator
+static char isTopicMatched(char* topicFilter, MQTTString* topicName)
+{
+    char* curf = topicFilter;
+    char* curn = topicName->lenstring.data;
+    char* curn_end = curn + topicName->lenstring.len;
+    
+    while (*curf && curn < curn_end)
+    {
+        if (*curn == '/' && *curf != '/')
+            break;
+        if (*curf != '+' && *curf != '#' && *curf != *curn)
+            break;
+        if (*curf == '+')
+        {   // skip until we meet the next separator, or end of string
+            char* nextpos = curn + 1;
+            while (nextpos < curn_end && *nextpos != '/')
+                nextpos = ++curn + 1;
+        }
+        else if (*curf == '#')
+            curn = curn_end - 1;    // skip until end of string
+        curf++;
+        curn++;
+    };
+    
+    return (curn == curn_end) && (*curf == '\0');
+}
+
+
+int v1_deliverMessage(struct v1_MessageHandlers* handlers, int count, messageHandler defaultHandler, MQTTString* topicName,
+                      MQTTMessage* message)
+{
+    int i;
+    int rc = FAILURE;
+
+    // we have to find the right message handler - indexed by topic
+    for (i = 0; i < count; ++i)
+    {
+        if (handlers[i].topicFilter != 0 && (MQTTPacket_equals(topicName, (char*)handlers[i].topicFilter) ||
+                isTopicMatched((char*)handlers[i].topicFilter, topicName)))
+        {
+            if (handlers[i].fp != NULL)
+            {
+                MessageData md;
+                md.topicName = topicName;
+                md.message = message;
+                handlers[i].fp(&md);
+                rc = SUCCESS;
+            }
+        }
+    }
+    
+    if (rc == FAILURE && defaultHandler != NULL) 
+    {
+        MessageData md;
+        md.topicName = topicName;
+        md.message = message;
+        defaultHandler(&md);
+        rc = SUCCESS;
+    }   
+    
+    return rc;
+}
@@ -0,0 +1,21 @@
+/**************************************************************************/
+/**
+ * @file        mqtt_dispatch_v1.h
+ * @brief       Interface of the MQTT message dispatch before the hashed handler table, see mqtt_dispatch_v1.c
+ *****************************************************************************/
+
+#ifndef MQTT_DISPATCH_V1_H_
+#define MQTT_DISPATCH_V1_H_
+
+#include "MQTTClient/MQTTClient.h"
+
+/** One entry of the old messageHandlers array */
+struct v1_MessageHandlers {
+	const char* topicFilter;
+	void (*fp) (MessageData*);
+};
+
+int v1_deliverMessage(struct v1_MessageHandlers* handlers, int count, messageHandler defaultHandler, MQTTString* topicName,
+                      MQTTMessage* message);
+
+#endif /* MQTT_DISPATCH_V1_H_ */
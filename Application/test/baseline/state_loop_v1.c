@@ -0,0 +1,26 @@
+/**************************************************************************/
+/**
+ * @file        state_loop_v1.c
+ * @brief       State publishing of the WiFi task loop as it was before StatePublisher (and before it waited on
+ *				notifications), kept to compare against (test_state_publisher.c). Called every iteration, 100 ms.
+ * @details     The button is published on change, the voice state on every call, both at QoS 2. The if/else
+ *				chain of the voice payloads is a table here; the topics are those of WifiHandler.h.
+ *****************************************************************************/
+
+#include "state_loop_v1.h"
+
+void v1_PublishStates(bool button, int voice, v1_StatePublish publish)
+{
+	static const char *const voicePayloads[] = {"No", "Blink", "Hold in one color", "Hold in multiple colors", "Close LED", "start",
+	                                            "forward", "backward", "left", "right", "stop", "end"};
+	static bool button_prev_state = false;  // tracks last state
+
+	if (button != button_prev_state) {
+		button_prev_state = button;
+		publish("debug/button", button ? "on" : "off", 2);
+	}
+
+	if (voice >= 0 && voice < (int)(sizeof(voicePayloads) / sizeof(voicePayloads[0]))) {
+		publish("Status/Voice", voicePayloads[voice], 2);
+	}
+}
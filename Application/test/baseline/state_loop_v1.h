@@ -0,0 +1,18 @@
+/**************************************************************************/
+/**
+ * @file        state_loop_v1.h
+ * @brief       Interface of the state publishing of the WiFi task before StatePublisher, see state_loop_v1.c
+ *****************************************************************************/
+
+#ifndef STATE_LOOP_V1_H_
+#define STATE_LOOP_V1_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Same as StatePublish: mqtt_publish of a constant payload */
+typedef int (*v1_StatePublish)(const char *topic, const char *payload, uint8_t qos);
+
+void v1_PublishStates(bool button, int voice, v1_StatePublish publish);
+
+#endif /* STATE_LOOP_V1_H_ */
@@ -0,0 +1,4 @@
+/**
+ * @file        CliThread.h
+ * @brief       Host stand-in: the serial console only needs the semaphore it gives, declared in SerialConsole.c
+ */
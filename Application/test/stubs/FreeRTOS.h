@@ -0,0 +1,34 @@
+/**
+ * @file        FreeRTOS.h
+ * @brief       Host stand-in for the FreeRTOS configuration Heap/Heap.c and StaticAlloc.h are built with
+ * @details     Same heap size and alignment as config/FreeRTOSConfig.h and the CM0 port, with the default
+ *				static task allocation. A test can pass -DconfigTOTAL_HEAP_SIZE=... for the dynamic one.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "host_rtos.h"
+
+#ifndef configTOTAL_HEAP_SIZE
+#define configTOTAL_HEAP_SIZE ((size_t)(3072))
+#endif
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configUSE_MALLOC_FAILED_HOOK 0
+#define configASSERT(x) assert(x)
+
+#define portBYTE_ALIGNMENT 8
+#define portBYTE_ALIGNMENT_MASK (0x0007)
+
+#define traceMALLOC(address, size)
+#define traceFREE(address, size)
+
+void *pvPortMalloc(size_t xWantedSize);
+void vPortFree(void *pv);
+size_t xPortGetFreeHeapSize(void);
+size_t xPortGetMinimumEverFreeHeapSize(void);
+
+#endif /* HOST_FREERTOS_H */
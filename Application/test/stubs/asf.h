@@ -0,0 +1,17 @@
+/**
+ * @file        asf.h
+ * @brief       Host stand-in for the ASF umbrella header: the C types, host_rtos.h and host_drivers.h
+ */
+
+#ifndef HOST_ASF_H
+#define HOST_ASF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "host_drivers.h"
+#include "host_rtos.h"
+
+#endif /* HOST_ASF_H */
@@ -0,0 +1,21 @@
+/**
+ * @file        I2cDriver.h
+ * @brief       Host stand-in for the I2C driver (I2cDriver/I2cDriver.h) as used by the benchmarks
+ */
+
+#ifndef HOST_I2C_DRIVER_H
+#define HOST_I2C_DRIVER_H
+
+#include "asf.h"
+
+typedef struct I2C_Data {
+	uint8_t address;
+	const uint8_t *msgOut;
+	uint8_t *msgIn;
+	uint16_t lenIn;
+	uint16_t lenOut;
+} I2C_Data;
+
+int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime);
+
+#endif /* HOST_I2C_DRIVER_H */
@@ -0,0 +1,23 @@
+/**
+ * @file        LCD.h
+ * @brief       Host stand-in for the ST7735 driver (LCD/LCD.h) as used by the benchmarks
+ */
+
+#ifndef HOST_LCD_H
+#define HOST_LCD_H
+
+#include "asf.h"
+
+#define LCD_CS_PIN PIN_PA11
+
+#define ST7735_BLACK 0x0000
+#define ST7735_WHITE 0xFFFF
+#define ST7735_WIDTH 160
+#define ST7735_HEIGHT 128
+
+extern struct spi_module spi_master_instance;
+
+void lcd_fill_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color);
+void lcd_fill_rect_dma(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color);
+
+#endif /* HOST_LCD_H */
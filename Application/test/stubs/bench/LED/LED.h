@@ -0,0 +1,11 @@
+/**
+ * @file        LED.h
+ * @brief       Host stand-in for the SK6812 strip driver (LED/LED.h) as used by the benchmarks
+ */
+
+#ifndef HOST_LED_H
+#define HOST_LED_H
+
+void SK6812_Send(void);
+
+#endif /* HOST_LED_H */
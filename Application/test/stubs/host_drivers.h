@@ -0,0 +1,132 @@
+/**
+ * @file        host_drivers.h
+ * @brief       Host stand-ins for the ASF SERCOM USART and DMA driver interfaces used by the serial console,
+ *				the SPI and port calls of the benchmarks, and the FatFs file calls used by the SD writer
+ * @details     Only the types and the calls are declared here. The tests that link the console or the writer
+ *				define the calls and model the hardware behind them.
+ */
+
+#ifndef HOST_DRIVERS_H
+#define HOST_DRIVERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum status_code { STATUS_OK = 0, STATUS_ERR_IO = 0x10, STATUS_ERR_BUSY = 0x05, STATUS_ERR_NOT_FOUND = 0x18 };
+
+#define NVIC_SetPriority(irq, priority)
+#define SERCOM4_IRQn 13
+
+/* SERCOM USART */
+typedef struct {
+	struct {
+		struct {
+			uint16_t reg;
+		} DATA;
+	} USART;
+} Sercom;
+
+struct usart_module {
+	Sercom *hw;
+};
+
+struct usart_config {
+	uint32_t baudrate;
+	uint32_t mux_setting;
+	uint32_t pinmux_pad0, pinmux_pad1, pinmux_pad2, pinmux_pad3;
+};
+
+enum usart_callback { USART_CALLBACK_BUFFER_TRANSMITTED, USART_CALLBACK_BUFFER_RECEIVED };
+typedef void (*usart_callback_t)(struct usart_module *const module);
+
+#define EDBG_CDC_MODULE ((Sercom *)0)
+#define EDBG_CDC_SERCOM_MUX_SETTING 0
+#define EDBG_CDC_SERCOM_PINMUX_PAD0 0
+#define EDBG_CDC_SERCOM_PINMUX_PAD1 0
+#define EDBG_CDC_SERCOM_PINMUX_PAD2 0
+#define EDBG_CDC_SERCOM_PINMUX_PAD3 0
+
+void usart_get_config_defaults(struct usart_config *config);
+enum status_code usart_init(struct usart_module *module, Sercom *hw, const struct usart_config *config);
+void usart_enable(struct usart_module *module);
+void usart_disable(struct usart_module *module);
+void usart_register_callback(struct usart_module *module, usart_callback_t callback, enum usart_callback type);
+void usart_enable_callback(struct usart_module *module, enum usart_callback type);
+enum status_code usart_read_buffer_job(struct usart_module *module, uint8_t *rx_data, uint16_t length);
+enum status_code usart_write_buffer_job(struct usart_module *module, uint8_t *tx_data, uint16_t length);
+
+/* DMAC */
+typedef struct {
+	struct { uint16_t reg; } BTCTRL;
+	struct { uint16_t reg; } BTCNT;
+	struct { uint32_t reg; } SRCADDR;
+	struct { uint32_t reg; } DSTADDR;
+	struct { uint32_t reg; } DESCADDR;
+} DmacDescriptor;
+
+struct dma_resource {
+	DmacDescriptor *descriptor;
+};
+
+struct dma_resource_config {
+	uint8_t peripheral_trigger;
+	uint8_t trigger_action;
+};
+
+struct dma_descriptor_config {
+	uint8_t beat_size;
+	bool src_increment_enable;
+	bool dst_increment_enable;
+	uint32_t source_address;
+	uint32_t destination_address;
+	uint16_t block_transfer_count;
+};
+
+enum dma_callback_type { DMA_CALLBACK_TRANSFER_DONE };
+typedef void (*dma_callback_t)(struct dma_resource *const resource);
+
+#define SERCOM4_DMAC_ID_TX 0x0A
+#define DMA_TRIGGER_ACTION_BEAT 2
+#define DMA_BEAT_SIZE_BYTE 0
+
+void dma_get_config_defaults(struct dma_resource_config *config);
+enum status_code dma_allocate(struct dma_resource *resource, struct dma_resource_config *config);
+void dma_register_callback(struct dma_resource *resource, dma_callback_t callback, enum dma_callback_type type);
+void dma_enable_callback(struct dma_resource *resource, enum dma_callback_type type);
+void dma_descriptor_get_config_defaults(struct dma_descriptor_config *config);
+void dma_descriptor_create(DmacDescriptor *descriptor, struct dma_descriptor_config *config);
+enum status_code dma_start_transfer_job(struct dma_resource *resource);
+
+/* PORT */
+#define PIN_PA11 11
+
+bool port_pin_get_output_level(uint8_t gpio_pin);
+
+/* SERCOM SPI */
+struct spi_module {
+	Sercom *hw;
+};
+
+enum status_code spi_write_buffer_wait(struct spi_module *const module, const uint8_t *tx_data, uint16_t length);
+
+/* FatFs */
+typedef unsigned int UINT;
+typedef uint32_t DWORD;
+typedef enum { FR_OK = 0, FR_DISK_ERR, FR_NOT_READY = 3 } FRESULT;
+
+#define FA_WRITE 0x02
+#define FA_CREATE_ALWAYS 0x08
+
+typedef struct {
+	DWORD fptr;
+} FIL;
+
+#define f_tell(fp) ((fp)->fptr)
+
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_sync(FIL *fp);
+FRESULT f_close(FIL *fp);
+FRESULT f_unlink(const char *path);
+
+#endif /* HOST_DRIVERS_H */
@@ -0,0 +1,87 @@
+/**
+ * @file        host_queue.c
+ * @brief       Host stand-ins for FreeRTOS queues, see queue.h
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+
+// Waits for a change of the queue, at most until deadline. Returns 0 once the deadline has passed
+static int WaitForChange(QueueHandle_t queue, TickType_t ticksToWait, const struct timespec *deadline)
+{
+	if (ticksToWait == 0) {
+		return 0;
+	}
+	if (ticksToWait == portMAX_DELAY) {
+		pthread_cond_wait(&queue->changed, &queue->lock);
+		return 1;
+	}
+	return pthread_cond_timedwait(&queue->changed, &queue->lock, deadline) != ETIMEDOUT;
+}
+
+static void Deadline(TickType_t ticksToWait, struct timespec *deadline)
+{
+	clock_gettime(CLOCK_REALTIME, deadline);
+	if (ticksToWait != portMAX_DELAY) {
+		deadline->tv_sec += ticksToWait / 1000;
+		deadline->tv_nsec += (long)(ticksToWait % 1000) * 1000000;
+		if (deadline->tv_nsec >= 1000000000) {
+			deadline->tv_sec++;
+			deadline->tv_nsec -= 1000000000;
+		}
+	}
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *queue)
+{
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->changed, NULL);
+	queue->storage = storage;
+	queue->length = length;
+	queue->itemSize = itemSize;
+	queue->count = 0;
+	queue->head = 0;
+	return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+	struct timespec deadline;
+	BaseType_t rc = errQUEUE_FULL;
+
+	Deadline(ticksToWait, &deadline);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->length && WaitForChange(queue, ticksToWait, &deadline)) {
+	}
+	if (queue->count < queue->length) {
+		memcpy(&queue->storage[((queue->head + queue->count) % queue->length) * queue->itemSize], item, queue->itemSize);
+		queue->count++;
+		pthread_cond_broadcast(&queue->changed);
+		rc = pdPASS;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return rc;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait)
+{
+	struct timespec deadline;
+	BaseType_t rc = errQUEUE_EMPTY;
+
+	Deadline(ticksToWait, &deadline);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0 && WaitForChange(queue, ticksToWait, &deadline)) {
+	}
+	if (queue->count > 0) {
+		memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+		queue->head = (queue->head + 1) % queue->length;
+		queue->count--;
+		pthread_cond_broadcast(&queue->changed);
+		rc = pdPASS;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return rc;
+}
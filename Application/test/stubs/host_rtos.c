@@ -0,0 +1,93 @@
+/**
+ * @file        host_rtos.c
+ * @brief       Host stand-ins for FreeRTOS, see host_rtos.h
+ */
+
+#include <assert.h>
+
+#include "host_rtos.h"
+
+// Most stand-ins ignore their arguments
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+TickType_t hostTicks;
+uint32_t hostNotifications;
+int hostSchedulerSuspended;
+UBaseType_t hostPriority;
+
+TickType_t xTaskGetTickCount(void)
+{
+	return hostTicks;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return &hostTicks;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	hostNotifications++;
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+	return 0;
+}
+
+// FreeRTOS asserts the same: a task cannot block with the scheduler suspended
+void vTaskDelay(TickType_t ticks)
+{
+	assert(hostSchedulerSuspended == 0);
+	hostTicks += ticks;
+}
+
+void vTaskSuspendAll(void)
+{
+	hostSchedulerSuspended++;
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+	assert(hostSchedulerSuspended > 0);
+	hostSchedulerSuspended--;
+	return pdFALSE;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+	return hostPriority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+{
+	hostPriority = priority;
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timeOut)
+{
+	timeOut->xTimeOnEntering = hostTicks;
+}
+
+// Same as FreeRTOS: counts the ticks since the last call off *ticksToWait, pdTRUE once none are left
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeOut, TickType_t *ticksToWait)
+{
+	TickType_t elapsed = hostTicks - timeOut->xTimeOnEntering;
+
+	if (*ticksToWait == portMAX_DELAY) {
+		return pdFALSE;
+	}
+	if (elapsed >= *ticksToWait) {
+		*ticksToWait = 0;
+		return pdTRUE;
+	}
+	*ticksToWait -= elapsed;
+	vTaskSetTimeOutState(timeOut);
+	return pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken)
+{
+	return pdPASS;
+}
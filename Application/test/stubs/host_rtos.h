@@ -0,0 +1,61 @@
+/**
+ * @file        host_rtos.h
+ * @brief       Host stand-ins for the few FreeRTOS calls and device constants the tested modules use
+ * @details     One task, no preemption: critical sections are empty and notifications are only counted.
+ *				The tick count is hostTicks, advanced by the tests. Suspending the scheduler and the task
+ *				priority are only recorded, for the tests to check.
+ */
+
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+#include <stdint.h>
+
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef void *SemaphoreHandle_t;
+
+typedef struct {
+	TickType_t xTimeOnEntering;
+} TimeOut_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define tskIDLE_PRIORITY 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+#define configMAX_PRIORITIES 5
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+extern TickType_t hostTicks;        ///< Returned by xTaskGetTickCount
+extern uint32_t hostNotifications;  ///< Number of xTaskNotifyGive calls
+extern int hostSchedulerSuspended;  ///< Nesting depth of vTaskSuspendAll
+extern UBaseType_t hostPriority;    ///< Priority of the task, see vTaskPrioritySet
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+void vTaskSetTimeOutState(TimeOut_t *timeOut);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeOut, TickType_t *ticksToWait);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken);
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+/// Start of the SRAM: with -no-pie the host image keeps its constants below its writable data, like the flash
+extern char __data_start[];
+#define HMCRAMC0_ADDR ((uint32_t)(uintptr_t)__data_start)
+#define FLASH_ADDR (0x00000000u)
+#define NVMCTRL_ROW_SIZE 256
+
+#endif /* HOST_RTOS_H */
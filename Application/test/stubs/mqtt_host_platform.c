@@ -0,0 +1,34 @@
+/**************************************************************************/
+/**
+ * @file        mqtt_host_platform.c
+ * @brief       Timers of the host MQTT platform, see mqtt_host_platform.h
+ *****************************************************************************/
+
+#include "MQTTClient/MQTTClient.h"
+
+unsigned long hostMillis = 0;
+
+void TimerInit(Timer *timer)
+{
+    timer->deadline = 0;
+}
+
+char TimerIsExpired(Timer *timer)
+{
+    return hostMillis >= timer->deadline;
+}
+
+void TimerCountdownMS(Timer *timer, unsigned int timeout_ms)
+{
+    timer->deadline = hostMillis + timeout_ms;
+}
+
+void TimerCountdown(Timer *timer, unsigned int timeout)
+{
+    TimerCountdownMS(timer, timeout * 1000);
+}
+
+int TimerLeftMS(Timer *timer)
+{
+    return TimerIsExpired(timer) ? 0 : (int) (timer->deadline - hostMillis);
+}
@@ -0,0 +1,25 @@
+/**************************************************************************/
+/**
+ * @file        mqtt_host_platform.h
+ * @brief       Host platform of the Paho MQTT client for the host tests (MQTTCLIENT_PLATFORM_HEADER)
+ * @details     Time is simulated: hostMillis only moves when a test moves it, so timeouts are deterministic.
+ *****************************************************************************/
+
+#ifndef MQTT_HOST_PLATFORM_H
+#define MQTT_HOST_PLATFORM_H
+
+typedef struct Timer {
+    unsigned long deadline; ///< hostMillis at which the timer expires
+} Timer;
+
+typedef struct Network Network;
+
+struct Network {
+    int (*mqttrecv)(Network *, unsigned char *, int, int);
+    int (*mqttwrite)(Network *, unsigned char *, int, int);
+    void *context; ///< Test data
+};
+
+extern unsigned long hostMillis; ///< Simulated time, in ms
+
+#endif /* MQTT_HOST_PLATFORM_H */
@@ -0,0 +1,35 @@
+/**
+ * @file        queue.h
+ * @brief       Host stand-in for FreeRTOS queues, see host_queue.c
+ * @details     Unlike the rest of host_rtos.h these block for real: a test may run tasks as POSIX threads
+ *				that pass items through them. Waits are measured in ms of wall-clock time.
+ */
+
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+
+#include <pthread.h>
+
+#include "host_rtos.h"
+
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL ((BaseType_t)0)
+
+/** Queue control block, in the caller's memory like StaticQueue_t */
+typedef struct HostQueue {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	uint8_t *storage;
+	UBaseType_t length;
+	UBaseType_t itemSize;
+	UBaseType_t count;
+	UBaseType_t head;   ///< Index of the oldest item
+} StaticQueue_t;
+
+typedef struct HostQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait);
+
+#endif /* HOST_QUEUE_H */
@@ -0,0 +1,5 @@
+/**
+ * @file        semphr.h
+ * @brief       Host stand-in for the FreeRTOS semaphore header, the calls are in host_rtos.h
+ */
+#include "host_rtos.h"
@@ -0,0 +1,5 @@
+/**
+ * @file        task.h
+ * @brief       Host stand-in for the FreeRTOS task header, the calls are in host_rtos.h
+ */
+#include "host_rtos.h"
@@ -0,0 +1,26 @@
+/**
+ * @file        nm_bsp.h
+ * @brief       Host stand-in for the WINC1500 BSP: its integer types and nm_bsp_wait_for_event
+ */
+
+#ifndef HOST_NM_BSP_H
+#define HOST_NM_BSP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t sint8;
+typedef int16_t sint16;
+typedef int32_t sint32;
+
+#define NMI_API
+
+void nm_bsp_wait_for_event(uint32 u32TimeoutMs);
+
+#endif /* HOST_NM_BSP_H */
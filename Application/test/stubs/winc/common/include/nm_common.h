@@ -0,0 +1,11 @@
+/**
+ * @file        nm_common.h
+ * @brief       Host stand-in for the WINC1500 common definitions used by the MQTT platform (MCHP_ATWx.c)
+ */
+
+#ifndef HOST_NM_COMMON_H
+#define HOST_NM_COMMON_H
+
+#include "bsp/include/nm_bsp.h"
+
+#endif /* HOST_NM_COMMON_H */
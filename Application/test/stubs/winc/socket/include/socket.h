@@ -0,0 +1,76 @@
+/**
+ * @file        socket.h
+ * @brief       Host stand-in for the WINC1500 socket API used by the MQTT platform (MCHP_ATWx.c)
+ * @details     The calls are renamed so they do not collide with the BSD sockets of the host; the test defines
+ *				them and models the driver behind them.
+ */
+
+#ifndef HOST_WINC_SOCKET_H
+#define HOST_WINC_SOCKET_H
+
+#include "common/include/nm_common.h"
+
+#define TCP_SOCK_MAX 7
+#define AF_INET 2
+#define SOCK_STREAM 1
+
+#define SOCK_ERR_NO_ERROR 0
+#define SOCK_ERR_INVALID_ARG -6
+#define SOCK_ERR_INVALID -9
+#define SOCK_ERR_TIMEOUT -13
+
+#define _htons(A) (uint16)((((uint16)(A)) << 8) | (((uint16)(A)) >> 8))
+
+typedef sint8 SOCKET;
+
+enum {
+	SOCKET_MSG_BIND = 1,
+	SOCKET_MSG_LISTEN,
+	SOCKET_MSG_DNS_RESOLVE,
+	SOCKET_MSG_ACCEPT,
+	SOCKET_MSG_CONNECT,
+	SOCKET_MSG_RECV,
+	SOCKET_MSG_SEND,
+	SOCKET_MSG_SENDTO,
+	SOCKET_MSG_RECVFROM
+};
+
+struct sockaddr {
+	uint16 sa_family;
+	uint8 sa_data[14];
+};
+
+struct in_addr {
+	uint32 s_addr;
+};
+
+struct sockaddr_in {
+	uint16 sin_family;
+	uint16 sin_port;
+	struct in_addr sin_addr;
+	uint8 sin_zero[8];
+};
+
+typedef struct {
+	uint8 *pu8Buffer;
+	sint16 s16BufferSize;
+	uint16 u16RemainingSize;
+	struct sockaddr_in strRemoteAddr;
+} tstrSocketRecvMsg;
+
+#define socket winc_socket
+#define connect winc_connect
+#define recv winc_recv
+#define send winc_send
+#define close winc_close
+#define gethostbyname winc_gethostbyname
+
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags);
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen);
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec);
+void socketSetRecvBuffer(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen);
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags);
+sint8 close(SOCKET sock);
+sint8 gethostbyname(uint8 *pcHostName);
+
+#endif /* HOST_WINC_SOCKET_H */
@@ -0,0 +1,270 @@
+/**************************************************************************/
+/**
+ * @file        test_bench.c
+ * @brief       Host test of the "bench" suite (Bench/Bench.c) over stub drivers
+ * @details     The drivers charge a fixed number of cycles per operation to a simulated cycle counter, which
+ *				BenchTimerNow returns, so every result is known exactly. Each case starts while a drawing task
+ *				still holds the LCD CS low for a few ticks: the LCD and SPI benchmarks must wait for it, then
+ *				touch the bus only with the scheduler suspended and the CS high. After every case the scheduler
+ *				runs again, the priority, the clock display flag and the log levels are back where they were,
+ *				and the scratch file of the SD benchmarks is gone. Driver failures must come back as errors.
+ *****************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Bench.h"
+#include "BenchTimer.h"
+#include "I2cDriver/I2cDriver.h"
+#include "LCD/LCD.h"
+#include "LED/LED.h"
+#include "SerialConsole.h"
+
+#define CPU_MHZ 48
+#define SPI_BYTE_CYCLES 32           ///< 12 MHz SPI clock
+#define PIXEL_CYCLES 90              ///< lcd_write_data16: two blocking byte writes and the call
+#define DMA_CHUNK_CYCLES 150         ///< Per 32-pixel chunk of lcd_fill_rect_dma
+#define I2C_READ_CYCLES 9000
+#define SD_BLOCK_CYCLES 40000        ///< Per 512 B
+#define SD_CALL_CYCLES 3000
+#define LED_SEND_CYCLES (10 * 48000) ///< Ends with a 10 ms delay
+#define LOG_CYCLES 700
+#define CS_BUSY_TICKS 3              ///< The drawing task keeps the CS low this long after a case starts
+
+struct spi_module spi_master_instance;
+volatile int stop_rtc_show_flag;
+volatile uint8_t logModuleLevels[N_LOG_MODULES];
+
+static uint32_t cycles;              ///< Returned by BenchTimerNow
+static TickType_t csHighAt;          ///< Tick at which the drawing task releases the CS
+static int busViolations;            ///< LCD bus used with the scheduler running or the CS low
+static int busUses;
+static enum eDebugLogLevels logLevel = LOG_DEBUG_LVL;
+static int logPrinted, logFiltered;
+static FRESULT sdOpenResult, sdWriteResult;
+static UINT sdShortWrite;            ///< Bytes f_write writes, 0 for all of them
+static bool sdOpen, sdExists;
+static int32_t i2cResult;
+
+uint32_t BenchTimerNow(void)
+{
+	return cycles;
+}
+
+uint32_t BenchTimerCyclesToUs(uint32_t count)
+{
+	return count / CPU_MHZ;
+}
+
+bool port_pin_get_output_level(uint8_t gpio_pin)
+{
+	return gpio_pin != LCD_CS_PIN || hostTicks >= csHighAt;
+}
+
+static void UseLcdBus(uint32_t cost)
+{
+	busUses++;
+	busViolations += hostSchedulerSuspended == 0 || !port_pin_get_output_level(LCD_CS_PIN);
+	cycles += cost;
+}
+
+enum status_code spi_write_buffer_wait(struct spi_module *const module, const uint8_t *tx_data, uint16_t length)
+{
+	(void)module;
+	(void)tx_data;
+	UseLcdBus(length * SPI_BYTE_CYCLES);
+	return STATUS_OK;
+}
+
+void lcd_fill_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color)
+{
+	(void)x;
+	(void)y;
+	(void)color;
+	UseLcdBus(w * h * PIXEL_CYCLES);
+}
+
+void lcd_fill_rect_dma(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t color)
+{
+	(void)x;
+	(void)y;
+	(void)color;
+	UseLcdBus(w * h * 2 * SPI_BYTE_CYCLES + (w * h / 32) * DMA_CHUNK_CYCLES);
+}
+
+int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
+{
+	(void)delay;
+	(void)xMaxBlockTime;
+	*data->msgIn = 0x6C;
+	cycles += I2C_READ_CYCLES;
+	return i2cResult;
+}
+
+void SK6812_Send(void)
+{
+	cycles += LED_SEND_CYCLES;
+}
+
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode)
+{
+	(void)path;
+	(void)mode;
+	if (sdOpenResult != FR_OK) {
+		return sdOpenResult;
+	}
+	fp->fptr = 0;
+	sdOpen = sdExists = true;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+	(void)buff;
+	*bw = 0;
+	if (sdWriteResult != FR_OK) {
+		return sdWriteResult;
+	}
+	*bw = (sdShortWrite != 0 && sdShortWrite < btw) ? sdShortWrite : btw;
+	fp->fptr += *bw;
+	cycles += SD_CALL_CYCLES + *bw / 512 * SD_BLOCK_CYCLES;
+	return FR_OK;
+}
+
+FRESULT f_sync(FIL *fp)
+{
+	(void)fp;
+	cycles += SD_CALL_CYCLES;
+	return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+	(void)fp;
+	sdOpen = false;
+	return FR_OK;
+}
+
+FRESULT f_unlink(const char *path)
+{
+	sdExists = sdExists && strcmp(path, BENCH_SD_FILE_NAME) != 0;
+	return FR_OK;
+}
+
+void LogMessage(enum eDebugLogLevels level, const char *format, ...)
+{
+	(void)format;
+	if (level >= logLevel) {
+		logPrinted++;
+		cycles += LOG_CYCLES;
+	} else {
+		logFiltered++;
+	}
+}
+
+enum eDebugLogLevels getLogLevel(void)
+{
+	return logLevel;
+}
+
+void setLogLevel(enum eDebugLogLevels debugLevel)
+{
+	logLevel = debugLevel;
+	for (int module = 0; module < N_LOG_MODULES; module++) {
+		logModuleLevels[module] = debugLevel;
+	}
+}
+
+int setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel)
+{
+	logModuleLevels[module] = debugLevel;
+	return 0;
+}
+
+/**
+ * @fn			static int RunCase(int index, int expected, struct BenchResult *result)
+ * @brief		Runs one benchmark while the CS is still low and checks what it leaves behind
+ * @return		1 if the benchmark did not return expected, or left the system or the bus in a wrong state
+ *****************************************************************************/
+static int RunCase(int index, int expected, struct BenchResult *result)
+{
+	static const uint8_t moduleLevels[N_LOG_MODULES] = {LOG_WARNING_LVL, LOG_DEBUG_LVL, LOG_OFF_LVL, LOG_INFO_LVL};
+	int failures = 0;
+
+	logLevel = LOG_ERROR_LVL;
+	memcpy((void *)logModuleLevels, moduleLevels, sizeof(moduleLevels));
+	hostPriority = 2;
+	stop_rtc_show_flag = 0;
+	csHighAt = hostTicks + CS_BUSY_TICKS;
+	busViolations = busUses = 0;
+	logPrinted = logFiltered = 0;
+
+	uint32_t start = cycles;
+	int res = BenchRun(index, result);
+	uint32_t charged = cycles - start;
+
+	failures += res != expected;
+	failures += hostSchedulerSuspended != 0 || hostPriority != 2 || stop_rtc_show_flag != 0;
+	failures += busViolations != 0;
+	failures += logLevel != LOG_ERROR_LVL || memcmp((const void *)logModuleLevels, moduleLevels, sizeof(moduleLevels)) != 0;
+	failures += sdOpen || sdExists;
+	if (res == 0) {
+		uint32_t bytes = result->bytesPerOp * result->iterations;
+		failures += result->cyclesPerOp != charged / result->iterations;
+		failures += result->usPerOp != result->cyclesPerOp / CPU_MHZ;
+		failures += result->kBps != ((charged >= CPU_MHZ) ? (uint32_t)((uint64_t)bytes * 1000 / (charged / CPU_MHZ)) : 0);
+		// The LCD cases wait until the drawing task is done
+		failures += busUses > 0 && hostTicks < csHighAt;
+	}
+	return failures != 0;
+}
+
+int main(void)
+{
+	struct BenchResult result;
+	int failures = 0, count = BenchCount();
+
+	printf("%-14s %5s %10s %8s %7s %4s\n", "bench", "ops", "cycles/op", "us/op", "kB/s", "bus");
+	for (int i = 0; i < count; i++) {
+		int fail = RunCase(i, 0, &result);
+		if (strcmp(BenchName(i), "log_message") == 0) {
+			// Never filtered, whatever the levels were
+			fail |= logPrinted != (int)result.iterations || logFiltered != 0;
+		}
+		printf("%-14s %5lu %10lu %8lu %7lu %4d: %s\n", BenchName(i), (unsigned long)result.iterations,
+		       (unsigned long)result.cyclesPerOp, (unsigned long)result.usPerOp, (unsigned long)result.kBps, busUses,
+		       fail ? "FAIL" : "PASS");
+		failures += fail;
+	}
+
+	int bad = BenchRun(-1, &result) != -EINVAL || BenchRun(count, &result) != -EINVAL || BenchName(count) != NULL;
+	printf("index out of range: %s\n", bad ? "FAIL" : "PASS");
+	failures += bad;
+
+	// Driver errors come back, and the SD cases still close and delete their file
+	for (int i = 0; i < count; i++) {
+		const char *name = BenchName(i);
+		if (strcmp(name, "sd_write_4k") == 0) {
+			sdOpenResult = FR_NOT_READY;
+			bad = RunCase(i, -ENODEV, &result);
+			sdOpenResult = FR_OK;
+			sdWriteResult = FR_DISK_ERR;
+			bad |= RunCase(i, -EIO, &result);
+			sdWriteResult = FR_OK;
+			sdShortWrite = 1000;
+			bad |= RunCase(i, -ENOSPC, &result);
+			sdShortWrite = 0;
+			printf("%s: no card -ENODEV, write error -EIO, card full -ENOSPC: %s\n", name, bad ? "FAIL" : "PASS");
+			failures += bad;
+		} else if (strcmp(name, "i2c_read") == 0) {
+			i2cResult = -EIO;
+			bad = RunCase(i, -EIO, &result);
+			i2cResult = 0;
+			printf("%s: I2C error returned: %s\n", name, bad ? "FAIL" : "PASS");
+			failures += bad;
+		}
+	}
+
+	return failures;
+}
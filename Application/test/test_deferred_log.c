@@ -0,0 +1,175 @@
+/**************************************************************************/
+/**
+ * @file        test_deferred_log.c
+ * @brief       Round trip of log calls through the deferred logger records (DeferredLog.c) and the host decoder
+ *				(Tools/DeferredLogDecode.c)
+ * @details     Every message must decode to what printf makes of the same call, with the level and tick count of
+ *				the call. DeferredLog.c is included so that the test can read its ring. Built with -no-pie: the
+ *				records hold 32 bit format addresses, which a host image loaded below 4 GB keeps.
+ *****************************************************************************/
+
+#include "SerialConsole/DeferredLog.c"
+
+#include <assert.h>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "DeferredLogDecode.h"
+
+static int errors;
+static char expected[DEFERRED_LOG_DECODE_LINE_SIZE];
+static char ramFormat[] = "from RAM: %d %s\r\n"; ///< Not a constant: the logger copies it into the record
+static char longRamFormat[] = "a RAM format longer than the copy kept: %d %s, never printed\r\n";
+
+void SerialConsoleWriteString(char *string)
+{
+	(void)string;
+}
+
+void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+/**
+ * @fn			static const char *LookupFormat(uint32_t address, void *context)
+ * @brief		The format strings are the test's own constants
+ *****************************************************************************/
+static const char *LookupFormat(uint32_t address, void *context)
+{
+	(void)context;
+	return (address != 0) ? (const char *)(uintptr_t)address : NULL;
+}
+
+/**
+ * @fn			static size_t TakeRecords(uint8_t *data, size_t size)
+ * @brief		Moves everything stored in the ring to data, as the debugger would dump it
+ *****************************************************************************/
+static size_t TakeRecords(uint8_t *data, size_t size)
+{
+	size_t length = circular_buf_size(&logRing);
+	assert(length <= size);
+	circular_buf_get_n(&logRing, data, length);
+	return length;
+}
+
+/**
+ * @fn			static int Log(enum eDebugLogLevels level, const char *format, ...)
+ * @brief		What LogMessage does in deferred mode
+ *****************************************************************************/
+static int Log(enum eDebugLogLevels level, const char *format, ...)
+{
+	va_list args;
+
+	hostTicks += 7;
+	va_start(args, format);
+	int res = DeferredLogWrite(level, format, args);
+	va_end(args);
+	return res;
+}
+
+/**
+ * @fn			static void Expect(const char *name, int written, enum eDebugLogLevels level, const char *text)
+ * @brief		Decodes the record of the last Log call and compares it with the level, tick count and text
+ *****************************************************************************/
+static void Expect(const char *name, int written, enum eDebugLogLevels level, const char *text)
+{
+	uint8_t data[DEFERRED_LOG_BUFFER_SIZE];
+	struct DeferredLogLine line = {0};
+
+	size_t length = TakeRecords(data, sizeof(data));
+	int used = DeferredLogDecode(data, length, LookupFormat, NULL, &line);
+	bool ok = written == 0 && used == (int)length && line.level == level && line.ticks == hostTicks && strcmp(line.text, text) == 0;
+	printf("%-28s %3d B record: %s\n", name, used, ok ? "PASS" : "FAIL");
+	if (!ok) {
+		printf("    expected \"%s\"\n    decoded  \"%s\" (level %u, ticks %lu)\n", text, line.text, line.level, (unsigned long)line.ticks);
+		errors++;
+	}
+}
+
+/** Logs a message and expects what snprintf makes of the same arguments */
+#define CHECK(name, level, ...)                                 \
+	do {                                                        \
+		snprintf(expected, sizeof(expected), __VA_ARGS__);      \
+		Expect(name, Log(level, __VA_ARGS__), level, expected); \
+	} while (0)
+
+int main(void)
+{
+	uint8_t data[DEFERRED_LOG_BUFFER_SIZE];
+	char firmwareLine[DEFERRED_LOG_OUTPUT_SIZE];
+	struct DeferredLogLine line;
+	const char *digits = "0123456789012345678901234567890123456789";
+	size_t length;
+	int bad;
+
+	// What vDeferredLogTask does before it drains
+	circular_buf_init(&logRing, logRingStorage, DEFERRED_LOG_BUFFER_SIZE);
+	drainTaskHandle = xTaskGetCurrentTaskHandle();
+
+	CHECK("plain text", LOG_INFO_LVL, "Initialized I2C Driver!\r\n");
+	CHECK("32 bit integers", LOG_WARNING_LVL, "%d %i %u %x %X %o %c\r\n", -123456, INT_MIN, UINT_MAX, 0xBEEFu, 0xCAFEu, 0777u, 'Q');
+	CHECK("long, size_t (32 bit there)", LOG_ERROR_LVL, "%ld %lu %lx %zu\r\n", -5L, 4000000000UL, 0xDEADBEEFUL, (size_t)4096);
+	CHECK("64 bit integers", LOG_DEBUG_LVL, "%lld %llu %jx\r\n", LLONG_MIN, ULLONG_MAX, (intmax_t)0x123456789ABCDEF0LL);
+	CHECK("doubles", LOG_INFO_LVL, "%f %.3e %g %8.2f\r\n", 3.14159, -DBL_MAX, 1e-300, -0.5);
+	CHECK("strings", LOG_INFO_LVL, "%s [%10s] [%-6.2s] %s\r\n", "MQTT", "right", "cut", "");
+	CHECK("width and precision args", LOG_FATAL_LVL, "[%*d] [%-*.*f]\r\n", 6, -42, 9, 2, 2.71828);
+	CHECK("percent and flags", LOG_INFO_LVL, "100%% [%+05d] [%#x] [% d]\r\n", 7, 255u, 3);
+	CHECK("format in RAM", LOG_DEBUG_LVL, ramFormat, -1, "copied");
+
+	// A %s argument is cut to DEFERRED_LOG_MAX_STRING characters
+	snprintf(expected, sizeof(expected), "<%.*s>\r\n", DEFERRED_LOG_MAX_STRING, "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	Expect("long string cut", Log(LOG_INFO_LVL, "<%s>\r\n", "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"), LOG_INFO_LVL, expected);
+
+	// A format in RAM is cut to DEFERRED_LOG_MAX_STRING characters and marked, here and in the firmware's formatter
+	char cutFormat[DEFERRED_LOG_MAX_STRING + 1];
+	memcpy(cutFormat, longRamFormat, DEFERRED_LOG_MAX_STRING);
+	cutFormat[DEFERRED_LOG_MAX_STRING] = '\0';
+	snprintf(expected, sizeof(expected), cutFormat, 12, "cut");
+	strcat(expected, DEFERRED_LOG_TRUNCATED_MARK);
+	Log(LOG_WARNING_LVL, longRamFormat, 12, "cut");
+	length = TakeRecords(data, sizeof(data));
+	bad = DeferredLogDecode(data, length, LookupFormat, NULL, &line) != (int)length || line.level != LOG_WARNING_LVL;
+	format_record(data, firmwareLine, sizeof(firmwareLine));
+	bad += strcmp(line.text, expected) != 0 || strcmp(firmwareLine, expected) != 0;
+	printf("%-28s %3zu B record: %s\n", "format in RAM cut", length, bad ? "FAIL" : "PASS");
+	if (bad) {
+		printf("    expected \"%s\"\n    decoded  \"%s\"\n    firmware \"%s\"\n", expected, line.text, firmwareLine);
+	}
+	errors += (bad != 0);
+
+	// A record cut at DEFERRED_LOG_MAX_RECORD: the string that crosses the end is cut, the missing arguments
+	// are printed as their specification
+	snprintf(expected, sizeof(expected), "%s %s %.*s %%s %%d\r\n", digits, digits, DEFERRED_LOG_MAX_RECORD - DEFERRED_LOG_HEADER_SIZE - 2 * 41 - 1, digits);
+	Expect("record cut at the maximum", Log(LOG_INFO_LVL, "%s %s %s %s %d\r\n", digits, digits, digits, digits, 5), LOG_INFO_LVL, expected);
+
+	// Several records in a row are decoded one after the other, and agree with the firmware's own formatter
+	bad = 0;
+	for (int i = 0; i < 8; i++) {
+		Log((enum eDebugLogLevels)(i % N_DEBUG_LEVELS), "record %d of %s\r\n", i, "eight");
+	}
+	length = TakeRecords(data, sizeof(data));
+	size_t pos = 0;
+	for (int i = 0; i < 8; i++) {
+		int used = DeferredLogDecode(data + pos, length - pos, LookupFormat, NULL, &line);
+		format_record(data + pos, firmwareLine, sizeof(firmwareLine));
+		snprintf(expected, sizeof(expected), "record %d of eight\r\n", i);
+		bad += used <= 0 || line.level != i % N_DEBUG_LEVELS || strcmp(line.text, expected) != 0 || strcmp(firmwareLine, expected) != 0;
+		pos += (used > 0) ? used : 0;
+	}
+	bad += pos != length;
+	printf("%-28s %3zu B in 8 records: %s\n", "stream of records", length, bad ? "FAIL" : "PASS");
+	errors += (bad != 0);
+
+	// Malformed input
+	Log(LOG_INFO_LVL, "%s\r\n", "incomplete");
+	length = TakeRecords(data, sizeof(data));
+	bad = DeferredLogDecode(data, length - 1, LookupFormat, NULL, &line) != 0;
+	data[0] = DEFERRED_LOG_DECODE_HEADER_SIZE - 1;
+	bad += DeferredLogDecode(data, length, LookupFormat, NULL, &line) != -1;
+	printf("%-28s %s\n", "incomplete and bad records", bad ? "FAIL" : "PASS");
+	errors += (bad != 0);
+
+	return errors ? 1 : 0;
+}
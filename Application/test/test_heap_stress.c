@@ -0,0 +1,212 @@
+/**************************************************************************/
+/**
+ * @file        test_heap_stress.c
+ * @brief       Host stress test of the coalescing heap (Heap/Heap.c) with the firmware's allocation pattern
+ * @details     The firmware allocates at runtime only from the HTTP client: the 512 B receive buffer once, and
+ *				the extra header of each request, freed by the next request. Tasks and queues are static, the
+ *				semaphores are created at boot. The test replays the boot, then OTA downloads (manifest with
+ *				If-None-Match, image, resumes with Range) and checks that the heap comes back to where it was,
+ *				and counts the downloads heap_1 (never frees, modelled as a bump allocator) would survive.
+ *				A random churn of short-lived blocks then measures fragmentation and allocation time with
+ *				more live blocks than the firmware has. Block headers are 24 B here and 16 B on the target,
+ *				so the byte counts are slightly pessimistic.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "Heap.h"
+
+#define BOOT_SEMAPHORES 6        ///< I2cDriver x2, FatFsSync, CliThread, TraceSd, main21
+#define SEMAPHORE_SIZE 80        ///< sizeof(Queue_t) on the CM0
+#define HTTP_RECV_BUFFER 512     ///< MAIN_BUFFER_MAX_SIZE
+#define DOWNLOADS 10000
+#define MAX_RESUMES 6            ///< Range requests after a dropped connection, per download
+#define CHURN_SLOTS 12         ///< Half of them live on average: about half of the free heap
+#define CHURN_OPS 2000000
+#define CHURN_MAX_SIZE 256
+#define HISTOGRAM_NS 10000     ///< Allocation times are counted per ns up to this, slower ones are preemptions of the host
+
+static void *extHeader;          ///< module->req.ext_header of the HTTP client
+static size_t heap1Used;         ///< Bytes heap_1 would have handed out
+static int heap1Exhausted;       ///< Download during which heap_1 would have returned NULL, 0 if it did not
+static int download;
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// heap_1 rounds the size up to the alignment and never gives anything back
+static void Heap1Malloc(size_t size)
+{
+	heap1Used += (size + portBYTE_ALIGNMENT_MASK) & ~(size_t)portBYTE_ALIGNMENT_MASK;
+	if (heap1Used > configTOTAL_HEAP_SIZE - portBYTE_ALIGNMENT && heap1Exhausted == 0) {
+		heap1Exhausted = download;
+	}
+}
+
+// Same as http_client_send_request: the previous header is freed, the new one copied to the heap
+static int SendRequest(const char *header)
+{
+	vPortFree(extHeader);
+	extHeader = NULL;
+	if (header != NULL) {
+		extHeader = pvPortMalloc(strlen(header) + 1);
+		Heap1Malloc(strlen(header) + 1);
+		if (extHeader == NULL) {
+			return 1;
+		}
+		strcpy(extHeader, header);
+	}
+	return 0;
+}
+
+static void PrintStats(const char *name)
+{
+	struct HeapStats stats;
+	HeapGetStats(&stats);
+	printf("%-30s free %4zu of %4zu B, largest block %4zu B, %2zu free blocks, fragmentation %3u permille, %u failures\n", name,
+	       stats.freeBytes, stats.heapSize, stats.largestFreeBlock, stats.freeBlocks, stats.fragmentationPermille, stats.failures);
+}
+
+static int ReplayFirmware(void)
+{
+	struct HeapStats boot, after;
+	char header[32];
+	int requests = 0, failures = 0;
+
+	for (int i = 0; i < BOOT_SEMAPHORES; i++) {
+		failures += pvPortMalloc(SEMAPHORE_SIZE) == NULL;
+		Heap1Malloc(SEMAPHORE_SIZE);
+	}
+	failures += pvPortMalloc(HTTP_RECV_BUFFER) == NULL;
+	Heap1Malloc(HTTP_RECV_BUFFER);
+	PrintStats("after boot");
+	HeapGetStats(&boot);
+
+	for (download = 1; download <= DOWNLOADS; download++) {
+		snprintf(header, sizeof(header), "If-None-Match: \"%08lx\"\r\n", (unsigned long)rand());
+		failures += SendRequest(header);
+		failures += SendRequest(NULL);
+		requests += 2;
+		uint32_t received = 0;
+		for (int resume = rand() % (MAX_RESUMES + 1); resume > 0; resume--) {
+			received += rand() % 40000;
+			snprintf(header, sizeof(header), "Range: bytes=%lu-\r\n", (unsigned long)received);
+			failures += SendRequest(header);
+			requests++;
+		}
+	}
+	failures += SendRequest(NULL);
+	PrintStats("after the downloads");
+	HeapGetStats(&after);
+
+	int ok = failures == 0 && after.freeBytes == boot.freeBytes && after.freeBlocks == 1;
+	printf("%d downloads, %d requests: heap back to its boot state: %s\n", DOWNLOADS, requests, ok ? "PASS" : "FAIL");
+	printf("heap_1 would have had %zu B left after boot and run out of memory in download %d\n",
+	       configTOTAL_HEAP_SIZE - BOOT_SEMAPHORES * SEMAPHORE_SIZE - HTTP_RECV_BUFFER, heap1Exhausted);
+	return ok ? 0 : 1;
+}
+
+// Keeps up to CHURN_SLOTS blocks of random size and lifetime live next to what the boot left
+static int Churn(void)
+{
+	static void *slots[CHURN_SLOTS];
+	static size_t sizes[CHURN_SLOTS];
+	static long histogram[HISTOGRAM_NS + 1];
+	struct HeapStats stats, before;
+	double overhead, start, elapsed, allocTime = 0, freeTime = 0;
+	long allocs = 0, frees = 0, fragmented = 0, refused = 0, samples = 0;
+	uint64_t fragmentationSum = 0;
+	unsigned fragmentationMax = 0;
+	size_t freeBlocksMax = 0;
+
+	HeapGetStats(&before);
+	start = Now();
+	for (int i = 0; i < 1000; i++) {
+		elapsed = Now();
+	}
+	overhead = (Now() - start) / 1000;
+
+	for (long op = 0; op < CHURN_OPS; op++) {
+		int slot = rand() % CHURN_SLOTS;
+		if (slots[slot] == NULL) {
+			size_t size = 1 + rand() % CHURN_MAX_SIZE;
+			HeapGetStats(&stats);
+			start = Now();
+			slots[slot] = pvPortMalloc(size);
+			elapsed = Now() - start - overhead;
+			allocTime += elapsed;
+			allocs++;
+			long ns = (elapsed > 0) ? (long)(elapsed * 1e9) : 0;
+			histogram[(ns < HISTOGRAM_NS) ? ns : HISTOGRAM_NS]++;
+			if (slots[slot] == NULL) {
+				refused++;
+				// Enough bytes free, but not in one block
+				fragmented += stats.freeBytes >= size + 32;   // header and padding
+			} else {
+				memset(slots[slot], slot, size);
+				sizes[slot] = size;
+			}
+		} else {
+			if (((unsigned char *)slots[slot])[sizes[slot] - 1] != (unsigned char)slot) {
+				printf("block %d overwritten\n", slot);
+				return 1;
+			}
+			start = Now();
+			vPortFree(slots[slot]);
+			freeTime += Now() - start - overhead;
+			frees++;
+			slots[slot] = NULL;
+		}
+
+		if (op % 16 == 0) {
+			HeapGetStats(&stats);
+			fragmentationSum += stats.fragmentationPermille;
+			samples++;
+			if (stats.fragmentationPermille > fragmentationMax) {
+				fragmentationMax = stats.fragmentationPermille;
+			}
+			if (stats.freeBlocks > freeBlocksMax) {
+				freeBlocksMax = stats.freeBlocks;
+			}
+		}
+	}
+
+	for (int slot = 0; slot < CHURN_SLOTS; slot++) {
+		vPortFree(slots[slot]);
+	}
+	HeapGetStats(&stats);
+
+	long p999 = 0;
+	for (long count = 0; p999 < HISTOGRAM_NS && (count += histogram[p999]) < allocs - allocs / 1000;) {
+		p999++;
+	}
+
+	int ok = stats.freeBytes == before.freeBytes && stats.freeBlocks == 1;
+	printf("churn, %d slots of 1..%d B:      %ld allocations, %ld refused (%ld with enough bytes free but split)\n", CHURN_SLOTS,
+	       CHURN_MAX_SIZE, allocs, refused, fragmented);
+	printf("  fragmentation mean %llu, max %u permille, up to %zu free blocks\n", (unsigned long long)(fragmentationSum / samples),
+	       fragmentationMax, freeBlocksMax);
+	printf("  pvPortMalloc %.0f ns mean, %ld ns at the 99.9th percentile; vPortFree %.0f ns mean\n", allocTime / allocs * 1e9, p999,
+	       freeTime / frees * 1e9);
+	printf("  all blocks freed, heap coalesced back: %s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
+
+int main(void)
+{
+	int failures = 0;
+	srand(9);
+
+	failures += ReplayFirmware();
+	failures += Churn();
+
+	return failures;
+}
@@ -0,0 +1,132 @@
+/**************************************************************************/
+/**
+ * @file        test_imu_telemetry.c
+ * @brief       Round trip of IMU batches through the firmware encoder (ImuTelemetry.c) and the host decoder
+ *				(Tools/ImuTelemetryDecode.c)
+ * @details     Every batch must decode to the samples that were added. The worst case batch, full scale swings
+ *				and the largest time step, must take exactly IMU_TELEMETRY_MAX_SAMPLE_SIZE bytes per sample and fit
+ *				a buffer of IMU_TELEMETRY_SIZE(n).
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ImuTelemetryDecode.h"
+#include "Telemetry/ImuTelemetry.h"
+
+#define BATCH_SAMPLES 64
+
+static int errors;
+
+/**
+ * @fn			static void RoundTrip(const char *name, const int16_t (*xyz)[3], const uint32_t *timeMs, int n, size_t expectedSize)
+ * @brief		Encodes the n samples into a buffer of IMU_TELEMETRY_SIZE(n), decodes them and compares.
+ *				expectedSize is checked when not 0
+ *****************************************************************************/
+static void RoundTrip(const char *name, const int16_t (*xyz)[3], const uint32_t *timeMs, int n, size_t expectedSize)
+{
+	static char buffer[IMU_TELEMETRY_SIZE(IMU_TELEMETRY_DECODE_MAX_SAMPLES)];
+	struct ImuTelemetrySample samples[IMU_TELEMETRY_DECODE_MAX_SAMPLES];
+	struct ImuTelemetryBatch batch;
+	int bad = 0;
+
+	ImuTelemetryBegin(&batch, buffer, IMU_TELEMETRY_SIZE(n));
+	for (int i = 0; i < n; i++) {
+		if (!ImuTelemetryAdd(&batch, xyz[i][0], xyz[i][1], xyz[i][2], timeMs[i])) {
+			printf("%-34s sample %d not added: FAIL\n", name, i);
+			errors++;
+			return;
+		}
+	}
+	size_t size = ImuTelemetryEnd(&batch);
+
+	int count = ImuTelemetryDecode((const uint8_t *)buffer, size, samples, IMU_TELEMETRY_DECODE_MAX_SAMPLES);
+	if (count != n) {
+		bad++;
+	} else {
+		for (int i = 0; i < n; i++) {
+			if (samples[i].timeMs != timeMs[i] || samples[i].x != xyz[i][0] || samples[i].y != xyz[i][1] || samples[i].z != xyz[i][2]) {
+				bad++;
+			}
+		}
+	}
+	if (expectedSize != 0 && size != expectedSize) {
+		bad++;
+	}
+	printf("%-34s %3d samples, %5zu B, %5.2f B/sample after the first, %d mismatches: %s\n", name, n, size,
+	       (n > 1) ? (double)(size - IMU_TELEMETRY_HEADER_SIZE - IMU_TELEMETRY_FIRST_SAMPLE_SIZE) / (n - 1) : 0.0, bad, bad ? "FAIL" : "PASS");
+	errors += (bad != 0);
+}
+
+int main(void)
+{
+	static int16_t xyz[IMU_TELEMETRY_DECODE_MAX_SAMPLES][3];
+	static uint32_t timeMs[IMU_TELEMETRY_DECODE_MAX_SAMPLES];
+	struct ImuTelemetryBatch batch;
+	char small[IMU_TELEMETRY_SIZE(2) - 1];
+
+	srand(17);
+
+	// Resting sensor: gravity on z, a few milli-g of noise, 20 ms period
+	for (int i = 0; i < BATCH_SAMPLES; i++) {
+		xyz[i][0] = (int16_t)(rand() % 9 - 4);
+		xyz[i][1] = (int16_t)(rand() % 9 - 4);
+		xyz[i][2] = (int16_t)(1000 + rand() % 9 - 4);
+		timeMs[i] = 123456 + 20 * i;
+	}
+	RoundTrip("resting sensor", xyz, timeMs, BATCH_SAMPLES, 0);
+
+	// Falling values only: every delta is negative
+	for (int i = 0; i < BATCH_SAMPLES; i++) {
+		xyz[i][0] = (int16_t)(1000 - 3 * i);
+		xyz[i][1] = (int16_t)(-1000 - 150 * i);
+		xyz[i][2] = (int16_t)(32767 - 1000 * i);
+		timeMs[i] = 20 * i;
+	}
+	RoundTrip("negative deltas", xyz, timeMs, BATCH_SAMPLES, 0);
+
+	// Worst case: full scale swings (deltas of +-65535) and the largest time step, 12 B per sample
+	for (int i = 0; i < BATCH_SAMPLES; i++) {
+		xyz[i][0] = (i & 1) ? INT16_MIN : INT16_MAX;
+		xyz[i][1] = (i & 1) ? INT16_MAX : INT16_MIN;
+		xyz[i][2] = (i & 1) ? INT16_MIN : INT16_MAX;
+		timeMs[i] = 0xFFFF0000u + (uint32_t)i * IMU_TELEMETRY_MAX_STEP_MS; // the time wraps around
+	}
+	RoundTrip("worst case", xyz, timeMs, BATCH_SAMPLES, IMU_TELEMETRY_SIZE(BATCH_SAMPLES));
+
+	// Random samples over the whole range, the largest batch
+	for (int i = 0; i < IMU_TELEMETRY_DECODE_MAX_SAMPLES; i++) {
+		xyz[i][0] = (int16_t)(rand() & 0xFFFF);
+		xyz[i][1] = (int16_t)(rand() & 0xFFFF);
+		xyz[i][2] = (int16_t)(rand() & 0xFFFF);
+		timeMs[i] = (i == 0) ? (uint32_t)rand() : timeMs[i - 1] + (uint32_t)(rand() % (IMU_TELEMETRY_MAX_STEP_MS + 1));
+	}
+	RoundTrip("random, 255 samples", xyz, timeMs, IMU_TELEMETRY_DECODE_MAX_SAMPLES, 0);
+
+	// Refusals: a time step over the limit, a sample that might not fit, a 256th sample
+	static char big[IMU_TELEMETRY_SIZE(IMU_TELEMETRY_DECODE_MAX_SAMPLES + 1)];
+	int refused = 0;
+	ImuTelemetryBegin(&batch, big, sizeof(big));
+	refused += ImuTelemetryAdd(&batch, 0, 0, 0, 0) && !ImuTelemetryAdd(&batch, 0, 0, 0, IMU_TELEMETRY_MAX_STEP_MS + 1);
+	ImuTelemetryBegin(&batch, small, sizeof(small));
+	refused += ImuTelemetryAdd(&batch, 0, 0, 0, 0) && !ImuTelemetryAdd(&batch, 0, 0, 0, 1);
+	ImuTelemetryBegin(&batch, big, sizeof(big));
+	for (int i = 0; i < IMU_TELEMETRY_DECODE_MAX_SAMPLES; i++) {
+		ImuTelemetryAdd(&batch, 0, 0, 0, i);
+	}
+	refused += !ImuTelemetryAdd(&batch, 0, 0, 0, IMU_TELEMETRY_DECODE_MAX_SAMPLES);
+	printf("%-34s %d/3 refused: %s\n", "step too long, no room, 256th", refused, (refused == 3) ? "PASS" : "FAIL");
+	errors += (refused != 3);
+
+	// The decoder rejects a truncated batch
+	ImuTelemetryBegin(&batch, big, sizeof(big));
+	ImuTelemetryAdd(&batch, 1, 2, 3, 0);
+	ImuTelemetryAdd(&batch, 300, -300, 3, 500);
+	size_t size = ImuTelemetryEnd(&batch);
+	struct ImuTelemetrySample samples[2];
+	int truncated = ImuTelemetryDecode((const uint8_t *)big, size - 1, samples, 2);
+	printf("%-34s %s\n", "truncated batch rejected", (truncated < 0) ? "PASS" : "FAIL");
+	errors += (truncated >= 0);
+
+	return errors ? 1 : 0;
+}
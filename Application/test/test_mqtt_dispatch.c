@@ -0,0 +1,120 @@
+/**************************************************************************/
+/**
+ * @file        test_mqtt_dispatch.c
+ * @brief       Host benchmark of the MQTT message dispatch (deliverMessage in MQTTClient.c) against the linear scan
+ *				it replaced (baseline/mqtt_dispatch_v1.c)
+ * @details     5, 20 and 100 exact topics are subscribed, the firmware has 7. Messages arrive on the subscribed
+ *				topics in turn, and on a topic nobody subscribed every tenth time. The old dispatch compares the
+ *				topic against every entry, as an exact topic and as a filter; the hashed one does one lookup and
+ *				then walks the (empty) wildcard list. The test fails if a message reaches the wrong handler; the
+ *				rates depend on the host and are only compared to each other.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "MQTTClient/MQTTClient.h"
+#include "mqtt_dispatch_v1.h"
+
+#define MAX_TOPICS 100
+#define MESSAGES 4000000
+#define TOPIC_LENGTH 32
+
+int deliverMessage(MQTTClient* c, MQTTString* topicName, MQTTMessage* message);
+
+static char topics[MAX_TOPICS + 1][TOPIC_LENGTH];   ///< The last one is never subscribed
+static MQTTString topicNames[MAX_TOPICS + 1];
+static const char *expectedTopic;
+static long handled, misrouted, unhandled;
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void OnMessage(MessageData *md)
+{
+	handled++;
+	misrouted += md->topicName->lenstring.data != expectedTopic;
+}
+
+static void OnUnsubscribed(MessageData *md)
+{
+	unhandled++;
+	misrouted += md->topicName->lenstring.data != expectedTopic;
+}
+
+// Message n goes to topic n % topicCount, every tenth to the unsubscribed topic
+static MQTTString *MessageTopic(long n, int topicCount)
+{
+	return &topicNames[(n % 10 == 9) ? MAX_TOPICS : n % topicCount];
+}
+
+static double RunHashed(int topicCount)
+{
+	static unsigned char sendbuf[64], readbuf[64];
+	static MQTTClient client;
+	MQTTMessage message = {0};
+	double start;
+
+	MQTTClientInit(&client, NULL, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+	for (int i = 0; i < topicCount; i++) {
+		MQTTSetMessageHandler(&client, topics[i], OnMessage);
+	}
+	client.defaultMessageHandler = OnUnsubscribed;
+
+	start = Now();
+	for (long n = 0; n < MESSAGES; n++) {
+		MQTTString *topic = MessageTopic(n, topicCount);
+		expectedTopic = topic->lenstring.data;
+		deliverMessage(&client, topic, &message);
+	}
+	return MESSAGES / (Now() - start);
+}
+
+static double RunLinear(int topicCount)
+{
+	static struct v1_MessageHandlers handlers[MAX_TOPICS];
+	MQTTMessage message = {0};
+	double start;
+
+	for (int i = 0; i < topicCount; i++) {
+		handlers[i].topicFilter = topics[i];
+		handlers[i].fp = OnMessage;
+	}
+
+	start = Now();
+	for (long n = 0; n < MESSAGES; n++) {
+		MQTTString *topic = MessageTopic(n, topicCount);
+		expectedTopic = topic->lenstring.data;
+		v1_deliverMessage(handlers, topicCount, OnUnsubscribed, topic, &message);
+	}
+	return MESSAGES / (Now() - start);
+}
+
+int main(void)
+{
+	static const int topicCounts[] = {5, 20, 100};
+	int failures = 0;
+
+	for (int i = 0; i <= MAX_TOPICS; i++) {
+		snprintf(topics[i], TOPIC_LENGTH, "Status/node%03d/%s", i, (i == MAX_TOPICS) ? "unsubscribed" : "control");
+		topicNames[i].lenstring.data = topics[i];
+		topicNames[i].lenstring.len = strlen(topics[i]);
+	}
+
+	printf("%-8s %20s %20s %8s\n", "topics", "linear scan msg/s", "hashed msg/s", "speedup");
+	for (int i = 0; i < (int)(sizeof(topicCounts) / sizeof(topicCounts[0])); i++) {
+		handled = misrouted = unhandled = 0;
+		double linear = RunLinear(topicCounts[i]);
+		double hashed = RunHashed(topicCounts[i]);
+		int ok = misrouted == 0 && unhandled == 2 * (MESSAGES / 10) && handled == 2 * (MESSAGES - MESSAGES / 10);
+		printf("%-8d %20.0f %20.0f %7.1fx %s\n", topicCounts[i], linear, hashed, hashed / linear, ok ? "PASS" : "FAIL");
+		failures += !ok;
+	}
+
+	return failures;
+}
@@ -0,0 +1,421 @@
+/**************************************************************************/
+/**
+ * @file        test_mqtt_stream.c
+ * @brief       Host test of the in-place MQTT receive path (readPacket in MQTTClient.c, WINC1500_recv in MCHP_ATWx.c)
+ * @details     A stream of PUBLISH packets is cut into TCP segments of random size and handed to the firmware's
+ *				platform layer the way the WINC1500 driver does (Socket_ReadSocketData): a segment larger than
+ *				the buffer given to recv comes in several SOCKET_MSG_RECV callbacks, each chunk into the buffer
+ *				the socket points at when it is read. Every packet that fits readbuf must come out of MQTTYield
+ *				whole and in order; packets larger than readbuf are skipped.
+ *
+ *				The publish cases send QoS 1 and 2 messages over the same socket to a simulated broker that
+ *				acknowledges each packet BROKER_RTT_MS after it was sent. The blocking MQTTPublish (the old
+ *				state publish) is compared to MQTTPublishAsync with 1, 4 and 8 publishes in flight, driven like
+ *				the WiFi task does: publish until the window is full, then MQTTYield for WIFI_MQTT_YIELD_MS.
+ *				Time is simulated (1 ms per tick, a send takes SEND_MS), so the rates are exact.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MQTTClient/Wrapper/mqtt.h"
+#include "driver/include/m2m_wifi.h"
+
+#define READBUF_SIZE 512
+#define STREAM_SIZE 262144
+#define MAX_PACKETS 1024
+#define SIM_SOCKET 3
+#define BROKER_RTT_MS 30
+#define SEND_MS 1
+#define YIELD_MS 20            ///< WIFI_MQTT_YIELD_MS
+#define MAX_RESPONSES 32
+#define PUBLISH_MESSAGES 200
+
+struct SimSocket {
+    unsigned char stream[STREAM_SIZE];
+    int length;         ///< Bytes in stream
+    int position;       ///< Next byte to deliver
+    int maxSegment;     ///< Largest segment
+    bool recvPending;   ///< recv was called, the next event delivers a segment
+    bool sendPending;
+    uint8 *userBuffer;  ///< Where the driver puts the next chunk
+    uint16 userSize;
+    uint32 timeout;
+    int split;          ///< Segments delivered in more than one chunk
+    int overflows;      ///< Segments in more than two chunks: larger than the buffer and the spill of the platform
+    int failures;       ///< MQTTYield calls that returned FAILURE
+    struct {
+        TickType_t due;
+        unsigned char packet[4];
+    } responses[MAX_RESPONSES];   ///< Acknowledgements of the broker on their way
+    int responseCount;
+    int brokerPublishes;          ///< PUBLISH packets the broker received
+    int brokerErrors;             ///< Packets the broker could not parse or answer
+};
+
+struct mqtt_client_pool mqttClientPool[MQTT_MAX_CLIENTS];
+
+static struct SimSocket sim;
+static int expectedLength[MAX_PACKETS]; ///< Payload length of each packet, -1 if it does not fit readbuf
+static int packets;
+static int delivered;                   ///< Index of the next expected packet
+static int errors;
+
+// The broker answers a QoS 1 PUBLISH with PUBACK, a QoS 2 one with PUBREC, a PUBREL with PUBCOMP, one round trip later
+static void SimBrokerReceive(const unsigned char *packet, int length)
+{
+    unsigned char dup, type, retained;
+    unsigned short id;
+    int qos, payloadlen;
+    unsigned char *payload;
+    MQTTString topic;
+
+    switch (packet[0] >> 4) {
+        case PUBLISH:
+            if (MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topic, &payload, &payloadlen, (unsigned char *) packet, length) != 1) {
+                sim.brokerErrors++;
+                return;
+            }
+            sim.brokerPublishes++;
+            type = (qos == QOS1) ? PUBACK : (qos == QOS2) ? PUBREC : 0;
+            break;
+        case PUBREL:
+            if (MQTTDeserialize_ack(&type, &dup, &id, (unsigned char *) packet, length) != 1) {
+                sim.brokerErrors++;
+                return;
+            }
+            type = PUBCOMP;
+            break;
+        default:
+            return;
+    }
+    if (type == 0) {
+        return;
+    }
+    if (sim.responseCount == MAX_RESPONSES) {
+        sim.brokerErrors++;
+        return;
+    }
+    sim.responses[sim.responseCount].due = hostTicks + BROKER_RTT_MS;
+    MQTTSerialize_ack(sim.responses[sim.responseCount].packet, 4, type, 0, id);
+    sim.responseCount++;
+}
+
+// Puts the acknowledgements that arrive within timeout ms on the stream, at the time the first one arrives
+static bool SimBrokerRespond(uint32 timeout)
+{
+    int first = -1;
+    for (int i = 0; i < sim.responseCount; i++) {
+        if (first < 0 || sim.responses[i].due < sim.responses[first].due) {
+            first = i;
+        }
+    }
+    if (first < 0 || sim.responses[first].due > hostTicks + timeout) {
+        return false;
+    }
+    if (sim.responses[first].due > hostTicks) {
+        hostTicks = sim.responses[first].due;
+    }
+    for (int i = 0; i < sim.responseCount;) {
+        if (sim.responses[i].due <= hostTicks) {
+            memcpy(&sim.stream[sim.length], sim.responses[i].packet, 4);
+            sim.length += 4;
+            sim.responses[i] = sim.responses[--sim.responseCount];
+        } else {
+            i++;
+        }
+    }
+    return true;
+}
+
+// Stand-ins for the WINC driver: most ignore their arguments
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec)
+{
+    if (sock != SIM_SOCKET || pvRecvBuf == NULL || u16BufLen == 0) {
+        return SOCK_ERR_INVALID_ARG;
+    }
+    sim.userBuffer = pvRecvBuf;
+    sim.userSize = u16BufLen;
+    sim.timeout = u32Timeoutmsec;
+    sim.recvPending = true;
+    return SOCK_ERR_NO_ERROR;
+}
+
+void socketSetRecvBuffer(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen)
+{
+    if (sock == SIM_SOCKET && pvRecvBuf != NULL && u16BufLen != 0) {
+        sim.userBuffer = pvRecvBuf;
+        sim.userSize = u16BufLen;
+    }
+}
+
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags)
+{
+    SimBrokerReceive(pvSendBuffer, u16SendLength);
+    sim.sendPending = true;
+    return SOCK_ERR_NO_ERROR;
+}
+
+sint8 close(SOCKET sock)
+{
+    return SOCK_ERR_NO_ERROR;
+}
+
+// Not called: the test starts on a connected socket
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags)
+{
+    return SIM_SOCKET;
+}
+
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen)
+{
+    return SOCK_ERR_INVALID;
+}
+
+sint8 gethostbyname(uint8 *pcHostName)
+{
+    return SOCK_ERR_INVALID;
+}
+
+void nm_bsp_wait_for_event(uint32 u32TimeoutMs)
+{
+}
+#pragma GCC diagnostic pop
+
+// Same loop as Socket_ReadSocketData: one segment per receive, in chunks of what the socket's buffer holds
+static void SimDeliverSegment(void)
+{
+    tstrSocketRecvMsg msg = {0};
+    int chunks = 0;
+
+    sim.recvPending = false;
+    hostTicks++;
+    if (sim.position == sim.length && !SimBrokerRespond(sim.timeout)) {
+        hostTicks += sim.timeout;
+        msg.s16BufferSize = SOCK_ERR_TIMEOUT;
+        tcpClientSocketEventHandler(SIM_SOCKET, SOCKET_MSG_RECV, &msg);
+        return;
+    }
+    int remaining = 1 + rand() % sim.maxSegment;
+    if (remaining > sim.length - sim.position) {
+        remaining = sim.length - sim.position;
+    }
+    while (remaining > 0) {
+        int size = (remaining < sim.userSize) ? remaining : sim.userSize;
+        memcpy(sim.userBuffer, &sim.stream[sim.position], size);
+        sim.position += size;
+        remaining -= size;
+        msg.pu8Buffer = sim.userBuffer;
+        msg.s16BufferSize = (sint16) size;
+        msg.u16RemainingSize = (uint16) remaining;
+        chunks++;
+        tcpClientSocketEventHandler(SIM_SOCKET, SOCKET_MSG_RECV, &msg);
+    }
+    sim.split += chunks > 1;
+    sim.overflows += chunks > 2;
+}
+
+sint8 m2m_wifi_handle_events(void *arg)
+{
+    (void) arg;
+    if (sim.recvPending) {
+        SimDeliverSegment();
+    }
+    if (sim.sendPending) {
+        sim.sendPending = false;
+        hostTicks += SEND_MS;
+        tcpClientSocketEventHandler(SIM_SOCKET, SOCKET_MSG_SEND, NULL);
+    }
+    return 0;
+}
+
+static void OnMessage(MessageData *md)
+{
+    const unsigned char *payload = md->message->payload;
+    while (delivered < packets && expectedLength[delivered] < 0) {
+        delivered++; // skipped as expected
+    }
+    if (delivered == packets || (int) md->message->payloadlen != expectedLength[delivered]) {
+        errors++;
+        return;
+    }
+    for (int i = 0; i < expectedLength[delivered]; i++) {
+        if (payload[i] != (unsigned char) (delivered + i)) {
+            errors++;
+            break;
+        }
+    }
+    delivered++;
+}
+
+/**
+ * @brief	Builds the stream: packets with payloads of up to maxPayload bytes, every bigEvery-th one larger than readbuf
+ */
+static void BuildStream(int count, int maxPayload, int bigEvery)
+{
+    unsigned char payload[2048];
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = "test/stream";
+
+    memset(&sim, 0, sizeof(sim));
+    packets = 0;
+    for (int n = 0; n < count && packets < MAX_PACKETS; n++) {
+        int length = (bigEvery > 0 && n % bigEvery == bigEvery - 1) ? READBUF_SIZE + 100 : rand() % (maxPayload + 1);
+        for (int i = 0; i < length; i++) {
+            payload[i] = (unsigned char) (packets + i);
+        }
+        int size = MQTTSerialize_publish(&sim.stream[sim.length], STREAM_SIZE - sim.length, 0, 0, 0, 0, topic, payload, length);
+        if (size <= 0) {
+            break;
+        }
+        sim.length += size;
+        expectedLength[packets++] = (size > READBUF_SIZE) ? -1 : length;
+    }
+}
+
+// A client of the firmware's platform layer, connected to the simulated socket
+static MQTTClient *ConnectClient(void)
+{
+    static unsigned char sendbuf[256], readbuf[READBUF_SIZE];
+    static struct mqtt_module module;
+    MQTTClient *client = &mqttClientPool[0].client;
+
+    NetworkInit(&module.network);
+    module.network.socket = SIM_SOCKET;
+    module.client = client;
+    mqttClientPool[0].mqtt_instance = &module;
+    MQTTClientInit(client, &module.network, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+    client->isconnected = 1;
+    client->keepAliveInterval = 0;
+    return client;
+}
+
+static int RunCase(const char *name, int count, int maxPayload, int maxSegment, int bigEvery, int overflowsAllowed)
+{
+    BuildStream(count, maxPayload, bigEvery);
+    sim.maxSegment = maxSegment;
+    delivered = errors = 0;
+    MQTTClient *client = ConnectClient();
+    MQTTSetMessageHandler(client, "test/stream", OnMessage);
+
+    for (int i = 0; i < 100000 && sim.position < sim.length; i++) {
+        if (MQTTYield(client, 10) == FAILURE) {
+            sim.failures++;
+        }
+    }
+    MQTTYield(client, 10);
+    client->ipstack->disconnect(client->ipstack); // drops what the platform still holds
+    while (delivered < packets && expectedLength[delivered] < 0) {
+        delivered++;
+    }
+
+    int ok = errors == 0 && (overflowsAllowed ? sim.failures >= sim.overflows : (delivered == packets && sim.overflows == 0));
+    printf("%-38s %4d packets, %4d delivered in order, %d corrupt, %3d segments split, %d overflows, %d yield failures: %s\n", name, packets,
+           delivered, errors, sim.split, sim.overflows, sim.failures, ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+static int inflight, acknowledged, unacknowledged;
+
+static void OnPublishComplete(MQTTClient *c, unsigned short id, int rc, void *context)
+{
+    (void) c;
+    (void) id;
+    (void) context;
+    inflight--;
+    acknowledged += rc == SUCCESS;
+    unacknowledged += rc != SUCCESS;
+}
+
+/**
+ * @brief	Publishes PUBLISH_MESSAGES messages, blocking (window 0) or with up to window in flight
+ * @return	Messages per second, 0 if one was not acknowledged or the broker did not get all of them
+ */
+static double RunPublish(int qos, int window)
+{
+    static const char payload[] = "Hold in multiple colors";
+    MQTTMessage message = {.qos = qos, .payload = (void *) payload, .payloadlen = sizeof(payload) - 1};
+    int sent = 0;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.maxSegment = 1460;
+    inflight = acknowledged = unacknowledged = 0;
+    MQTTClient *client = ConnectClient();
+    client->publishComplete = OnPublishComplete;
+
+    TickType_t start = hostTicks;
+    if (window == 0) {
+        for (; sent < PUBLISH_MESSAGES; sent++) {
+            acknowledged += MQTTPublish(client, "test/state", &message) == SUCCESS;
+        }
+    } else {
+        while (acknowledged + unacknowledged < PUBLISH_MESSAGES) {
+            while (sent < PUBLISH_MESSAGES && inflight < window) {
+                int rc = MQTTPublishAsync(client, "test/state", &message, NULL);
+                if (rc != SUCCESS) {
+                    unacknowledged += rc != INFLIGHT_WINDOW_FULL;
+                    break;
+                }
+                inflight++;
+                sent++;
+            }
+            if (MQTTYield(client, YIELD_MS) == FAILURE) {
+                sim.failures++;
+                break;
+            }
+        }
+    }
+    double seconds = (hostTicks - start) / 1000.0;
+    client->ipstack->disconnect(client->ipstack);
+
+    int ok = acknowledged == PUBLISH_MESSAGES && sim.brokerPublishes == PUBLISH_MESSAGES && sim.brokerErrors == 0 && sim.failures == 0;
+    return ok ? PUBLISH_MESSAGES / seconds : 0;
+}
+
+int main(void)
+{
+    int failures = 0;
+    srand(20);
+
+    // Segments up to the old 256-byte FIFO must always fit, whatever is buffered
+    failures += RunCase("packets <= 256 B, segments <= 256 B", 800, 240, 256, 0, 0);
+    failures += RunCase("small packets, many per segment", 800, 20, 256, 0, 0);
+    failures += RunCase("byte-sized segments", 300, 200, 1, 0, 0);
+    failures += RunCase("packets larger than readbuf", 400, 200, 256, 25, 0);
+    // Full-sized segments are larger than what is free in readbuf: the rest of the segment goes to the spill
+    failures += RunCase("segments up to 1460 B", 400, 200, 1460, 0, 0);
+    failures += RunCase("segments up to 1460 B, large packets", 400, 200, 1460, 25, 0);
+    // Larger than the MSS, cannot happen: the stream cannot be parsed after the lost part, MQTTYield must fail
+    // (the wrapper then reconnects) instead of delivering corrupt payloads
+    failures += RunCase("segments up to 4000 B (overflows)", 400, 200, 4000, 0, 1);
+
+    // Every message must be acknowledged. From window 4 on, more publishes in flight must be faster, and faster
+    // than waiting for every acknowledgement. Window 1 may be slower than that: the yield runs its full time
+    printf("%d messages, broker round trip %d ms, yield %d ms:\n", PUBLISH_MESSAGES, BROKER_RTT_MS, YIELD_MS);
+    printf("  %-26s %10s %10s\n", "", "QoS 1", "QoS 2");
+    for (int qos = QOS1; qos <= QOS2; qos++) {
+        static const int windows[] = {0, 1, 4, 8};
+        static double rates[2][4];
+        for (int i = 0; i < 4; i++) {
+            rates[qos - QOS1][i] = RunPublish(qos, windows[i]);
+        }
+        if (qos == QOS2) {
+            for (int i = 0; i < 4; i++) {
+                char name[32];
+                snprintf(name, sizeof(name), (windows[i] == 0) ? "MQTTPublish (blocking)" : "MQTTPublishAsync, window %d", windows[i]);
+                int ok = rates[0][i] > 0 && rates[1][i] > 0;
+                if (windows[i] >= 4) {
+                    ok = ok && rates[0][i] > rates[0][i - 1] && rates[1][i] > rates[1][i - 1] && rates[0][i] > rates[0][0] &&
+                         rates[1][i] > rates[1][0];
+                }
+                printf("  %-26s %7.0f/s %7.0f/s: %s\n", name, rates[0][i], rates[1][i], ok ? "PASS" : "FAIL");
+                failures += !ok;
+            }
+        }
+    }
+
+    return failures;
+}
@@ -0,0 +1,125 @@
+/**************************************************************************/
+/**
+ * @file        test_ring_bench.c
+ * @brief       Host benchmark of the SPSC console ring (circular_buffer.c) against the ring it replaced
+ *				(baseline/circular_buffer_v1.c)
+ * @details     The same byte stream goes through a 512 B ring, the size of the console rings, in chunks of a
+ *				log line: the producer stores a chunk (as much as fits), then the consumer takes a chunk. The old
+ *				ring is used one byte per call, as the console did; the SPSC ring one byte per call, with put_n
+ *				and get_n, and with put_n and peek_span/consume as the TX DMA path does. The test fails if a
+ *				stream does not come out intact; the rates depend on the host and are only compared to each other.
+ *				Both differ on the target: the old ring's '%' is a library call there (no divide instruction),
+ *				and the SPSC ring's fences only hold back the compiler there, as they do on an x86 host.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "SerialConsole/circular_buffer.h"
+#include "circular_buffer_v1.h"
+
+#define RING_SIZE 512
+#define CHUNK 48                     ///< A typical log line
+#define STREAM_BYTES (64u << 20)
+
+enum RingMode { V1_BYTES, SPSC_BYTES, SPSC_BULK, SPSC_SPAN, N_MODES };
+
+static const char *const modeNames[N_MODES] = {"old ring, put2/get per byte", "SPSC, put/get per byte", "SPSC, put_n/get_n",
+                                               "SPSC, put_n/peek_span+consume"};
+
+static uint8_t storage[RING_SIZE];
+#define PERIOD (CHUNK * 256)           ///< The stream repeats itself after PERIOD bytes
+static uint8_t source[PERIOD + CHUNK]; ///< One period and the start of the next: a chunk is read at any offset
+
+/**
+ * @fn			static double Now(void)
+ * @brief		Monotonic time in seconds
+ *****************************************************************************/
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @fn			static double Run(enum RingMode mode, uint32_t *mismatches)
+ * @brief		Moves STREAM_BYTES through the ring, checking every byte that comes out
+ * @return		Bytes per second
+ *****************************************************************************/
+static double Run(enum RingMode mode, uint32_t *mismatches)
+{
+	circular_buf_t ring;
+	v1_cbuf_handle_t v1 = NULL;
+	uint8_t chunk[CHUNK];
+	size_t produced = 0, consumed = 0;
+
+	if (mode == V1_BYTES) {
+		v1 = v1_circular_buf_init(storage, RING_SIZE);
+	} else {
+		circular_buf_init(&ring, storage, RING_SIZE);
+	}
+	*mismatches = 0;
+
+	double start = Now();
+	while (consumed < STREAM_BYTES) {
+		const uint8_t *in = &source[produced % PERIOD];
+		size_t stored = 0, taken = 0;
+		uint8_t *span;
+
+		switch (mode) {
+			case V1_BYTES:
+				while (stored < CHUNK && v1_circular_buf_put2(v1, in[stored]) == 0) stored++;
+				while (taken < CHUNK && v1_circular_buf_get(v1, &chunk[taken]) == 0) taken++;
+				break;
+			case SPSC_BYTES:
+				while (stored < CHUNK && circular_buf_put(&ring, in[stored]) == 0) stored++;
+				while (taken < CHUNK && circular_buf_get(&ring, &chunk[taken]) == 0) taken++;
+				break;
+			case SPSC_BULK:
+				stored = circular_buf_put_n(&ring, in, CHUNK);
+				taken = circular_buf_get_n(&ring, chunk, CHUNK);
+				break;
+			case SPSC_SPAN:
+				stored = circular_buf_put_n(&ring, in, CHUNK);
+				taken = circular_buf_peek_span(&ring, &span);
+				taken = (taken > CHUNK) ? CHUNK : taken;
+				memcpy(chunk, span, taken);
+				circular_buf_consume(&ring, taken);
+				break;
+			default:
+				break;
+		}
+		produced += stored;
+
+		for (size_t i = 0; i < taken; i++) {
+			*mismatches += chunk[i] != source[(consumed + i) % PERIOD];
+		}
+		consumed += taken;
+	}
+	double seconds = Now() - start;
+
+	if (v1 != NULL) {
+		v1_circular_buf_free(v1);
+	}
+	return consumed / seconds;
+}
+
+int main(void)
+{
+	double rates[N_MODES];
+	int errors = 0;
+
+	for (size_t i = 0; i < sizeof(source); i++) {
+		source[i] = (uint8_t)((i % PERIOD) * 131 + ((i % PERIOD) >> 8));
+	}
+	for (int mode = 0; mode < N_MODES; mode++) {
+		uint32_t mismatches;
+		rates[mode] = Run((enum RingMode)mode, &mismatches);
+		printf("%-30s %7.1f MB/s (x%4.1f), %u bad bytes: %s\n", modeNames[mode], rates[mode] / 1e6, rates[mode] / rates[V1_BYTES], mismatches,
+		       mismatches ? "FAIL" : "PASS");
+		errors += (mismatches != 0);
+	}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/**************************************************************************/
+/**
+ * @file        test_sd_writer.c
+ * @brief       Host test of the double-buffered SD writer (Storage/SdWriter.c) against a simulated slow card
+ * @details     vSdWriterTask runs as a thread, the test is the WiFi task: it receives a 1460 B packet every
+ *				NET_PACKET_US (the WINC SPI transfer) and hands it to the receive callback. The callback either
+ *				calls f_write itself, as store_file_packet did, or SdWriterWrite.
+ *
+ *				f_write sleeps as long as the card would take, modelled on FatFs appending to a file: a call
+ *				costs CALL_US (cluster chain, command), the sector that an unaligned write completes goes out
+ *				from the file's sector buffer as a single-block write, whole sectors go out as one multi-block
+ *				write, and the unaligned tail stays in the sector buffer. Every BUSY_SECTORS sectors the slow
+ *				card is busy for BUSY_US, as SD cards are while they erase; the steady card never is. The writes and their file offsets are
+ *				recorded: the test fails if the file is not intact, or if an SdWriter write after the first
+ *				one does not start on a sector or (except the last) does not cover whole sectors.
+ *				Times are wall-clock sleeps of the host and vary by a few percent from run to run.
+ *****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Storage/SdWriter.h"
+
+#define FILE_SIZE (128 * 1024)
+#define START_OFFSET 700        ///< The download resumes mid-sector, as after a Range request
+#define PACKET_SIZE 1460        ///< One TCP segment from the WINC
+#define NET_PACKET_US 3000      ///< About 490 KB/s from the WINC
+#define CALL_US 300
+#define COMMAND_US 500
+#define SECTOR_US 500
+#define BUSY_SECTORS 64
+#define BUSY_US 30000
+#define MAX_WRITES 1024
+
+static uint8_t source[FILE_SIZE];
+static uint8_t card[FILE_SIZE];
+static uint32_t sectorsWritten;       ///< Drives the busy periods of the card
+static uint32_t writeOffsets[MAX_WRITES], writeLengths[MAX_WRITES];
+static int writes;
+static int failAtWrite = -1;          ///< f_write call that fails, -1 for none
+static long busyUs;                   ///< 0 or BUSY_US
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void SleepUs(long us)
+{
+	struct timespec delay = {us / 1000000, (us % 1000000) * 1000};
+	nanosleep(&delay, NULL);
+}
+
+// SysTick: xTaskGetTickCount counts ms from the start of the test
+static void *TickThread(void *arg)
+{
+	(void)arg;
+	double start = Now();
+	for (;;) {
+		hostTicks = (TickType_t)((Now() - start) * 1000);
+		SleepUs(250);
+	}
+	return NULL;
+}
+
+static void *WriterThread(void *arg)
+{
+	(void)arg;
+	vSdWriterTask(NULL);
+	return NULL;
+}
+
+// Time the card needs for n sectors, with the busy periods they run into
+static long SectorsUs(uint32_t n)
+{
+	long us = n * SECTOR_US;
+	us += ((sectorsWritten + n) / BUSY_SECTORS - sectorsWritten / BUSY_SECTORS) * busyUs;
+	sectorsWritten += n;
+	return us;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+	uint32_t position = fp->fptr;
+	uint32_t end = position + btw;
+	long us = CALL_US;
+
+	*bw = 0;
+	if (writes < MAX_WRITES) {
+		writeOffsets[writes] = position;
+		writeLengths[writes] = btw;
+	}
+	if (writes++ == failAtWrite || end > FILE_SIZE) {
+		return FR_DISK_ERR;
+	}
+
+	// An unaligned start fills the buffered sector, which goes out once it is complete
+	if (position % SD_WRITER_SECTOR_SIZE != 0 && end >= (position / SD_WRITER_SECTOR_SIZE + 1) * SD_WRITER_SECTOR_SIZE) {
+		us += COMMAND_US + SectorsUs(1);
+		position = (position / SD_WRITER_SECTOR_SIZE + 1) * SD_WRITER_SECTOR_SIZE;
+	}
+	// Whole sectors go straight to the card
+	if (position % SD_WRITER_SECTOR_SIZE == 0 && end - position >= SD_WRITER_SECTOR_SIZE) {
+		us += COMMAND_US + SectorsUs((end - position) / SD_WRITER_SECTOR_SIZE);
+	}
+	SleepUs(us);
+
+	memcpy(&card[fp->fptr], buff, btw);
+	fp->fptr = end;
+	*bw = btw;
+	return FR_OK;
+}
+
+struct RunResult {
+	double seconds;
+	double longestCallbackMs;   ///< Longest time the WiFi task spent in the receive callback
+	int writes;
+	int misaligned;
+	int corrupt;
+	int rc;
+};
+
+static void Download(bool useWriter, struct RunResult *result)
+{
+	FIL file = {START_OFFSET};
+
+	memset(card, 0, sizeof(card));
+	memset(result, 0, sizeof(*result));
+	sectorsWritten = 0;
+	writes = 0;
+	if (useWriter) {
+		SdWriterStart(&file);
+	}
+
+	double start = Now();
+	for (uint32_t offset = START_OFFSET; offset < FILE_SIZE && result->rc == 0; offset += PACKET_SIZE) {
+		UINT length = (FILE_SIZE - offset < PACKET_SIZE) ? FILE_SIZE - offset : PACKET_SIZE;
+		SleepUs(NET_PACKET_US);
+
+		double callback = Now();
+		if (useWriter) {
+			result->rc = SdWriterWrite(&source[offset], length);
+		} else {
+			UINT written;
+			result->rc = (f_write(&file, &source[offset], length, &written) == FR_OK) ? 0 : -EIO;
+		}
+		callback = (Now() - callback) * 1000;
+		if (callback > result->longestCallbackMs) {
+			result->longestCallbackMs = callback;
+		}
+	}
+	if (useWriter) {
+		int rc = SdWriterStop();
+		if (result->rc == 0) {
+			result->rc = rc;
+		}
+	}
+	result->seconds = Now() - start;
+
+	result->writes = writes;
+	result->corrupt = memcmp(&card[START_OFFSET], &source[START_OFFSET], FILE_SIZE - START_OFFSET) != 0;
+	for (int i = 1; i < writes && i < MAX_WRITES; i++) {
+		result->misaligned += writeOffsets[i] % SD_WRITER_SECTOR_SIZE != 0 ||
+		                      (i < writes - 1 && writeLengths[i] % SD_WRITER_SECTOR_SIZE != 0);
+	}
+}
+
+static void PrintResult(const char *name, const struct RunResult *result)
+{
+	printf("  %-32s %5.0f ms %5.0f KB/s %4d f_write, callback up to %5.1f ms", name, result->seconds * 1000,
+	       (FILE_SIZE - START_OFFSET) / 1024.0 / result->seconds, result->writes, result->longestCallbackMs);
+}
+
+int main(void)
+{
+	pthread_t tick, writer;
+	FIL idle = {0};
+	struct RunResult direct, buffered;
+	struct SdWriterStats stats;
+	int failures = 0;
+
+	for (int i = 0; i < FILE_SIZE; i++) {
+		source[i] = (uint8_t)(i * 7 + (i >> 9));
+	}
+	pthread_create(&tick, NULL, TickThread, NULL);
+	pthread_create(&writer, NULL, WriterThread, NULL);
+	while (SdWriterStart(&idle) == -EAGAIN) {
+		SleepUs(1000);
+	}
+	SdWriterStop();
+
+	printf("%d KB from offset %d, %d B packets every %.1f ms, card %d us/sector\n", FILE_SIZE / 1024, START_OFFSET, PACKET_SIZE,
+	       NET_PACKET_US / 1000.0, SECTOR_US);
+
+	for (int profile = 0; profile < 2; profile++) {
+		busyUs = profile ? BUSY_US : 0;
+		if (busyUs == 0) {
+			printf("steady card:\n");
+		} else {
+			printf("slow card, %ld ms busy every %d sectors:\n", busyUs / 1000, BUSY_SECTORS);
+		}
+
+		Download(false, &direct);
+		PrintResult("f_write in the receive callback", &direct);
+		printf(": %s\n", (direct.rc == 0 && !direct.corrupt) ? "PASS" : "FAIL");
+		failures += direct.rc != 0 || direct.corrupt;
+
+		Download(true, &buffered);
+		SdWriterGetStats(&stats);
+		PrintResult("SdWriter, 2 x 1 KB buffers", &buffered);
+		int ok = buffered.rc == 0 && !buffered.corrupt && buffered.misaligned == 0 && stats.bytesWritten == FILE_SIZE - START_OFFSET;
+		printf(": %s\n", ok ? "PASS" : "FAIL");
+		printf("    writer: %lu ms in f_write, producer waited %lu ms for a buffer, %d misaligned writes\n",
+		       (unsigned long)stats.writeMs, (unsigned long)stats.waitMs, buffered.misaligned);
+		failures += !ok;
+	}
+
+	// A failed write is reported to the producer and by the flush, and nothing is written after it
+	failAtWrite = 10;
+	Download(true, &buffered);
+	SdWriterGetStats(&stats);
+	int ok = buffered.rc == -EIO && buffered.writes == failAtWrite + 1;
+	printf("write %d fails: SdWriter returns %d after %d f_write: %s\n", failAtWrite, buffered.rc, buffered.writes, ok ? "PASS" : "FAIL");
+	failures += !ok;
+
+	return failures;
+}
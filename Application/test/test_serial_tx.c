@@ -0,0 +1,224 @@
+/**************************************************************************/
+/**
+ * @file        test_serial_tx.c
+ * @brief       Host test of the serial console TX path (SerialConsole.c) against a simulated UART
+ * @details     The USART and DMA driver calls are modelled at 115200 baud 8N1: a span handed to the DMA (or to a
+ *				USART buffer job when no channel is free) leaves at one byte per 86.8 us, and its completion
+ *				callback runs when the last byte is out. Log bursts are written with SerialConsoleWriteString
+ *				between the completions. The bytes that reach the UART must be exactly the bytes the ring accepted,
+ *				in order, and no span may start while another one is in flight.
+ *				Reported: throughput, dropped bytes and TX interrupts, which were one per byte before the DMA path.
+ *****************************************************************************/
+
+#include "SerialConsole/SerialConsole.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define UART_BYTES_PER_SECOND (115200 / 10)  ///< 8N1: 10 bits per byte
+#define BYTE_TIME_US (1e6 / UART_BYTES_PER_SECOND)
+#define MAX_OUTPUT (1 << 20)
+
+/** The simulated SERCOM and DMA channel */
+static struct {
+	bool noDma;                ///< dma_allocate fails: the console uses USART buffer jobs
+	double nowUs;              ///< Simulated time
+	const uint8_t *span;       ///< Span being sent, NULL when idle
+	size_t spanLength;
+	double doneUs;             ///< When the last byte of the span is out
+	double idleUs;             ///< When the last span completed
+	uint32_t interrupts;       ///< TX interrupts: one per DMA span, one per byte for a USART buffer job
+	uint32_t overlaps;         ///< Spans started while one was in flight
+	size_t longestSpan;
+	uint8_t output[MAX_OUTPUT];  ///< What left the UART
+	size_t outputLength;
+	usart_callback_t writeCallback;
+	dma_callback_t dmaCallback;
+} uart;
+
+static uint8_t expected[MAX_OUTPUT];  ///< What the ring accepted, in order
+static size_t expectedLength;
+static Sercom sercom;
+static int errors;
+
+// Stand-ins for the ASF drivers SerialConsole.c calls: most ignore their arguments
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+void usart_get_config_defaults(struct usart_config *config) {}
+void usart_enable(struct usart_module *module) {}
+void usart_disable(struct usart_module *module) {}
+void usart_enable_callback(struct usart_module *module, enum usart_callback type) {}
+void dma_get_config_defaults(struct dma_resource_config *config) {}
+void dma_enable_callback(struct dma_resource *resource, enum dma_callback_type type) {}
+void dma_descriptor_get_config_defaults(struct dma_descriptor_config *config) {}
+
+enum status_code usart_init(struct usart_module *module, Sercom *hw, const struct usart_config *config)
+{
+	module->hw = &sercom;
+	return STATUS_OK;
+}
+
+void usart_register_callback(struct usart_module *module, usart_callback_t callback, enum usart_callback type)
+{
+	if (type == USART_CALLBACK_BUFFER_TRANSMITTED) {
+		uart.writeCallback = callback;
+	}
+}
+
+enum status_code usart_read_buffer_job(struct usart_module *module, uint8_t *rx_data, uint16_t length)
+{
+	return STATUS_OK;
+}
+
+enum status_code dma_allocate(struct dma_resource *resource, struct dma_resource_config *config)
+{
+	return uart.noDma ? STATUS_ERR_NOT_FOUND : STATUS_OK;
+}
+
+void dma_register_callback(struct dma_resource *resource, dma_callback_t callback, enum dma_callback_type type)
+{
+	uart.dmaCallback = callback;
+}
+
+void dma_descriptor_create(DmacDescriptor *descriptor, struct dma_descriptor_config *config)
+{
+	descriptor->DSTADDR.reg = config->destination_address;
+}
+
+/**
+ * @fn			static void StartSpan(const uint8_t *span, size_t length, uint32_t interrupts)
+ * @brief		Starts sending a span, it completes length byte times from now
+ *****************************************************************************/
+static void StartSpan(const uint8_t *span, size_t length, uint32_t interrupts)
+{
+	if (uart.span != NULL) {
+		uart.overlaps++;
+	}
+	uart.span = span;
+	uart.spanLength = length;
+	uart.doneUs = uart.nowUs + length * BYTE_TIME_US;
+	uart.interrupts += interrupts;
+	if (length > uart.longestSpan) {
+		uart.longestSpan = length;
+	}
+}
+
+enum status_code usart_write_buffer_job(struct usart_module *module, uint8_t *tx_data, uint16_t length)
+{
+	StartSpan(tx_data, length, length); // the DRE interrupt loads every byte
+	return STATUS_OK;
+}
+
+enum status_code dma_start_transfer_job(struct dma_resource *resource)
+{
+	// SRCADDR is the address after the last beat, see start_tx_span
+	size_t length = resource->descriptor->BTCNT.reg;
+	StartSpan((const uint8_t *)(uintptr_t)(resource->descriptor->SRCADDR.reg - length), length, 1);
+	return STATUS_OK;
+}
+#pragma GCC diagnostic pop
+
+/**
+ * @fn			static void RunUntil(double timeUs)
+ * @brief		Advances the simulated time, completing the spans that end before timeUs. The bytes are read when
+ *				the span completes, so a producer that overwrote them while they were in flight is caught
+ *****************************************************************************/
+static void RunUntil(double timeUs)
+{
+	while (uart.span != NULL && uart.doneUs <= timeUs) {
+		uart.nowUs = uart.doneUs;
+		uart.idleUs = uart.doneUs;
+		if (uart.outputLength + uart.spanLength <= MAX_OUTPUT) {
+			memcpy(&uart.output[uart.outputLength], uart.span, uart.spanLength);
+			uart.outputLength += uart.spanLength;
+		}
+		uart.span = NULL;
+		if (uart.noDma) {
+			uart.writeCallback(&usart_instance);
+		} else {
+			uart.dmaCallback(&txDmaResource);
+		}
+	}
+	if (timeUs > uart.nowUs) {
+		uart.nowUs = timeUs;
+	}
+}
+
+/**
+ * @fn			static void Write(const char *message)
+ * @brief		Writes a message to the console and records the part of it the ring accepted
+ *****************************************************************************/
+static void Write(const char *message)
+{
+	uint32_t dropped = txBytesDropped;
+	size_t length = strlen(message);
+
+	SerialConsoleWriteString((char *)message);
+	size_t accepted = length - (txBytesDropped - dropped);
+	if (expectedLength + accepted <= MAX_OUTPUT) {
+		memcpy(&expected[expectedLength], message, accepted);
+		expectedLength += accepted;
+	}
+}
+
+/**
+ * @fn			static void RunCase(const char *name, bool noDma, double seconds, double burstPeriodMs, int maxBurst)
+ * @brief		Every burstPeriodMs a burst of 1..maxBurst log lines of 20 to 100 characters is written, one line
+ *				every 200 us. Then the ring is left to drain
+ *****************************************************************************/
+static void RunCase(const char *name, bool noDma, double seconds, double burstPeriodMs, int maxBurst)
+{
+	char message[128];
+	uint32_t line = 0;
+	size_t offered = 0;
+
+	memset(&uart, 0, sizeof(uart));
+	uart.noDma = noDma;
+	expectedLength = 0;
+	txBytesSent = 0;
+	txBytesDropped = 0;
+	txSpanLength = 0;
+	InitializeSerialConsole();
+
+	for (double burstUs = 0; burstUs < seconds * 1e6; burstUs += burstPeriodMs * 1000) {
+		int lines = 1 + rand() % maxBurst;
+		for (int i = 0; i < lines; i++) {
+			RunUntil(burstUs + i * 200.0);
+			int length = snprintf(message, sizeof(message), "[%lu] line %lu ", (unsigned long)(uart.nowUs / 1000), (unsigned long)line++);
+			int target = 20 + rand() % 80;
+			while (length < target - 2) {
+				message[length++] = (char)('a' + line % 26);
+			}
+			message[length++] = '\r';
+			message[length++] = '\n';
+			message[length] = '\0';
+			offered += length;
+			Write(message);
+		}
+	}
+	RunUntil(1e18);
+
+	struct SerialConsoleTxStats stats;
+	SerialConsoleGetTxStats(&stats);
+	bool ok = uart.outputLength == expectedLength && memcmp(uart.output, expected, expectedLength) == 0 && uart.overlaps == 0 &&
+	          stats.bytesSent == uart.outputLength && stats.bytesPending == 0 && stats.bytesDropped == offered - expectedLength &&
+	          stats.dmaEnabled == !noDma;
+	double busySeconds = uart.idleUs / 1e6;
+	printf("%-24s %-4s %7zu B offered, %7lu B sent (%5.0f B/s, link %d B/s), %6lu B dropped, %7lu interrupts (%6.1f per KB), longest span %3zu B: %s\n",
+	       name, noDma ? "IRQ" : "DMA", offered, (unsigned long)stats.bytesSent, stats.bytesSent / busySeconds, UART_BYTES_PER_SECOND,
+	       (unsigned long)stats.bytesDropped, (unsigned long)uart.interrupts, 1024.0 * uart.interrupts / (stats.bytesSent ? stats.bytesSent : 1),
+	       uart.longestSpan, ok ? "PASS" : "FAIL");
+	errors += !ok;
+}
+
+int main(void)
+{
+	srand(1);
+	RunCase("bursts of 1-4 lines", false, 20, 100, 4);
+	RunCase("bursts of 1-4 lines", true, 20, 100, 4);
+	RunCase("bursts of 1-12 lines", false, 20, 100, 12);
+	RunCase("bursts of 1-12 lines", true, 20, 100, 12);
+	RunCase("saturated, ~3.5x the link", false, 5, 10, 12);
+	RunCase("saturated, ~3.5x the link", true, 5, 10, 12);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+/**************************************************************************/
+/**
+ * @file        test_state_publisher.c
+ * @brief       Host test of the publish-on-change state topics (StatePublisher/StatePublisher.c) against the old
+ *				100 ms loop (baseline/state_loop_v1.c), counting what reaches the broker
+ * @details     Ten simulated minutes of a player: a voice command every 5 to 40 s, some of them a burst of two
+ *				or three changes 30 to 80 ms apart (the recognizer's "start" before the command), and a button
+ *				press every 3 to 20 s, held 150 to 600 ms. The old loop samples and publishes every 100 ms; the
+ *				new one is the WiFi task's: it wakes after what StatePublisherRun returns, at most 100 ms
+ *				(WIFI_MQTT_POLL_MS). A broker packet is a PUBLISH and its acknowledgements: 4 at QoS 2, 2 at
+ *				QoS 1. The test fails if the broker misses a press, or holds a stale voice state once it has been
+ *				steady for the coalescing window and a poll period.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatePublisher/StatePublisher.h"
+#include "state_loop_v1.h"
+
+#define MINUTES 10
+#define RUN_MS (MINUTES * 60000)
+#define POLL_MS 100              ///< WIFI_MQTT_POLL_MS, and the period of the old loop
+#define VOICE_COALESCE_MS 200    ///< WIFI_VOICE_COALESCE_MS
+#define VOICE_HEARTBEAT_MS 60000 ///< WIFI_VOICE_HEARTBEAT_MS
+#define MAX_CHANGES 1024
+
+/** A value that holds from at (ms) on */
+struct Change {
+	TickType_t at;
+	int32_t value;
+};
+
+static struct Change voiceChanges[MAX_CHANGES], buttonChanges[MAX_CHANGES];
+static int voiceCount, buttonCount, presses;
+
+/** What reached the broker */
+static struct {
+	long publishes;
+	long packets;
+	long presses;                ///< "on" publications of the button
+	const char *voice;           ///< Last voice payload
+	const char *button;
+} broker;
+
+static const char *const voicePayloads[] = {"No", "Blink", "Hold in one color", "Hold in multiple colors", "Close LED", "start",
+                                            "forward", "backward", "left", "right", "stop", "end"};
+
+static const char *ButtonPayload(int32_t pressed)
+{
+	return pressed ? "on" : "off";
+}
+
+static const char *VoicePayload(int32_t flag)
+{
+	return (flag >= 0 && flag < (int32_t)(sizeof(voicePayloads) / sizeof(voicePayloads[0]))) ? voicePayloads[flag] : NULL;
+}
+
+static int BrokerPublish(const char *topic, const char *payload, uint8_t qos)
+{
+	broker.publishes++;
+	broker.packets += (qos == 2) ? 4 : (qos == 1) ? 2 : 1;
+	if (strcmp(topic, "Status/Voice") == 0) {
+		broker.voice = payload;
+	} else {
+		broker.presses += strcmp(payload, "on") == 0;
+		broker.button = payload;
+	}
+	return 0;
+}
+
+static void AddChange(struct Change *changes, int *count, TickType_t at, int32_t value)
+{
+	if (*count < MAX_CHANGES && at < RUN_MS) {
+		changes[*count].at = at;
+		changes[(*count)++].value = value;
+	}
+}
+
+static void BuildScenario(void)
+{
+	voiceCount = buttonCount = presses = 0;
+	AddChange(voiceChanges, &voiceCount, 0, 0);
+	for (TickType_t t = 5000 + rand() % 35000; t < RUN_MS; t += 5000 + rand() % 35000) {
+		if (rand() % 10 < 3) {
+			AddChange(voiceChanges, &voiceCount, t, 5);   // "start"
+			t += 30 + rand() % 50;
+			if (rand() % 2) {
+				AddChange(voiceChanges, &voiceCount, t, 1 + rand() % 11);
+				t += 30 + rand() % 50;
+			}
+		}
+		AddChange(voiceChanges, &voiceCount, t, 1 + rand() % 11);
+	}
+
+	AddChange(buttonChanges, &buttonCount, 0, 0);
+	for (TickType_t t = 3000 + rand() % 17000; t + 1000 < RUN_MS; t += 3000 + rand() % 17000) {
+		AddChange(buttonChanges, &buttonCount, t, 1);
+		t += 150 + rand() % 450;
+		AddChange(buttonChanges, &buttonCount, t, 0);
+		presses++;
+	}
+}
+
+/** Value at time t, and since when it holds */
+static int32_t ValueAt(const struct Change *changes, int count, TickType_t t, TickType_t *since)
+{
+	int i = 0;
+	while (i + 1 < count && changes[i + 1].at <= t) {
+		i++;
+	}
+	*since = changes[i].at;
+	return changes[i].value;
+}
+
+static void PrintRate(const char *name)
+{
+	printf("  %-36s %6.1f publishes/min %7.1f broker packets/min", name, (double)broker.publishes / MINUTES, (double)broker.packets / MINUTES);
+}
+
+int main(void)
+{
+	struct StateTopic topics[2] = {
+		STATE_TOPIC("debug/button", 2, 0, 0, ButtonPayload),
+		STATE_TOPIC("Status/Voice", 1, VOICE_COALESCE_MS, VOICE_HEARTBEAT_MS, VoicePayload),
+	};
+	TickType_t since;
+	long oldPackets;
+	int failures = 0;
+
+	srand(16);
+	BuildScenario();
+	printf("%d minutes: %d voice changes, %d button presses\n", MINUTES, voiceCount - 1, presses);
+
+	// The old loop: every 100 ms, voice at QoS 2 whether it changed or not
+	memset(&broker, 0, sizeof(broker));
+	for (TickType_t t = 0; t < RUN_MS; t += POLL_MS) {
+		v1_PublishStates(ValueAt(buttonChanges, buttonCount, t, &since), ValueAt(voiceChanges, voiceCount, t, &since), BrokerPublish);
+	}
+	PrintRate("old 100 ms loop, QoS 2");
+	int ok = broker.presses == presses;
+	printf(": %s\n", ok ? "PASS" : "FAIL");
+	failures += !ok;
+	oldPackets = broker.packets;
+
+	// StatePublisher, woken as the WiFi task is
+	memset(&broker, 0, sizeof(broker));
+	int stale = 0;
+	hostTicks = 0;
+	StatePublisherInvalidate(topics, 2);
+	while (hostTicks < RUN_MS) {
+		int32_t button = ValueAt(buttonChanges, buttonCount, hostTicks, &since);
+		StatePublisherSet(&topics[0], button);
+		int32_t voice = ValueAt(voiceChanges, voiceCount, hostTicks, &since);
+		StatePublisherSet(&topics[1], voice);
+
+		TickType_t wait = StatePublisherRun(topics, 2, BrokerPublish);
+
+		stale += hostTicks - since >= VOICE_COALESCE_MS + POLL_MS && broker.voice != VoicePayload(voice);
+		ValueAt(buttonChanges, buttonCount, hostTicks, &since);
+		stale += hostTicks - since >= POLL_MS && broker.button != ButtonPayload(button);
+		hostTicks += (wait < POLL_MS) ? wait : POLL_MS;
+	}
+	PrintRate("StatePublisher");
+	ok = broker.presses == presses && stale == 0 && broker.packets < oldPackets;
+	printf(": %s\n", ok ? "PASS" : "FAIL");
+	printf("  broker packets %.1fx fewer, %d stale samples\n", (double)oldPackets / broker.packets, stale);
+	failures += !ok;
+
+	return failures;
+}
@@ -34,11 +34,11 @@
 /******************************************************************************
  * Structures and Enumerations
  ******************************************************************************/
-cbuf_handle_t cbufRx;   ///< Circular buffer handler for receiving characters from the Serial Interface
-cbuf_handle_t cbufTx;   ///< Circular buffer handler for transmitting characters from the Serial Interface
+circular_buf_t cbufRx;   ///< Circular buffer for receiving characters from the Serial Interface
+circular_buf_t cbufTx;   ///< Circular buffer for transmitting characters from the Serial Interface
 
 char latestRx;   ///< Holds the latest character that was received
-char latestTx;   ///< Holds the latest character to be transmitted.
+static volatile size_t txSpanLength = 0;   ///< Bytes of the TX ring handed to the current write job, 0 when idle
 
 /******************************************************************************
  *  Callback Declaration
@@ -51,6 +51,7 @@ void usart_read_callback(struct usart_module *const usart_module);    // Callbac
  ******************************************************************************/
 static void configure_usart(void);
 static void configure_usart_callbacks(void);
+static void start_tx_span(void);
 
 /******************************************************************************
  * Global Local Variables
@@ -75,8 +76,8 @@ enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL;   ///< Variable that hold
 void InitializeSerialConsole() {
 
     // Initialize circular buffers for RX and TX
-    cbufRx = circular_buf_init((uint8_t *) rxCharacterBuffer, RX_BUFFER_SIZE);
-    cbufTx = circular_buf_init((uint8_t *) txCharacterBuffer, TX_BUFFER_SIZE);
+    circular_buf_init(&cbufRx, (uint8_t *) rxCharacterBuffer, RX_BUFFER_SIZE);
+    circular_buf_init(&cbufTx, (uint8_t *) txCharacterBuffer, TX_BUFFER_SIZE);
 
     // Configure USART and Callbacks
     configure_usart();
@@ -101,14 +102,14 @@ void DeinitializeSerialConsole() { usart_disable(&usart_instance); }
  *****************************************************************************/
 void SerialConsoleWriteString(char *string) {
     if (string != NULL) {
-        for (size_t iter = 0; iter < strlen(string); iter++) {
-            circular_buf_put(cbufTx, string[iter]);
-        }
+        circular_buf_put_n(&cbufTx, (uint8_t *) string, strlen(string));   // Bytes that do not fit are dropped
 
-        if (usart_get_job_status(&usart_instance, USART_TRANSCEIVER_TX) == STATUS_OK) {
-            circular_buf_get(cbufTx, (uint8_t *) &latestTx);   // Perform only if the SERCOM TX is free (not busy)
-            usart_write_buffer_job(&usart_instance, (uint8_t *) &latestTx, 1);
+        // The write callback may start the next span too; only one of us may start it
+        system_interrupt_enter_critical_section();
+        if (txSpanLength == 0) {
+            start_tx_span();   // Perform only if the SERCOM TX is free (not busy)
         }
+        system_interrupt_leave_critical_section();
     }
 }
 
@@ -122,7 +123,7 @@ void SerialConsoleWriteString(char *string) {
  * @return		Returns -1 if there are no characters in the buffer
  * @note			Use to receive characters from the RX buffer (FIFO)
  *****************************************************************************/
-int SerialConsoleReadCharacter(uint8_t *rxChar) { return circular_buf_get(cbufRx, (uint8_t *) rxChar); }
+int SerialConsoleReadCharacter(uint8_t *rxChar) { return circular_buf_get(&cbufRx, (uint8_t *) rxChar); }
 
 /*
 DEBUG LOGGER FUNCTIONS
@@ -194,6 +195,20 @@ static void configure_usart_callbacks(void) {
     usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_RECEIVED);
 }
 
+/**
+ * @fn			static void start_tx_span(void)
+ * @brief		Starts a write job on the largest contiguous run of the TX ring buffer
+ * @note		Call with interrupts disabled or from the write callback
+ *****************************************************************************/
+static void start_tx_span(void) {
+    uint8_t *span;
+
+    txSpanLength = circular_buf_peek_span(&cbufTx, &span);
+    if (txSpanLength > 0) {
+        usart_write_buffer_job(&usart_instance, span, txSpanLength);
+    }
+}
+
 /******************************************************************************
  * Callback Functions
  ******************************************************************************/
@@ -211,10 +226,8 @@ void usart_read_callback(struct usart_module *const usart_module) {}
  * @note
  *****************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module) {
-    if (circular_buf_get(cbufTx, (uint8_t *) &latestTx) != -1)   // Only continue if there are more characters to send
-    {
-        usart_write_buffer_job(&usart_instance, (uint8_t *) &latestTx, 1);
-    }
+    circular_buf_consume(&cbufTx, txSpanLength);
+    start_tx_span();   // Only continue if there are more characters to send
 }
 
 /**
@@ -1,179 +1,202 @@
-
 /**************************************************************************//**
 * @file        circular_buffer library
 * @ingroup 	   Serial Console
-* @brief       This library for a circular buffer is taken from https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer/circular_buffer.c
-*				Author: Phillips Johnston
-* @details     Please refer to the github code above and to "https://embeddedartistry.com/blog/2017/4/6/circular-buffers-in-cc" for more information
+* @brief       Lock-free single-producer/single-consumer byte ring, see circular_buffer.h
+* @details     The API follows https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer/circular_buffer.c
+*				and "https://embeddedartistry.com/blog/2017/4/6/circular-buffers-in-cc".
 *
-*				See "https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer_test.c" for examples on how to use the buffer
+*				Ordering rules: the producer writes the data before it publishes the new head, the consumer
+*				reads the data before it publishes the new tail. CIRCULAR_BUF_BARRIER keeps the compiler (and
+*				the core) from moving the data accesses across the index update.
 *
 * @copyright
 * @author		Phillips Johnston
 * @date        Aug 6, 2018
-* @version		0.1
+* @version		0.2
 *****************************************************************************/
 
 
- #include <stdlib.h>
- #include <stdint.h>
- #include <stddef.h>
- #include <stdbool.h>
- #include <assert.h>
+ #include <string.h>
 
  #include "circular_buffer.h"
 
-
- // The definition of our circular buffer structure is hidden from the user
- struct circular_buf_t {
-	 uint8_t * buffer;
-	 size_t head;
-	 size_t tail;
-	 size_t max; //of the buffer
-	 bool full;
- };
+ /// Memory barrier between the data accesses and the head/tail update (dmb on the Cortex-M0+)
+ #define CIRCULAR_BUF_BARRIER() __sync_synchronize()
 
  #pragma mark - Private Functions -
 
- static void advance_pointer(cbuf_handle_t cbuf)
+ /// Copy len bytes from data into the ring starting at counter 'from', wrapping at the end of storage
+ static void copy_in(cbuf_handle_t cbuf, size_t from, const uint8_t * data, size_t len)
  {
-	 //assert(cbuf);
+	 size_t offset = from & cbuf->mask;
+	 size_t first = cbuf->mask + 1 - offset;
 
-	 if(cbuf->full)
+	 if(first > len)
 	 {
-		 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+		 first = len;
 	 }
 
-	 cbuf->head = (cbuf->head + 1) % cbuf->max;
-
-	 // We mark full because we will advance tail on the next time around
-	 cbuf->full = (cbuf->head == cbuf->tail);
+	 memcpy(&cbuf->buffer[offset], data, first);
+	 memcpy(&cbuf->buffer[0], data + first, len - first);
  }
 
- static void retreat_pointer(cbuf_handle_t cbuf)
+ /// Copy len bytes out of the ring starting at counter 'from', wrapping at the end of storage
+ static void copy_out(cbuf_handle_t cbuf, size_t from, uint8_t * data, size_t len)
  {
-	 //assert(cbuf);
+	 size_t offset = from & cbuf->mask;
+	 size_t first = cbuf->mask + 1 - offset;
+
+	 if(first > len)
+	 {
+		 first = len;
+	 }
 
-	 cbuf->full = false;
-	 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+	 memcpy(data, &cbuf->buffer[offset], first);
+	 memcpy(data + first, &cbuf->buffer[0], len - first);
  }
 
  #pragma mark - APIs -
 
- cbuf_handle_t circular_buf_init(uint8_t* buffer, size_t size)
+ int circular_buf_init(cbuf_handle_t cbuf, uint8_t* buffer, size_t size)
  {
-	// assert(buffer && size);
-
-	 cbuf_handle_t cbuf = malloc(sizeof(circular_buf_t));
-	 //assert(cbuf);
+	 if(cbuf == NULL || buffer == NULL || size == 0 || (size & (size - 1)) != 0)
+	 {
+		 return -1;
+	 }
 
 	 cbuf->buffer = buffer;
-	 cbuf->max = size;
+	 cbuf->mask = size - 1;
 	 circular_buf_reset(cbuf);
 
-	// assert(circular_buf_empty(cbuf));
-
-	 return cbuf;
- }
-
- void circular_buf_free(cbuf_handle_t cbuf)
- {
-	// assert(cbuf);
-	 free(cbuf);
+	 return 0;
  }
 
  void circular_buf_reset(cbuf_handle_t cbuf)
  {
-	// assert(cbuf);
-
 	 cbuf->head = 0;
 	 cbuf->tail = 0;
-	 cbuf->full = false;
  }
 
  size_t circular_buf_size(cbuf_handle_t cbuf)
  {
-	// assert(cbuf);
+	 // Unsigned subtraction stays correct when the counters wrap
+	 return cbuf->head - cbuf->tail;
+ }
 
-	 size_t size = cbuf->max;
+ size_t circular_buf_capacity(cbuf_handle_t cbuf)
+ {
+	 return cbuf->mask + 1;
+ }
 
-	 if(!cbuf->full)
-	 {
-		 if(cbuf->head >= cbuf->tail)
-		 {
-			 size = (cbuf->head - cbuf->tail);
-		 }
-		 else
-		 {
-			 size = (cbuf->max + cbuf->head - cbuf->tail);
-		 }
+ int circular_buf_put(cbuf_handle_t cbuf, uint8_t data)
+ {
+	 size_t head = cbuf->head;
 
+	 if(head - cbuf->tail > cbuf->mask)
+	 {
+		 return -1;
 	 }
 
-	 return size;
+	 cbuf->buffer[head & cbuf->mask] = data;
+	 CIRCULAR_BUF_BARRIER();
+	 cbuf->head = head + 1;
+
+	 return 0;
  }
 
- size_t circular_buf_capacity(cbuf_handle_t cbuf)
+ size_t circular_buf_put_n(cbuf_handle_t cbuf, const uint8_t * data, size_t len)
  {
-	 //assert(cbuf);
+	 size_t head = cbuf->head;
+	 size_t space = cbuf->mask + 1 - (head - cbuf->tail);
+
+	 if(len > space)
+	 {
+		 len = space;
+	 }
 
-	 return cbuf->max;
+	 if(len > 0)
+	 {
+		 copy_in(cbuf, head, data, len);
+		 CIRCULAR_BUF_BARRIER();
+		 cbuf->head = head + len;
+	 }
+
+	 return len;
  }
 
- void circular_buf_put(cbuf_handle_t cbuf, uint8_t data)
+ int circular_buf_get(cbuf_handle_t cbuf, uint8_t * data)
  {
-	 //assert(cbuf && cbuf->buffer);
+	 size_t tail = cbuf->tail;
+
+	 if(cbuf->head == tail)
+	 {
+		 return -1;
+	 }
 
-	 cbuf->buffer[cbuf->head] = data;
+	 CIRCULAR_BUF_BARRIER();
+	 *data = cbuf->buffer[tail & cbuf->mask];
+	 CIRCULAR_BUF_BARRIER();
+	 cbuf->tail = tail + 1;
 
-	 advance_pointer(cbuf);
+	 return 0;
  }
 
- int circular_buf_put2(cbuf_handle_t cbuf, uint8_t data)
+ size_t circular_buf_get_n(cbuf_handle_t cbuf, uint8_t * data, size_t len)
  {
-	 int r = -1;
+	 size_t tail = cbuf->tail;
+	 size_t used = cbuf->head - tail;
 
-	 //assert(cbuf && cbuf->buffer);
+	 if(len > used)
+	 {
+		 len = used;
+	 }
 
-	 if(!circular_buf_full(cbuf))
+	 if(len > 0)
 	 {
-		 cbuf->buffer[cbuf->head] = data;
-		 advance_pointer(cbuf);
-		 r = 0;
+		 CIRCULAR_BUF_BARRIER();
+		 copy_out(cbuf, tail, data, len);
+		 CIRCULAR_BUF_BARRIER();
+		 cbuf->tail = tail + len;
 	 }
 
-	 return r;
+	 return len;
  }
 
- int circular_buf_get(cbuf_handle_t cbuf, uint8_t * data)
+ size_t circular_buf_peek_span(cbuf_handle_t cbuf, uint8_t ** data)
  {
-	 //assert(cbuf && data && cbuf->buffer);
-	 
-	 int r = -1;
+	 size_t tail = cbuf->tail;
+	 size_t used = cbuf->head - tail;
+	 size_t offset = tail & cbuf->mask;
 
-	 if(!circular_buf_empty(cbuf))
+	 if(used == 0)
 	 {
-		 *data = cbuf->buffer[cbuf->tail];
-		 retreat_pointer(cbuf);
+		 return 0;
+	 }
+
+	 CIRCULAR_BUF_BARRIER();
+	 *data = &cbuf->buffer[offset];
 
-		 r = 0;
+	 // If the data wraps around the end of the storage, hand out the part up to the end
+	 if(used > cbuf->mask + 1 - offset)
+	 {
+		 used = cbuf->mask + 1 - offset;
 	 }
 
-	 return r;
+	 return used;
  }
 
- bool circular_buf_empty(cbuf_handle_t cbuf)
+ void circular_buf_consume(cbuf_handle_t cbuf, size_t len)
  {
-	 //assert(cbuf);
+	 CIRCULAR_BUF_BARRIER();
+	 cbuf->tail += len;
+ }
 
-	 return (!cbuf->full && (cbuf->head == cbuf->tail));
+ bool circular_buf_empty(cbuf_handle_t cbuf)
+ {
+	 return cbuf->head == cbuf->tail;
  }
 
  bool circular_buf_full(cbuf_handle_t cbuf)
  {
-	// assert(cbuf);
-
-	 return cbuf->full;
+	 return (cbuf->head - cbuf->tail) > cbuf->mask;
  }
- 
- 
\ No newline at end of file
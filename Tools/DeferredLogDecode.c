@@ -0,0 +1,195 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLogDecode.c
+ * @brief       Host decoder of the deferred logger records, see DeferredLogDecode.h
+ * @details     Walks the format string with the parser of DeferredLogWrite (DeferredLogFormat.c) to know how each
+ *				argument was stored, and formats each conversion with the host snprintf. The length modifiers are rewritten for
+ *				the host, where long and pointers are 64 bits.
+ *****************************************************************************/
+
+#include "DeferredLogDecode.h"
+
+#include "DeferredLogFormat.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SPEC 16 ///< Longest conversion specification that is formatted, as in the firmware
+
+/**
+ * @fn			static uint32_t GetWord(const uint8_t *data)
+ * @brief		Reads a 32 bit little endian value
+ *****************************************************************************/
+static uint32_t GetWord(const uint8_t *data)
+{
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * @fn			static void HostSpec(const struct DeferredLogConversion *conversion, char *spec)
+ * @brief		Copies the specification without its length modifiers, with "ll" in front of a 64 bit integer
+ *				conversion: the values are passed to snprintf as int, unsigned long long or double
+ *****************************************************************************/
+static void HostSpec(const struct DeferredLogConversion *conversion, char *spec)
+{
+	size_t used = 0;
+
+	for (size_t i = 0; i < conversion->length - 1; i++) {
+		if (strchr("ljztL", conversion->start[i]) == NULL) {
+			spec[used++] = conversion->start[i];
+		}
+	}
+	if (conversion->kind == DEFERRED_ARG_WIDE_INT) {
+		spec[used++] = 'l';
+		spec[used++] = 'l';
+	}
+	spec[used++] = conversion->start[conversion->length - 1];
+	spec[used] = '\0';
+}
+
+/**
+ * @fn			static size_t FormatConversion(const struct DeferredLogConversion *conversion, const uint8_t *record, size_t *pos,
+ *										char *out, size_t outLength)
+ * @brief		Formats one conversion with the next arguments of the record, the specification itself if the
+ *				record ran out of arguments
+ * @return		Number of characters written to out, terminator excluded
+ *****************************************************************************/
+static size_t FormatConversion(const struct DeferredLogConversion *conversion, const uint8_t *record, size_t *pos, char *out, size_t outLength)
+{
+	const size_t end = record[0];
+	char spec[MAX_SPEC + 3];
+	char string[256];
+	int star[2] = {0, 0};
+	int written = -1;
+
+	if (conversion->kind == DEFERRED_ARG_NONE && conversion->length == 2 && conversion->start[1] == '%') {
+		written = snprintf(out, outLength, "%%");
+		return ((size_t)written < outLength) ? (size_t)written : outLength - 1;
+	}
+	for (uint8_t i = 0; i < conversion->stars && *pos + 4 <= end; i++) {
+		star[i] = (int)GetWord(&record[*pos]);
+		*pos += 4;
+	}
+
+	if (conversion->length <= MAX_SPEC) {
+		HostSpec(conversion, spec);
+
+#define FORMAT_VALUE(value)                                                                                                    \
+	((conversion->stars == 0) ? snprintf(out, outLength, spec, value)                                                          \
+	 : (conversion->stars == 1) ? snprintf(out, outLength, spec, star[0], value)                                               \
+	                            : snprintf(out, outLength, spec, star[0], star[1], value))
+
+		switch (conversion->kind) {
+			case DEFERRED_ARG_WORD:
+				if (*pos + 4 <= end) {
+					uint32_t value = GetWord(&record[*pos]);
+					*pos += 4;
+					if (spec[strlen(spec) - 1] == 'n') {
+						written = 0;
+					} else if (spec[strlen(spec) - 1] == 'p') {
+						written = FORMAT_VALUE((void *)(uintptr_t)value);
+					} else {
+						written = FORMAT_VALUE((unsigned int)value);
+					}
+				}
+				break;
+
+			case DEFERRED_ARG_WIDE_INT:
+				if (*pos + 8 <= end) {
+					unsigned long long value = (unsigned long long)GetWord(&record[*pos]) | ((unsigned long long)GetWord(&record[*pos + 4]) << 32);
+					*pos += 8;
+					written = FORMAT_VALUE(value);
+				}
+				break;
+
+			case DEFERRED_ARG_DOUBLE:
+				if (*pos + 8 <= end) {
+					double value;
+					memcpy(&value, &record[*pos], sizeof(value)); // both sides are little endian IEEE 754
+					*pos += 8;
+					written = FORMAT_VALUE(value);
+				}
+				break;
+
+			case DEFERRED_ARG_STRING:
+				if (*pos + 1 <= end && *pos + 1 + record[*pos] <= end) {
+					size_t length = record[*pos];
+					memcpy(string, &record[*pos + 1], length);
+					string[length] = '\0';
+					*pos += 1 + length;
+					written = FORMAT_VALUE(string);
+				}
+				break;
+
+			default:
+				break;
+		}
+#undef FORMAT_VALUE
+	}
+
+	if (written < 0) {
+		written = snprintf(out, outLength, "%.*s", (int)conversion->length, conversion->start);
+	}
+	return ((size_t)written < outLength) ? (size_t)written : outLength - 1;
+}
+
+int DeferredLogDecode(const uint8_t *data, size_t length, DeferredLogFormatLookup lookup, void *context, struct DeferredLogLine *line)
+{
+	char inlineFormat[256];
+	char unknownFormat[40];
+	struct DeferredLogConversion conversion;
+	size_t pos = DEFERRED_LOG_DECODE_HEADER_SIZE;
+	size_t used = 0;
+
+	if (length < 1 || length < data[0]) {
+		return 0;
+	}
+	if (data[0] < DEFERRED_LOG_DECODE_HEADER_SIZE) {
+		return -1;
+	}
+	line->level = data[1] & ~(DEFERRED_LOG_DECODE_INLINE_FORMAT | DEFERRED_LOG_DECODE_TRUNCATED);
+	line->ticks = GetWord(&data[2]);
+
+	const char *format;
+	if (data[1] & DEFERRED_LOG_DECODE_INLINE_FORMAT) {
+		if (pos + 1 > data[0] || pos + 1 + data[pos] > data[0]) {
+			return -1;
+		}
+		memcpy(inlineFormat, &data[pos + 1], data[pos]);
+		inlineFormat[data[pos]] = '\0';
+		format = inlineFormat;
+		pos += 1 + data[pos];
+	} else {
+		format = lookup(GetWord(&data[6]), context);
+		if (format == NULL) {
+			snprintf(unknownFormat, sizeof(unknownFormat), "<format at 0x%08lX>\r\n", (unsigned long)GetWord(&data[6]));
+			format = unknownFormat;
+		}
+	}
+
+	while (*format != '\0' && used < sizeof(line->text) - 1) {
+		const char *next = DeferredLogNextConversion(format, &conversion);
+		size_t literal = (next != NULL) ? (size_t)(conversion.start - format) : strlen(format);
+
+		if (literal > sizeof(line->text) - 1 - used) {
+			literal = sizeof(line->text) - 1 - used;
+		}
+		memcpy(&line->text[used], format, literal);
+		used += literal;
+		if (next == NULL) {
+			break;
+		}
+		used += FormatConversion(&conversion, data, &pos, &line->text[used], sizeof(line->text) - used);
+		format = next;
+	}
+	if (data[1] & DEFERRED_LOG_DECODE_TRUNCATED) {
+		const size_t mark = sizeof(DEFERRED_LOG_DECODE_TRUNCATED_MARK) - 1;
+		if (used > sizeof(line->text) - 1 - mark) {
+			used = sizeof(line->text) - 1 - mark;
+		}
+		memcpy(&line->text[used], DEFERRED_LOG_DECODE_TRUNCATED_MARK, mark);
+		used += mark;
+	}
+	line->text[used] = '\0';
+	return data[0];
+}
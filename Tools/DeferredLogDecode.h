@@ -0,0 +1,40 @@
+/**************************************************************************/
+/**
+ * @file        DeferredLogDecode.h
+ * @brief       Host decoder of the binary records of the deferred logger
+ * @details     The record layout is described in Application/src/SerialConsole/DeferredLog.h. A record holds the
+ *				flash address of its format string, so the decoder needs the firmware image to find the strings.
+ *				Arguments are 32 bits on the target: they are formatted as such whatever the length modifier says.
+ *****************************************************************************/
+
+#ifndef DEFERRED_LOG_DECODE_H
+#define DEFERRED_LOG_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFERRED_LOG_DECODE_HEADER_SIZE 10       ///< length, level, u32 ticks, u32 format address
+#define DEFERRED_LOG_DECODE_INLINE_FORMAT 0x80   ///< Level flag: the format string is in the record
+#define DEFERRED_LOG_DECODE_TRUNCATED 0x40       ///< Level flag: that format string was cut
+#define DEFERRED_LOG_DECODE_TRUNCATED_MARK "...\r\n" ///< Printed after the text of a cut format, as the firmware does
+#define DEFERRED_LOG_DECODE_LINE_SIZE 256        ///< Longest decoded line, terminator included
+
+/** One decoded record */
+struct DeferredLogLine {
+	uint8_t level;                             ///< enum eDebugLogLevels of the firmware
+	uint32_t ticks;                            ///< RTOS tick count of the log call
+	char text[DEFERRED_LOG_DECODE_LINE_SIZE];  ///< Formatted message
+};
+
+/** Returns the format string at a flash address of the firmware, NULL if the address is not in the image */
+typedef const char *(*DeferredLogFormatLookup)(uint32_t address, void *context);
+
+/**
+ * @fn			int DeferredLogDecode(const uint8_t *data, size_t length, DeferredLogFormatLookup lookup, void *context,
+ *								  struct DeferredLogLine *line)
+ * @brief		Decodes the record at the start of data
+ * @return		Length of the record, 0 if data holds less than a whole record, -1 if it does not start with a record
+ *****************************************************************************/
+int DeferredLogDecode(const uint8_t *data, size_t length, DeferredLogFormatLookup lookup, void *context, struct DeferredLogLine *line);
+
+#endif /* DEFERRED_LOG_DECODE_H */
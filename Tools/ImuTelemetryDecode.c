@@ -0,0 +1,83 @@
+/**************************************************************************/
+/**
+ * @file        ImuTelemetryDecode.c
+ * @brief       Host decoder of the IMU telemetry batches, see ImuTelemetryDecode.h
+ *****************************************************************************/
+
+#include "ImuTelemetryDecode.h"
+
+#define FIRST_SAMPLE_END 12   ///< Header (format, count, u32 time) and the s16 x, y, z of the first sample
+
+/**
+ * @fn			static int ReadVarint(const uint8_t *payload, size_t length, size_t *offset, uint32_t *value)
+ * @brief		Reads an unsigned LEB128 varint of at most 5 bytes at *offset and moves past it
+ * @return		0, or -1 if the payload ends inside the varint or it is too long
+ *****************************************************************************/
+static int ReadVarint(const uint8_t *payload, size_t length, size_t *offset, uint32_t *value)
+{
+	uint32_t result = 0;
+
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (*offset >= length) {
+			return -1;
+		}
+		uint8_t byte = payload[(*offset)++];
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @fn			static int ReadDelta(const uint8_t *payload, size_t length, size_t *offset, int16_t *value)
+ * @brief		Reads a zigzag varint and adds it to *value
+ *****************************************************************************/
+static int ReadDelta(const uint8_t *payload, size_t length, size_t *offset, int16_t *value)
+{
+	uint32_t zigzag;
+
+	if (ReadVarint(payload, length, offset, &zigzag) != 0) {
+		return -1;
+	}
+	int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+	*value = (int16_t)(*value + delta);
+	return 0;
+}
+
+/**
+ * @fn			static int16_t ReadS16LE(const uint8_t *p)
+ * @brief		Reads a little endian s16
+ *****************************************************************************/
+static int16_t ReadS16LE(const uint8_t *p)
+{
+	return (int16_t)(p[0] | (p[1] << 8));
+}
+
+int ImuTelemetryDecode(const uint8_t *payload, size_t length, struct ImuTelemetrySample *samples, size_t maxSamples)
+{
+	size_t offset = FIRST_SAMPLE_END;
+
+	if (length < FIRST_SAMPLE_END || payload[0] != IMU_TELEMETRY_DECODE_FORMAT || payload[1] == 0 || payload[1] > maxSamples) {
+		return -1;
+	}
+	int count = payload[1];
+
+	samples[0].timeMs = (uint32_t)payload[2] | ((uint32_t)payload[3] << 8) | ((uint32_t)payload[4] << 16) | ((uint32_t)payload[5] << 24);
+	samples[0].x = ReadS16LE(payload + 6);
+	samples[0].y = ReadS16LE(payload + 8);
+	samples[0].z = ReadS16LE(payload + 10);
+
+	for (int i = 1; i < count; i++) {
+		uint32_t stepMs;
+		samples[i] = samples[i - 1];
+		if (ReadVarint(payload, length, &offset, &stepMs) != 0 || ReadDelta(payload, length, &offset, &samples[i].x) != 0 ||
+		    ReadDelta(payload, length, &offset, &samples[i].y) != 0 || ReadDelta(payload, length, &offset, &samples[i].z) != 0) {
+			return -1;
+		}
+		samples[i].timeMs += stepMs;
+	}
+	return (offset == length) ? count : -1;
+}
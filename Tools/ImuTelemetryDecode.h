@@ -0,0 +1,31 @@
+/**************************************************************************/
+/**
+ * @file        ImuTelemetryDecode.h
+ * @brief       Host decoder of the IMU telemetry batches published by the firmware
+ * @details     The payload layout is described in Application/src/Telemetry/ImuTelemetry.h.
+ *****************************************************************************/
+
+#ifndef IMU_TELEMETRY_DECODE_H
+#define IMU_TELEMETRY_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMU_TELEMETRY_DECODE_FORMAT 1     ///< Payload format this decoder reads
+#define IMU_TELEMETRY_DECODE_MAX_SAMPLES 255
+
+/** One decoded sample */
+struct ImuTelemetrySample {
+	uint32_t timeMs;   ///< ms since boot
+	int16_t x, y, z;   ///< milli-g
+};
+
+/**
+ * @fn			int ImuTelemetryDecode(const uint8_t *payload, size_t length, struct ImuTelemetrySample *samples, size_t maxSamples)
+ * @brief		Decodes one batch payload into samples
+ * @return		Number of samples, or -1 if the payload is not a well formed batch of this format, or holds more
+ *				than maxSamples samples
+ *****************************************************************************/
+int ImuTelemetryDecode(const uint8_t *payload, size_t length, struct ImuTelemetrySample *samples, size_t maxSamples);
+
+#endif /* IMU_TELEMETRY_DECODE_H */
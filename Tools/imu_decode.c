@@ -0,0 +1,48 @@
+/**************************************************************************/
+/**
+ * @file        imu_decode.c
+ * @brief       Prints IMU telemetry batches as CSV
+ * @details     Usage: imu_decode [payload file]...  Each file holds one MQTT payload of IMU_TOPIC, stdin is read
+ *				when no file is given. One line per sample: time in ms since boot, x, y, z in milli-g.
+ *****************************************************************************/
+
+#include <stdio.h>
+
+#include "ImuTelemetryDecode.h"
+
+static int DecodeFile(FILE *file, const char *name)
+{
+	static uint8_t payload[8192];
+	struct ImuTelemetrySample samples[IMU_TELEMETRY_DECODE_MAX_SAMPLES];
+
+	size_t length = fread(payload, 1, sizeof(payload), file);
+	int count = ImuTelemetryDecode(payload, length, samples, IMU_TELEMETRY_DECODE_MAX_SAMPLES);
+	if (count < 0) {
+		fprintf(stderr, "%s: not an IMU telemetry batch\n", name);
+		return 1;
+	}
+	for (int i = 0; i < count; i++) {
+		printf("%lu,%d,%d,%d\n", (unsigned long)samples[i].timeMs, samples[i].x, samples[i].y, samples[i].z);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int res = 0;
+
+	if (argc < 2) {
+		return DecodeFile(stdin, "stdin");
+	}
+	for (int i = 1; i < argc; i++) {
+		FILE *file = fopen(argv[i], "rb");
+		if (file == NULL) {
+			perror(argv[i]);
+			res = 1;
+			continue;
+		}
+		res |= DecodeFile(file, argv[i]);
+		fclose(file);
+	}
+	return res;
+}
@@ -0,0 +1,110 @@
+/**************************************************************************/
+/**
+ * @file        log_decode.c
+ * @brief       Prints the binary records of the deferred logger as text
+ * @details     Usage: log_decode <Application.bin> [records file]
+ *				The records file is a dump of the record bytes, e.g. the used part of logRingStorage read with the
+ *				debugger, in order from the oldest record. stdin is read when it is not given. The format strings
+ *				are looked up in the image, which is linked at APP_START_ADDRESS (see Bootloader/src/BootMain.c).
+ *				One line per record: tick count, level, message.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DeferredLogDecode.h"
+
+#define APP_START_ADDRESS 0x12000   ///< Flash address of the first byte of Application.bin
+
+/** The firmware image the format strings are read from */
+struct Image {
+	uint8_t *data;
+	size_t size;
+};
+
+static const char *const levelNames[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "OFF"};
+
+/**
+ * @fn			static uint8_t *ReadFile(FILE *file, size_t *size)
+ * @brief		Reads the whole file into a buffer that the caller frees
+ *****************************************************************************/
+static uint8_t *ReadFile(FILE *file, size_t *size)
+{
+	size_t capacity = 65536;
+	uint8_t *data = malloc(capacity);
+
+	*size = 0;
+	while (data != NULL) {
+		*size += fread(data + *size, 1, capacity - *size, file);
+		if (*size < capacity) {
+			break;
+		}
+		capacity *= 2;
+		uint8_t *larger = realloc(data, capacity);
+		if (larger == NULL) {
+			free(data);
+		}
+		data = larger;
+	}
+	return data;
+}
+
+/**
+ * @fn			static const char *LookupFormat(uint32_t address, void *context)
+ * @brief		Finds a NULL terminated string at a flash address of the image
+ *****************************************************************************/
+static const char *LookupFormat(uint32_t address, void *context)
+{
+	const struct Image *image = context;
+
+	if (address < APP_START_ADDRESS || address - APP_START_ADDRESS >= image->size) {
+		return NULL;
+	}
+	const uint8_t *string = image->data + (address - APP_START_ADDRESS);
+	return (memchr(string, '\0', image->size - (address - APP_START_ADDRESS)) != NULL) ? (const char *)string : NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct Image image;
+	struct DeferredLogLine line;
+	size_t length;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s <Application.bin> [records file]\n", argv[0]);
+		return 2;
+	}
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	image.data = ReadFile(file, &image.size);
+	fclose(file);
+
+	file = (argc == 3) ? fopen(argv[2], "rb") : stdin;
+	if (file == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+	uint8_t *records = ReadFile(file, &length);
+	if (image.data == NULL || records == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	size_t pos = 0;
+	int res = 0;
+	while (pos < length) {
+		int used = DeferredLogDecode(records + pos, length - pos, LookupFormat, &image, &line);
+		if (used <= 0) {
+			fprintf(stderr, "%s at byte %zu\n", (used == 0) ? "incomplete record" : "not a record", pos);
+			res = 1;
+			break;
+		}
+		printf("%10lu %-7s %s", (unsigned long)line.ticks, (line.level < 6) ? levelNames[line.level] : "?", line.text);
+		pos += used;
+	}
+	return res;
+}